@@ -216,6 +216,48 @@ typedef bool (*PFN_vilOverlayTextEvent)(VilOverlay, const char* utf8);
 typedef void (*PFN_vilOverlayMouseMoveEvent)(VilOverlay, int x, int y);
 typedef void (*PFN_vilOverlayKeyboardModifier)(VilOverlay, enum VilKeyMod mod, bool active);
 
+// Controls lazy tracking for the given device. While enabled, vil does
+// not build its full internal representation of recorded command buffers,
+// making recording almost as cheap as without the layer. Only the
+// state needed for correctness (e.g. image layouts) is tracked.
+// Full tracking is automatically activated when an overlay is shown or
+// a local capture is requested. Passing false activates it immediately.
+// In both cases, it will only apply to command buffers begun afterwards.
+// Lazy tracking can also be enabled via the VIL_LAZY_TRACKING environment
+// variable.
+typedef void (*PFN_vilSetLazyTracking)(VkDevice, bool enable);
+
+enum VilFrameProfileMode {
+	VilFrameProfileModeOff = 0,
+	// Times all sections (render passes, subpasses, debug labels etc)
+	VilFrameProfileModeSections = 1,
+	// Additionally times all draw, dispatch and traceRays commands
+	VilFrameProfileModeCommands = 2,
+};
+
+// Node of the GPU frame timing tree, see vilGetFrameProfile.
+// The hierarchy is frame > submission > command buffer > commands.
+// Timings are in milliseconds, min, avg and p95 over the last 128 frames.
+typedef struct VilProfileNode {
+	char name[64]; // truncated, null-terminated
+	unsigned depth; // 0 for the frame
+	uint64_t sampleCount;
+	float lastMs;
+	float minMs;
+	float avgMs;
+	float p95Ms;
+} VilProfileNode;
+
+// Enables GPU frame profiling for the given device. While enabled, vil
+// writes timestamps around the commands of all submitted command buffers.
+// Changing the mode resets the gathered timings.
+typedef void (*PFN_vilSetFrameProfiling)(VkDevice, enum VilFrameProfileMode mode);
+
+// Writes (up to) 'maxNodes' nodes of the current frame timing tree into
+// 'nodes', in depth-first order. Returns the total number of nodes.
+// 'nodes' may be NULL when 'maxNodes' is 0.
+typedef unsigned (*PFN_vilGetFrameProfile)(VkDevice, unsigned maxNodes, VilProfileNode* nodes);
+
 typedef struct VilApi {
 	PFN_vilCreateOverlayForLastCreatedSwapchain CreateOverlayForLastCreatedSwapchain;
 
@@ -227,6 +269,11 @@ typedef struct VilApi {
 	PFN_vilOverlayKeyEvent OverlayKeyEvent;
 	PFN_vilOverlayTextEvent OverlayTextEvent;
 	PFN_vilOverlayKeyboardModifier OverlayKeyboardModifier;
+
+	PFN_vilSetLazyTracking SetLazyTracking;
+
+	PFN_vilSetFrameProfiling SetFrameProfiling;
+	PFN_vilGetFrameProfile GetFrameProfile;
 } VilApi;
 
 // Must be called only *after* a vulkan device was created.
@@ -269,6 +316,9 @@ static inline int vilLoadApi(VilApi* api) {
 	vilLoadSym(OverlayKeyEvent);
 	vilLoadSym(OverlayTextEvent);
 	vilLoadSym(OverlayKeyboardModifier);
+	vilLoadSym(SetLazyTracking);
+	vilLoadSym(SetFrameProfiling);
+	vilLoadSym(GetFrameProfile);
 
 	vilCloseLib();
 
@@ -8,7 +8,11 @@
 #include <util/export.hpp>
 #include <swapchain.hpp>
 #include <overlay.hpp>
+#include <commandHook/hook.hpp>
+#include <ds.hpp>
 #include <imgui/imgui.h>
+#include <algorithm>
+#include <cstring>
 
 using namespace vil;
 
@@ -164,3 +168,52 @@ extern "C" VIL_EXPORT void vilOverlayKeyboardModifier(VilOverlay overlay, enum V
 
 	ov.gui->addKeyEvent(key, active);
 }
+
+extern "C" VIL_EXPORT void vilSetLazyTracking(VkDevice vkDevice, bool enable) {
+	auto& dev = getDeviceByLoader(vkDevice);
+	dev.lazyTracking.store(enable);
+}
+
+static_assert(u32(VilFrameProfileModeOff) == u32(FrameProfileMode::off));
+static_assert(u32(VilFrameProfileModeSections) == u32(FrameProfileMode::sections));
+static_assert(u32(VilFrameProfileModeCommands) == u32(FrameProfileMode::commands));
+
+extern "C" VIL_EXPORT void vilSetFrameProfiling(VkDevice vkDevice,
+		VilFrameProfileMode mode) {
+	auto& dev = getDeviceByLoader(vkDevice);
+	dev.commandHook->profileMode(FrameProfileMode(mode));
+}
+
+static void writeProfileNodes(const ProfileNode& node, unsigned depth,
+		unsigned& count, unsigned maxNodes, VilProfileNode* nodes) {
+	if(count < maxNodes) {
+		auto& dst = nodes[count];
+		auto len = std::min<std::size_t>(node.name.size(), sizeof(dst.name) - 1);
+		std::memcpy(dst.name, node.name.data(), len);
+		dst.name[len] = '\0';
+		dst.depth = depth;
+		dst.sampleCount = node.stats.count;
+		dst.lastMs = node.stats.last;
+		dst.minMs = node.stats.min();
+		dst.avgMs = node.stats.avg();
+		dst.p95Ms = node.stats.p95();
+	}
+
+	++count;
+	for(auto& child : node.children) {
+		writeProfileNodes(child, depth + 1, count, maxNodes, nodes);
+	}
+}
+
+extern "C" VIL_EXPORT unsigned vilGetFrameProfile(VkDevice vkDevice,
+		unsigned maxNodes, VilProfileNode* nodes) {
+	auto& dev = getDeviceByLoader(vkDevice);
+	auto profile = dev.commandHook->frameProfile();
+	if(profile.stats.count == 0u) {
+		return 0u;
+	}
+
+	auto count = 0u;
+	writeProfileNodes(profile, 0u, count, maxNodes, nodes);
+	return count;
+}
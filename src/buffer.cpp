@@ -3,6 +3,7 @@
 #include <device.hpp>
 #include <data.hpp>
 #include <ds.hpp>
+#include <commandHook/hook.hpp>
 #include <threadContext.hpp>
 #include <util/util.hpp>
 
@@ -229,6 +230,9 @@ void bindBufferMemory(Buffer& buf, DeviceMemory& mem, VkDeviceSize offset) {
 	memBind.resource = &buf;
 
 	mem.allocations.insert(&memBind);
+	if(dev.commandHook) {
+		dev.commandHook->memoryBoundLocked(memBind);
+	}
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL BindBufferMemory(
@@ -2,6 +2,7 @@
 
 #include <fwd.hpp>
 #include <memory.hpp>
+#include <util/slab.hpp>
 #include <unordered_set>
 #include <atomic>
 
@@ -9,6 +10,7 @@ namespace vil {
 
 struct Buffer : MemoryResource {
 	static constexpr auto objectType = VK_OBJECT_TYPE_BUFFER;
+	VIL_SLAB_ALLOCATED(Buffer)
 
 	VkBuffer handle {};
 	VkBufferCreateInfo ci;
@@ -24,6 +26,7 @@ struct Buffer : MemoryResource {
 
 struct BufferView : SharedDeviceHandle {
 	static constexpr auto objectType = VK_OBJECT_TYPE_BUFFER_VIEW;
+	VIL_SLAB_ALLOCATED(BufferView)
 
 	VkBufferView handle;
 	VkBufferViewCreateInfo ci;
@@ -9,6 +9,7 @@
 #include <queryPool.hpp>
 #include <sync.hpp>
 #include <accelStruct.hpp>
+#include <stats.hpp>
 #include <threadContext.hpp>
 #include <vk/typemap_helper.h>
 #include <commandHook/hook.hpp>
@@ -157,6 +158,11 @@ CommandBuffer::~CommandBuffer() {
 			lastRecord_->cb = nullptr;
 			lastRecord_->hookRecords.clear();
 		}
+
+		if(prevRecord_) {
+			dlg_assert(!prevRecord_->cb);
+			prevRecord_->hookRecords.clear();
+		}
 	}
 }
 
@@ -192,6 +198,7 @@ void CommandBuffer::doReset(bool startRecord) {
 	// Make sure to never destroy a CommandBufferRecord inside the
 	// device lock.
 	IntrusivePtr<CommandRecord> keepAliveRecord;
+	IntrusivePtr<CommandRecord> keepAlivePrevRecord;
 
 	{
 		std::lock_guard lock(dev->mutex);
@@ -208,16 +215,31 @@ void CommandBuffer::doReset(bool startRecord) {
 			keepAliveRecord = std::move(builder_.record_);
 		}
 
+		// the record previous to an aborted recording can't be re-used
+		if(prevRecord_) {
+			dlg_assert(keepAliveRecord);
+			prevRecord_->hookRecords.clear();
+			keepAlivePrevRecord = std::move(prevRecord_);
+		}
+
 		// if this command buffer holds an executable record, disconnect
 		// it from this cb.
 		if(lastRecord_ && lastRecord_->cb) {
 			dlg_assert(lastRecord_->cb == this);
 			lastRecord_->cb = nullptr;
-			lastRecord_->hookRecords.clear();
 
 			// we can't have an executable record *and* a recording one
 			dlg_assert(!keepAliveRecord);
-			keepAliveRecord = std::move(lastRecord_);
+
+			// When a new record is started, keep the previous one (and
+			// its hook records) around. The new record might turn out
+			// to be identical, see doEnd.
+			if(startRecord && dev->dedupRecords && lastRecord_->hashComplete) {
+				prevRecord_ = std::move(lastRecord_);
+			} else {
+				lastRecord_->hookRecords.clear();
+				keepAliveRecord = std::move(lastRecord_);
+			}
 		}
 
 		// We have to lock our own mutex since other threads might read
@@ -240,6 +262,10 @@ void CommandBuffer::doReset(bool startRecord) {
 
 		builder_.reset(*this);
 
+		dormant_ = !forceTracking_ && dev->lazyTracking.load(std::memory_order_relaxed);
+		builder_.record_->dormant = dormant_;
+		builder_.record_->hashComplete = dev->dedupRecords && !dormant_;
+
 		computeState_ = &construct<ComputeState>(*this);
 		graphicsState_ = &construct<GraphicsState>(*this);
 		rayTracingState_ = &construct<RayTracingState>(*this);
@@ -276,12 +302,21 @@ void CommandBuffer::doEnd() {
 	rp_ = nullptr;
 	rpAttachments_ = {};
 
+	builder_.flushHash();
 	auto& rec = *builder_.record_;
 
+	// When the application recorded exactly the same as in the previous
+	// record, keep using the previous one. This way, we don't
+	// have to re-create hooked records for it.
+	// The previous record is not connected to this command buffer anymore
+	// and its content immutable, no need to lock.
+	auto reusePrev = prevRecord_ && sameContent(*prevRecord_, rec);
+
 	// Make sure to never call CommandRecord destructor inside lock.
 	// Don't just call reset() here or move lastRecord_ so that always have a valid
 	// lastRecord_ as state (some other thread could query it before we lock)
 	auto keepAliveRecord = lastRecord_;
+	IntrusivePtr<CommandRecord> keepAliveUnused;
 
 	// Critical section, update our state
 	{
@@ -293,7 +328,25 @@ void CommandBuffer::doEnd() {
 		state_ = State::executable;
 		rec.finished = true;
 
-		lastRecord_ = std::move(builder_.record_);
+		if(reusePrev) {
+			dlg_assert(!prevRecord_->cb);
+			prevRecord_->cb = this;
+			// The record id identifies the recording, it's only shown
+			// in the gui. Hooks and the gui use the record pointer.
+			prevRecord_->recordID = rec.recordID;
+			lastRecord_ = std::move(prevRecord_);
+
+			rec.cb = nullptr;
+			keepAliveUnused = std::move(builder_.record_);
+			++DebugStats::get().dedupedRecords;
+		} else {
+			if(prevRecord_) {
+				prevRecord_->hookRecords.clear();
+				keepAliveUnused = std::move(prevRecord_);
+			}
+
+			lastRecord_ = std::move(builder_.record_);
+		}
 	}
 }
 
@@ -393,12 +446,32 @@ T& addCmd(CommandBuffer& cb, Args&&... args) {
 		capture->command = cb.builder().lastCommand();
 		hook.addLocalCapture(std::move(capture));
 
+		// the capture references this record, it must not be
+		// replaced by the previous one, see doEnd.
+		cb.builder().record_->hashComplete = false;
+
 		cb.localCapture_ = {};
 	}
 
 	return cmd;
 }
 
+// Returns the driver handles for the given handles, used for forwarding
+// in dormant records (see CommandRecord::dormant).
+template<typename H>
+const H* unwrapHandles(ThreadMemScope& tms, const H* handles, u32 count) {
+	if(!HandleDesc<H>::wrap) {
+		return handles;
+	}
+
+	auto ret = tms.allocUndef<H>(count);
+	for(auto i = 0u; i < count; ++i) {
+		ret[i] = unwrapHandle(handles[i]);
+	}
+
+	return ret.data();
+}
+
 // api
 // command pool
 VKAPI_ATTR VkResult VKAPI_CALL CreateCommandPool(
@@ -662,36 +735,9 @@ template<typename T>
 auto& useHandleImpl(CommandRecord& rec, Command& cmd, T& handle) {
 	ExtZoneScoped;
 	auto& set = GetUsedSet::get(rec, handle);
-	auto it = find(set, handle);
-
-	if(it == set.end()) {
-		RefHandle<T> rh(rec.alloc);
-		rh.handle.reset(&handle);
-		it = set.insert(std::move(rh)).first;
-	} else {
-		dlg_assert(handle.refCount > 1u);
-	}
-
-	auto& use = const_cast<RefHandle<T>&>(*it);
-	// use.commands.push_back(&cmd);
-	(void) cmd;
-	return use;
-}
-
-UsedImage& useHandleImpl(CommandRecord& rec, Command& cmd, Image& img) {
-	ExtZoneScoped;
-	auto& set = rec.used.images;
-	auto it = find(set, img);
-
-	if(it == set.end()) {
-		UsedImage rh(rec.alloc);
-		rh.handle.reset(&img);
-		it = set.insert(std::move(rh)).first;
-	} else {
-		dlg_assert(img.refCount > 1u);
-	}
+	auto [use, inserted] = set.tryEmplace(&handle, rec.alloc, handle);
+	dlg_assert(inserted || handle.refCount > 1u);
 
-	auto& use = const_cast<UsedImage&>(*it);
 	// use.commands.push_back(&cmd);
 	(void) cmd;
 	return use;
@@ -700,15 +746,9 @@ UsedImage& useHandleImpl(CommandRecord& rec, Command& cmd, Image& img) {
 UsedDescriptorSet& useHandleImpl(CommandRecord& rec, Command& cmd, DescriptorSet& ds) {
 	ExtZoneScoped;
 	auto& set = rec.used.descriptorSets;
-	auto it = find(set, ds);
-
-	if(it == set.end()) {
-		UsedDescriptorSet rh(rec.alloc);
-		rh.ds = static_cast<void*>(&ds);
-		it = set.insert(std::move(rh)).first;
-	}
+	auto [use, inserted] = set.tryEmplace(&ds, rec.alloc, static_cast<void*>(&ds));
+	(void) inserted;
 
-	auto& use = const_cast<UsedDescriptorSet&>(*it);
 	// use.commands.push_back(&cmd);
 	(void) cmd;
 	return use;
@@ -724,6 +764,11 @@ void useHandle(CommandRecord& rec, Command& cmd, DescriptorSet& ds) {
 	dlg_assert(ds.pool);
 	// also use the pool here, making sure it's kept alive
 	useHandleImpl(rec, cmd, *ds.pool);
+
+	dlg_assert(ds.layout);
+	if(ds.layout->writableBindings) {
+		rec.writes.descriptorSets.tryEmplace(&ds, &ds);
+	}
 }
 
 UsedImage& useHandle(CommandRecord& rec, Command& cmd, Image& img) {
@@ -758,6 +803,9 @@ void useHandle(CommandRecord& rec, Command& cmd, Image& image,
 
 	resolve(layoutChange.range, image.ci);
 	img.layoutChanges.push_back(layoutChange);
+
+	// layout transitions write the image
+	rec.writes.handles.tryEmplace(&image, &image);
 }
 
 template<typename... Args>
@@ -767,6 +815,30 @@ decltype(auto) useHandle(CommandBuffer& cb, Args&&... args) {
 	return useHandle(*cb.builder().record_, std::forward<Args>(args)...);
 }
 
+// Marks the given resource as potentially written by the record.
+// See CommandRecord::writes.
+void useWrite(CommandBuffer& cb, const Image& img) {
+	cb.builder().record_->writes.handles.tryEmplace(&img, &img);
+}
+
+void useWrite(CommandBuffer& cb, const Buffer& buf) {
+	cb.builder().record_->writes.handles.tryEmplace(&buf, &buf);
+}
+
+void useWrite(CommandBuffer& cb, const ImageView& view) {
+	dlg_assert(view.img);
+	if(view.img) {
+		useWrite(cb, *view.img);
+	}
+}
+
+void useWrite(CommandBuffer& cb, const BufferView& view) {
+	dlg_assert(view.buffer);
+	if(view.buffer) {
+		useWrite(cb, *view.buffer);
+	}
+}
+
 // commands
 void cmdBarrier(
 		CommandBuffer& cb,
@@ -1102,6 +1174,15 @@ VKAPI_ATTR void VKAPI_CALL CmdBindDescriptorSets(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		ThreadMemScope tms;
+		cb.dev->dispatch.CmdBindDescriptorSets(cb.handle, pipelineBindPoint,
+			unwrapHandle(layout), firstSet, descriptorSetCount,
+			unwrapHandles(tms, pDescriptorSets, descriptorSetCount),
+			dynamicOffsetCount, pDynamicOffsets);
+		return;
+	}
+
 	auto& cmd = addCmd<BindDescriptorSetCmd>(cb);
 
 	cmd.firstSet = firstSet;
@@ -1177,6 +1258,12 @@ VKAPI_ATTR void VKAPI_CALL CmdBindIndexBuffer(
 		VkDeviceSize                                offset,
 		VkIndexType                                 indexType) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdBindIndexBuffer(cb.handle,
+			unwrapHandle(buffer), offset, indexType);
+		return;
+	}
+
 	auto& cmd = addCmd<BindIndexBufferCmd>(cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1201,6 +1288,14 @@ span<VkBuffer> cmdBindVertexBuffers(CommandBuffer& cb, ThreadMemScope& tms,
 		const VkDeviceSize*                         pOffsets,
 		const VkDeviceSize*                         pSizes,
 		const VkDeviceSize*                         pStrides) {
+	if(cb.dormant_) {
+		auto bufHandles = tms.allocUndef<VkBuffer>(bindingCount);
+		for(auto i = 0u; i < bindingCount; ++i) {
+			bufHandles[i] = unwrapHandle(pBuffers[i]);
+		}
+
+		return bufHandles;
+	}
 
 	auto& cmd = addCmd<BindVertexBuffersCmd>(cb);
 	cmd.firstBinding = firstBinding;
@@ -1254,6 +1349,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDraw(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDraw(cb.handle,
+			vertexCount, instanceCount, firstVertex, firstInstance);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawCmd>(cb, cb);
 
 	cmd.vertexCount = vertexCount;
@@ -1278,6 +1379,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndexed(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDrawIndexed(cb.handle,
+			indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndexedCmd>(cb, cb);
 
 	cmd.firstInstance = firstInstance;
@@ -1302,6 +1409,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndirect(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDrawIndirect(cb.handle,
+			unwrapHandle(buffer), offset, drawCount, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndirectCmd>(cb, cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1329,6 +1442,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndexedIndirect(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDrawIndexedIndirect(cb.handle,
+			unwrapHandle(buffer), offset, drawCount, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndirectCmd>(cb, cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1358,6 +1477,13 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndirectCount(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDrawIndirectCount(cb.handle,
+			unwrapHandle(buffer), offset, unwrapHandle(countBuffer),
+			countBufferOffset, maxDrawCount, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndirectCountCmd>(cb, cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1392,6 +1518,13 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndexedIndirectCount(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDrawIndexedIndirectCount(cb.handle,
+			unwrapHandle(buffer), offset, unwrapHandle(countBuffer),
+			countBufferOffset, maxDrawCount, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndirectCountCmd>(cb, cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1423,6 +1556,11 @@ VKAPI_ATTR void VKAPI_CALL CmdDispatch(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDispatch(cb.handle, groupCountX, groupCountY, groupCountZ);
+		return;
+	}
+
 	auto& cmd = addCmd<DispatchCmd>(cb, cb);
 
 	cmd.groupsX = groupCountX;
@@ -1442,6 +1580,11 @@ VKAPI_ATTR void VKAPI_CALL CmdDispatchIndirect(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDispatchIndirect(cb.handle, unwrapHandle(buffer), offset);
+		return;
+	}
+
 	auto& cmd = addCmd<DispatchIndirectCmd>(cb, cb);
 	cmd.offset = offset;
 
@@ -1466,6 +1609,13 @@ VKAPI_ATTR void VKAPI_CALL CmdDispatchBase(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDispatchBase(cb.handle,
+			baseGroupX, baseGroupY, baseGroupZ,
+			groupCountX, groupCountY, groupCountZ);
+		return;
+	}
+
 	auto& cmd = addCmd<DispatchBaseCmd>(cb, cb);
 
 	cmd.baseGroupX = baseGroupX;
@@ -1505,6 +1655,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyImage(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	cb.dev->dispatch.CmdCopyImage(cb.handle,
 		src.handle, srcImageLayout,
@@ -1530,6 +1681,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyImage2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	auto copy = *info;
 	copy.dstImage = dst.handle;
@@ -1561,6 +1713,7 @@ VKAPI_ATTR void VKAPI_CALL CmdBlitImage(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	cb.dev->dispatch.CmdBlitImage(cb.handle,
 		src.handle, srcImageLayout,
@@ -1587,6 +1740,7 @@ VKAPI_ATTR void VKAPI_CALL CmdBlitImage2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	auto copy = *info;
 	copy.srcImage = src.handle;
@@ -1614,6 +1768,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyBufferToImage(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	cb.dev->dispatch.CmdCopyBufferToImage(cb.handle,
 		src.handle, dst.handle, dstImageLayout, regionCount, pRegions);
@@ -1636,6 +1791,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyBufferToImage2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	auto copy = *info;
 	copy.srcBuffer = src.handle;
@@ -1663,6 +1819,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyImageToBuffer(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	cb.dev->dispatch.CmdCopyImageToBuffer(cb.handle,
 		src.handle, srcImageLayout, dst.handle, regionCount, pRegions);
@@ -1685,6 +1842,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyImageToBuffer2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	auto copy = *info;
 	copy.dstBuffer = dst.handle;
@@ -1709,6 +1867,7 @@ VKAPI_ATTR void VKAPI_CALL CmdClearColorImage(
 	cmd.ranges = copySpan(cb, pRanges, rangeCount);
 
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	cb.dev->dispatch.CmdClearColorImage(cb.handle,
 		dst.handle, imageLayout, pColor, rangeCount, pRanges);
@@ -1731,6 +1890,7 @@ VKAPI_ATTR void VKAPI_CALL CmdClearDepthStencilImage(
 	cmd.ranges = copySpan(cb, pRanges, rangeCount);
 
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	cb.dev->dispatch.CmdClearDepthStencilImage(cb.handle, dst.handle,
 		imageLayout, pDepthStencil, rangeCount, pRanges);
@@ -1776,6 +1936,7 @@ VKAPI_ATTR void VKAPI_CALL CmdResolveImage(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	cb.dev->dispatch.CmdResolveImage(cb.handle, src.handle, srcImageLayout,
 		dst.handle, dstImageLayout, regionCount, pRegions);
@@ -1799,6 +1960,7 @@ VKAPI_ATTR void VKAPI_CALL CmdResolveImage2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	useWrite(cb, dst);
 
 	auto copy = *info;
 	copy.dstImage = dst.handle;
@@ -1877,6 +2039,11 @@ VKAPI_ATTR void VKAPI_CALL CmdExecuteCommands(
 
 		auto& rec = *recordPtr;
 
+		// incomplete secondary records make the primary one incomplete
+		if(rec.dormant) {
+			cb.builder().record_->dormant = true;
+		}
+
 		static_assert(CommandRecord::UsedHandles::handleTypeCount == 17u);
 
 		useAllHandles(rec.used.buffers);
@@ -1905,6 +2072,11 @@ VKAPI_ATTR void VKAPI_CALL CmdExecuteCommands(
 				uimg.layoutChanges.begin(), uimg.layoutChanges.end());
 		}
 
+		// descriptor sets were already handled by useHandle above
+		for(auto* handle : rec.writes.handles) {
+			cb.builder().record_->writes.handles.tryEmplace(handle, handle);
+		}
+
 		cb.builder().record_->secondaries.push_back(std::move(recordPtr));
 		cbHandles[i] = secondary.handle,
 		last = &childCmd;
@@ -1932,6 +2104,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyBuffer(
 
 	useHandle(cb, cmd, srcBuf);
 	useHandle(cb, cmd, dstBuf);
+	useWrite(cb, dstBuf);
 
 	cb.dev->dispatch.CmdCopyBuffer(cb.handle,
 		srcBuf.handle, dstBuf.handle, regionCount, pRegions);
@@ -1953,6 +2126,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyBuffer2(
 
 	useHandle(cb, cmd, srcBuf);
 	useHandle(cb, cmd, dstBuf);
+	useWrite(cb, dstBuf);
 
 	auto copy = *info;
 	copy.srcBuffer = srcBuf.handle;
@@ -1977,6 +2151,7 @@ VKAPI_ATTR void VKAPI_CALL CmdUpdateBuffer(
 	cmd.offset = dstOffset;
 
 	useHandle(cb, cmd, buf);
+	useWrite(cb, buf);
 
 	cb.dev->dispatch.CmdUpdateBuffer(cb.handle, buf.handle, dstOffset, dataSize, pData);
 }
@@ -1997,6 +2172,7 @@ VKAPI_ATTR void VKAPI_CALL CmdFillBuffer(
 	cmd.data = data;
 
 	useHandle(cb, cmd, buf);
+	useWrite(cb, buf);
 
 	cb.dev->dispatch.CmdFillBuffer(cb.handle, buf.handle, dstOffset, size, data);
 }
@@ -2039,6 +2215,15 @@ bool checkDebugLabelForLocalCapture(CommandBuffer& cb, std::string_view name) {
 			}
 		}
 
+		// Dormant records can't be hooked. Activate full tracking,
+		// the capture will work in the following recordings.
+		if(cb.dormant_) {
+			dlg_info("Local capture '{}' requested in dormant record, "
+				"activating full tracking", lci.name);
+			cb.dev->lazyTracking.store(false);
+			return true;
+		}
+
 		cb.localCapture_ = std::move(lci);
 		return true;
 	}
@@ -2135,6 +2320,12 @@ VKAPI_ATTR void VKAPI_CALL CmdBindPipeline(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdBindPipeline(cb.handle, pipelineBindPoint,
+			unwrapHandle(pipeline));
+		return;
+	}
+
 	auto& cmd = addCmd<BindPipelineCmd>(cb);
 	cmd.bindPoint = pipelineBindPoint;
 
@@ -2258,6 +2449,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyQueryPoolResults(
 
 	useHandle(cb, cmd, *cmd.pool);
 	useHandle(cb, cmd, *cmd.dstBuffer);
+	useWrite(cb, *cmd.dstBuffer);
 
 	cb.dev->dispatch.CmdCopyQueryPoolResults(cb.handle, cmd.pool->handle,
 		firstQuery, queryCount, cmd.dstBuffer->handle, dstOffset, stride, flags);
@@ -2273,6 +2465,12 @@ VKAPI_ATTR void VKAPI_CALL CmdPushConstants(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdPushConstants(cb.handle, unwrapHandle(pipeLayout),
+			stageFlags, offset, size, pValues);
+		return;
+	}
+
 	auto& cmd = addCmd<PushConstantsCmd>(cb);
 
 	// NOTE: See BindDescriptorSets for rationale on pipe layout handling here.
@@ -2357,6 +2555,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetViewport(
 		uint32_t                                    viewportCount,
 		const VkViewport*                           pViewports) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetViewport(cb.handle, firstViewport, viewportCount, pViewports);
+		return;
+	}
+
 	auto& cmd = addCmd<SetViewportCmd>(cb);
 	cmd.first = firstViewport;
 	cmd.viewports = copySpan(cb, pViewports, viewportCount);
@@ -2376,6 +2579,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetScissor(
 		uint32_t                                    scissorCount,
 		const VkRect2D*                             pScissors) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetScissor(cb.handle, firstScissor, scissorCount, pScissors);
+		return;
+	}
+
 	auto& cmd = addCmd<SetScissorCmd>(cb);
 	cmd.first = firstScissor;
 	cmd.scissors = copySpan(cb, pScissors, scissorCount);
@@ -2393,6 +2601,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetLineWidth(
 		VkCommandBuffer                             commandBuffer,
 		float                                       lineWidth) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetLineWidth(cb.handle, lineWidth);
+		return;
+	}
+
 	auto& cmd = addCmd<SetLineWidthCmd>(cb);
 	cmd.width = lineWidth;
 
@@ -2407,6 +2620,12 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDepthBias(
 		float                                       depthBiasClamp,
 		float                                       depthBiasSlopeFactor) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetDepthBias(cb.handle,
+			depthBiasConstantFactor, depthBiasClamp, depthBiasSlopeFactor);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDepthBiasCmd>(cb);
 	cmd.state = {depthBiasConstantFactor, depthBiasClamp, depthBiasSlopeFactor};
 
@@ -2421,6 +2640,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetBlendConstants(
 		VkCommandBuffer                             commandBuffer,
 		const float                                 blendConstants[4]) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetBlendConstants(cb.handle, blendConstants);
+		return;
+	}
+
 	auto& cmd = addCmd<SetBlendConstantsCmd>(cb);
 	std::memcpy(cmd.values.data(), blendConstants, sizeof(cmd.values));
 
@@ -2436,6 +2660,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDepthBounds(
 		float                                       minDepthBounds,
 		float                                       maxDepthBounds) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetDepthBounds(cb.handle, minDepthBounds, maxDepthBounds);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDepthBoundsCmd>(cb);
 	cmd.min = minDepthBounds;
 	cmd.max = maxDepthBounds;
@@ -2452,6 +2681,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetStencilCompareMask(
 		VkStencilFaceFlags                          faceMask,
 		uint32_t                                    compareMask) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetStencilCompareMask(cb.handle, faceMask, compareMask);
+		return;
+	}
+
 	auto& cmd = addCmd<SetStencilCompareMaskCmd>(cb);
 	cmd.faceMask = faceMask;
 	cmd.value = compareMask;
@@ -2472,6 +2706,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetStencilWriteMask(
 		VkStencilFaceFlags                          faceMask,
 		uint32_t                                    writeMask) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetStencilWriteMask(cb.handle, faceMask, writeMask);
+		return;
+	}
+
 	auto& cmd = addCmd<SetStencilWriteMaskCmd>(cb);
 	cmd.faceMask = faceMask;
 	cmd.value = writeMask;
@@ -2492,6 +2731,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetStencilReference(
 		VkStencilFaceFlags                          faceMask,
 		uint32_t                                    reference) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetStencilReference(cb.handle, faceMask, reference);
+		return;
+	}
+
 	auto& cmd = addCmd<SetStencilReferenceCmd>(cb);
 	cmd.faceMask = faceMask;
 	cmd.value = reference;
@@ -2541,6 +2785,9 @@ VKAPI_ATTR void VKAPI_CALL CmdPushDescriptorSetKHR(
 					copies[i] = write.pBufferInfo[i];
 					copies[i].buffer = buf.handle;
 					useHandle(cb, cmd, buf);
+					if(isWritable(write.descriptorType)) {
+						useWrite(cb, buf);
+					}
 				}
 				write.pBufferInfo = copies.data();
 				break;
@@ -2553,6 +2800,9 @@ VKAPI_ATTR void VKAPI_CALL CmdPushDescriptorSetKHR(
 						auto& iv = get(*cb.dev, write.pImageInfo[i].imageView);
 						copies[i].imageView = iv.handle;
 						useHandle(cb, cmd, iv);
+						if(isWritable(write.descriptorType)) {
+							useWrite(cb, iv);
+						}
 					}
 					if(copies[i].sampler) {
 						auto& sampler = get(*cb.dev, write.pImageInfo[i].sampler);
@@ -2569,6 +2819,9 @@ VKAPI_ATTR void VKAPI_CALL CmdPushDescriptorSetKHR(
 					auto& bv = get(*cb.dev, write.pTexelBufferView[i]);
 					copies[i] = bv.handle;
 					useHandle(cb, cmd, bv);
+					if(isWritable(write.descriptorType)) {
+						useWrite(cb, bv);
+					}
 				}
 				write.pTexelBufferView = copies.data();
 				break;
@@ -2640,6 +2893,9 @@ VKAPI_ATTR void VKAPI_CALL CmdPushDescriptorSetWithTemplateKHR(
 						auto& iv = get(*cb.dev, imgInfo.imageView);
 						imgInfo.imageView = iv.handle;
 						useHandle(cb, cmd, iv);
+						if(isWritable(dsType)) {
+							useWrite(cb, iv);
+						}
 					}
 					if(imgInfo.sampler) {
 						auto& sampler = get(*cb.dev, imgInfo.sampler);
@@ -2652,12 +2908,18 @@ VKAPI_ATTR void VKAPI_CALL CmdPushDescriptorSetWithTemplateKHR(
 					auto& buf = get(*cb.dev, bufInfo.buffer);
 					bufInfo.buffer = buf.handle;
 					useHandle(cb, cmd, buf);
+					if(isWritable(dsType)) {
+						useWrite(cb, buf);
+					}
 					break;
 				} case DescriptorCategory::bufferView: {
 					auto& vkBufView = *reinterpret_cast<VkBufferView*>(data);
 					auto& bv = get(*cb.dev, vkBufView);
 					vkBufView = bv.handle;
 					useHandle(cb, cmd, bv);
+					if(isWritable(dsType)) {
+						useWrite(cb, bv);
+					}
 					break;
 				} case DescriptorCategory::accelStruct: {
 					auto& vkAccelStruct = *reinterpret_cast<VkAccelerationStructureKHR*>(data);
@@ -2685,6 +2947,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetFragmentShadingRateKHR(
 		const VkExtent2D*                           pFragmentSize,
 		const VkFragmentShadingRateCombinerOpKHR    combinerOps[2]) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetFragmentShadingRateKHR(cb.handle, pFragmentSize, combinerOps);
+		return;
+	}
+
 	auto& cmd = addCmd<SetFragmentShadingRateCmd>(cb);
 	cmd.fragmentSize = *pFragmentSize;
 	cmd.combinerOps = {combinerOps[0], combinerOps[1]};
@@ -2723,6 +2990,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetLineStippleEXT(
 		uint32_t                                    lineStippleFactor,
 		uint16_t                                    lineStipplePattern) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetLineStippleEXT(cb.handle, lineStippleFactor, lineStipplePattern);
+		return;
+	}
+
 	auto& cmd = addCmd<SetLineStippleCmd>(cb);
 	cmd.stippleFactor = lineStippleFactor;
 	cmd.stipplePattern = lineStipplePattern;
@@ -2734,6 +3006,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetCullMode(
 		VkCommandBuffer                             commandBuffer,
 		VkCullModeFlags                             cullMode) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetCullModeEXT(cb.handle, cullMode);
+		return;
+	}
+
 	auto& cmd = addCmd<SetCullModeCmd>(cb);
 	cmd.cullMode = cullMode;
 
@@ -2744,16 +3021,26 @@ VKAPI_ATTR void VKAPI_CALL CmdSetFrontFace(
 		VkCommandBuffer                             commandBuffer,
 		VkFrontFace                                 frontFace) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetFrontFaceEXT(cb.handle, frontFace);
+		return;
+	}
+
 	auto& cmd = addCmd<SetFrontFaceCmd>(cb);
 	cmd.frontFace = frontFace;
 
-	cb.dev->dispatch.CmdSetCullModeEXT(cb.handle, frontFace);
+	cb.dev->dispatch.CmdSetFrontFaceEXT(cb.handle, frontFace);
 }
 
 VKAPI_ATTR void VKAPI_CALL CmdSetPrimitiveTopology(
 		VkCommandBuffer                             commandBuffer,
 		VkPrimitiveTopology                         primitiveTopology) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetPrimitiveTopologyEXT(cb.handle, primitiveTopology);
+		return;
+	}
+
 	auto& cmd = addCmd<SetPrimitiveTopologyCmd>(cb);
 	cmd.topology = primitiveTopology;
 
@@ -2765,6 +3052,12 @@ VKAPI_ATTR void VKAPI_CALL CmdSetViewportWithCount(
 		uint32_t                                    viewportCount,
 		const VkViewport*                           pViewports) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetViewportWithCountEXT(cb.handle, viewportCount,
+			pViewports);
+		return;
+	}
+
 	auto& cmd = addCmd<SetViewportWithCountCmd>(cb);
 	cmd.viewports = copySpan(cb, pViewports, viewportCount);
 
@@ -2777,6 +3070,12 @@ VKAPI_ATTR void VKAPI_CALL CmdSetScissorWithCount(
 		uint32_t                                    scissorCount,
 		const VkRect2D*                             pScissors) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetScissorWithCountEXT(cb.handle, scissorCount,
+			pScissors);
+		return;
+	}
+
 	auto& cmd = addCmd<SetScissorWithCountCmd>(cb);
 	cmd.scissors = copySpan(cb, pScissors, scissorCount);
 
@@ -2805,6 +3104,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDepthTestEnable(
 		VkCommandBuffer                             commandBuffer,
 		VkBool32                                    depthTestEnable) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetDepthTestEnableEXT(cb.handle, depthTestEnable);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDepthTestEnableCmd>(cb);
 	cmd.enable = depthTestEnable;
 
@@ -2815,6 +3119,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDepthWriteEnable(
 		VkCommandBuffer                             commandBuffer,
 		VkBool32                                    depthWriteEnable) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetDepthWriteEnableEXT(cb.handle, depthWriteEnable);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDepthWriteEnableCmd>(cb);
 	cmd.enable = depthWriteEnable;
 
@@ -2825,6 +3134,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDepthCompareOp(
 		VkCommandBuffer                             commandBuffer,
 		VkCompareOp                                 depthCompareOp) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetDepthCompareOpEXT(cb.handle, depthCompareOp);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDepthCompareOpCmd>(cb);
 	cmd.op = depthCompareOp;
 
@@ -2835,6 +3149,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDepthBoundsTestEnable(
 		VkCommandBuffer                             commandBuffer,
 		VkBool32                                    depthBoundsTestEnable) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetDepthBoundsTestEnableEXT(cb.handle, depthBoundsTestEnable);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDepthBoundsTestEnableCmd>(cb);
 	cmd.enable = depthBoundsTestEnable;
 
@@ -2845,6 +3164,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetStencilTestEnable(
 		VkCommandBuffer                             commandBuffer,
 		VkBool32                                    stencilTestEnable) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetStencilTestEnableEXT(cb.handle, stencilTestEnable);
+		return;
+	}
+
 	auto& cmd = addCmd<SetStencilTestEnableCmd>(cb);
 	cmd.enable = stencilTestEnable;
 
@@ -2859,6 +3183,12 @@ VKAPI_ATTR void VKAPI_CALL CmdSetStencilOp(
 		VkStencilOp                                 depthFailOp,
 		VkCompareOp                                 compareOp) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetStencilOpEXT(cb.handle, faceMask,
+			failOp, passOp, depthFailOp, compareOp);
+		return;
+	}
+
 	auto& cmd = addCmd<SetStencilOpCmd>(cb);
 	cmd.faceMask = faceMask;
 	cmd.failOp = failOp;
@@ -2874,6 +3204,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetPatchControlPointsEXT(
 		VkCommandBuffer                             commandBuffer,
 		uint32_t                                    patchControlPoints) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetPatchControlPointsEXT(cb.handle, patchControlPoints);
+		return;
+	}
+
 	auto& cmd = addCmd<SetPatchControlPointsCmd>(cb);
 	cmd.patchControlPoints = patchControlPoints;
 
@@ -2884,6 +3219,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetRasterizerDiscardEnableEXT(
 		VkCommandBuffer                             commandBuffer,
 		VkBool32                                    rasterizerDiscardEnable) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetRasterizerDiscardEnableEXT(cb.handle, rasterizerDiscardEnable);
+		return;
+	}
+
 	auto& cmd = addCmd<SetRasterizerDiscardEnableCmd>(cb);
 	cmd.enable = rasterizerDiscardEnable;
 
@@ -2894,6 +3234,11 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDepthBiasEnableEXT(
 		VkCommandBuffer                             commandBuffer,
 		VkBool32                                    depthBiasEnable) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetDepthBiasEnableEXT(cb.handle, depthBiasEnable);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDepthBiasEnableCmd>(cb);
 	cmd.enable = depthBiasEnable;
 
@@ -2904,26 +3249,41 @@ VKAPI_ATTR void VKAPI_CALL CmdSetLogicOpEXT(
 		VkCommandBuffer                             commandBuffer,
 		VkLogicOp                                   logicOp) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetLogicOpEXT(cb.handle, logicOp);
+		return;
+	}
+
 	auto& cmd = addCmd<SetLogicOpCmd>(cb);
 	cmd.logicOp = logicOp;
 
-	cb.dev->dispatch.CmdSetDepthBiasEnableEXT(cb.handle, logicOp);
+	cb.dev->dispatch.CmdSetLogicOpEXT(cb.handle, logicOp);
 }
 
 VKAPI_ATTR void VKAPI_CALL CmdSetPrimitiveRestartEnableEXT(
 		VkCommandBuffer                             commandBuffer,
 		VkBool32                                    primitiveRestartEnable) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetPrimitiveRestartEnableEXT(cb.handle, primitiveRestartEnable);
+		return;
+	}
+
 	auto& cmd = addCmd<SetPrimitiveRestartEnableCmd>(cb);
 	cmd.enable = primitiveRestartEnable;
 
-	cb.dev->dispatch.CmdSetDepthBiasEnableEXT(cb.handle, primitiveRestartEnable);
+	cb.dev->dispatch.CmdSetPrimitiveRestartEnableEXT(cb.handle, primitiveRestartEnable);
 }
 
 VKAPI_ATTR void VKAPI_CALL CmdSetSampleLocationsEXT(
 		VkCommandBuffer                             commandBuffer,
 		const VkSampleLocationsInfoEXT*             pSampleLocationsInfo) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetSampleLocationsEXT(cb.handle, pSampleLocationsInfo);
+		return;
+	}
+
 	auto& cmd = addCmd<SetSampleLocationsCmd>(cb);
 	cmd.info = *pSampleLocationsInfo;
 	copyChainInPlace(cb, cmd.info.pNext);
@@ -2937,6 +3297,12 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDiscardRectangleEXT(
 		uint32_t                                    discardRectangleCount,
 		const VkRect2D*                             pDiscardRectangles) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetDiscardRectangleEXT(cb.handle,
+			firstDiscardRectangle, discardRectangleCount, pDiscardRectangles);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDiscardRectangleCmd>(cb);
 	cmd.first = firstDiscardRectangle;
 	cmd.rects = copySpan(cb, pDiscardRectangles, discardRectangleCount);
@@ -2946,6 +3312,18 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDiscardRectangleEXT(
 }
 
 // VK_KHR_acceleration_structure
+void addDormantAccelStructBuilds(CommandBuffer& cb, span<AccelStruct*> dsts) {
+	auto& rec = *cb.builder().record_;
+	for(auto* dst : dsts) {
+		rec.dormantAccelStructBuilds.push_back(dst);
+	}
+
+	// Dormant records are never hooked, so we can't capture the data
+	// used to build the acceleration structures here. Make sure the
+	// next records of this command buffer are fully tracked.
+	cb.forceTracking_ = true;
+}
+
 VKAPI_ATTR void VKAPI_CALL CmdBuildAccelerationStructuresKHR(
 		VkCommandBuffer                             commandBuffer,
 		uint32_t                                    infoCount,
@@ -2996,6 +3374,10 @@ VKAPI_ATTR void VKAPI_CALL CmdBuildAccelerationStructuresKHR(
 	// is submitted to the gpu to retrieve the actual data used for building.
 	cb.builder().record_->buildsAccelStructs = true;
 
+	if(cb.dormant_) {
+		addDormantAccelStructBuilds(cb, cmd.dsts);
+	}
+
 	cb.dev->dispatch.CmdBuildAccelerationStructuresKHR(cb.handle,
 		infoCount, cmd.buildInfos.data(), ppBuildRangeInfos);
 }
@@ -3056,6 +3438,10 @@ VKAPI_ATTR void VKAPI_CALL CmdBuildAccelerationStructuresIndirectKHR(
 	// is submitted to the gpu to retrieve the actual data used for building.
 	cb.builder().record_->buildsAccelStructs = true;
 
+	if(cb.dormant_) {
+		addDormantAccelStructBuilds(cb, cmd.dsts);
+	}
+
 	cb.dev->dispatch.CmdBuildAccelerationStructuresIndirectKHR(cb.handle,
 		infoCount, cmd.buildInfos.data(), pIndirectDeviceAddresses,
 		pIndirectStrides, ppMaxPrimitiveCounts);
@@ -3162,6 +3548,16 @@ VKAPI_ATTR void VKAPI_CALL CmdTraceRaysKHR(
 		uint32_t                                    height,
 		uint32_t                                    depth) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdTraceRaysKHR(cb.handle,
+			pRaygenShaderBindingTable,
+			pMissShaderBindingTable,
+			pHitShaderBindingTable,
+			pCallableShaderBindingTable,
+			width, height, depth);
+		return;
+	}
+
 	auto& cmd = addCmd<TraceRaysCmd>(cb, cb);
 	cmd.raygenBindingTable = *pRaygenShaderBindingTable;
 	cmd.missBindingTable = *pMissShaderBindingTable;
@@ -3189,6 +3585,16 @@ VKAPI_ATTR void VKAPI_CALL CmdTraceRaysIndirectKHR(
 		const VkStridedDeviceAddressRegionKHR*      pCallableShaderBindingTable,
 		VkDeviceAddress                             indirectDeviceAddress) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdTraceRaysIndirectKHR(cb.handle,
+			pRaygenShaderBindingTable,
+			pMissShaderBindingTable,
+			pHitShaderBindingTable,
+			pCallableShaderBindingTable,
+			indirectDeviceAddress);
+		return;
+	}
+
 	auto& cmd = addCmd<TraceRaysIndirectCmd>(cb, cb);
 	cmd.raygenBindingTable = *pRaygenShaderBindingTable;
 	cmd.missBindingTable = *pMissShaderBindingTable;
@@ -3241,11 +3647,13 @@ VKAPI_ATTR void VKAPI_CALL CmdBeginRendering(
 		if(src.imageView) {
 			dst.view = &unwrap(src.imageView);
 			useHandle(cb, cmd, *dst.view);
+			useWrite(cb, *dst.view);
 		}
 
 		if(src.resolveImageView) {
 			dst.resolveView = &unwrap(src.resolveImageView);
 			useHandle(cb, cmd, *dst.resolveView);
+			useWrite(cb, *dst.resolveView);
 		}
 
 		return dst.view;
@@ -3367,6 +3775,13 @@ VKAPI_ATTR void VKAPI_CALL CmdSetVertexInputEXT(
 		uint32_t                                    vertexAttributeDescriptionCount,
 		const VkVertexInputAttributeDescription2EXT* pVertexAttributeDescriptions) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetVertexInputEXT(cb.handle,
+			vertexBindingDescriptionCount, pVertexBindingDescriptions,
+			vertexAttributeDescriptionCount, pVertexAttributeDescriptions);
+		return;
+	}
+
 	auto& cmd = addCmd<SetVertexInputCmd>(cb);
 	cmd.bindings = copySpan(cb, pVertexBindingDescriptions, vertexBindingDescriptionCount);
 	cmd.attribs = copySpan(cb, pVertexAttributeDescriptions, vertexAttributeDescriptionCount);
@@ -3383,6 +3798,12 @@ VKAPI_ATTR void VKAPI_CALL CmdSetColorWriteEnableEXT(
 		uint32_t                                    attachmentCount,
 		const VkBool32*                             pColorWriteEnables) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdSetColorWriteEnableEXT(cb.handle,
+			attachmentCount, pColorWriteEnables);
+		return;
+	}
+
 	auto& cmd = addCmd<SetColorWriteEnableCmd>(cb);
 	cmd.writeEnables = copySpan(cb, pColorWriteEnables, attachmentCount);
 
@@ -3402,6 +3823,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawMultiEXT(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDrawMultiEXT(cb.handle,
+			drawCount, pVertexInfo, instanceCount, firstInstance, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawMultiCmd>(cb, cb);
 
 	cmd.vertexInfos = alloc<VkMultiDrawInfoEXT>(cb, drawCount);
@@ -3433,6 +3860,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawMultiIndexedEXT(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(cb.dormant_) {
+		cb.dev->dispatch.CmdDrawMultiIndexedEXT(cb.handle, drawCount,
+			pIndexInfo, instanceCount, firstInstance, stride, pVertexOffset);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawMultiIndexedCmd>(cb, cb);
 
 	cmd.indexInfos = alloc<VkMultiDrawIndexedInfoEXT>(cb, drawCount);
@@ -92,6 +92,10 @@ private:
 	// i.e. by vkEndCommandBuffer.
 	IntrusivePtr<CommandRecord> lastRecord_;
 	u32 recordCount_ {};
+	// While recording: the previous record (with its hook records) that
+	// may be re-used when the new record turns out to be identical.
+	// Disconnected from this command buffer until then.
+	IntrusivePtr<CommandRecord> prevRecord_;
 
 	// Only needed while recording.
 	ComputeState* computeState_ {};
@@ -114,6 +118,14 @@ public: // Only public for recording, should not be accessed outside api
 		LocalCaptureFlags flags {};
 	} localCapture_;
 
+	// Whether the current record is dormant, see CommandRecord::dormant.
+	// Determined in BeginCommandBuffer.
+	bool dormant_ {};
+	// Whether lazy tracking should be ignored for the following
+	// records of this command buffer. Set when a dormant record built
+	// acceleration structures, we want to capture their data.
+	bool forceTracking_ {};
+
 	void popLabelSections();
 	auto& ignoreEndDebugLabels() { return ignoreEndDebugLabels_; }
 
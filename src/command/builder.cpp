@@ -1,6 +1,9 @@
 #include <command/builder.hpp>
 #include <command/commands.hpp>
 #include <command/alloc.hpp>
+#include <command/match.hpp>
+#include <cstring>
+#include <type_traits>
 
 #ifdef VIL_COMMAND_CALLSTACKS
 	#include <backward/trace.hpp>
@@ -14,6 +17,741 @@ void doReset(RecordBuilder& builder) {
 	builder.section_ = &construct<RecordBuilder::Section>(*builder.record_);
 	builder.section_->cmd = builder.record_->commands;
 	builder.lastCommand_ = nullptr;
+	builder.unhashed_ = nullptr;
+}
+
+// record hashing
+template<typename T, typename = void>
+struct HasPNext : std::false_type {};
+
+template<typename T>
+struct HasPNext<T, std::void_t<decltype(std::declval<T>().pNext)>> : std::true_type {};
+
+struct RecordHasher {
+	u64& hash;
+	bool& complete; // unset when something can't be hashed
+	// When set, all hashed values are additionally stored here.
+	// Allows to compare the hashed content exactly, see sameCommands.
+	std::vector<u64>* words {};
+
+	void add(u64 val) {
+		if(words) {
+			words->push_back(val);
+		}
+
+		auto& h = hash;
+		h = (h ^ val) * 0x9E3779B97F4A7C15ull;
+		h ^= h >> 32u;
+	}
+
+	void add(const void* ptr) {
+		add(u64(reinterpret_cast<std::uintptr_t>(ptr)));
+	}
+
+	void add(span<const std::byte> bytes) {
+		add(u64(bytes.size()));
+
+		auto it = bytes.data();
+		auto end = it + bytes.size();
+		for(; it + 8u <= end; it += 8u) {
+			u64 val;
+			std::memcpy(&val, it, 8u);
+			add(val);
+		}
+
+		if(it != end) {
+			u64 val {};
+			std::memcpy(&val, it, end - it);
+			add(val);
+		}
+	}
+
+	// Chained extension structs can't be hashed generically.
+	// We don't consider records using them for deduplication.
+	void addChain(const void* pNext) {
+		if(pNext) {
+			complete = false;
+		}
+	}
+
+	// Hashes the raw memory of the given values. Only valid for types
+	// that don't reference other memory (except via an empty pNext).
+	template<typename T>
+	void addRaw(span<T> vals) {
+		static_assert(std::is_trivially_copyable_v<T>);
+		if constexpr(HasPNext<T>::value) {
+			for(auto& val : vals) {
+				addChain(val.pNext);
+			}
+		}
+
+		auto* data = reinterpret_cast<const std::byte*>(vals.data());
+		add(span<const std::byte>(data, vals.size() * sizeof(T)));
+	}
+
+	template<typename T>
+	void addRaw(const T& val) {
+		addRaw(span<const T>(&val, 1u));
+	}
+
+	template<typename T>
+	void addPtrs(span<T*> ptrs) {
+		add(u64(ptrs.size()));
+		for(auto* ptr : ptrs) {
+			add(ptr);
+		}
+	}
+
+	void add(const char* str) {
+		auto* data = reinterpret_cast<const std::byte*>(str);
+		add(span<const std::byte>(data, std::strlen(str)));
+	}
+
+	void addState(const DescriptorState* state) {
+		if(!state) {
+			add(u64(0u));
+			return;
+		}
+
+		add(u64(state->descriptorSets.size()));
+		for(auto& ds : state->descriptorSets) {
+			// dsID is needed since descriptor set memory is re-used
+			add(ds.dsEntry);
+			add(ds.dsPool);
+			add(u64(ds.dsID));
+			add(ds.layout);
+			addRaw(ds.dynamicOffsets);
+		}
+	}
+};
+
+void hashParams(RecordHasher& h, const Command&) {
+	// not supported
+	h.complete = false;
+}
+
+// commands without parameters
+void hashParams(RecordHasher&, const EndRenderPassCmd&) {}
+void hashParams(RecordHasher&, const EndRenderingCmd&) {}
+void hashParams(RecordHasher&, const EndDebugUtilsLabelCmd&) {}
+void hashParams(RecordHasher&, const EndConditionalRenderingCmd&) {}
+
+void hashParams(RecordHasher& h, const BeginRenderPassCmd& cmd) {
+	// The only chained struct we know is the attachment info for imageless
+	// framebuffers, already covered by cmd.attachments.
+	auto* chain = static_cast<const VkBaseInStructure*>(cmd.info.pNext);
+	for(; chain; chain = chain->pNext) {
+		if(chain->sType != VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO) {
+			h.complete = false;
+		}
+	}
+
+	h.add(cmd.rp);
+	h.add(cmd.fb);
+	h.addPtrs(cmd.attachments);
+	h.addRaw(cmd.info.renderArea);
+	h.addRaw(cmd.clearValues);
+	h.addChain(cmd.subpassBeginInfo.pNext);
+	h.add(u64(cmd.subpassBeginInfo.contents));
+}
+
+void hashParams(RecordHasher& h, const FirstSubpassCmd& cmd) {
+	h.add(u64(cmd.subpassID));
+}
+
+void hashParams(RecordHasher& h, const NextSubpassCmd& cmd) {
+	h.add(u64(cmd.subpassID));
+	h.addChain(cmd.beginInfo.pNext);
+	h.addChain(cmd.endInfo.pNext);
+	h.add(u64(cmd.beginInfo.contents));
+}
+
+void hashParams(RecordHasher& h, const BeginRenderingCmd& cmd) {
+	auto addAttachment = [&](const BeginRenderingCmd::Attachment& att) {
+		h.add(att.view);
+		h.add(att.resolveView);
+		h.add(u64(att.imageLayout));
+		h.add(u64(att.resolveMode));
+		h.add(u64(att.resolveImageLayout));
+		h.add(u64(att.loadOp));
+		h.add(u64(att.storeOp));
+		h.addRaw(att.clearValue);
+	};
+
+	h.add(u64(cmd.layerCount));
+	h.add(u64(cmd.viewMask));
+	h.add(u64(cmd.flags));
+	h.addRaw(cmd.renderArea);
+	h.add(u64(cmd.colorAttachments.size()));
+	for(auto& att : cmd.colorAttachments) {
+		addAttachment(att);
+	}
+
+	addAttachment(cmd.depthAttachment);
+	addAttachment(cmd.stencilAttachment);
+}
+
+void hashParams(RecordHasher& h, const BeginDebugUtilsLabelCmd& cmd) {
+	h.add(cmd.name);
+	h.addRaw(cmd.color);
+}
+
+void hashParams(RecordHasher& h, const InsertDebugUtilsLabelCmd& cmd) {
+	h.add(cmd.name);
+	h.addRaw(cmd.color);
+}
+
+void hashParams(RecordHasher& h, const BeginConditionalRenderingCmd& cmd) {
+	h.add(cmd.buffer);
+	h.add(u64(cmd.offset));
+	h.add(u64(cmd.flags));
+}
+
+// The bound state (pipeline, buffers, dynamic state, push constants) is
+// fully determined by the previously recorded commands that are hashed
+// themselves. We only have to include the descriptor set ids.
+void hashParams(RecordHasher& h, const DrawCmd& cmd) {
+	h.addState(cmd.state);
+	h.add(u64(cmd.vertexCount));
+	h.add(u64(cmd.instanceCount));
+	h.add(u64(cmd.firstVertex));
+	h.add(u64(cmd.firstInstance));
+}
+
+void hashParams(RecordHasher& h, const DrawIndexedCmd& cmd) {
+	h.addState(cmd.state);
+	h.add(u64(cmd.indexCount));
+	h.add(u64(cmd.instanceCount));
+	h.add(u64(cmd.firstIndex));
+	h.add(u64(cmd.vertexOffset));
+	h.add(u64(cmd.firstInstance));
+}
+
+void hashParams(RecordHasher& h, const DrawIndirectCmd& cmd) {
+	h.addState(cmd.state);
+	h.add(cmd.buffer);
+	h.add(u64(cmd.offset));
+	h.add(u64(cmd.drawCount));
+	h.add(u64(cmd.stride));
+	h.add(u64(cmd.indexed));
+}
+
+void hashParams(RecordHasher& h, const DrawIndirectCountCmd& cmd) {
+	h.addState(cmd.state);
+	h.add(cmd.buffer);
+	h.add(u64(cmd.offset));
+	h.add(u64(cmd.maxDrawCount));
+	h.add(u64(cmd.stride));
+	h.add(cmd.countBuffer);
+	h.add(u64(cmd.countBufferOffset));
+	h.add(u64(cmd.indexed));
+}
+
+void hashParams(RecordHasher& h, const DrawMultiCmd& cmd) {
+	h.addState(cmd.state);
+	h.addRaw(cmd.vertexInfos);
+	h.add(u64(cmd.instanceCount));
+	h.add(u64(cmd.firstInstance));
+	h.add(u64(cmd.stride));
+}
+
+void hashParams(RecordHasher& h, const DrawMultiIndexedCmd& cmd) {
+	h.addState(cmd.state);
+	h.addRaw(cmd.indexInfos);
+	h.add(u64(cmd.instanceCount));
+	h.add(u64(cmd.firstInstance));
+	h.add(u64(cmd.stride));
+	h.add(u64(cmd.vertexOffset.has_value()));
+	h.add(u64(cmd.vertexOffset.value_or(0)));
+}
+
+void hashParams(RecordHasher& h, const DispatchCmd& cmd) {
+	h.addState(cmd.state);
+	h.add(u64(cmd.groupsX));
+	h.add(u64(cmd.groupsY));
+	h.add(u64(cmd.groupsZ));
+}
+
+void hashParams(RecordHasher& h, const DispatchIndirectCmd& cmd) {
+	h.addState(cmd.state);
+	h.add(cmd.buffer);
+	h.add(u64(cmd.offset));
+}
+
+void hashParams(RecordHasher& h, const DispatchBaseCmd& cmd) {
+	h.addState(cmd.state);
+	h.add(u64(cmd.baseGroupX));
+	h.add(u64(cmd.baseGroupY));
+	h.add(u64(cmd.baseGroupZ));
+	h.add(u64(cmd.groupsX));
+	h.add(u64(cmd.groupsY));
+	h.add(u64(cmd.groupsZ));
+}
+
+void hashParams(RecordHasher& h, const TraceRaysCmd& cmd) {
+	h.addState(cmd.state);
+	h.add(u64(cmd.width));
+	h.add(u64(cmd.height));
+	h.add(u64(cmd.depth));
+	h.addRaw(cmd.raygenBindingTable);
+	h.addRaw(cmd.missBindingTable);
+	h.addRaw(cmd.hitBindingTable);
+	h.addRaw(cmd.callableBindingTable);
+}
+
+void hashParams(RecordHasher& h, const TraceRaysIndirectCmd& cmd) {
+	h.addState(cmd.state);
+	h.add(u64(cmd.indirectDeviceAddress));
+	h.addRaw(cmd.raygenBindingTable);
+	h.addRaw(cmd.missBindingTable);
+	h.addRaw(cmd.hitBindingTable);
+	h.addRaw(cmd.callableBindingTable);
+}
+
+void hashParams(RecordHasher& h, const CopyImageCmd& cmd) {
+	h.addChain(cmd.pNext);
+	h.add(cmd.src);
+	h.add(cmd.dst);
+	h.add(u64(cmd.srcLayout));
+	h.add(u64(cmd.dstLayout));
+	h.addRaw(cmd.copies);
+}
+
+void hashParams(RecordHasher& h, const CopyBufferToImageCmd& cmd) {
+	h.addChain(cmd.pNext);
+	h.add(cmd.src);
+	h.add(cmd.dst);
+	h.add(u64(cmd.dstLayout));
+	h.addRaw(cmd.copies);
+}
+
+void hashParams(RecordHasher& h, const CopyImageToBufferCmd& cmd) {
+	h.addChain(cmd.pNext);
+	h.add(cmd.src);
+	h.add(cmd.dst);
+	h.add(u64(cmd.srcLayout));
+	h.addRaw(cmd.copies);
+}
+
+void hashParams(RecordHasher& h, const BlitImageCmd& cmd) {
+	h.addChain(cmd.pNext);
+	h.add(cmd.src);
+	h.add(cmd.dst);
+	h.add(u64(cmd.srcLayout));
+	h.add(u64(cmd.dstLayout));
+	h.add(u64(cmd.filter));
+	h.addRaw(cmd.blits);
+}
+
+void hashParams(RecordHasher& h, const ResolveImageCmd& cmd) {
+	h.addChain(cmd.pNext);
+	h.add(cmd.src);
+	h.add(cmd.dst);
+	h.add(u64(cmd.srcLayout));
+	h.add(u64(cmd.dstLayout));
+	h.addRaw(cmd.regions);
+}
+
+void hashParams(RecordHasher& h, const CopyBufferCmd& cmd) {
+	h.addChain(cmd.pNext);
+	h.add(cmd.src);
+	h.add(cmd.dst);
+	h.addRaw(cmd.regions);
+}
+
+void hashParams(RecordHasher& h, const UpdateBufferCmd& cmd) {
+	h.add(cmd.dst);
+	h.add(u64(cmd.offset));
+	h.add(cmd.data);
+}
+
+void hashParams(RecordHasher& h, const FillBufferCmd& cmd) {
+	h.add(cmd.dst);
+	h.add(u64(cmd.offset));
+	h.add(u64(cmd.size));
+	h.add(u64(cmd.data));
+}
+
+void hashParams(RecordHasher& h, const ClearColorImageCmd& cmd) {
+	h.add(cmd.dst);
+	h.addRaw(cmd.color);
+	h.add(u64(cmd.dstLayout));
+	h.addRaw(cmd.ranges);
+}
+
+void hashParams(RecordHasher& h, const ClearDepthStencilImageCmd& cmd) {
+	h.add(cmd.dst);
+	h.addRaw(cmd.value);
+	h.add(u64(cmd.dstLayout));
+	h.addRaw(cmd.ranges);
+}
+
+void hashParams(RecordHasher& h, const ClearAttachmentCmd& cmd) {
+	h.addRaw(cmd.attachments);
+	h.addRaw(cmd.rects);
+}
+
+void hashParams(RecordHasher& h, const BarrierCmdBase& cmd) {
+	h.add(u64(cmd.srcStageMask));
+	h.add(u64(cmd.dstStageMask));
+	h.addRaw(cmd.memBarriers);
+	h.addRaw(cmd.bufBarriers);
+	h.addRaw(cmd.imgBarriers);
+	h.addPtrs(cmd.images);
+	h.addPtrs(cmd.buffers);
+}
+
+void hashParams(RecordHasher& h, const Barrier2CmdBase& cmd) {
+	h.add(u64(cmd.flags));
+	h.addRaw(cmd.memBarriers);
+	h.addRaw(cmd.bufBarriers);
+	h.addRaw(cmd.imgBarriers);
+	h.addPtrs(cmd.images);
+	h.addPtrs(cmd.buffers);
+}
+
+void hashParams(RecordHasher& h, const BarrierCmd& cmd) {
+	hashParams(h, static_cast<const BarrierCmdBase&>(cmd));
+	h.add(u64(cmd.dependencyFlags));
+}
+
+void hashParams(RecordHasher& h, const WaitEventsCmd& cmd) {
+	hashParams(h, static_cast<const BarrierCmdBase&>(cmd));
+	h.addPtrs(cmd.events);
+}
+
+void hashParams(RecordHasher& h, const WaitEvents2Cmd& cmd) {
+	hashParams(h, static_cast<const Barrier2CmdBase&>(cmd));
+	h.addPtrs(cmd.events);
+}
+
+void hashParams(RecordHasher& h, const SetEventCmd& cmd) {
+	h.add(cmd.event);
+	h.add(u64(cmd.stageMask));
+}
+
+void hashParams(RecordHasher& h, const SetEvent2Cmd& cmd) {
+	hashParams(h, static_cast<const Barrier2CmdBase&>(cmd));
+	h.add(cmd.event);
+}
+
+void hashParams(RecordHasher& h, const ResetEventCmd& cmd) {
+	h.add(cmd.event);
+	h.add(u64(cmd.stageMask));
+	h.add(u64(cmd.legacy));
+}
+
+void hashParams(RecordHasher& h, const ExecuteCommandsCmd& cmd) {
+	// Secondary records are only identical when they were
+	// deduplicated themselves.
+	for(auto* child = cmd.children_; child;
+			child = static_cast<ExecuteCommandsChildCmd*>(child->next)) {
+		h.add(child->record_);
+	}
+}
+
+void hashParams(RecordHasher& h, const BindVertexBuffersCmd& cmd) {
+	h.add(u64(cmd.firstBinding));
+	h.add(u64(cmd.buffers.size()));
+	for(auto& buf : cmd.buffers) {
+		h.add(buf.buffer);
+		h.add(u64(buf.offset));
+		h.add(u64(buf.size));
+		h.add(u64(buf.stride));
+	}
+}
+
+void hashParams(RecordHasher& h, const BindIndexBufferCmd& cmd) {
+	h.add(cmd.buffer);
+	h.add(u64(cmd.offset));
+	h.add(u64(cmd.indexType));
+}
+
+void hashParams(RecordHasher& h, const BindPipelineCmd& cmd) {
+	h.add(u64(cmd.bindPoint));
+	h.add(cmd.pipe);
+}
+
+void hashParams(RecordHasher& h, const BindDescriptorSetCmd& cmd) {
+	h.add(u64(cmd.firstSet));
+	h.add(u64(cmd.pipeBindPoint));
+	h.add(cmd.pipeLayout);
+	h.addPtrs(cmd.sets);
+	h.addRaw(cmd.dynamicOffsets);
+}
+
+void hashParams(RecordHasher& h, const PushConstantsCmd& cmd) {
+	h.add(cmd.pipeLayout);
+	h.add(u64(cmd.stages));
+	h.add(u64(cmd.offset));
+	h.add(cmd.values);
+}
+
+void hashParams(RecordHasher& h, const SetViewportCmd& cmd) {
+	h.add(u64(cmd.first));
+	h.addRaw(cmd.viewports);
+}
+
+void hashParams(RecordHasher& h, const SetScissorCmd& cmd) {
+	h.add(u64(cmd.first));
+	h.addRaw(cmd.scissors);
+}
+
+void hashParams(RecordHasher& h, const SetViewportWithCountCmd& cmd) {
+	h.addRaw(cmd.viewports);
+}
+
+void hashParams(RecordHasher& h, const SetScissorWithCountCmd& cmd) {
+	h.addRaw(cmd.scissors);
+}
+
+void hashParams(RecordHasher& h, const SetLineWidthCmd& cmd) { h.addRaw(cmd.width); }
+void hashParams(RecordHasher& h, const SetDepthBiasCmd& cmd) { h.addRaw(cmd.state); }
+void hashParams(RecordHasher& h, const SetBlendConstantsCmd& cmd) { h.addRaw(cmd.values); }
+void hashParams(RecordHasher& h, const SetCullModeCmd& cmd) { h.add(u64(cmd.cullMode)); }
+void hashParams(RecordHasher& h, const SetFrontFaceCmd& cmd) { h.add(u64(cmd.frontFace)); }
+void hashParams(RecordHasher& h, const SetPrimitiveTopologyCmd& cmd) { h.add(u64(cmd.topology)); }
+void hashParams(RecordHasher& h, const SetDepthTestEnableCmd& cmd) { h.add(u64(cmd.enable)); }
+void hashParams(RecordHasher& h, const SetDepthWriteEnableCmd& cmd) { h.add(u64(cmd.enable)); }
+void hashParams(RecordHasher& h, const SetDepthCompareOpCmd& cmd) { h.add(u64(cmd.op)); }
+void hashParams(RecordHasher& h, const SetDepthBoundsTestEnableCmd& cmd) { h.add(u64(cmd.enable)); }
+void hashParams(RecordHasher& h, const SetStencilTestEnableCmd& cmd) { h.add(u64(cmd.enable)); }
+void hashParams(RecordHasher& h, const SetRasterizerDiscardEnableCmd& cmd) { h.add(u64(cmd.enable)); }
+void hashParams(RecordHasher& h, const SetDepthBiasEnableCmd& cmd) { h.add(u64(cmd.enable)); }
+void hashParams(RecordHasher& h, const SetPrimitiveRestartEnableCmd& cmd) { h.add(u64(cmd.enable)); }
+void hashParams(RecordHasher& h, const SetLogicOpCmd& cmd) { h.add(u64(cmd.logicOp)); }
+void hashParams(RecordHasher& h, const SetPatchControlPointsCmd& cmd) { h.add(u64(cmd.patchControlPoints)); }
+
+void hashParams(RecordHasher& h, const SetDepthBoundsCmd& cmd) {
+	h.addRaw(cmd.min);
+	h.addRaw(cmd.max);
+}
+
+void hashParams(RecordHasher& h, const SetStencilCompareMaskCmd& cmd) {
+	h.add(u64(cmd.faceMask));
+	h.add(u64(cmd.value));
+}
+
+void hashParams(RecordHasher& h, const SetStencilWriteMaskCmd& cmd) {
+	h.add(u64(cmd.faceMask));
+	h.add(u64(cmd.value));
+}
+
+void hashParams(RecordHasher& h, const SetStencilReferenceCmd& cmd) {
+	h.add(u64(cmd.faceMask));
+	h.add(u64(cmd.value));
+}
+
+void hashParams(RecordHasher& h, const SetStencilOpCmd& cmd) {
+	h.add(u64(cmd.faceMask));
+	h.add(u64(cmd.failOp));
+	h.add(u64(cmd.passOp));
+	h.add(u64(cmd.depthFailOp));
+	h.add(u64(cmd.compareOp));
+}
+
+void hashParams(RecordHasher& h, const SetLineStippleCmd& cmd) {
+	h.add(u64(cmd.stippleFactor));
+	h.add(u64(cmd.stipplePattern));
+}
+
+void hashParams(RecordHasher& h, const BeginQueryCmd& cmd) {
+	h.add(cmd.pool);
+	h.add(u64(cmd.query));
+	h.add(u64(cmd.flags));
+}
+
+void hashParams(RecordHasher& h, const EndQueryCmd& cmd) {
+	h.add(cmd.pool);
+	h.add(u64(cmd.query));
+}
+
+void hashParams(RecordHasher& h, const ResetQueryPoolCmd& cmd) {
+	h.add(cmd.pool);
+	h.add(u64(cmd.first));
+	h.add(u64(cmd.count));
+}
+
+void hashParams(RecordHasher& h, const WriteTimestampCmd& cmd) {
+	h.add(cmd.pool);
+	h.add(u64(cmd.stage));
+	h.add(u64(cmd.query));
+	h.add(u64(cmd.legacy));
+}
+
+void hashParams(RecordHasher& h, const CopyQueryPoolResultsCmd& cmd) {
+	h.add(cmd.pool);
+	h.add(u64(cmd.first));
+	h.add(u64(cmd.count));
+	h.add(cmd.dstBuffer);
+	h.add(u64(cmd.dstOffset));
+	h.add(u64(cmd.stride));
+	h.add(u64(cmd.flags));
+}
+
+// Parameters that matching hard-rejects on, independent from the
+// MatchType. Must be kept in sync with command/match.cpp, debug builds
+// check this in match(const Command&, const Command&, MatchType).
+// Handles are never included since they might be deep-matched.
+void hashStructure(RecordHasher&, const Command&) {}
+
+void hashStructure(RecordHasher& h, const DrawCmd& cmd) {
+	h.add(u64(cmd.vertexCount));
+	h.add(u64(cmd.firstVertex));
+}
+
+void hashStructure(RecordHasher& h, const DrawIndexedCmd& cmd) {
+	h.add(u64(cmd.indexCount));
+	h.add(u64(cmd.firstIndex));
+	h.add(u64(cmd.vertexOffset));
+	h.add(u64(cmd.state ? cmd.state->indices.type : VK_INDEX_TYPE_MAX_ENUM));
+}
+
+template<typename Cmd>
+void hashIndirectStructure(RecordHasher& h, const Cmd& cmd) {
+	h.add(u64(cmd.indexed));
+	h.add(u64(cmd.stride));
+	if(cmd.indexed) {
+		h.add(u64(cmd.state ? cmd.state->indices.type : VK_INDEX_TYPE_MAX_ENUM));
+	}
+}
+
+void hashStructure(RecordHasher& h, const DrawIndirectCmd& cmd) {
+	hashIndirectStructure(h, cmd);
+}
+
+void hashStructure(RecordHasher& h, const DrawIndirectCountCmd& cmd) {
+	hashIndirectStructure(h, cmd);
+}
+
+void hashStructure(RecordHasher& h, const BindVertexBuffersCmd& cmd) {
+	h.add(u64(cmd.firstBinding));
+}
+
+void hashStructure(RecordHasher& h, const BindDescriptorSetCmd& cmd) {
+	h.add(u64(cmd.firstSet));
+	h.add(u64(cmd.pipeBindPoint));
+}
+
+void hashStructure(RecordHasher& h, const BindPipelineCmd& cmd) {
+	h.add(u64(cmd.bindPoint));
+}
+
+void hashStructure(RecordHasher& h, const BeginDebugUtilsLabelCmd& cmd) {
+	h.add(cmd.name);
+}
+
+// The bound state that matching considers for state commands.
+// Not needed for the record hash since it's fully determined by the
+// previously recorded commands but commands are matched on their own.
+void hashBoundState(RecordHasher&, const Command&) {}
+
+// Returns false if the command has no state, only for dummy commands.
+template<typename Cmd>
+bool hashPipeState(RecordHasher& h, const Cmd& cmd) {
+	if(!cmd.state) {
+		h.add(u64(0u));
+		return false;
+	}
+
+	h.add(cmd.state->pipe);
+	h.add(cmd.pushConstants.data);
+	return true;
+}
+
+void hashBoundState(RecordHasher& h, const DrawCmdBase& cmd) {
+	if(hashPipeState(h, cmd)) {
+		h.addRaw(cmd.state->vertices);
+		h.addRaw(cmd.state->indices);
+	}
+}
+
+void hashBoundState(RecordHasher& h, const DispatchCmdBase& cmd) {
+	hashPipeState(h, cmd);
+}
+
+void hashBoundState(RecordHasher& h, const TraceRaysCmdBase& cmd) {
+	hashPipeState(h, cmd);
+}
+
+u64 nonZero(u64 hash) {
+	return hash ? hash : 1u;
+}
+
+void computeFingerprints(Command& cmd) {
+	auto visitor = TemplateCommandVisitor([&](const auto& derived) {
+		auto structureComplete = true;
+		u64 structure {};
+		RecordHasher sh {structure, structureComplete};
+		sh.add(u64(cmd.type()));
+		hashStructure(sh, derived);
+
+		auto paramsComplete = true;
+		u64 params {};
+		RecordHasher ph {params, paramsComplete};
+		hashParams(ph, derived);
+		hashBoundState(ph, derived);
+
+		cmd.structureHash = nonZero(structure);
+		cmd.paramHash = paramsComplete ? nonZero(params) : 0u;
+	});
+	cmd.visit(visitor);
+}
+
+// Stores everything that is hashed for the given command into 'words'.
+void hashedWords(const Command& cmd, std::vector<u64>& words) {
+	words.clear();
+
+	u64 hash {};
+	auto complete = true;
+	RecordHasher h {hash, complete, &words};
+	h.add(u64(cmd.type()));
+
+	auto visitor = TemplateCommandVisitor([&](const auto& derived) {
+		hashStructure(h, derived);
+		hashParams(h, derived);
+		hashBoundState(h, derived);
+	});
+	cmd.visit(visitor);
+}
+
+bool sameCommands(const Command* a, const Command* b,
+		std::vector<u64>& wordsA, std::vector<u64>& wordsB) {
+	while(a && b) {
+		hashedWords(*a, wordsA);
+		hashedWords(*b, wordsB);
+		if(wordsA != wordsB) {
+			return false;
+		}
+
+		if(!sameCommands(a->children(), b->children(), wordsA, wordsB)) {
+			return false;
+		}
+
+		a = a->next;
+		b = b->next;
+	}
+
+	return !a && !b;
+}
+
+// Computes the fingerprints of the given command, now that its
+// parameters are known, and adds them to the record hash.
+void finishCommand(CommandRecord& rec, Command& cmd) {
+	computeFingerprints(cmd);
+
+	if(!rec.hashComplete) {
+		return;
+	}
+
+	if(!cmd.paramHash) {
+		rec.hashComplete = false;
+		return;
+	}
+
+	RecordHasher h {rec.hash, rec.hashComplete};
+	h.add(cmd.structureHash);
+	h.add(cmd.paramHash);
 }
 
 // RecordBuilder
@@ -159,6 +897,28 @@ void RecordBuilder::append(Command& cmd) {
 	}
 
 	lastCommand_ = &cmd;
+
+	// hash
+	if(unhashed_) {
+		finishCommand(*record_, *unhashed_);
+	}
+
+	unhashed_ = &cmd;
+}
+
+void RecordBuilder::flushHash() {
+	dlg_assert(record_);
+	if(unhashed_) {
+		finishCommand(*record_, *unhashed_);
+	}
+
+	unhashed_ = nullptr;
+}
+
+bool sameCommands(const Command* a, const Command* b) {
+	std::vector<u64> wordsA;
+	std::vector<u64> wordsB;
+	return sameCommands(a, b, wordsA, wordsB);
 }
 
 std::vector<const Command*> RecordBuilder::lastCommand() const {
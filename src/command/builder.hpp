@@ -31,6 +31,10 @@ struct RecordBuilder {
 	IntrusivePtr<CommandRecord> record_;
 	Section* section_ {}; // the last, lowest, deepest-down section
 	Command* lastCommand_ {}; // the last added command in current section (might be null)
+	// The last appended command. Its parameters are only set after it
+	// was appended, so its fingerprints are computed and added to the
+	// record hash when the next command is appended or in flushHash.
+	Command* unhashed_ {};
 
 	RecordBuilder() = default;
 
@@ -47,6 +51,10 @@ struct RecordBuilder {
 	void beginSection(SectionCommand& cmd);
 	void endSection(Command* cmd);
 	void append(Command& cmd);
+	// Computes the fingerprints of the last appended command and adds them
+	// to the record hash. Must be called when recording is finished,
+	// before record_->hash or the command fingerprints are used.
+	void flushHash();
 	std::vector<const Command*> lastCommand() const;
 
 	template<typename T, SectionType ST = SectionType::none, typename... Args>
@@ -80,4 +88,9 @@ struct RecordBuilder {
 	}
 };
 
+// Returns whether the two command lists (including their children)
+// are equal in everything that is considered by the record hash.
+// Compares the hashed values themselves, not just their hashes.
+bool sameCommands(const Command* a, const Command* b);
+
 } // namespace vil
@@ -7,6 +7,7 @@
 #include <util/linalloc.hpp>
 #include <nytl/flags.hpp>
 #include <nytl/span.hpp>
+#include <atomic>
 
 // See ~Command. Keep in mind that we use a custom per-CommandRecord allocator
 // for all Commands, that's why we can use span<> here without the referenced
@@ -19,6 +20,22 @@
 
 namespace vil {
 
+// A lazily computed MatchVal (match and total as floats), packed into a
+// single atomic since commands of a record may be matched from multiple
+// threads at once. Zero when not computed yet. Copying takes over the value.
+struct CachedMatchVal {
+	mutable std::atomic<u64> packed {};
+
+	CachedMatchVal() = default;
+	CachedMatchVal(const CachedMatchVal& rhs) :
+		packed(rhs.packed.load(std::memory_order_relaxed)) {}
+	CachedMatchVal& operator=(const CachedMatchVal& rhs) {
+		packed.store(rhs.packed.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+		return *this;
+	}
+};
+
 // The type of a command is used e.g. to hide them in the UI.
 enum class CommandCategory : u32 {
 	other = (1u << 0u),
@@ -208,6 +225,20 @@ struct Command {
 	// Forms a forward linked list with siblings
 	Command* next {};
 
+	// Fingerprints, computed by RecordBuilder once the parameters of
+	// the command are known. Zero when not computed.
+	// Commands with different structure hashes never match, it covers
+	// the command type and the parameters matching hard-rejects on.
+	// The params hash covers all parameters, the referenced handles and
+	// the bound state. Zero when the command has parameters we can't hash.
+	// See match(const Command&, const Command&, MatchType).
+	u64 structureHash {};
+	u64 paramHash {};
+	// The result of matching the command with itself, returned by matching
+	// for commands with identical fingerprints. Computed lazily by the
+	// matcher on first use, see selfMatch in command/match.cpp.
+	CachedMatchVal selfMatch {};
+
 #ifdef VIL_COMMAND_CALLSTACKS
 	span<void*> stacktrace {};
 #endif // VIL_COMMAND_CALLSTACKS
@@ -11,6 +11,7 @@
 #include <buffer.hpp>
 #include <util/dlg.hpp>
 #include <util/profiling.hpp>
+#include <cstring>
 
 // We interpret matching of two command sequences submitted
 // to the gpu as an instance of the common longest subsequence
@@ -1168,7 +1169,7 @@ u32 evaluateRelID(RelIDMap& ids, const Command& start, const Command& dst) {
 }
 
 FindResult find(MatchType mt, const Command& srcParent, const Command& src,
-		const Command& dstParent, span<const Command*> dst,
+		const Command& dstParent, span<const Command* const> dst,
 		const CommandDescriptorSnapshot& dstDsState, float threshold) {
 	ZoneScoped;
 
@@ -1326,7 +1327,7 @@ FindResult find(MatchType mt, const Command& srcParent, const Command& src,
 }
 
 FindResult find(MatchType mt, const ParentCommand& srcRoot,
-		span<const Command*> dstHierarchyToFind,
+		span<const Command* const> dstHierarchyToFind,
 		const CommandDescriptorSnapshot& dstDescriptors, float threshold) {
 	// empty hierarchy
 	if(!srcRoot.children()) {
@@ -1347,6 +1348,83 @@ FindResult find(MatchType mt, const ParentCommand& srcRoot,
 	return ret;
 }
 
+// Returns whether the section (or one of its child sections) might
+// contain a command equivalent to rest.back(), nested in sections equivalent
+// to the rest of 'rest'.
+bool sectionMayContain(const ParentCommand& section, span<const Command* const> rest) {
+	dlg_assert(!rest.empty());
+
+	auto& cmd = *rest[0];
+	if(rest.size() > 1u || cmd.children()) {
+		// Commands of different types never match
+		for(auto it = section.firstChildParent(); it; it = it->nextParent_) {
+			if(it->type() != cmd.type()) {
+				continue;
+			}
+
+			if(rest.size() == 1u || sectionMayContain(*it, rest.subspan(1))) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	auto& stats = section.sectionStats();
+	switch(cmd.category()) {
+		case CommandCategory::draw: return stats.numDraws > 0u;
+		case CommandCategory::dispatch: return stats.numDispatches > 0u;
+		case CommandCategory::traceRays: return stats.numRayTraces > 0u;
+		case CommandCategory::sync: return stats.numSyncCommands > 0u;
+		case CommandCategory::transfer: return stats.numTransfers > 0u;
+		default: return stats.numTotalCommands > 0u;
+	}
+}
+
+// Returns whether a pipeline matching 'pipe' is bound anywhere in the
+// given section or its child sections.
+bool mayBindPipe(MatchType mt, const ParentCommand& section, const Pipeline& pipe) {
+	for(auto* node = section.sectionStats().boundPipelines; node; node = node->next) {
+		if(!noMatch(match(mt, node->pipe, &pipe))) {
+			return true;
+		}
+	}
+
+	for(auto it = section.firstChildParent(); it; it = it->nextParent_) {
+		if(mayBindPipe(mt, *it, pipe)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool mayFind(MatchType mt, const ParentCommand& srcRoot,
+		span<const Command* const> dstHierarchyToFind) {
+	ZoneScoped;
+
+	dlg_assert(dstHierarchyToFind.size() >= 2);
+	dlg_assert(dynamic_cast<const ParentCommand*>(dstHierarchyToFind[0]));
+
+	if(!srcRoot.children()) {
+		return false;
+	}
+
+	if(!sectionMayContain(srcRoot, dstHierarchyToFind.subspan(1))) {
+		return false;
+	}
+
+	// State commands only match commands with matching pipelines, see
+	// matchState. Bound state is not inherited between records, so the
+	// pipeline must have been bound in the record itself.
+	auto* stateCmd = dynamic_cast<const StateCmdBase*>(dstHierarchyToFind.back());
+	if(stateCmd && stateCmd->boundPipe()) {
+		return mayBindPipe(mt, srcRoot, *stateCmd->boundPipe());
+	}
+
+	return true;
+}
+
 MatchVal match(MatchType, const VkBufferCopy2KHR& a, const VkBufferCopy2KHR& b) {
 	MatchVal m;
 	add(m, a.size, b.size);
@@ -2405,11 +2483,7 @@ MatchVal invokeCommandMatch(MatchType mt, const Cmd& a, const Command& base) {
 	}
 }
 
-// Returns how much this commands matches with the given one.
-// Will always return 0.f for two commands that don't have the
-// same type. Should not consider child commands, just itself.
-// Will also never consider the stackTrace.
-MatchVal match(const Command& a, const Command& b, MatchType matchType) {
+MatchVal matchCommand(const Command& a, const Command& b, MatchType matchType) {
 	MatchVal ret;
 	auto invoker = [&](const auto& cmd) {
 		ret = invokeCommandMatch(matchType, cmd, b);
@@ -2420,4 +2494,55 @@ MatchVal match(const Command& a, const Command& b, MatchType matchType) {
 	return ret;
 }
 
+// Returns how the command matches with itself. Computed on first use
+// and then cached in the command. Threads racing here compute the same value.
+static MatchVal selfMatch(const Command& cmd) {
+	static_assert(sizeof(MatchVal) == sizeof(u64));
+
+	MatchVal ret;
+	auto packed = cmd.selfMatch.packed.load(std::memory_order_relaxed);
+	if(packed) {
+		std::memcpy(&ret, &packed, sizeof(ret));
+		return ret;
+	}
+
+	// All handles are identical, the match type does not matter
+	ret = matchCommand(cmd, cmd, MatchType::identity);
+	std::memcpy(&packed, &ret, sizeof(ret));
+	cmd.selfMatch.packed.store(packed, std::memory_order_relaxed);
+	return ret;
+}
+
+// Returns how much this commands matches with the given one.
+// Will always return 0.f for two commands that don't have the
+// same type. Should not consider child commands, just itself.
+// Will also never consider the stackTrace.
+MatchVal match(const Command& a, const Command& b, MatchType matchType) {
+	// Fast paths via the fingerprints computed at record time.
+	// Different structure means a different type or hard-rejected
+	// parameters. Identical parameters mean that all handles are
+	// the same, independent from the match type, so the commands
+	// match exactly like the command with itself.
+	// Records keep their handles alive, pointers can't be re-used.
+	if(a.structureHash && b.structureHash) {
+		if(a.structureHash != b.structureHash) {
+			// hashStructure in command/builder.cpp must only cover the
+			// parameters the match functions above hard-reject on.
+			dlg_check({
+				auto slow = matchCommand(a, b, matchType);
+				dlg_assertm(noMatch(slow), "hashStructure out of sync for {}",
+					typeid(a).name());
+			});
+
+			return MatchVal::noMatch();
+		}
+
+		if(a.paramHash && a.paramHash == b.paramHash) {
+			return selfMatch(a);
+		}
+	}
+
+	return matchCommand(a, b, matchType);
+}
+
 } // namespace vil
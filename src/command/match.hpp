@@ -72,10 +72,17 @@ struct FindResult {
 // sequence from 'srcRoot'.
 FindResult find(MatchType,
 	const ParentCommand& srcRoot,
-	span<const Command*> dstHierarchyToFind,
+	span<const Command* const> dstHierarchyToFind,
 	const CommandDescriptorSnapshot& dstDescriptors,
 	float threshold = 0.0);
 
+// Cheap, conservative check whether 'find' could find 'dstHierarchyToFind'
+// in the command sequence from 'srcRoot'. When this returns false,
+// 'find' will not find a match. Only considers the section structure,
+// the section stats and the bound pipelines, never single commands.
+bool mayFind(MatchType, const ParentCommand& srcRoot,
+	span<const Command* const> dstHierarchyToFind);
+
 // Matcher utility
 template<typename T>
 bool add(MatchVal& m, const T& a, const T& b, float weight = 1.f) {
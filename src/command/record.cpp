@@ -1,4 +1,5 @@
 #include <command/record.hpp>
+#include <command/builder.hpp>
 #include <command/commands.hpp>
 #include <command/alloc.hpp>
 #include <commandHook/record.hpp>
@@ -46,7 +47,7 @@ CommandRecord::CommandRecord(CommandBuffer& xcb) :
 }
 
 CommandRecord::CommandRecord(ManualTag, Device* xdev) :
-		alloc(onRecordAlloc, onRecordFree),
+		alloc(&LinBlockPool::get(), onRecordAlloc, onRecordFree),
 		dev(xdev),
 		cb(nullptr),
 		recordID(0u),
@@ -54,7 +55,9 @@ CommandRecord::CommandRecord(ManualTag, Device* xdev) :
 		// initialize allocators
 		pushLables(alloc),
 		accelStructCopies(alloc),
+		dormantAccelStructBuilds(alloc),
 		used(alloc),
+		writes(alloc),
 		secondaries(alloc) {
 	++DebugStats::get().aliveRecords;
 }
@@ -241,7 +244,74 @@ CommandRecord::UsedHandles::UsedHandles(LinAllocator& alloc) :
 		images(alloc) {
 }
 
+CommandRecord::WriteSummary::WriteSummary(LinAllocator& alloc) :
+		handles(alloc),
+		descriptorSets(alloc) {
+}
+
+template<typename T, typename KeyFn>
+bool sameKeys(const FlatPtrSet<T, KeyFn>& a, const FlatPtrSet<T, KeyFn>& b) {
+	if(a.size() != b.size()) {
+		return false;
+	}
+
+	for(auto& entry : a) {
+		if(!b.contains(KeyFn{}(entry))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool sameContent(const CommandRecord& a, const CommandRecord& b) {
+	if(!a.hashComplete || !b.hashComplete || a.hash != b.hash) {
+		return false;
+	}
+
+	// Records that are incomplete or need special per-record
+	// tracking are never considered equal.
+	if(a.dormant || b.dormant || a.buildsAccelStructs || b.buildsAccelStructs) {
+		return false;
+	}
+
+	if(a.usageFlags != b.usageFlags ||
+			a.queueFamily != b.queueFamily ||
+			a.numPopLabels != b.numPopLabels ||
+			a.pushLables.size() != b.pushLables.size() ||
+			a.brokenHierarchyLabels != b.brokenHierarchyLabels ||
+			a.secondaries.size() != b.secondaries.size()) {
+		return false;
+	}
+
+	static_assert(CommandRecord::UsedHandles::handleTypeCount == 17u);
+	auto& ua = a.used;
+	auto& ub = b.used;
+	return sameKeys(ua.buffers, ub.buffers) &&
+		sameKeys(ua.graphicsPipes, ub.graphicsPipes) &&
+		sameKeys(ua.computePipes, ub.computePipes) &&
+		sameKeys(ua.rtPipes, ub.rtPipes) &&
+		sameKeys(ua.pipeLayouts, ub.pipeLayouts) &&
+		sameKeys(ua.dsuTemplates, ub.dsuTemplates) &&
+		sameKeys(ua.renderPasses, ub.renderPasses) &&
+		sameKeys(ua.framebuffers, ub.framebuffers) &&
+		sameKeys(ua.queryPools, ub.queryPools) &&
+		sameKeys(ua.imageViews, ub.imageViews) &&
+		sameKeys(ua.bufferViews, ub.bufferViews) &&
+		sameKeys(ua.samplers, ub.samplers) &&
+		sameKeys(ua.accelStructs, ub.accelStructs) &&
+		sameKeys(ua.events, ub.events) &&
+		sameKeys(ua.dsPools, ub.dsPools) &&
+		sameKeys(ua.descriptorSets, ub.descriptorSets) &&
+		sameKeys(ua.images, ub.images) &&
+		// Equal hashes could still be a collision
+		sameCommands(a.commands, b.commands);
+}
+
 UsedImage::UsedImage(LinAllocator& alloc) noexcept :
 	RefHandle<Image>(alloc), layoutChanges(alloc) {}
 
+UsedImage::UsedImage(LinAllocator& alloc, Image& img) noexcept :
+	RefHandle<Image>(alloc, img), layoutChanges(alloc) {}
+
 } // namespace vil
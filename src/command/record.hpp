@@ -4,6 +4,7 @@
 #include <nytl/span.hpp>
 #include <util/linalloc.hpp>
 #include <util/intrusive.hpp>
+#include <util/flatPtrSet.hpp>
 #include <util/debugMutex.hpp>
 #include <threadContext.hpp>
 #include <imageLayout.hpp>
@@ -169,12 +170,14 @@ template<typename K,
 constexpr struct ManualTag {} manualTag;
 
 // NOTE: we don't need RefHandle.commands atm, so we comment it out.
-// Until we use C++20 transparent lookup, it's a major performance impact (see useHandleImpl in cb.cpp)
+// It's a major performance impact (see useHandleImpl in cb.cpp)
 
 // Links a 'DeviceHandle' to a 'CommandRecord'.
 template<typename T>
 struct RefHandle {
 	explicit RefHandle(LinAllocator& alloc) noexcept /*: commands(alloc)*/ { (void) alloc; }
+	RefHandle(LinAllocator& alloc, T& xhandle) noexcept :
+		RefHandle(alloc) { handle.reset(&xhandle); }
 
 	// List of commands where the associated handle is used inside the
 	// associated record.
@@ -194,11 +197,14 @@ inline bool operator!=(const RefHandle<T>& a, const RefHandle<T>& b) {
 
 struct UsedImage : RefHandle<Image> {
 	explicit UsedImage(LinAllocator& alloc) noexcept;
+	UsedImage(LinAllocator& alloc, Image& img) noexcept;
 	CommandAllocVector<ImageSubresourceLayout> layoutChanges;
 };
 
 struct UsedDescriptorSet {
 	explicit UsedDescriptorSet(LinAllocator& alloc) noexcept /*: commands(alloc)*/ { (void) alloc; }
+	UsedDescriptorSet(LinAllocator& alloc, void* xds) noexcept :
+		UsedDescriptorSet(alloc) { ds = xds; }
 
 	// Must not access directly, might have been destroyed.
 	void* ds {};
@@ -213,54 +219,32 @@ inline bool operator!=(const UsedDescriptorSet& a, const UsedDescriptorSet& b) {
 	return a.ds != b.ds;
 }
 
-struct RefHandleHash {
+struct RefHandleKey {
 	template<typename T>
-	size_t operator()(const RefHandle<T>& x) const {
-		auto ptr = x.handle.get();
-		return std::hash<std::remove_reference_t<decltype(ptr)>>{}(ptr);
+	const void* operator()(const RefHandle<T>& x) const {
+		return x.handle.get();
 	}
 };
 
-struct UsedDescriptorHash {
-	size_t operator()(const UsedDescriptorSet& x) const {
-		return std::hash<void*>{}(x.ds);
+struct UsedDescriptorKey {
+	const void* operator()(const UsedDescriptorSet& x) const {
+		return x.ds;
 	}
 };
 
+// Sets of used handles, keyed by the handle pointer.
+// Allows transparent lookup, see FlatPtrSet.
 template<typename T>
-using UsedHandleSet = CommandAllocHashSet<RefHandle<T>, RefHandleHash>;
-
-template<typename K>
-auto find(UsedHandleSet<K>& used, K& elem) {
-	// TODO: better, transparent find with c++20
-	RefHandle<K> rh(ThreadContext::instance.linalloc_);
-	rh.handle = IntrusivePtr<K>(acquireOwnership, &elem);
-	auto it = used.find(rh);
-	(void) rh.handle.release();
-	return it;
-}
+using UsedHandleSet = FlatPtrSet<RefHandle<T>, RefHandleKey>;
+using UsedImageSet = FlatPtrSet<UsedImage, RefHandleKey>;
+using UsedDescriptorSetSet = FlatPtrSet<UsedDescriptorSet, UsedDescriptorKey>;
 
-// TODO: kinda hacky, only a template so we don't have to include stuff
-template<typename Image>
-auto find(CommandAllocHashSet<UsedImage, RefHandleHash>& used, Image& elem) {
-	// TODO: better, transparent find with c++20
-	UsedImage rh(ThreadContext::instance.linalloc_);
-	rh.handle = IntrusivePtr<Image>(acquireOwnership, &elem);
-	auto it = used.find(rh);
-	(void) rh.handle.release();
-	return it;
-}
+struct RawPtrKey {
+	const void* operator()(const void* x) const {
+		return x;
+	}
+};
 
-// TODO: kinda hacky, only a template so we don't have to include stuff
-template<typename DescriptorSet>
-inline auto find(CommandAllocHashSet<UsedDescriptorSet, UsedDescriptorHash>& used,
-		DescriptorSet& ds) {
-	// TODO: better, transparent find with c++20
-	UsedDescriptorSet rh(ThreadContext::instance.linalloc_);
-	rh.ds = &ds;
-	auto it = used.find(rh);
-	return it;
-}
 
 struct AccelStructCopy {
 	AccelStruct* src;
@@ -297,6 +281,22 @@ struct CommandRecord {
 	// Labels allow nesting in ways that mess with a strict hierarchy view.
 	// Will display such records differently by default.
 	bool brokenHierarchyLabels {};
+	// Whether the record was recorded in lazy tracking mode, see
+	// Device::lazyTracking. Such records are incomplete: binds, draws,
+	// dispatches, trace rays, push constants and dynamic state
+	// are not recorded and don't contribute to used handles.
+	// Image layout changes and acceleration structure operations are
+	// still tracked. Dormant records are never hooked.
+	bool dormant {};
+	// Whether 'hash' covers all recorded commands. False when the record
+	// contains commands the hash does not support or when it must
+	// not be replaced by a previous record (e.g. referenced by a local capture).
+	bool hashComplete {true};
+	// Structural hash over the recorded commands, their parameters and
+	// the handles they reference. Computed incrementally by RecordBuilder.
+	// Used to detect re-recordings that are identical to the previous
+	// record of a command buffer, see CommandBuffer::doEnd.
+	u64 hash {};
 	// The usageFlags passed to BeginCommandBuffer
 	VkCommandBufferUsageFlags usageFlags {};
 
@@ -312,6 +312,9 @@ struct CommandRecord {
 	CommandAllocList<const char*> pushLables;
 
 	CommandAllocList<AccelStructCopy> accelStructCopies;
+	// Acceleration structures built by this record while it was dormant.
+	// Since dormant records aren't hooked, their content is unknown.
+	CommandAllocList<AccelStruct*> dormantAccelStructBuilds;
 
 	struct UsedHandles {
 		// NOTE: change this when adding maps here!
@@ -334,12 +337,29 @@ struct CommandRecord {
 		UsedHandleSet<Event> events;
 		UsedHandleSet<DescriptorPool> dsPools;
 
-		CommandAllocHashSet<UsedDescriptorSet, UsedDescriptorHash> descriptorSets;
-		CommandAllocHashSet<UsedImage, RefHandleHash> images;
+		UsedDescriptorSetSet descriptorSets;
+		UsedImageSet images;
 
 		UsedHandles(LinAllocator& alloc);
 	} used;
 
+	// Summary of the resources this record potentially writes. Allows
+	// to quickly check whether a pending submission has to be
+	// synchronized with the gui, see potentiallyWritesLocked.
+	// Built while recording, includes the writes of secondaries.
+	struct WriteSummary {
+		// Images and buffers written directly by commands, e.g. as transfer
+		// destination, attachment, via layout transition or storage
+		// push descriptor.
+		FlatPtrSet<const void*, RawPtrKey> handles;
+		// The used descriptor sets with writable (storage) bindings.
+		// Their content may change after recording (e.g. update_after_bind),
+		// so they have to be inspected at the time of the query.
+		FlatPtrSet<void*, RawPtrKey> descriptorSets;
+
+		WriteSummary(LinAllocator& alloc);
+	} writes;
+
 	// We have to keep the secondary records (via cmdExecuteCommands) alive
 	// since the command buffers can be reused by the application and
 	// we only reference the CommandRecord objects, don't copy them.
@@ -356,6 +376,16 @@ struct CommandRecord {
 	// For CommandHook: can store hooked versions of this record here.
 	std::vector<FinishPtr<CommandHookRecord>> hookRecords;
 
+	// For CommandHook: cached result of matching this record against the
+	// hook target, see CommandHook::matchTarget. Only valid when
+	// 'targetGeneration' is the generation of the current target.
+	// Protected by device mutex.
+	struct HookMatch {
+		u64 targetGeneration {}; // zero when there is no cached result
+		std::vector<const Command*> hierarchy; // empty when not matching
+		float match {};
+	} hookMatch;
+
 	CommandRecord(CommandBuffer& cb);
 	explicit CommandRecord(ManualTag, Device* dev); // mainly for testing
 	~CommandRecord();
@@ -387,6 +417,11 @@ CommandDescriptorSnapshot snapshotRelevantDescriptorsLocked(const Command&);
 // that the descriptor sets are still valid. Faster.
 CommandDescriptorSnapshot snapshotRelevantDescriptorsValidLocked(const Command&);
 
+// Returns whether the two records have complete and equal hashes,
+// equal commands and reference exactly the same handles, i.e. whether
+// one of them can be used in place of the other.
+bool sameContent(const CommandRecord& a, const CommandRecord& b);
+
 // Tries to find 'dst' in 'rec' and returns it full hierachy.
 // Returns empty vector if it can't be found.
 std::vector<const Command*> findHierarchy(const CommandRecord& rec, const Command& dst);
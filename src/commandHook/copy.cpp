@@ -189,9 +189,6 @@ bool CopiedImage::init(Device& dev, VkFormat format, const VkExtent3D& extent,
 	dev.dispatch.GetImageMemoryRequirements(dev.handle, image, &memReqs);
 
 	// new memory
-	VkMemoryAllocateInfo allocInfo {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memReqs.size;
 	// NOTE: even though using host visible memory would make some operations
 	//   eaiser (such as showing a specific texel value in gui), the guarantees
 	//   vulkan gives for support of linear images are quite small.
@@ -199,12 +196,15 @@ bool CopiedImage::init(Device& dev, VkFormat format, const VkExtent3D& extent,
 	//   at least what i'm interested in mainly), using host visible here
 	//   means transfering all the data from gpu to cpu which would
 	//   have a significant overhead.
-	auto memBits = memReqs.memoryTypeBits & dev.deviceLocalMemTypeBits;
-	allocInfo.memoryTypeIndex = findLSB(memBits);
-	VK_CHECK_DEV(dev.dispatch.AllocateMemory(dev.handle, &allocInfo, nullptr, &memory), dev);
-	nameHandle(dev, this->memory, "CopiedImage:memory");
+	memory = dev.captureHeap->alloc(memReqs, dev.deviceLocalMemTypeBits);
+	if(!memory) {
+		dev.dispatch.DestroyImage(dev.handle, image, nullptr);
+		image = {};
+		return false;
+	}
 
-	VK_CHECK_DEV(dev.dispatch.BindImageMemory(dev.handle, image, memory, 0), dev);
+	VK_CHECK_DEV(dev.dispatch.BindImageMemory(dev.handle, image,
+		memory.memory, memory.offset), dev);
 
 	neededMemory = memReqs.size;
 	DebugStats::get().copiedImageMem += memReqs.size;
@@ -218,7 +218,7 @@ CopiedImage::~CopiedImage() {
 	}
 
 	dev->dispatch.DestroyImage(dev->handle, image, nullptr);
-	dev->dispatch.FreeMemory(dev->handle, memory, nullptr);
+	dev->captureHeap->free(memory);
 
 	DebugStats::get().copiedImageMem -= neededMemory;
 }
@@ -491,7 +491,11 @@ void initAndSampleCopy(Device& dev, VkCommandBuffer cb,
 	}
 
 	const auto neededSize = texelCount * texelSize;
-	dst.buffer.ensure(dev, neededSize, usage, queueFamsBitset);
+	if(!dst.buffer.ensureCapture(dev, neededSize, usage, queueFamsBitset)) {
+		dlg_warn("Allocating image copy buffer failed");
+		return;
+	}
+
 	dst.format = dstFormat;
 
 	// = record =
@@ -563,7 +567,10 @@ void initAndSampleCopy(Device& dev, VkCommandBuffer cb,
 		dai.descriptorSetCount = 1u;
 		dai.pSetLayouts = &hook.sampleImageDsLayout_;
 		dai.descriptorPool = dev.dsPool;
-		VK_CHECK_DEV(dev.dispatch.AllocateDescriptorSets(dev.handle, &dai, &ds), dev);
+		{
+			std::lock_guard lock(dev.dsPoolMutex);
+			VK_CHECK_DEV(dev.dispatch.AllocateDescriptorSets(dev.handle, &dai, &ds), dev);
+		}
 
 		VkDescriptorImageInfo imgInfo {};
 		imgInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -700,7 +707,11 @@ void initAndCopy(Device& dev, VkCommandBuffer cb, OwnBuffer& dst,
 		VkBufferUsageFlags addFlags, Buffer& src,
 		VkDeviceSize offset, VkDeviceSize size, u32 queueFamsBitset) {
 	addFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-	dst.ensure(dev, size, addFlags, queueFamsBitset);
+	if(!dst.ensureCapture(dev, size, addFlags, queueFamsBitset)) {
+		dlg_warn("Allocating buffer copy failed");
+		return;
+	}
+
 	performCopy(dev, cb, src, offset, dst, 0, size);
 }
 
@@ -710,7 +721,7 @@ void performCopy(Device& dev, VkCommandBuffer cb, VkDeviceAddress srcPtr,
 		return;
 	}
 
-	auto& srcBuf = bufferAtLocked(dev, srcPtr);
+	auto& srcBuf = bufferAt(dev, srcPtr);
 	dlg_assert(srcBuf.deviceAddress);
 	auto srcOff = srcPtr - srcBuf.deviceAddress;
 	performCopy(dev, cb, srcBuf, srcOff, dst, dstOffset, size);
@@ -719,7 +730,11 @@ void performCopy(Device& dev, VkCommandBuffer cb, VkDeviceAddress srcPtr,
 void initAndCopy(Device& dev, VkCommandBuffer cb, OwnBuffer& dst,
 		VkDeviceAddress srcPtr, VkDeviceSize size, u32 queueFamsBitset) {
 	auto addFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-	dst.ensure(dev, size, addFlags, queueFamsBitset);
+	if(!dst.ensureCapture(dev, size, addFlags, queueFamsBitset)) {
+		dlg_warn("Allocating buffer copy failed");
+		return;
+	}
+
 	performCopy(dev, cb, srcPtr, dst, 0, size);
 }
 
@@ -47,9 +47,9 @@
 //   for asserts). Remove? might be useful in future for threading stuff tho.
 // TODO: move hooked command recording out of critical section, if possible.
 //   We have the guarantee that all handles in cb stay valid during submission
-//   and don't really access global state.
-//   Only difficulty: what if hook ops/target is changed in the meantime?
-//   Just discard the recording and abort hooking?
+//   but the recording adds copy-on-writes to descriptors and resources
+//   and links the record into our list.
+//   Matching is already done outside the critical section, see hook.
 
 namespace vil {
 
@@ -298,11 +298,12 @@ void CommandHook::initAccelStructCopy(Device& dev) {
 // for all update_after_bind descriptors isn't a huge problem?
 // meh ok it probably is, will cause us to never reuse a HookedRecord that
 // copies and update_after_bind descriptor
-bool CommandHook::copiedDescriptorChanged(const CommandHookRecord& record) {
-	// dlg_assert_or(record.dsState.size() == ops_.descriptorCopies.size(), return true);
+bool CommandHook::copiedDescriptorChanged(const CommandHookRecord& record,
+		const Ops& ops) {
+	// dlg_assert_or(record.dsState.size() == ops.descriptorCopies.size(), return true);
 
 	dlg_assert(!record.hcommand.empty());
-	if(ops_.descriptorCopies.empty()) {
+	if(ops.descriptorCopies.empty()) {
 		return false;
 	}
 
@@ -315,8 +316,8 @@ bool CommandHook::copiedDescriptorChanged(const CommandHookRecord& record) {
 	const DescriptorState& dsState =
 		static_cast<const StateCmdBase*>(cmd)->boundDescriptors();
 
-	for(auto i = 0u; i < ops_.descriptorCopies.size(); ++i) {
-		auto [setID, bindingID, elemID, _1, _2] = ops_.descriptorCopies[i];
+	for(auto i = 0u; i < ops.descriptorCopies.size(); ++i) {
+		auto [setID, bindingID, elemID, _1, _2] = ops.descriptorCopies[i];
 
 		// We can safely access the ds here since we know that the record
 		// is still valid
@@ -344,6 +345,8 @@ bool CommandHook::copiedDescriptorChanged(const CommandHookRecord& record) {
 }
 
 void CommandHook::hook(QueueSubmitter& subm) {
+	ZoneScoped;
+
 	auto& dev = *dev_;
 	keepAliveLC_.clear();
 
@@ -356,9 +359,12 @@ void CommandHook::hook(QueueSubmitter& subm) {
 	{
 		// We can't delete CompletedHook objects while holding
 		// device mutex since their destruction might trigger
-		// a CommandRecord destruction
+		// a CommandRecord destruction. Same for the records
+		// released by the profiler.
 		std::vector<CompletedHook> keepAlive;
+		std::vector<IntrusivePtr<CommandRecord>> keepAliveProfiled;
 		std::lock_guard lock(dev.mutex);
+		keepAliveProfiled = profiler_.releaseLocked();
 		if(completed_.size() > maxCompletedHooks) {
 			auto upTo = completed_.size() - maxCompletedHooks;
 			for(auto i = 0u; i < upTo; ++i) {
@@ -369,176 +375,264 @@ void CommandHook::hook(QueueSubmitter& subm) {
 		}
 	}
 
-	// we put all of this in a critical section to protect against changes
-	// of target_ and ops_ and the list of hooked records.
-	// TODO: might be possible to just use internal mutex, try it.
-	// Would help performance, the hooked recording is in the critical
-	// section here as well and quite expensive.
-	std::lock_guard lock(dev.mutex);
-
-	// fast early-outs
-	if(localCaptures_.empty() && !forceHook.load()) {
-		auto hasBuildCmd = false;
-		for(auto [subID, sub] : enumerate(subm.dstBatch->submissions)) {
-			auto& cmdSub = std::get<CommandSubmission>(sub.data);
-			for(auto [cbID, cb] : enumerate(cmdSub.cbs)) {
-				auto& rec = *cb.cb->lastRecordLocked();
-				if(rec.buildsAccelStructs) {
-					hasBuildCmd = true;
-				}
-			}
-		}
+	// We match against a snapshot of target and ops, without holding
+	// the device mutex. Matching can be expensive, e.g. for
+	// TargetType::all or when the whole frame has to be matched.
+	// The device mutex is only locked to gather the submitted records and
+	// for the hooking itself.
+	// NOTE: make sure that the snapshot and the records are only
+	// destroyed without the device mutex locked.
+	auto settings = this->settings();
+	auto& target = settings->target;
 
-		if(!hasBuildCmd && (target_.type == TargetType::none)) {
-			return;
-		}
-	}
+	std::vector<SubmittedRecord> records;
+	std::vector<FrameSubmission> currFrame;
 
-	LinAllocScope localMatchMem(matchAlloc_);
-
-	const CommandRecord* frameDstRecord {};
-	span<const CommandSectionMatch> frameRecMatchData {};
-	auto swapchain = dev_->swapchainLocked();
-	if(target_.type == TargetType::inFrame) {
-		if(!swapchain) {
-			dlg_warn("no swapchain anymore");
-			return;
-		}
-
-		// different queue
-		dlg_assert(target_.submissionID < target_.frame.size());
-		if(subm.queue != target_.frame[target_.submissionID].queue) {
-			return;
-		}
-
-		// get the current frame
-		std::vector<FrameSubmission> currFrame =
-			swapchain->nextFrameSubmissions.batches;
+	{
+		std::lock_guard lock(dev.mutex);
 
-		// add the new submissions
-		auto& curr = currFrame.emplace_back();
-		curr.queue = subm.queue;
-		curr.submissionID = subm.globalSubmitID;
+		auto hasWork = !localCaptures_.empty() || forceHook.load() ||
+			profileMode_ != FrameProfileMode::off ||
+			target.type != TargetType::none;
 		for(auto& sub : subm.dstBatch->submissions) {
 			auto& cmdSub = std::get<CommandSubmission>(sub.data);
 			for(auto& cb : cmdSub.cbs) {
 				dlg_assertm(!cb.hook, "Hooking already hooked submission?!");
 				auto rec = cb.cb->lastRecordPtrLocked();
 				dlg_assert(rec);
-				curr.submissions.push_back(std::move(rec));
+				if(rec->buildsAccelStructs && !rec->dormant) {
+					hasWork = true;
+				}
+
+				auto& dst = records.emplace_back();
+				if(settings->targetGeneration &&
+						rec->hookMatch.targetGeneration == settings->targetGeneration) {
+					dst.match.hierarchy = rec->hookMatch.hierarchy;
+					dst.match.match = rec->hookMatch.match;
+					dst.cached = true;
+				}
+
+				dst.record = std::move(rec);
 			}
 		}
 
-		// Match current frame against hook target frame.
-		// Since we don't have the full current frame here yet and want
-		// to avoid false negatives, we trim the target frame up unto
-		// the target submission.
-		auto trimmedTargetFrame = span<FrameSubmission>(target_.frame);
-		auto off = target_.submissionID;
-		dlg_assert(off < target_.frame.size());
-		trimmedTargetFrame = trimmedTargetFrame.first(off + 1);
+		// fast early-out
+		if(!hasWork) {
+			return;
+		}
 
-		ThreadMemScope tms;
-		auto frameMatch = match(localMatchMem, tms, matchType, target_.frame, currFrame);
+		if(target.type == TargetType::inFrame) {
+			auto swapchain = dev.swapchainLocked();
+			if(!swapchain) {
+				dlg_warn("no swapchain anymore");
+				return;
+			}
 
-		for(auto& submMatch : frameMatch.matches) {
-			if(submMatch.a != &target_.frame[target_.submissionID]) {
-				continue;
+			// different queue
+			dlg_assert(target.submissionID < target.frame.size());
+			if(subm.queue != target.frame[target.submissionID].queue) {
+				return;
 			}
 
-			for(auto& recMatch : submMatch.matches) {
-				if(recMatch.a == target_.record) {
-					frameDstRecord = recMatch.b;
-					frameRecMatchData = recMatch.matches;
-					break;
-				}
+			// get the current frame
+			currFrame = swapchain->nextFrameSubmissions.batches;
+		}
+	}
+
+	auto frozen = freeze.load();
+	if(!frozen) {
+		matchTarget(*settings, subm, records, std::move(currFrame));
+	}
+
+	std::unique_lock lock(dev.mutex);
+
+	// The target or ops might have been changed while we were matching.
+	// We must not create hook records for outdated ops, there is no
+	// guarantee they would get invalidated.
+	bool outdated;
+	{
+		std::lock_guard settingsLock(mutex_);
+		outdated = (settings != settings_);
+	}
 
+	if(outdated || frozen) {
+		for(auto& rec : records) {
+			rec.match = {};
+		}
+	} else if(target.type != TargetType::none &&
+			target.type != TargetType::inFrame) {
+		// The results only depend on record and target, we can cache them.
+		// NOTE: for update_after_bind descriptors, the descriptors
+		// considered by 'find' might change during the lifetime of the
+		// record. We ignore that here, the matching is heuristic anyways.
+		for(auto& rec : records) {
+			if(rec.cached || rec.record->dormant) {
+				continue;
 			}
 
-			break;
+			auto& cache = rec.record->hookMatch;
+			cache.targetGeneration = settings->targetGeneration;
+			cache.hierarchy = rec.match.hierarchy;
+			cache.match = rec.match.match;
 		}
 	}
 
 	// iterate through all submitted records and hook them if needed
-	for(auto [subID, sub] : enumerate(subm.dstBatch->submissions)) {
-		auto& srcSub = subm.submitInfos[subID];
-
-		span<VkCommandBufferSubmitInfo> patchedCbInfos {};
-
+	std::vector<NewHookRecord> newRecords;
+	auto recID = 0u;
+	for(auto& sub : subm.dstBatch->submissions) {
 		auto& cmdSub = std::get<CommandSubmission>(sub.data);
-		for(auto [cbID, cb] : enumerate(cmdSub.cbs)) {
-			auto& rec = *cb.cb->lastRecordLocked();
+		for(auto& cb : cmdSub.cbs) {
+			auto& rec = *records[recID].record;
+			auto& targetMatch = records[recID].match;
+			++recID;
+
+			// dormant records are incomplete, we can't hook them
+			if(rec.dormant) {
+				continue;
+			}
 
-			VkCommandBuffer hooked = VK_NULL_HANDLE;
-			std::unique_ptr<CommandHookSubmission> hookData;
+			auto hooked = false;
 
 			// first check for local captures
 			// NOTE: only doing exact matches for now
 			// TODO: records captures by local capture can't be captured otherwise rn.
 			for(auto& lc : localCaptures_) {
-				auto* rec = cb.cb->lastRecordLocked();
-				if(rec != lc->record.get()) {
+				if(&rec != lc->record.get()) {
 					continue;
 				}
 
 				// shouldn't need descriptors to find *identicial* command
-				auto findRes = find(MatchType::identity, *rec->commands, lc->command, {});
+				auto findRes = find(MatchType::identity, *rec.commands, lc->command, {});
 				dlg_assert(!findRes.hierarchy.empty());
-				hooked = doHook(*rec, findRes.hierarchy,
-					findRes.match, sub, hookData, lc.get());
+				doHook(rec, findRes.hierarchy, findRes.match, sub, cb,
+					*settings, newRecords, lc.get());
+				hooked = true;
 
 				break;
 			}
 
-			if(!freeze.load() && !hookData) {
-				auto hookViaFind = false;
+			if(!hooked && !targetMatch.hierarchy.empty()) {
+				doHook(rec, targetMatch.hierarchy, targetMatch.match, sub, cb,
+					*settings, newRecords);
+				hooked = true;
+			}
 
-				if(&rec == frameDstRecord) {
-					dlg_assert(target_.type == TargetType::inFrame);
-					hooked = hook(rec, frameRecMatchData, sub, hookData);
-				} else if(target_.type == TargetType::commandRecord) {
-					if(&rec == target_.record) {
-						hookViaFind = true;
-					}
-				} else if(target_.type == TargetType::commandBuffer) {
-					dlg_assert(rec.cb);
-					if(rec.cb == target_.cb.get()) {
-						hookViaFind = true;
-					}
-				} else if(target_.type == TargetType::all) {
-					hookViaFind = true;
-				}
+			// When profiling, every record is hooked. Hooked records for
+			// a command write the timestamps as well.
+			auto profile = (profileMode_ != FrameProfileMode::off);
+			if(!hooked && (forceHook.load() || profile ||
+					(rec.buildsAccelStructs && hookAccelStructBuilds))) {
+				doHook(rec, {}, 0.f, sub, cb, *settings, newRecords);
+			}
+		}
+	}
 
-				if(hookViaFind) {
-					auto findRes = find(matchType,
-						*rec.commands, target_.command,
-						target_.descriptors);
-					if(findRes.match > 0.f) {
-						hooked = doHook(rec, findRes.hierarchy,
-							findRes.match, sub, hookData);
-					}
+	// Re-recording is expensive, we don't hold the device mutex for it.
+	// The records (and therefore the handles used by them) are kept
+	// alive by the submission.
+	if(!newRecords.empty()) {
+		auto hookCounter = counter_;
+		auto profileMode = profileMode_;
+		lock.unlock();
+
+		for(auto& newRecord : newRecords) {
+			auto& ops = newRecord.localCapture ?
+				newRecord.localCaptureOps : settings->ops;
+			newRecord.hookRecord = new CommandHookRecord(*this,
+				*newRecord.record, std::move(newRecord.hierarchy),
+				newRecord.descriptors, ops, hookCounter, profileMode,
+				newRecord.localCapture);
+			newRecord.hookRecord->match = newRecord.match;
+		}
+
+		lock.lock();
+
+		// Like the matches above, we must not use recordings for outdated
+		// settings. They might also have been invalidated in the meantime.
+		{
+			std::lock_guard settingsLock(mutex_);
+			outdated = (settings != settings_);
+		}
+
+		outdated |= (hookCounter != counter_);
+
+		for(auto& newRecord : newRecords) {
+			auto& hookRecord = *newRecord.hookRecord;
+
+			// local captures with the 'once' flag might have been
+			// completed in the meantime.
+			auto lcCompleted = newRecord.localCapture &&
+				find_if(localCaptures_, [&](const auto& lc) {
+					return lc.get() == newRecord.localCapture;
+				}) == localCaptures_.end();
+
+			if(!outdated && !lcCompleted) {
+				hookRecord.next = records_;
+				if(records_) {
+					records_->prev = &hookRecord;
 				}
+				records_ = &hookRecord;
+
+				newRecord.record->hookRecords.push_back(
+					FinishPtr<CommandHookRecord>(&hookRecord));
+			} else if(!hookRecord.accelStructOps.empty()) {
+				// We still need the copied build data, so we submit it
+				// as an already invalidated record. It is destroyed
+				// when the submission finishes, see
+				// CommandHookSubmission::finish.
+				hookRecord.hook = nullptr;
+			} else {
+				delete &hookRecord;
+				continue;
 			}
 
-			if(!hookData && (forceHook.load() || (rec.buildsAccelStructs && hookAccelStructBuilds))) {
-				dlg_assert(!hooked);
-				hooked = doHook(rec, {}, 0.f, sub, hookData);
+			newRecord.cb->hook.reset(new CommandHookSubmission(hookRecord,
+				*newRecord.subm, std::move(newRecord.descriptors)));
+		}
+	}
+
+	// patch the submission infos to use the hooked command buffers
+	for(auto [subID, sub] : enumerate(subm.dstBatch->submissions)) {
+		auto& srcSub = subm.submitInfos[subID];
+
+		span<VkCommandBufferSubmitInfo> patchedCbInfos {};
+
+		auto& cmdSub = std::get<CommandSubmission>(sub.data);
+		for(auto [cbID, cb] : enumerate(cmdSub.cbs)) {
+			if(!cb.hook) {
+				continue;
 			}
 
-			dlg_assert(!!hooked == !!hookData);
-			if(hookData) {
-				if(patchedCbInfos.empty()) {
-					// NOTE: important to use subm.memScope instead of
-					// some local ThreadMemScope here!
-					patchedCbInfos = subm.memScope.copy(srcSub.pCommandBufferInfos,
-						srcSub.commandBufferInfoCount);
-				}
+			auto& hookRecord = *cb.hook->record;
 
-				patchedCbInfos[cbID].commandBuffer = hooked;
-				cb.hook = std::move(hookData);
+#ifdef VIL_DEBUG
+			// slow checks validating the hooked record.
+			dlg_check({
+				auto& target = settings->target;
+				if(hookRecord.hook && !hookRecord.localCapture &&
+						hookRecord.hasHookedCmd() && !target.command.empty()) {
+					dlg_assert(target.record);
+
+					auto findRes = find(matchType, *hookRecord.record->commands,
+						target.command, target.descriptors);
+					dlg_assert(findRes.match > 0.f);
+					dlg_assert(std::equal(
+						hookRecord.hcommand.begin(), hookRecord.hcommand.end(),
+						findRes.hierarchy.begin(), findRes.hierarchy.end()));
+				}
+			});
+#endif // VIL_DEBUG
 
-				subm.lastLayerSubmission = &sub;
+			if(patchedCbInfos.empty()) {
+				// NOTE: important to use subm.memScope instead of
+				// some local ThreadMemScope here!
+				patchedCbInfos = subm.memScope.copy(srcSub.pCommandBufferInfos,
+					srcSub.commandBufferInfoCount);
 			}
+
+			patchedCbInfos[cbID].commandBuffer = hookRecord.cb;
+			subm.lastLayerSubmission = &sub;
 		}
 
 		if(!patchedCbInfos.empty()) {
@@ -548,19 +642,139 @@ void CommandHook::hook(QueueSubmitter& subm) {
 	}
 }
 
-VkCommandBuffer CommandHook::hook(CommandRecord& record,
-		span<const CommandSectionMatch> matchData,
-		Submission& subm,
-		std::unique_ptr<CommandHookSubmission>& data) {
+void CommandHook::matchTarget(const Settings& settings,
+		const QueueSubmitter& subm, span<SubmittedRecord> records,
+		std::vector<FrameSubmission> currFrame) {
+	ZoneScoped;
+
+	auto& target = settings.target;
+	if(target.type == TargetType::none) {
+		return;
+	}
+
+	// Cheap rejection filters. Records failing them can't contain
+	// the target command.
+	auto mayContainTarget = [&](const CommandRecord& rec) {
+		if(target.command.empty()) {
+			return true;
+		}
+
+		dlg_assert(target.record);
+		if(rec.queueFamily != target.record->queueFamily) {
+			return false;
+		}
+
+		return mayFind(matchType, *rec.commands, target.command);
+	};
+
+	const CommandRecord* frameDstRecord {};
+	span<const CommandSectionMatch> frameRecMatchData {};
 
+	// Only used during this call, records are immutable after recording.
+	// We don't share an allocator between calls since hook might be
+	// called from multiple threads at the same time.
+	LinAllocator matchAlloc {&LinBlockPool::get()};
+	LinAllocScope localMatchMem(matchAlloc);
+
+	if(target.type == TargetType::inFrame) {
+		// Matching the frame is expensive, only do it when one of the
+		// submitted records could contain the target.
+		auto anyCandidate = false;
+		for(auto& rec : records) {
+			if(!rec.record->dormant && mayContainTarget(*rec.record)) {
+				anyCandidate = true;
+				break;
+			}
+		}
+
+		if(!anyCandidate) {
+			return;
+		}
+
+		// add the new submissions
+		auto& curr = currFrame.emplace_back();
+		curr.queue = subm.queue;
+		curr.submissionID = subm.globalSubmitID;
+		for(auto& rec : records) {
+			curr.submissions.push_back(rec.record);
+		}
+
+		// Match current frame against hook target frame.
+		// Since we don't have the full current frame here yet and want
+		// to avoid false negatives, we trim the target frame up unto
+		// the target submission.
+		auto trimmedTargetFrame = span<const FrameSubmission>(target.frame);
+		auto off = target.submissionID;
+		dlg_assert(off < target.frame.size());
+		trimmedTargetFrame = trimmedTargetFrame.first(off + 1);
+
+		ThreadMemScope tms;
+		auto frameMatch = match(localMatchMem, tms, matchType, target.frame, currFrame);
+
+		for(auto& submMatch : frameMatch.matches) {
+			if(submMatch.a != &target.frame[target.submissionID]) {
+				continue;
+			}
+
+			for(auto& recMatch : submMatch.matches) {
+				if(recMatch.a == target.record) {
+					frameDstRecord = recMatch.b;
+					frameRecMatchData = recMatch.matches;
+					break;
+				}
+
+			}
+
+			break;
+		}
+	}
+
+	for(auto& dst : records) {
+		auto& rec = *dst.record;
+		if(dst.cached || rec.dormant) {
+			continue;
+		}
+
+		auto hookViaFind = false;
+		if(&rec == frameDstRecord) {
+			dlg_assert(target.type == TargetType::inFrame);
+			if(mayContainTarget(rec)) {
+				dst.match = matchInFrame(target, rec, frameRecMatchData);
+			}
+		} else if(target.type == TargetType::commandRecord) {
+			if(&rec == target.record) {
+				hookViaFind = true;
+			}
+		} else if(target.type == TargetType::commandBuffer) {
+			dlg_assert(rec.cb);
+			if(rec.cb == target.cb.get()) {
+				hookViaFind = true;
+			}
+		} else if(target.type == TargetType::all) {
+			hookViaFind = mayContainTarget(rec);
+		}
+
+		if(hookViaFind) {
+			auto findRes = find(matchType, *rec.commands, target.command,
+				target.descriptors);
+			if(findRes.match > 0.f) {
+				dst.match = std::move(findRes);
+			}
+		}
+	}
+}
+
+FindResult CommandHook::matchInFrame(const Target& target,
+		const CommandRecord& record,
+		span<const CommandSectionMatch> matchData) {
 	float dstMatch {1.f};
 	std::vector<const Command*> dstHierarchy;
 
-	if(target_.command.empty()) {
+	if(target.command.empty()) {
 		// hook on the whole recording, mainly for time queries or testing
 		dstHierarchy.push_back(record.commands);
 	} else {
-		auto hierarchy = span<const Command*>(target_.command);
+		auto hierarchy = span<const Command* const>(target.command);
 		span<const CommandSectionMatch> sectionMatches = matchData;
 
 		// our matching algorithm (the data in matchData) only matches sections,
@@ -568,7 +782,7 @@ VkCommandBuffer CommandHook::hook(CommandRecord& record,
 		// When the command in the hierarchy is a parent command, we can find
 		// it via the matching result, otherwise we have to run an additional
 		// local 'find' on it.
-		auto finalCmdIsParent = !!target_.command.back()->children();
+		auto finalCmdIsParent = !!target.command.back()->children();
 		if(!finalCmdIsParent) {
 			hierarchy = hierarchy.first(hierarchy.size() - 1);
 		}
@@ -596,18 +810,18 @@ VkCommandBuffer CommandHook::hook(CommandRecord& record,
 
 		// no hook needed
 		if(!found) {
-			return VK_NULL_HANDLE;
+			return {};
 		}
 
 		if(!finalCmdIsParent) {
-			dlg_assert(dstHierarchy.size() == target_.command.size() - 1);
+			dlg_assert(dstHierarchy.size() == target.command.size() - 1);
 			auto* parent = static_cast<const ParentCommand*>(dstHierarchy.back());
-			auto findResult = find(matchType, *parent, span(target_.command).last(2),
-				target_.descriptors);
+			auto findResult = find(matchType, *parent, span(target.command).last(2),
+				target.descriptors);
 
 			// no hook needed
 			if(findResult.hierarchy.empty()) {
-				return VK_NULL_HANDLE;
+				return {};
 			}
 
 			dstMatch *= findResult.match;
@@ -617,7 +831,7 @@ VkCommandBuffer CommandHook::hook(CommandRecord& record,
 
 			dstHierarchy.push_back(findResult.hierarchy[1]);
 		} else {
-			dlg_assert(dstHierarchy.size() == target_.command.size());
+			dlg_assert(dstHierarchy.size() == target.command.size());
 
 			// Run 'find' as debug check
 			// There may be cases where 'find' and 'match' result in differences
@@ -628,7 +842,7 @@ VkCommandBuffer CommandHook::hook(CommandRecord& record,
 				auto* parent = static_cast<const ParentCommand*>(
 					dstHierarchy[dstHierarchy.size() - 2]);
 				auto findResult = find(matchType, *parent,
-					span(target_.command).last(2), target_.descriptors);
+					span(target.command).last(2), target.descriptors);
 				dlg_assert(!findResult.hierarchy.empty());
 				dlg_assert(findResult.hierarchy.size() == 2u);
 				dlg_assert(findResult.hierarchy[0] == parent);
@@ -639,7 +853,7 @@ VkCommandBuffer CommandHook::hook(CommandRecord& record,
 		}
 	}
 
-	return doHook(record, dstHierarchy, dstMatch, subm, data);
+	return {std::move(dstHierarchy), dstMatch};
 }
 
 void fillLocalCaptureHookOps(Flags<LocalCaptureBits> flags, CommandHookOps& opsTmp,
@@ -763,10 +977,12 @@ void fillLocalCaptureHookOps(Flags<LocalCaptureBits> flags, CommandHookOps& opsT
 	}
 }
 
-VkCommandBuffer CommandHook::doHook(CommandRecord& record,
+void CommandHook::doHook(CommandRecord& record,
 		span<const Command*> dstCommand, float dstCommandMatch,
-		Submission& subm, std::unique_ptr<CommandHookSubmission>& data,
+		Submission& subm, SubmittedCommandBuffer& cb,
+		const Settings& settings, std::vector<NewHookRecord>& newRecords,
 		LocalCapture* localCapture) {
+	assertOwned(dev_->mutex);
 
 	// Check if there already is a valid CommandHookRecord we can use.
 	CommandHookRecord* foundHookRecord {};
@@ -800,7 +1016,13 @@ VkCommandBuffer CommandHook::doHook(CommandRecord& record,
 				continue;
 			}
 
-			if(hookRecord->state->refCount > 1u) {
+			// records hooked just for profiling (or forceHook) don't
+			// capture anything
+			if(hookRecord->hasHookedCmd() != hookNeededForCmd) {
+				continue;
+			}
+
+			if(hookRecord->state && hookRecord->state->refCount > 1u) {
 				// We can't reuse this hook record, its state is still needded
 				// somewhere, e.g. referenced in gui or our completed list.
 				// The one ref count is always there and comes from the record.
@@ -868,7 +1090,12 @@ VkCommandBuffer CommandHook::doHook(CommandRecord& record,
 		// Not possible to reuse the hook-recorded cb when the command
 		// buffer uses any update_after_bind descriptors that changed.
 		// We therefore compare them.
-		if(hookNeededForCmd && copiedDescriptorChanged(*foundHookRecord)) {
+		if(hookNeededForCmd && copiedDescriptorChanged(*foundHookRecord, settings.ops)) {
+			invalidate(*foundHookRecord);
+			foundHookRecord = nullptr;
+		} else if(foundHookRecord->cowsAliased) {
+			// Writes to the sources of the deferred copies can't be
+			// tracked anymore. Re-recording will copy them eagerly.
 			invalidate(*foundHookRecord);
 			foundHookRecord = nullptr;
 		}
@@ -879,50 +1106,140 @@ VkCommandBuffer CommandHook::doHook(CommandRecord& record,
 		descriptors = captureDescriptors(*dstCommand.back());
 	}
 
-	if(!foundHookRecord) {
-		dlg_assertlm(dlg_level_warn, record.hookRecords.size() < 8,
-			"Alarmingly high number of hooks for a single record");
+	if(foundHookRecord) {
+		cb.hook.reset(new CommandHookSubmission(*foundHookRecord, subm,
+			std::move(descriptors)));
+		return;
+	}
+
+	dlg_assertlm(dlg_level_warn, record.hookRecords.size() < 8,
+		"Alarmingly high number of hooks for a single record");
+
+	// The new hook record is recorded later on, without the device
+	// mutex locked. See hook.
+	auto& newRecord = newRecords.emplace_back();
+	newRecord.cb = &cb;
+	newRecord.subm = &subm;
+	newRecord.record = &record;
+	newRecord.hierarchy = {dstCommand.begin(), dstCommand.end()};
+	newRecord.match = dstCommandMatch;
+	newRecord.localCapture = localCapture;
+	newRecord.descriptors = std::move(descriptors);
+
+	if(localCapture) {
+		dlg_trace("Creating hook record for local capture");
+		fillLocalCaptureHookOps(localCapture->flags,
+			newRecord.localCaptureOps, dstCommand);
+	}
+}
 
-		const CommandHookOps* ops = &ops_;
-		CommandHookOps opsTmp {};
+void CommandHook::invalidateCowsLocked(const SubmissionBatch& batch) {
+	ZoneScoped;
+	assertOwned(dev_->mutex);
 
-		if(localCapture) {
-			dlg_trace("Creating hook record for local capture");
-			fillLocalCaptureHookOps(localCapture->flags, opsTmp, dstCommand);
-			ops = &opsTmp;
+	// NOTE: out-of-order submissions via timeline semaphores might
+	// execute before a hooked submission, invalidating them just
+	// means we re-do copies we might not have needed.
+	for(auto* rec = records_; rec; rec = rec->next) {
+		if(!rec->cowsValid) {
+			continue;
 		}
 
-		auto hook = new CommandHookRecord(*this, record,
-			{dstCommand.begin(), dstCommand.end()},
-			descriptors, *ops, localCapture);
-		hook->match = dstCommandMatch;
-		record.hookRecords.push_back(FinishPtr<CommandHookRecord>(hook));
+		for(auto& cow : rec->cows) {
+			auto written = false;
+			for(auto& subm : batch.submissions) {
+				if(potentiallyWritesLocked(subm, cow.image.get(), cow.buffer.get())) {
+					written = true;
+					break;
+				}
+			}
 
-		foundHookRecord = hook;
+			if(written) {
+				rec->cowsValid = false;
+				break;
+			}
+		}
 	}
+}
 
-#ifdef VIL_DEBUG
-	// slow checks validating the hooked record.
-	dlg_check({
-		if(!localCapture && hookNeededForCmd && !target_.command.empty()) {
-			dlg_assert(target_.record);
-
-			auto findRes = find(matchType, *record.commands,
-				target_.command, target_.descriptors);
-			dlg_assert(findRes.match > 0.f);
-			dlg_assert(std::equal(
-				foundHookRecord->hcommand.begin(), foundHookRecord->hcommand.end(),
-				findRes.hierarchy.begin(), findRes.hierarchy.end()));
+void CommandHook::memoryBoundLocked(const MemoryBind& bind) {
+	ZoneScoped;
+	assertOwned(dev_->mutex);
+	dlg_assert(bind.memory);
+
+	const auto bindEnd = bind.memOffset + bind.memSize;
+	for(auto* rec = records_; rec; rec = rec->next) {
+		if(rec->cowsAliased) {
+			continue;
 		}
-	});
-#endif // VIL_DEBUG
 
-	data.reset(new CommandHookSubmission(*foundHookRecord, subm, std::move(descriptors)));
-	return foundHookRecord->cb;
+		for(auto& cow : rec->cows) {
+			const MemoryResource& res = cow.image ?
+				static_cast<const MemoryResource&>(*cow.image) : *cow.buffer;
+			// copyCb only defers copies of resources with full binds
+			auto& src = std::get<FullMemoryBind>(res.memory);
+			if(&src == &bind || src.memory != bind.memory) {
+				continue;
+			}
+
+			if(src.memOffset < bindEnd && bind.memOffset < src.memOffset + src.memSize) {
+				rec->cowsAliased = true;
+				rec->cowsValid = false;
+				break;
+			}
+		}
+	}
+}
+
+void CommandHook::profileMode(FrameProfileMode mode) {
+	{
+		std::vector<IntrusivePtr<CommandRecord>> keepAlive;
+		std::lock_guard lock(dev_->mutex);
+		if(profileMode_ == mode) {
+			return;
+		}
+
+		profileMode_ = mode;
+		profiler_.clearLocked();
+		keepAlive = profiler_.releaseLocked();
+	}
+
+	// hooked records have to be re-recorded with (or without) timestamps
+	invalidateRecordings(true);
+}
+
+FrameProfileMode CommandHook::profileMode() const {
+	std::lock_guard lock(dev_->mutex);
+	return profileMode_;
+}
+
+ProfileNode CommandHook::frameProfile() const {
+	std::lock_guard lock(dev_->mutex);
+	return profiler_.root;
+}
+
+void CommandHook::clearFrameProfile() {
+	std::vector<IntrusivePtr<CommandRecord>> keepAlive;
+	std::lock_guard lock(dev_->mutex);
+	profiler_.clearLocked();
+	keepAlive = profiler_.releaseLocked();
+}
+
+void CommandHook::frameLocked(const FrameSubmissions& frame) {
+	assertOwned(dev_->mutex);
+	if(profileMode_ == FrameProfileMode::off) {
+		return;
+	}
+
+	profiler_.frameLocked(*dev_, frame);
 }
 
 std::vector<CompletedHook> CommandHook::moveCompleted() {
 	std::vector<CompletedHook> moved;
+	if(!newCompleted_.exchange(false, std::memory_order_acquire)) {
+		return moved;
+	}
+
 	{
 		std::lock_guard lock(dev_->mutex);
 		moved = std::move(this->completed_);
@@ -930,6 +1247,33 @@ std::vector<CompletedHook> CommandHook::moveCompleted() {
 	return moved;
 }
 
+std::vector<PendingHook> CommandHook::pendingHooks() const {
+	std::vector<PendingHook> ret;
+
+	std::lock_guard lock(dev_->mutex);
+	for(auto* subm : pending_) {
+		auto& hookRecord = *subm->record;
+		dlg_assert(hookRecord.writer);
+
+		// invalidated
+		if(!hookRecord.hook) {
+			continue;
+		}
+
+		auto& dst = ret.emplace_back();
+		dst.record = IntrusivePtr<CommandRecord>(hookRecord.record);
+		dst.state = hookRecord.state;
+		dst.command = hookRecord.hcommand;
+		dst.match = hookRecord.match;
+		dst.descriptorSnapshot = subm->descriptorSnapshot;
+		dst.submissionID = hookRecord.writer->parent->globalSubmitID;
+		dst.queue = hookRecord.writer->parent->queue;
+		dst.queueSubmitID = hookRecord.writer->queueSubmitID;
+	}
+
+	return ret;
+}
+
 void CommandHook::clearCompleted() {
 	(void) moveCompleted();
 }
@@ -971,26 +1315,32 @@ CommandHookState::~CommandHookState() {
 void CommandHook::updateHook(Update&& update) {
 	{
 		// make sure we don't destroy these while lock is held
-		Target oldTarget;
+		std::shared_ptr<const Settings> oldSettings;
 
 		{
-			std::lock_guard lock(dev_->mutex);
+			std::lock_guard lock(mutex_);
 
+			// settings are immutable once published, see hook
+			auto newSettings = std::make_shared<Settings>(*settings_);
 			if(update.newTarget) {
-				oldTarget = std::move(target_);
-				target_ = std::move(*update.newTarget);
+				auto& target = newSettings->target;
+				target = std::move(*update.newTarget);
+				newSettings->targetGeneration = ++targetGeneration_;
 
 				// validate
-				if(target_.type == TargetType::inFrame) {
-					dlg_assert(target_.submissionID != u32(-1));
-					dlg_assert(target_.submissionID < target_.frame.size());
+				if(target.type == TargetType::inFrame) {
+					dlg_assert(target.submissionID != u32(-1));
+					dlg_assert(target.submissionID < target.frame.size());
 				}
 			}
 
 			if(update.newOps) {
 				dlg_assert(update.invalidate);
-				ops_ = std::move(*update.newOps);
+				newSettings->ops = std::move(*update.newOps);
 			}
+
+			oldSettings = std::move(settings_);
+			settings_ = std::move(newSettings);
 		}
 	}
 
@@ -1000,14 +1350,17 @@ void CommandHook::updateHook(Update&& update) {
 	}
 }
 
+std::shared_ptr<const CommandHook::Settings> CommandHook::settings() const {
+	std::lock_guard lock(mutex_);
+	return settings_;
+}
+
 CommandHook::Ops CommandHook::ops() const {
-	std::lock_guard lock(dev_->mutex);
-	return ops_;
+	return settings()->ops;
 }
 
 CommandHook::Target CommandHook::target() const {
-	std::lock_guard lock(dev_->mutex);
-	return target_;
+	return settings()->target;
 }
 
 void CommandHook::addLocalCapture(std::unique_ptr<LocalCapture>&& lc) {
@@ -2,6 +2,9 @@
 
 #include <fwd.hpp>
 #include <commandHook/state.hpp>
+#include <commandHook/profile.hpp>
+#include <commandHook/xfb.hpp>
+#include <command/match.hpp>
 #include <command/record.hpp>
 #include <util/intrusive.hpp>
 #include <nytl/bytes.hpp>
@@ -12,6 +15,7 @@
 #include <vk/vulkan.h>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <variant>
 #include <optional>
 #include <string>
@@ -65,6 +69,12 @@ struct CommandHookOps {
 	bool copyIndexBuffers {};
 	bool copyXfb {}; // transform feedback
 	bool copyIndirectCmd {};
+	// Only relevant for copyXfb: the draw (of a multi or indirect draw)
+	// and the chunk of that draw to capture, see xfbChunkCount.
+	// For indirect draws, only chunk 0 is supported. It holds as much of the
+	// draw as fits into maxXfbChunkSize.
+	u32 xfbDraw {};
+	u32 xfbChunk {};
 	std::vector<DescriptorCopyOp> descriptorCopies;
 	std::vector<AttachmentCopyOp> attachmentCopies; // only for cmd inside renderpass
 	bool queryTime {};
@@ -103,6 +113,16 @@ struct CompletedHook {
 	float match; // how much the command matched
 };
 
+// A hooked submission that was activated but hasn't completed yet.
+// Its image captures can already be used by gui draws chained to the
+// submission, i.e. waiting for 'queue->submissionSemaphore' to reach
+// 'queueSubmitID' (see needsSyncLocked). Buffer captures must not be
+// read before the hook completed.
+struct PendingHook : CompletedHook {
+	Queue* queue {};
+	u64 queueSubmitID {};
+};
+
 enum class LocalCaptureBits : u32 {
 	// Capture all data needed for shader debugging
 	shaderDebugger = (1u << 0u),
@@ -180,6 +200,11 @@ public:
 	// Never re-uses hooked records, even if possible. Mainly for debugging.
 	std::atomic<bool> allowReuse {true};
 
+	// Defers copies of resources that aren't written by the hooked record,
+	// re-doing them only when a source was potentially written since.
+	// See CommandHookRecord::cowCb.
+	std::atomic<bool> allowCows {true};
+
 	// Mainly useful for debugging, should always be true otherwise
 	// as we need it to have accelStruct data.
 	std::atomic<bool> hookAccelStructBuilds {true};
@@ -198,26 +223,74 @@ public:
 	// not QueueBindSparse).
 	void hook(QueueSubmitter& subm);
 
+	// Called for every submitted batch. Invalidates the copy-on-write
+	// captures of all hook records whose sources are potentially written
+	// by the batch, see CommandHookRecord::cowsValid.
+	void invalidateCowsLocked(const SubmissionBatch&);
+
+	// Called when memory is bound to a resource. Marks all hook records
+	// with deferred copies of resources aliasing the new bind, they
+	// can't be re-used. See CommandHookRecord::cowsAliased.
+	void memoryBoundLocked(const MemoryBind&);
+
 	// Updates the hook operations
 	void updateHook(Update&& update);
 
 	// Moves all completed hooks to the caller, clearing them
-	// internally.
+	// internally. Does not lock the device mutex when there are no
+	// new completed hooks, cheap to poll.
 	[[nodiscard]] std::vector<CompletedHook> moveCompleted();
 
-	// NOTE: copies are being made here (inside a critical section)
-	// so these functions are more expensive than simple getters.
+	// Returns the currently pending hooks, see PendingHook.
+	// Doesn't include local captures.
+	[[nodiscard]] std::vector<PendingHook> pendingHooks() const;
+
+	// NOTE: copies are being made here so these functions are more
+	// expensive than simple getters.
 	Ops ops() const;
 	Target target() const;
 
 	void invalidateRecordings(bool forceAll = false);
 	void clearCompleted();
 
+	// Frame profiling: while enabled, every submitted record is hooked
+	// and timestamps are written around its commands, see FrameProfiler.
+	// Changing the mode invalidates all hooked records.
+	void profileMode(FrameProfileMode);
+	FrameProfileMode profileMode() const;
+
+	// Returns a copy of the current frame timing tree.
+	ProfileNode frameProfile() const;
+	void clearFrameProfile();
+
+	// Called for every presented frame of the main swapchain.
+	void frameLocked(const FrameSubmissions&);
+
 	void addLocalCapture(std::unique_ptr<LocalCapture>&&);
 	std::vector<LocalCapture*> localCaptures() const;
 	std::vector<LocalCapture*> localCapturesOnceCompleted() const;
 
 private:
+	// Immutable once published via settings_, see updateHook.
+	struct Settings {
+		Target target;
+		Ops ops;
+		// Changes with every new target. Used as key for the matching
+		// results cached in CommandRecord::hookMatch.
+		u64 targetGeneration {};
+	};
+
+	// A record submitted in the submission that is currently hooked
+	struct SubmittedRecord {
+		IntrusivePtr<CommandRecord> record;
+		// Result of matching the record against the target, empty
+		// hierarchy when the record doesn't need to be hooked for it.
+		FindResult match {};
+		bool cached {}; // whether 'match' came from record->hookMatch
+	};
+
+	std::shared_ptr<const Settings> settings() const;
+
 	// Initializes the pipelines and data needed for acceleration
 	// structure copies
 	void initAccelStructCopy(Device& dev);
@@ -226,17 +299,45 @@ private:
 	// Checks whether the copied descriptors in the associated
 	// record have changed (via update-after-bind) since the hooked
 	// record was created. Exepcts the given record to be valid.
-	bool copiedDescriptorChanged(const CommandHookRecord&);
-
-	VkCommandBuffer doHook(CommandRecord& record,
+	bool copiedDescriptorChanged(const CommandHookRecord&, const Ops&);
+
+	// A hook record that has to be newly recorded for a submitted
+	// command buffer. See hook.
+	struct NewHookRecord {
+		SubmittedCommandBuffer* cb {};
+		Submission* subm {};
+		CommandRecord* record {};
+		std::vector<const Command*> hierarchy;
+		float match {};
+		LocalCapture* localCapture {};
+		Ops localCaptureOps {}; // only used when localCapture is set
+		CommandDescriptorSnapshot descriptors;
+		CommandHookRecord* hookRecord {}; // the recorded result
+	};
+
+	// Hooks the given command buffer of the submission. When there is a
+	// valid CommandHookRecord that can be re-used, sets cb.hook.
+	// Otherwise adds a new hook record to be recorded to 'newRecords'.
+	// Expects the device mutex to be locked.
+	void doHook(CommandRecord& record,
 		span<const Command*> dstCommand, // might be empty
 		float dstCommandMatch,
-		Submission& subm, std::unique_ptr<CommandHookSubmission>& data,
+		Submission& subm, SubmittedCommandBuffer& cb,
+		const Settings& settings, std::vector<NewHookRecord>& newRecords,
 		LocalCapture* localCapture = nullptr);
 
-	VkCommandBuffer hook(CommandRecord& record,
-		span<const CommandSectionMatch> matchData,
-		Submission& subm, std::unique_ptr<CommandHookSubmission>& data);
+	// Matches the given records (of the given submission) against
+	// the target, setting their 'match'. Records with cached results
+	// are skipped. Cheap rejection filters (see mayFind) are run before
+	// the actual matching.
+	// 'currFrame' are the submissions of the current frame so far, only
+	// used for TargetType::inFrame.
+	// Called without the device mutex locked, records are immutable.
+	static void matchTarget(const Settings&, const QueueSubmitter& subm,
+		span<SubmittedRecord> records, std::vector<FrameSubmission> currFrame);
+
+	static FindResult matchInFrame(const Target&, const CommandRecord& record,
+		span<const CommandSectionMatch> matchData);
 
 private:
 	friend struct CommandHookRecord;
@@ -248,9 +349,21 @@ private:
 	CommandHookRecord* records_ {}; // intrusive linked list
 									//
 	std::vector<CompletedHook> completed_;
-	Ops ops_;
-	Target target_;
-	LinAllocator matchAlloc_;
+	// Set when a hook was added to completed_, unset when moved out.
+	// Allows to check for new completed hooks without locking.
+	std::atomic<bool> newCompleted_ {};
+	// Hook submissions that were activated but haven't completed yet.
+	std::vector<CommandHookSubmission*> pending_;
+	FrameProfileMode profileMode_ {FrameProfileMode::off};
+	FrameProfiler profiler_;
+
+	// Protects settings_. Hooking only takes a reference to the current
+	// settings and matches against them without holding any lock.
+	// Lock order: may be locked while holding the device mutex but
+	// no other mutex may be locked while holding it.
+	mutable std::mutex mutex_;
+	std::shared_ptr<const Settings> settings_ {std::make_shared<Settings>()};
+	u64 targetGeneration_ {};
 
 	std::vector<std::unique_ptr<LocalCapture>> localCaptures_;
 	// LocalCaptures with 'once' flag set that were completed.
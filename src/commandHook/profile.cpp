@@ -0,0 +1,266 @@
+#include <commandHook/profile.hpp>
+#include <command/commands.hpp>
+#include <device.hpp>
+#include <queue.hpp>
+#include <frame.hpp>
+#include <util/util.hpp>
+#include <util/profiling.hpp>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace vil {
+
+// TimingStats
+void TimingStats::add(float ms) {
+	window[count % windowSize] = ms;
+	last = ms;
+	++count;
+}
+
+float TimingStats::min() const {
+	auto n = std::min<u64>(count, windowSize);
+	if(n == 0u) {
+		return 0.f;
+	}
+
+	return *std::min_element(window.begin(), window.begin() + n);
+}
+
+float TimingStats::avg() const {
+	auto n = std::min<u64>(count, windowSize);
+	if(n == 0u) {
+		return 0.f;
+	}
+
+	auto sum = 0.f;
+	for(auto i = 0u; i < n; ++i) {
+		sum += window[i];
+	}
+
+	return sum / n;
+}
+
+float TimingStats::p95() const {
+	auto n = std::min<u64>(count, windowSize);
+	if(n == 0u) {
+		return 0.f;
+	}
+
+	auto sorted = window;
+	auto rank = u32(std::ceil(0.95f * n)) - 1u;
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.begin() + n);
+	return sorted[rank];
+}
+
+// samples
+void buildProfileChildren(ProfileSample& dst, u32 parent, u32& next,
+		span<const ProfiledCommand> commands, span<const u64> timestamps,
+		u64 mask, float period) {
+	while(next < commands.size() && commands[next].parent == parent) {
+		auto id = next++;
+		auto& cmd = *commands[id].command;
+		auto& child = dst.children.emplace_back();
+		child.name = std::string(cmd.nameDesc());
+
+		auto before = timestamps[2 + 2 * id];
+		auto after = timestamps[3 + 2 * id];
+		child.ms = float(((after - before) & mask) * double(period) / 1000.0 / 1000.0);
+
+		buildProfileChildren(child, id, next, commands, timestamps, mask, period);
+	}
+}
+
+ProfileSample buildProfileSample(std::string name,
+		span<const ProfiledCommand> commands, span<const u64> timestamps,
+		u64 mask, float period) {
+	dlg_assert(timestamps.size() == 2 + 2 * commands.size());
+
+	ProfileSample ret;
+	ret.name = std::move(name);
+	ret.ms = float(((timestamps[1] - timestamps[0]) & mask) * double(period) / 1000.0 / 1000.0);
+
+	auto next = 0u;
+	buildProfileChildren(ret, u32(-1), next, commands, timestamps, mask, period);
+	dlg_assert(next == commands.size());
+
+	return ret;
+}
+
+void merge(ProfileNode& dst, const ProfileSample& src, u64 frame, u64 keepFrames) {
+	dst.name = src.name;
+	dst.stats.add(src.ms);
+	dst.lastFrame = frame;
+
+	// Children of the same parent often have the same name (e.g.
+	// draw commands), we match them by their occurrence.
+	// New nodes are appended, the order of the first frame stays.
+	// Reserving makes sure the names in dstIDs stay valid.
+	dst.children.reserve(dst.children.size() + src.children.size());
+
+	std::unordered_map<std::string_view, std::vector<u32>> dstIDs;
+	for(auto [i, child] : enumerate(dst.children)) {
+		dstIDs[child.name].push_back(u32(i));
+	}
+
+	std::unordered_map<std::string_view, u32> occurrences;
+	for(auto& srcChild : src.children) {
+		auto occurrence = occurrences[srcChild.name]++;
+		auto& ids = dstIDs[srcChild.name];
+
+		ProfileNode* dstChild {};
+		if(occurrence < ids.size()) {
+			dstChild = &dst.children[ids[occurrence]];
+		} else {
+			dstChild = &dst.children.emplace_back();
+		}
+
+		merge(*dstChild, srcChild, frame, keepFrames);
+	}
+
+	erase_if(dst.children, [&](const ProfileNode& child) {
+		return frame - child.lastFrame > keepFrames;
+	});
+}
+
+// FrameProfiler
+void FrameProfiler::addLocked(u64 submissionID,
+		IntrusivePtr<CommandRecord> record, ProfileSample sample) {
+	// Happens when there are no presents, e.g. while the
+	// application isn't rendering to a swapchain.
+	if(samples_.size() >= maxSamples) {
+		auto end = samples_.begin() + maxSamples / 2;
+		for(auto it = samples_.begin(); it != end; ++it) {
+			releaseLocked(*it);
+		}
+
+		samples_.erase(samples_.begin(), end);
+	}
+
+	auto& dst = samples_.emplace_back();
+	dst.submissionID = submissionID;
+	dst.record = std::move(record);
+	dst.sample = std::move(sample);
+}
+
+void FrameProfiler::frameLocked(Device& dev, const FrameSubmissions& frame) {
+	ZoneScoped;
+
+	if(frames_.size() >= maxPendingFrames) {
+		releaseLocked(frames_.front());
+		frames_.erase(frames_.begin());
+	}
+
+	auto& dst = frames_.emplace_back();
+	dst.presentID = frame.presentID;
+	dst.submissionStart = frame.submissionStart;
+	dst.submissionEnd = frame.submissionEnd;
+
+	for(auto& batch : frame.batches) {
+		if(batch.type != SubmissionType::command) {
+			continue;
+		}
+
+		auto& dstBatch = dst.batches.emplace_back();
+		dstBatch.submissionID = batch.submissionID;
+		for(auto& rec : batch.submissions) {
+			dstBatch.records.push_back(rec);
+		}
+	}
+
+	resolveLocked(dev);
+}
+
+void FrameProfiler::resolveLocked(Device& dev) {
+	while(!frames_.empty()) {
+		auto& frame = frames_.front();
+		for(auto& pending : dev.pending) {
+			if(pending->globalSubmitID >= frame.submissionStart &&
+					pending->globalSubmitID <= frame.submissionEnd) {
+				return;
+			}
+		}
+
+		// The frame time is the sum of the submissions, timestamps
+		// of different queues can't be compared.
+		ProfileSample sample;
+		sample.name = "Frame";
+
+		for(auto& batch : frame.batches) {
+			ProfileSample batchSample;
+			batchSample.name = "Submission";
+
+			for(auto& rec : batch.records) {
+				auto it = find_if(samples_, [&](const RecordSample& rs) {
+					return rs.submissionID == batch.submissionID && rs.record == rec;
+				});
+
+				// not hooked, e.g. dormant
+				if(it == samples_.end()) {
+					continue;
+				}
+
+				batchSample.ms += it->sample.ms;
+				batchSample.children.push_back(std::move(it->sample));
+				releaseLocked(*it);
+				samples_.erase(it);
+			}
+
+			if(!batchSample.children.empty()) {
+				sample.ms += batchSample.ms;
+				sample.children.push_back(std::move(batchSample));
+			}
+		}
+
+		if(!sample.children.empty()) {
+			merge(root, sample, frame.presentID, keepFrames);
+			++numFrames;
+		}
+
+		auto end = frame.submissionEnd;
+		erase_if(samples_, [&](RecordSample& rs) {
+			if(rs.submissionID > end) {
+				return false;
+			}
+
+			releaseLocked(rs);
+			return true;
+		});
+
+		releaseLocked(frame);
+		frames_.erase(frames_.begin());
+	}
+}
+
+void FrameProfiler::clearLocked() {
+	for(auto& frame : frames_) {
+		releaseLocked(frame);
+	}
+
+	for(auto& sample : samples_) {
+		releaseLocked(sample);
+	}
+
+	root = {};
+	numFrames = 0u;
+	frames_.clear();
+	samples_.clear();
+}
+
+void FrameProfiler::releaseLocked(PendingFrame& frame) {
+	for(auto& batch : frame.batches) {
+		for(auto& rec : batch.records) {
+			released_.push_back(std::move(rec));
+		}
+	}
+}
+
+void FrameProfiler::releaseLocked(RecordSample& sample) {
+	released_.push_back(std::move(sample.record));
+}
+
+std::vector<IntrusivePtr<CommandRecord>> FrameProfiler::releaseLocked() {
+	return std::exchange(released_, {});
+}
+
+} // namespace vil
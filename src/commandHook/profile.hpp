@@ -0,0 +1,136 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <util/intrusive.hpp>
+#include <nytl/span.hpp>
+#include <array>
+#include <string>
+#include <vector>
+
+namespace vil {
+
+struct Command;
+struct FrameSubmissions;
+
+enum class FrameProfileMode {
+	// No frame profiling
+	off,
+	// Times every section (render passes, subpasses, debug labels etc)
+	// of every submitted record.
+	sections,
+	// Additionally times every draw, dispatch and traceRays command.
+	commands,
+};
+
+// Statistics over the last samples of a single timing.
+struct TimingStats {
+	static constexpr auto windowSize = 128u;
+
+	u64 count {}; // total number of samples
+	float last {}; // in milliseconds
+	std::array<float, windowSize> window {}; // ring buffer
+
+	void add(float ms);
+
+	// Statistics over the last (up to) windowSize samples.
+	// All of them return 0.f when there are no samples.
+	float min() const;
+	float avg() const;
+	float p95() const;
+};
+
+// Timings of a single frame (or record), in milliseconds.
+struct ProfileSample {
+	std::string name;
+	float ms {};
+	std::vector<ProfileSample> children;
+};
+
+// Node of the timing tree built by FrameProfiler. The hierarchy is
+// frame > submission > record > commands, where the commands mirror
+// the command hierarchy of the record.
+struct ProfileNode {
+	std::string name;
+	TimingStats stats;
+	u64 lastFrame {}; // presentID of the last frame containing this node
+	std::vector<ProfileNode> children;
+};
+
+// A command timed by a hooked record, see CommandHookRecord::profiled.
+// Stored in pre-order.
+struct ProfiledCommand {
+	const Command* command {};
+	u32 parent {u32(-1)}; // index of the parent, u32(-1) for top-level commands
+};
+
+// Builds the sample of a single hooked record submission.
+// 'timestamps' holds the begin and end timestamp of the whole record
+// followed by the begin and end timestamp for each command.
+ProfileSample buildProfileSample(std::string name,
+	span<const ProfiledCommand> commands, span<const u64> timestamps,
+	u64 timestampMask, float timestampPeriod);
+
+// Merges the given sample of a frame into 'dst'.
+// Children are matched by name and by the number of previous siblings
+// with the same name, i.e. the second "shadows" label is merged with the
+// second "shadows" label of earlier frames.
+// Children that were not part of the last 'keepFrames' frames are removed.
+void merge(ProfileNode& dst, const ProfileSample& src, u64 frame, u64 keepFrames);
+
+// Collects the timings of hooked record submissions and merges them
+// into a timing tree per presented frame.
+// Synchronized via device mutex.
+// Samples and pending frames keep their records alive, so a record can't
+// be confused with a new one allocated at the same address.
+struct FrameProfiler {
+	// Frames not completed after this many presents are dropped.
+	static constexpr auto maxPendingFrames = 8u;
+	// Samples are dropped when they can't be associated with a frame.
+	static constexpr auto maxSamples = 4096u;
+	// Nodes not part of a frame for this many frames are removed.
+	static constexpr auto keepFrames = u64(256u);
+
+	ProfileNode root;
+	u64 numFrames {}; // number of frames merged into root
+
+	void addLocked(u64 submissionID, IntrusivePtr<CommandRecord>, ProfileSample);
+
+	// Called for every presented frame of the main swapchain.
+	// Merges all frames whose submissions have completed.
+	void frameLocked(Device&, const FrameSubmissions&);
+	void clearLocked();
+
+	// Returns the records of dropped samples and frames. They must be
+	// destroyed without the device mutex locked.
+	std::vector<IntrusivePtr<CommandRecord>> releaseLocked();
+
+private:
+	struct PendingFrame {
+		u64 presentID {};
+		u64 submissionStart {};
+		u64 submissionEnd {};
+
+		struct Batch {
+			u64 submissionID {};
+			std::vector<IntrusivePtr<CommandRecord>> records;
+		};
+
+		std::vector<Batch> batches;
+	};
+
+	struct RecordSample {
+		u64 submissionID {};
+		IntrusivePtr<CommandRecord> record {};
+		ProfileSample sample;
+	};
+
+	std::vector<PendingFrame> frames_;
+	std::vector<RecordSample> samples_;
+	std::vector<IntrusivePtr<CommandRecord>> released_;
+
+	void resolveLocked(Device&);
+	void releaseLocked(PendingFrame&);
+	void releaseLocked(RecordSample&);
+};
+
+} // namespace vil
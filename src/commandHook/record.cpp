@@ -24,27 +24,29 @@ namespace vil {
 CommandHookRecord::CommandHookRecord(CommandHook& xhook,
 	CommandRecord& xrecord, std::vector<const Command*> hooked,
 	const CommandDescriptorSnapshot& descriptors,
-	const CommandHookOps& ops, LocalCapture* xlocalCapture) :
+	const CommandHookOps& ops, u32 xhookCounter, FrameProfileMode profileMode,
+	LocalCapture* xlocalCapture) :
 		hook(&xhook), record(&xrecord), hcommand(std::move(hooked)) {
 
 	++DebugStats::get().aliveHookRecords;
-	assertOwned(xhook.dev_->mutex);
 
 	this->localCapture = xlocalCapture;
-	this->next = hook->records_;
-	if(hook->records_) {
-		hook->records_->prev = this;
-	}
-	hook->records_ = this;
-
-	hookCounter = hook->counter_;
+	this->hookCounter = xhookCounter;
 
 	auto& dev = *xrecord.dev;
 
+	// We don't use the shared pool of the queue family, recording
+	// into it would have to be synchronized.
+	VkCommandPoolCreateInfo cpi {};
+	cpi.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cpi.queueFamilyIndex = record->queueFamily;
+	VK_CHECK_DEV(dev.dispatch.CreateCommandPool(dev.handle, &cpi, nullptr, &this->commandPool), dev);
+	nameHandle(dev, this->commandPool, "CommandHookRecord:commandPool");
+
 	VkCommandBufferAllocateInfo allocInfo {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = dev.queueFamilies[record->queueFamily].commandPool;
+	allocInfo.commandPool = this->commandPool;
 	allocInfo.commandBufferCount = 1;
 
 	VK_CHECK_DEV(dev.dispatch.AllocateCommandBuffers(dev.handle, &allocInfo, &this->cb), dev);
@@ -67,10 +69,36 @@ CommandHookRecord::CommandHookRecord(CommandHook& xhook,
 		}
 	}
 
+	// frame profiling
+	if(profileMode != FrameProfileMode::off) {
+		auto validBits = dev.queueFamilies[xrecord.queueFamily].props.timestampValidBits;
+		if(validBits != 0u) {
+			gatherProfiled(record->commands->children(), u32(-1),
+				profileMode == FrameProfileMode::commands);
+
+			VkQueryPoolCreateInfo qci {};
+			qci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			qci.queryCount = u32(2u + 2u * profiled.size());
+			qci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			VK_CHECK_DEV(dev.dispatch.CreateQueryPool(dev.handle, &qci, nullptr, &this->profilePool), dev);
+			nameHandle(dev, this->profilePool, "CommandHookRecord:profilePool");
+		}
+	}
+
 	RecordInfo info {ops};
 	info.descriptors = &descriptors;
 	initState(info);
 
+	// transform feedback
+	// When the xfb variant of the pipeline isn't ready yet, the recording
+	// is invalidated once it is, see XfbPipelineThread.
+	if(ops.copyXfb && !hcommand.empty() &&
+			hcommand.back()->category() == CommandCategory::draw) {
+		auto* drawCmd = deriveCast<const DrawCmdBase*>(hcommand.back());
+		dlg_assert(drawCmd->state->pipe);
+		info.xfb = requestXfbVariant(*drawCmd->state->pipe);
+	}
+
 	// TODO
 	// this->dsState.resize(ops.descriptorCopies.size());
 
@@ -85,13 +113,32 @@ CommandHookRecord::CommandHookRecord(CommandHook& xhook,
 		dev.dispatch.CmdResetQueryPool(cb, queryPool, 0, 2);
 	}
 
+	auto profileCount = u32(2u + 2u * profiled.size());
+	if(this->profilePool) {
+		dev.dispatch.CmdResetQueryPool(cb, profilePool, 0, profileCount);
+		dev.dispatch.CmdWriteTimestamp(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			profilePool, 0);
+	}
+
 	unsigned maxHookLevel {};
 	info.maxHookLevel = &maxHookLevel;
 
+	u32 nextProfiled {};
+	info.nextProfiled = &nextProfiled;
+
 	ZoneScopedN("HookRecord");
 	this->hookRecord(record->commands, info);
 
+	if(this->profilePool) {
+		dlg_assert(nextProfiled == profiled.size());
+		dev.dispatch.CmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			profilePool, 1);
+	}
+
 	VK_CHECK_DEV(dev.dispatch.EndCommandBuffer(this->cb), dev);
+	if(this->cowCb) {
+		VK_CHECK_DEV(dev.dispatch.EndCommandBuffer(this->cowCb), dev);
+	}
 
 	if(!hcommand.empty()) {
 		dlg_assert(maxHookLevel >= hcommand.size() - 1);
@@ -121,8 +168,6 @@ CommandHookRecord::~CommandHookRecord() {
 	assertOwned(dev.mutex);
 
 	// destroy resources
-	auto commandPool = dev.queueFamilies[record->queueFamily].commandPool;
-
 	for(auto imgView : imageViews) {
 		dev.dispatch.DestroyImageView(dev.handle, imgView, nullptr);
 	}
@@ -132,12 +177,15 @@ CommandHookRecord::~CommandHookRecord() {
 	}
 
 	if(!descriptorSets.empty()) {
+		std::lock_guard lock(dev.dsPoolMutex);
 		dev.dispatch.FreeDescriptorSets(dev.handle, dev.dsPool,
 			u32(descriptorSets.size()), descriptorSets.data());
 	}
 
-	dev.dispatch.FreeCommandBuffers(dev.handle, commandPool, 1, &cb);
+	// implicitly frees cb and cowCb
+	dev.dispatch.DestroyCommandPool(dev.handle, commandPool, nullptr);
 	dev.dispatch.DestroyQueryPool(dev.handle, queryPool, nullptr);
+	dev.dispatch.DestroyQueryPool(dev.handle, profilePool, nullptr);
 
 	dev.dispatch.DestroyRenderPass(dev.handle, rp0, nullptr);
 	dev.dispatch.DestroyRenderPass(dev.handle, rp1, nullptr);
@@ -418,36 +466,6 @@ void CommandHookRecord::hookRecordDst(Command& cmd, RecordInfo& info) {
 
 	hookRecordBeforeDst(cmd, info);
 
-	// transform feedback
-	auto endXfb = false;
-	if(cmd.category() == CommandCategory::draw) {
-		auto* drawCmd = deriveCast<DrawCmdBase*>(&cmd);
-		dlg_assert(drawCmd->state->pipe);
-
-		if(drawCmd->state->pipe->xfbPatch && info.ops.copyXfb) {
-			dlg_assert(dev.transformFeedback);
-			dlg_assert(dev.dispatch.CmdBeginTransformFeedbackEXT);
-			dlg_assert(dev.dispatch.CmdBindTransformFeedbackBuffersEXT);
-			dlg_assert(dev.dispatch.CmdEndTransformFeedbackEXT);
-
-			// init xfb buffer
-			auto xfbSize = 32 * 1024 * 1024; // TODO
-			auto usage =
-				VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-				VK_BUFFER_USAGE_TRANSFORM_FEEDBACK_BUFFER_BIT_EXT |
-				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-			state->transformFeedback.ensure(dev, xfbSize, usage);
-
-			auto offset = VkDeviceSize(0u);
-			dev.dispatch.CmdBindTransformFeedbackBuffersEXT(cb, 0u, 1u,
-				&state->transformFeedback.buf, &offset,
-				&state->transformFeedback.size);
-			dev.dispatch.CmdBeginTransformFeedbackEXT(cb, 0u, 0u, nullptr, nullptr);
-
-			endXfb = true;
-		}
-	}
-
 	// TODO: Improve the timing queries for draw commands. With proper
 	// subpass dependencies and barrier stages we can probably isolate
 	// draw commands better (especially in the case where we don't
@@ -475,7 +493,11 @@ void CommandHookRecord::hookRecordDst(Command& cmd, RecordInfo& info) {
 		}
 	}
 
-	dispatchRecord(cmd, info);
+	if(info.xfb) {
+		recordXfb(*deriveCast<DrawCmdBase*>(&cmd), info);
+	} else {
+		dispatchRecord(cmd, info);
+	}
 
 	auto cmdAsParent = dynamic_cast<const ParentCommand*>(&cmd);
 	auto nextInfo = info;
@@ -508,14 +530,311 @@ void CommandHookRecord::hookRecordDst(Command& cmd, RecordInfo& info) {
 		}
 	}
 
-	if(endXfb) {
-		dev.dispatch.CmdEndTransformFeedbackEXT(cb, 0u, 0u, nullptr, nullptr);
-	}
-
 	// render pass split: rp2
 	hookRecordAfterDst(cmd, info);
 }
 
+void CommandHookRecord::recordXfb(const DrawCmdBase& cmd, RecordInfo& info) {
+	auto& dev = *record->dev;
+	DebugLabel lbl(dev, cb, "vil:recordXfb");
+
+	dlg_assert(dev.transformFeedback);
+	dlg_assert(dev.dispatch.CmdBeginTransformFeedbackEXT);
+	dlg_assert(dev.dispatch.CmdBindTransformFeedbackBuffersEXT);
+	dlg_assert(dev.dispatch.CmdEndTransformFeedbackEXT);
+
+	auto split = xfbSplit(*cmd.state->pipe);
+	auto draw = info.ops.xfbDraw;
+	auto chunk = info.ops.xfbChunk;
+	state->xfbDraw = draw;
+	state->xfbChunk = chunk;
+
+	// The captured part is drawn once with the xfb variant of the pipeline
+	// bound instead of the original one. The variant has the same state,
+	// so it renders the same while capturing the vertex shader output.
+	auto& pipe = *cmd.state->pipe;
+	auto capture = [&](VkDeviceSize size, auto&& recordCaptured) {
+		auto& xfbBuf = state->transformFeedback;
+		auto usage =
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+			VK_BUFFER_USAGE_TRANSFORM_FEEDBACK_BUFFER_BIT_EXT |
+			VK_BUFFER_USAGE_TRANSFORM_FEEDBACK_COUNTER_BUFFER_BIT_EXT |
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+
+		// the counter is stored directly after the captured data
+		auto counterOffset = align(size, VkDeviceSize(4u));
+		if(!xfbBuf.ensureCapture(dev, counterOffset + 4u, usage)) {
+			dlg_warn("Allocating xfb buffer failed");
+			recordCaptured();
+			return;
+		}
+
+		state->xfbCounterOffset = counterOffset;
+
+		auto offset = VkDeviceSize(0u);
+		dev.dispatch.CmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe.xfbPipe);
+		dev.dispatch.CmdBindTransformFeedbackBuffersEXT(cb, 0u, 1u,
+			&xfbBuf.buf, &offset, &counterOffset);
+		dev.dispatch.CmdBeginTransformFeedbackEXT(cb, 0u, 0u, nullptr, nullptr);
+		recordCaptured();
+		dev.dispatch.CmdEndTransformFeedbackEXT(cb, 0u, 1u,
+			&xfbBuf.buf, &counterOffset);
+
+		dev.dispatch.CmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe.handle);
+	};
+
+	auto recordParts = [&](const XfbRange& range, u32 vertexCount,
+			u32 instanceCount, auto&& recordPart) {
+		auto size = xfbCaptureSize(split, range);
+		for(auto& part : xfbParts(range, vertexCount, instanceCount)) {
+			if(part.capture) {
+				capture(size, [&]{ recordPart(part.range); });
+			} else {
+				recordPart(part.range);
+			}
+		}
+	};
+
+	// Returns the range of the selected chunk for a draw
+	auto chunkRange = [&](u32 vertexCount, u32 instanceCount) -> std::optional<XfbRange> {
+		if(chunk >= xfbChunkCount(split, vertexCount, instanceCount)) {
+			return std::nullopt;
+		}
+
+		return xfbChunkRange(split, vertexCount, instanceCount, chunk);
+	};
+
+	auto invalid = [&]{
+		dlg_warn("Invalid xfb selection (draw {}, chunk {}) for {}",
+			draw, chunk, cmd.toString());
+		cmd.record(dev, cb, record->queueFamily);
+	};
+
+	if(auto* dcmd = commandCast<const DrawCmd*>(&cmd); dcmd) {
+		auto range = chunkRange(dcmd->vertexCount, dcmd->instanceCount);
+		if(draw != 0u || !range) {
+			return invalid();
+		}
+
+		recordParts(*range, dcmd->vertexCount, dcmd->instanceCount, [&](const XfbRange& r) {
+			dev.dispatch.CmdDraw(cb, r.vertexCount, r.instanceCount,
+				dcmd->firstVertex + r.firstVertex,
+				dcmd->firstInstance + r.firstInstance);
+		});
+	} else if(auto* dcmd = commandCast<const DrawIndexedCmd*>(&cmd); dcmd) {
+		auto range = chunkRange(dcmd->indexCount, dcmd->instanceCount);
+		if(draw != 0u || !range) {
+			return invalid();
+		}
+
+		recordParts(*range, dcmd->indexCount, dcmd->instanceCount, [&](const XfbRange& r) {
+			dev.dispatch.CmdDrawIndexed(cb, r.vertexCount, r.instanceCount,
+				dcmd->firstIndex + r.firstVertex, dcmd->vertexOffset,
+				dcmd->firstInstance + r.firstInstance);
+		});
+	} else if(auto* dcmd = commandCast<const DrawMultiCmd*>(&cmd); dcmd) {
+		auto infos = dcmd->vertexInfos;
+		auto range = draw < infos.size() ?
+			chunkRange(infos[draw].vertexCount, dcmd->instanceCount) :
+			std::nullopt;
+		if(!range) {
+			return invalid();
+		}
+
+		auto stride = u32(sizeof(VkMultiDrawInfoEXT));
+		if(draw > 0u) {
+			dev.dispatch.CmdDrawMultiEXT(cb, draw, infos.data(),
+				dcmd->instanceCount, dcmd->firstInstance, stride);
+		}
+
+		// Empty draws in front of the selected one make sure that
+		// gl_DrawIndex stays the same.
+		std::vector<VkMultiDrawInfoEXT> patched(infos.size());
+		auto& sel = infos[draw];
+		recordParts(*range, sel.vertexCount, dcmd->instanceCount, [&](const XfbRange& r) {
+			patched[draw].firstVertex = sel.firstVertex + r.firstVertex;
+			patched[draw].vertexCount = r.vertexCount;
+			dev.dispatch.CmdDrawMultiEXT(cb, draw + 1, patched.data(),
+				r.instanceCount, dcmd->firstInstance + r.firstInstance, stride);
+		});
+
+		if(draw + 1 < infos.size()) {
+			patched[draw] = {};
+			std::copy(infos.begin() + draw + 1, infos.end(), patched.begin() + draw + 1);
+			dev.dispatch.CmdDrawMultiEXT(cb, u32(patched.size()), patched.data(),
+				dcmd->instanceCount, dcmd->firstInstance, stride);
+		}
+	} else if(auto* dcmd = commandCast<const DrawMultiIndexedCmd*>(&cmd); dcmd) {
+		auto infos = dcmd->indexInfos;
+		auto range = draw < infos.size() ?
+			chunkRange(infos[draw].indexCount, dcmd->instanceCount) :
+			std::nullopt;
+		if(!range) {
+			return invalid();
+		}
+
+		auto stride = u32(sizeof(VkMultiDrawIndexedInfoEXT));
+		auto* vertexOffset = dcmd->vertexOffset ? &*dcmd->vertexOffset : nullptr;
+		if(draw > 0u) {
+			dev.dispatch.CmdDrawMultiIndexedEXT(cb, draw, infos.data(),
+				dcmd->instanceCount, dcmd->firstInstance, stride, vertexOffset);
+		}
+
+		// Empty draws in front of the selected one make sure that
+		// gl_DrawIndex stays the same.
+		std::vector<VkMultiDrawIndexedInfoEXT> patched(infos.size());
+		auto& sel = infos[draw];
+		recordParts(*range, sel.indexCount, dcmd->instanceCount, [&](const XfbRange& r) {
+			patched[draw].firstIndex = sel.firstIndex + r.firstVertex;
+			patched[draw].indexCount = r.vertexCount;
+			patched[draw].vertexOffset = sel.vertexOffset;
+			dev.dispatch.CmdDrawMultiIndexedEXT(cb, draw + 1, patched.data(),
+				r.instanceCount, dcmd->firstInstance + r.firstInstance,
+				stride, vertexOffset);
+		});
+
+		if(draw + 1 < infos.size()) {
+			patched[draw] = {};
+			std::copy(infos.begin() + draw + 1, infos.end(), patched.begin() + draw + 1);
+			dev.dispatch.CmdDrawMultiIndexedEXT(cb, u32(patched.size()), patched.data(),
+				dcmd->instanceCount, dcmd->firstInstance, stride, vertexOffset);
+		}
+	} else if(isIndirect(cmd)) {
+		// We can't split the vertex or instance range of indirect draws
+		// since the parameters are only known on the gpu. We only capture
+		// the selected draw, up to maxXfbChunkSize.
+		if(!info.xfbIndirect || chunk != 0u) {
+			return invalid();
+		}
+
+		auto* icmd = commandCast<const DrawIndirectCmd*>(&cmd);
+		auto* ccmd = commandCast<const DrawIndirectCountCmd*>(&cmd);
+		dlg_assert(icmd || ccmd);
+
+		auto indexed = icmd ? icmd->indexed : ccmd->indexed;
+		auto count = icmd ? icmd->drawCount : ccmd->maxDrawCount;
+		auto stride = icmd ? icmd->stride : ccmd->stride;
+		if(!stride) {
+			stride = indexed ?
+				sizeof(VkDrawIndexedIndirectCommand) :
+				sizeof(VkDrawIndirectCommand);
+		}
+
+		auto recordPart = [&](VkBuffer buf, VkDeviceSize offset, u32 drawCount) {
+			if(icmd && indexed) {
+				dev.dispatch.CmdDrawIndexedIndirect(cb, buf, offset, drawCount, stride);
+			} else if(icmd) {
+				dev.dispatch.CmdDrawIndirect(cb, buf, offset, drawCount, stride);
+			} else if(indexed) {
+				dev.dispatch.CmdDrawIndexedIndirectCount(cb, buf, offset,
+					ccmd->countBuffer->handle, ccmd->countBufferOffset,
+					drawCount, stride);
+			} else {
+				dev.dispatch.CmdDrawIndirectCount(cb, buf, offset,
+					ccmd->countBuffer->handle, ccmd->countBufferOffset,
+					drawCount, stride);
+			}
+		};
+
+		auto* srcBuf = icmd ? icmd->buffer : ccmd->buffer;
+		auto srcOffset = icmd ? icmd->offset : ccmd->offset;
+		if(draw > 0u) {
+			recordPart(srcBuf->handle, srcOffset, draw);
+		}
+
+		capture(maxXfbChunkSize, [&]{
+			recordPart(xfbIndirect.buf, 0u, draw + 1);
+		});
+
+		if(draw + 1 < count) {
+			recordPart(xfbIndirect.buf, VkDeviceSize(count) * stride, count);
+		}
+	} else {
+		dlg_error("Unsupported draw command for xfb: {}", cmd.toString());
+		cmd.record(dev, cb, record->queueFamily);
+	}
+}
+
+void CommandHookRecord::copyXfbIndirect(const Command& bcmd, RecordInfo& info) {
+	auto& dev = *record->dev;
+
+	const Buffer* src {};
+	VkDeviceSize srcOffset {};
+	u32 count {};
+	VkDeviceSize stride {};
+	VkDeviceSize cmdSize {};
+
+	auto init = [&](const auto& cmd, u32 drawCount) {
+		cmdSize = cmd.indexed ?
+			sizeof(VkDrawIndexedIndirectCommand) :
+			sizeof(VkDrawIndirectCommand);
+		stride = cmd.stride ? cmd.stride : cmdSize;
+		src = cmd.buffer;
+		srcOffset = cmd.offset;
+		count = drawCount;
+	};
+
+	if(auto* cmd = commandCast<const DrawIndirectCmd*>(&bcmd); cmd) {
+		init(*cmd, cmd->drawCount);
+	} else if(auto* cmd = commandCast<const DrawIndirectCountCmd*>(&bcmd); cmd) {
+		init(*cmd, cmd->maxDrawCount);
+	} else {
+		return;
+	}
+
+	auto draw = info.ops.xfbDraw;
+	if(!info.xfb || draw >= count) {
+		return;
+	}
+
+	dlg_assert(src);
+	DebugLabel lbl(dev, cb, "vil:copyXfbIndirect");
+
+	// The first half of the buffer holds the commands up to the captured
+	// draw, the second half the commands after it. The other commands are
+	// zeroed, i.e. empty draws. That way, gl_DrawIndex stays the same.
+	auto half = count * stride;
+	auto usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+	if(!xfbIndirect.ensureCapture(dev, 2 * half, usage, {},
+			OwnBuffer::Type::deviceLocal)) {
+		dlg_warn("Allocating xfb indirect buffer failed");
+		return;
+	}
+
+	// performCopy synchronizes with previous (e.g. compute shader) writes
+	// of the indirect commands and later writes by the application.
+	performCopy(dev, cb, *src, srcOffset + draw * stride,
+		xfbIndirect, draw * stride, cmdSize);
+	if(draw + 1 < count) {
+		performCopy(dev, cb, *src, srcOffset + (draw + 1) * stride,
+			xfbIndirect, half + (draw + 1) * stride,
+			(count - draw - 2) * stride + cmdSize);
+	}
+
+	if(draw > 0u) {
+		dev.dispatch.CmdFillBuffer(cb, xfbIndirect.buf, 0u, draw * stride, 0u);
+	}
+
+	dev.dispatch.CmdFillBuffer(cb, xfbIndirect.buf, half, (draw + 1) * stride, 0u);
+
+	VkBufferMemoryBarrier barrier {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.buffer = xfbIndirect.buf;
+	barrier.offset = 0u;
+	barrier.size = VK_WHOLE_SIZE;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+	dev.dispatch.CmdPipelineBarrier(cb,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	info.xfbIndirect = true;
+}
+
 void CommandHookRecord::hookRecord(Command* cmd, RecordInfo& info) {
 	*info.maxHookLevel = std::max(*info.maxHookLevel, info.nextHookLevel);
 
@@ -543,6 +862,15 @@ void CommandHookRecord::hookRecord(Command* cmd, RecordInfo& info) {
 			accelStructOps.push_back(AccelStructCopy{cas->src, cas->dst});
 		}
 
+		// frame profiling, see gatherProfiled
+		auto profileID = u32(-1);
+		if(profilePool && *info.nextProfiled < profiled.size() &&
+				profiled[*info.nextProfiled].command == cmd) {
+			profileID = (*info.nextProfiled)++;
+			dev.dispatch.CmdWriteTimestamp(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				profilePool, 2u + 2u * profileID);
+		}
+
 		// check if command is on hooking chain
 		if(info.nextHookLevel < hcommand.size() && cmd == hcommand[info.nextHookLevel]) {
 			auto hookDst = (info.nextHookLevel == hcommand.size() - 1);
@@ -605,10 +933,145 @@ void CommandHookRecord::hookRecord(Command* cmd, RecordInfo& info) {
 			}
 		}
 
+		if(profileID != u32(-1)) {
+			dev.dispatch.CmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				profilePool, 3u + 2u * profileID);
+		}
+
 		cmd = cmd->next;
 	}
 }
 
+void CommandHookRecord::gatherProfiled(const Command* cmd, u32 parent,
+		bool withCommands) {
+	for(; cmd; cmd = cmd->next) {
+		if(profiled.size() >= maxProfiledCommands) {
+			return;
+		}
+
+		auto* parentCmd = dynamic_cast<const ParentCommand*>(cmd);
+		auto category = cmd->category();
+		auto timed = (parentCmd && parentCmd->children()) || (withCommands &&
+			(category == CommandCategory::draw ||
+			 category == CommandCategory::dispatch ||
+			 category == CommandCategory::traceRays));
+		if(!timed) {
+			continue;
+		}
+
+		auto id = u32(profiled.size());
+		profiled.push_back({cmd, parent});
+
+		if(!parentCmd) {
+			continue;
+		}
+
+		// With multiview, timestamps inside the render pass use
+		// one query per view. We only time the render pass itself.
+		auto multiview = false;
+		if(auto* rpCmd = commandCast<const BeginRenderPassCmd*>(cmd); rpCmd) {
+			auto& desc = rpCmd->rp->desc;
+			multiview = hasChain(desc, VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO);
+			for(auto& subpass : desc.subpasses) {
+				multiview |= (subpass.viewMask != 0u);
+			}
+		} else if(auto* rCmd = commandCast<const BeginRenderingCmd*>(cmd); rCmd) {
+			multiview = (rCmd->viewMask != 0u);
+		}
+
+		if(!multiview) {
+			gatherProfiled(parentCmd->children(), id, withCommands);
+		}
+	}
+}
+
+VkCommandBuffer CommandHookRecord::copyCb(const Image* img, const Buffer* buf) {
+	auto& dev = *record->dev;
+	dlg_assert(!img != !buf);
+
+	// Deferring copies only pays off when the record (and therefore the
+	// copies in its state) is re-used.
+	if(!hook->allowCows.load() || !hook->allowReuse.load()) {
+		return cb;
+	}
+
+	// The memory bindings are synchronized via the device mutex.
+	// We are recording without it locked, see CommandHook::hook.
+	std::shared_lock lock(dev.mutex);
+
+	// We can't track writes to sparse resources via other resources
+	// bound to the same memory.
+	const MemoryResource& res = img ?
+		static_cast<const MemoryResource&>(*img) : *buf;
+	auto* bind = std::get_if<FullMemoryBind>(&res.memory);
+	if(!bind || bind->memState != FullMemoryBind::State::bound) {
+		return cb;
+	}
+
+	// Mappable memory might be written by the host at any time
+	dlg_assert(bind->memory);
+	auto& mem = *bind->memory;
+	auto memFlags = dev.memProps.memoryTypes[mem.typeIndex].propertyFlags;
+	if(memFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		return cb;
+	}
+
+	// Writes to aliasing resources are not tracked.
+	// Resources bound to the memory later on are detected in
+	// CommandHook::memoryBoundLocked.
+	const auto bindEnd = bind->memOffset + bind->memSize;
+	for(auto* other : mem.allocations) {
+		if(other->memOffset >= bindEnd) {
+			break;
+		}
+
+		if(other != bind && other->memOffset + other->memSize > bind->memOffset) {
+			return cb;
+		}
+	}
+
+	// The memory might be written outside of our knowledge, e.g.
+	// by another device or via a device address.
+	if(img && (img->externalMemory || img->swapchain)) {
+		return cb;
+	}
+
+	if(buf && (buf->externalMemory ||
+			(buf->ci.usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT))) {
+		return cb;
+	}
+
+	// When the hooked record itself writes the resource, the resource
+	// at the start of the record differs from the one at the hooked command.
+	if(potentiallyWritesLocked(*record, img, buf)) {
+		return cb;
+	}
+
+	lock.unlock();
+
+	if(!cowCb) {
+		VkCommandBufferAllocateInfo allocInfo {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VK_CHECK_DEV(dev.dispatch.AllocateCommandBuffers(dev.handle, &allocInfo, &cowCb), dev);
+		dev.setDeviceLoaderData(dev.handle, cowCb);
+		nameHandle(dev, cowCb, "CommandHookRecord:cowCb");
+
+		VkCommandBufferBeginInfo cbbi {};
+		cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		VK_CHECK_DEV(dev.dispatch.BeginCommandBuffer(cowCb, &cbbi), dev);
+	}
+
+	// we only read the resources, the handles are just kept alive
+	auto& cow = cows.emplace_back();
+	cow.image.reset(const_cast<Image*>(img));
+	cow.buffer.reset(const_cast<Buffer*>(buf));
+	return cowCb;
+}
+
 void CommandHookRecord::copyDs(Command& bcmd, RecordInfo& info,
 		const DescriptorCopyOp& copyDesc, unsigned dstID,
 		CommandHookState::CopiedDescriptor& dst,
@@ -720,8 +1183,15 @@ void CommandHookRecord::copyDs(Command& bcmd, RecordInfo& info,
 					// compute shader. Make that a return value of initAndSampleCopy?
 					info.rebindComputeState = true;
 				} else {
+					// When the layout was adjusted, the image is in a
+					// different layout at the start of the record.
+					auto dstCb = cb;
+					if(layout == elem.layout) {
+						dstCb = copyCb(imgView->img, nullptr);
+					}
+
 					auto& dstImg = dst.data.emplace<CopiedImage>();
-					initAndCopy(dev, cb, dstImg, *imgView->img, layout, subres,
+					initAndCopy(dev, dstCb, dstImg, *imgView->img, layout, subres,
 						record->queueFamily);
 				}
 			}
@@ -753,7 +1223,8 @@ void CommandHookRecord::copyDs(Command& bcmd, RecordInfo& info,
 		// we don't ever read the buffer from the gfxQueue so we can
 		// ignore queueFams here
 		auto& dstBuf = dst.data.emplace<OwnBuffer>();
-		initAndCopy(dev, cb, dstBuf, 0u, *elem.buffer, off, size, {});
+		initAndCopy(dev, copyCb(nullptr, elem.buffer), dstBuf, 0u,
+			*elem.buffer, off, size, {});
 	} else if(cat == DescriptorCategory::accelStruct) {
 		auto& elem = accelStructs(ds, bindingID)[elemID];
 
@@ -929,7 +1400,7 @@ void CommandHookRecord::copyTransfer(Command& bcmd, RecordInfo& info, bool isBef
 		dlg_assert(img || buf);
 		if(img) {
 			auto [src, layout, subres] = *img;
-			initAndCopy(dev, cb, toWrite.img, *src,
+			initAndCopy(dev, copyCb(src, nullptr), toWrite.img, *src,
 				layout, subres, record->queueFamily);
 		} else if(buf) {
 			auto [src, offset, size] = *buf;
@@ -940,7 +1411,8 @@ void CommandHookRecord::copyTransfer(Command& bcmd, RecordInfo& info, bool isBef
 
 			// we don't ever read the buffer from the gfxQueue so we can
 			// ignore queueFams here
-			initAndCopy(dev, cb, toWrite.buf, 0u, *src, offset, size, {});
+			initAndCopy(dev, copyCb(nullptr, src), toWrite.buf, 0u,
+				*src, offset, size, {});
 		}
 	}
 
@@ -1005,7 +1477,7 @@ void CommandHookRecord::copyTransfer(Command& bcmd, RecordInfo& info, bool isBef
 		dlg_assert(img || buf);
 		if(img) {
 			auto [src, layout, subres] = *img;
-			initAndCopy(dev, cb, toWrite.img, *src,
+			initAndCopy(dev, copyCb(src, nullptr), toWrite.img, *src,
 				layout, subres, record->queueFamily);
 		} else if(buf) {
 			auto [src, offset, size] = *buf;
@@ -1016,7 +1488,8 @@ void CommandHookRecord::copyTransfer(Command& bcmd, RecordInfo& info, bool isBef
 
 			// we don't ever read the buffer from the gfxQueue so we can
 			// ignore queueFams here
-			initAndCopy(dev, cb, toWrite.buf, 0u, *src, offset, size, {});
+			initAndCopy(dev, copyCb(nullptr, src), toWrite.buf, 0u,
+				*src, offset, size, {});
 		}
 	}
 }
@@ -1079,19 +1552,22 @@ void CommandHookRecord::beforeDstOutsideRp(Command& bcmd, RecordInfo& info) {
 				sizeof(VkDrawIndexedIndirectCommand) :
 				sizeof(VkDrawIndirectCommand);
 			auto size = 4 + cmd->maxDrawCount * cmdSize;
-			state->indirectCopy.ensure(dev, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-
-			// copy count
-			performCopy(dev, cb, *cmd->countBuffer, cmd->countBufferOffset,
-				state->indirectCopy, 0u, 4u);
-			// copy commands
-			// NOTE: using an indirect-transfer-emulation approach (see
-			// below, same problem as for indirect draw vertex/index bufs)
-			// we could avoid copying too much data here. Likely not worth
-			// it here though unless application pass *huge* maxDrawCount
-			// values (which they shouldn't).
-			performCopy(dev, cb, *cmd->buffer, cmd->offset,
-				state->indirectCopy, 4u, cmd->maxDrawCount * cmdSize);
+			if(!state->indirectCopy.ensureCapture(dev, size,
+					VK_BUFFER_USAGE_TRANSFER_DST_BIT)) {
+				dlg_warn("Allocating indirect copy failed");
+			} else {
+				// copy count
+				performCopy(dev, cb, *cmd->countBuffer, cmd->countBufferOffset,
+					state->indirectCopy, 0u, 4u);
+				// copy commands
+				// NOTE: using an indirect-transfer-emulation approach (see
+				// below, same problem as for indirect draw vertex/index bufs)
+				// we could avoid copying too much data here. Likely not worth
+				// it here though unless application pass *huge* maxDrawCount
+				// values (which they shouldn't).
+				performCopy(dev, cb, *cmd->buffer, cmd->offset,
+					state->indirectCopy, 4u, cmd->maxDrawCount * cmdSize);
+			}
 		} else if(auto* cmd = commandCast<TraceRaysIndirectCmd*>(&bcmd)) {
 			auto size = sizeof(VkTraceRaysIndirectCommandKHR);
 			initAndCopy(dev, cb, state->indirectCopy, cmd->indirectDeviceAddress,
@@ -1101,6 +1577,10 @@ void CommandHookRecord::beforeDstOutsideRp(Command& bcmd, RecordInfo& info) {
 		}
 	}
 
+	if(info.ops.copyXfb) {
+		copyXfbIndirect(bcmd, info);
+	}
+
 	// attachments
 	for(auto [i, ac] : enumerate(info.ops.attachmentCopies)) {
 		if(ac.before) {
@@ -1273,7 +1753,11 @@ void CommandHookRecord::hookBefore(const BuildAccelStructsCmd& cmd) {
 		// init AccelStructState
 		dlg_assert(cmd.buildRangeInfos[i].size() == srcBuildInfo.geometryCount);
 
-		dst.state = createState(*dst.dst, srcBuildInfo, cmd.buildRangeInfos[i].data());
+		{
+			// createState sets the effective type of the accelStruct
+			std::lock_guard lock(dev.mutex);
+			dst.state = createState(*dst.dst, srcBuildInfo, cmd.buildRangeInfos[i].data());
+		}
 		auto& state = *dst.state;
 
 		auto& dstBuffer = state.buffer;
@@ -1300,7 +1784,7 @@ void CommandHookRecord::hookBefore(const BuildAccelStructsCmd& cmd) {
 				dlg_assert(cmdHook.accelStructVertCopy_);
 
 				// make sure we can read it via copy
-				auto& vertBuf = bufferAtLocked(dev, srcTris.vertexData.deviceAddress);
+				auto& vertBuf = bufferAt(dev, srcTris.vertexData.deviceAddress);
 				dlg_assert(vertBuf.deviceAddress);
 
 				VkBufferMemoryBarrier barriers[2] = {};
@@ -1316,7 +1800,7 @@ void CommandHookRecord::hookBefore(const BuildAccelStructsCmd& cmd) {
 				auto nbarriers = 1u;
 				if(srcTris.indexType != VK_INDEX_TYPE_NONE_KHR) {
 					dlg_assert(srcTris.indexData.deviceAddress);
-					auto& indBuf = bufferAtLocked(dev, srcTris.indexData.deviceAddress);
+					auto& indBuf = bufferAt(dev, srcTris.indexData.deviceAddress);
 					dlg_assert(indBuf.deviceAddress);
 
 					barriers[1] = barriers[0];
@@ -2,8 +2,10 @@
 
 #include <fwd.hpp>
 #include <util/ownbuf.hpp>
+#include <util/intrusive.hpp>
 #include <command/record.hpp>
 #include <commandHook/state.hpp>
+#include <commandHook/profile.hpp>
 
 namespace vil {
 
@@ -40,13 +42,40 @@ struct CommandHookRecord {
 	// std::vector<IntrusivePtr<DescriptorSetCow>> dsState;
 
 	// == Resources ==
+	VkCommandPool commandPool {}; // owned, cb and cowCb are allocated from it
 	VkCommandBuffer cb {};
 
+	// Copy-on-write captures, see docs/own/cow.md.
+	// Copies of resources that aren't written by the hooked record are
+	// recorded into 'cowCb' instead of 'cb'. The copies in 'state' stay
+	// valid until a later submission potentially writes one of the
+	// sources, so 'cowCb' only has to be submitted (directly before 'cb')
+	// when the record is re-used after that. Might be null.
+	VkCommandBuffer cowCb {};
+	// Keeps the sources alive, see CommandHook::memoryBoundLocked.
+	struct Cow {
+		IntrusivePtr<Image> image {};
+		IntrusivePtr<Buffer> buffer {};
+	};
+	std::vector<Cow> cows;
+	// Whether the copies in 'cowCb' are still valid in 'state'.
+	// Synchronized via device mutex, see CommandHook::invalidateCowsLocked.
+	bool cowsValid {};
+	// Whether memory of one of the sources in 'cows' was bound to another
+	// resource after recording. Writes via that resource aren't tracked,
+	// the record must not be re-used. See CommandHook::memoryBoundLocked.
+	bool cowsAliased {};
+
 	// PERF: allocate resources from pool instead of giving each record
 	// its entirely own set of resources (e.g. queryPool and images/buffers
 	// in CommandHookState).
 	VkQueryPool queryPool {};
 
+	// Frame profiling, see FrameProfiler. Queries 0 and 1 time the whole
+	// record, queries 2 + 2 * i and 3 + 2 * i the i-th command in 'profiled'.
+	VkQueryPool profilePool {};
+	std::vector<ProfiledCommand> profiled;
+
 	// When the viewed command is inside a render pass and we need to
 	// perform transfer operations before/after it, we need to split
 	// up the render pass.
@@ -57,6 +86,10 @@ struct CommandHookRecord {
 	IntrusivePtr<CommandHookState> state {};
 	OwnBuffer dummyBuf {};
 
+	// Patched copies of the indirect commands when capturing a single
+	// draw of an indirect draw via xfb, see copyXfbIndirect.
+	OwnBuffer xfbIndirect {};
+
 	// AccelStruct-related stuff.
 	// We need to hook every CmdBuildAccelerationStructure, making sure
 	// we store the state the accelStruct is built with.
@@ -101,10 +134,14 @@ struct CommandHookRecord {
 	CommandHookRecord* prev {};
 
 public:
+	// Records the hooked command buffer. Called without the device
+	// mutex locked, the record is only linked into hook->records_
+	// afterwards, see CommandHook::hook.
 	CommandHookRecord(CommandHook& hook, CommandRecord& record,
 		std::vector<const Command*> hooked,
 		const CommandDescriptorSnapshot& descriptors,
-		const CommandHookOps& ops, LocalCapture* localCapture = nullptr);
+		const CommandHookOps& ops, u32 hookCounter,
+		FrameProfileMode profileMode, LocalCapture* localCapture = nullptr);
 	~CommandHookRecord();
 
 	// Called when associated record is destroyed or hook replaced.
@@ -130,8 +167,13 @@ private:
 
 		unsigned nextHookLevel {}; // on hcommand, hook hierarchy
 		unsigned* maxHookLevel {};
+		u32* nextProfiled {}; // index into 'profiled'
 
 		bool rebindComputeState {};
+		// whether the xfb variant of the pipeline is used for the hooked
+		// draw. Decided once so that all operations agree on it.
+		bool xfb {};
+		bool xfbIndirect {}; // whether copyXfbIndirect was done
 	};
 
 	void initState(RecordInfo&);
@@ -154,15 +196,36 @@ private:
 	// Will perform all needed operations.
 	void hookRecordAfterDst(Command& dst, RecordInfo&);
 
+	// Records the hooked draw command in multiple parts, capturing only
+	// the selected part via transform feedback. See xfbParts.
+	void recordXfb(const DrawCmdBase& dst, RecordInfo&);
+
+	// Writes the patched indirect commands needed by recordXfb for
+	// indirect draws into 'xfbIndirect'. Must be called outside the
+	// render pass.
+	void copyXfbIndirect(const Command& dst, RecordInfo&);
+
 	// Recursively records the given linked list of commands.
 	void hookRecord(Command* cmdChain, RecordInfo&);
 
+	// Recursively collects the commands to be timed into 'profiled'.
+	// Sections are always timed, draw/dispatch/traceRays commands
+	// only when 'withCommands' is true.
+	void gatherProfiled(const Command* cmdChain, u32 parent, bool withCommands);
+
 	// Returns the state of the *last* AccelStruct build for the acceleration
 	// structure at the given address, or null if there is none.
 	IntrusivePtr<AccelStructState> lastAccelStructBuild(u64 accelStructAddress);
 
 	// = Copying =
 	void copyTransfer(Command& bcmd, RecordInfo&, bool isBefore);
+
+	// Returns the command buffer a copy of the given Image or Buffer
+	// should be recorded into: cowCb when it can be deferred, otherwise cb.
+	// Resources that are mappable, have a device address or might be
+	// written in ways we can't track are always copied eagerly.
+	VkCommandBuffer copyCb(const Image*, const Buffer*);
+
 	void copyDs(Command& bcmd, RecordInfo&,
 		const DescriptorCopyOp&, unsigned copyDstID,
 		CommandHookState::CopiedDescriptor& dst,
@@ -189,6 +252,9 @@ private:
 	// bad idea in many cases, e.g. when huge upload heaps are used.
 	static constexpr auto copyFullTransferBuffer = false;
 
+	// Maximum number of commands timed per record when profiling.
+	static constexpr auto maxProfiledCommands = 8 * 1024u;
+
 	// See node 1963
 	static constexpr auto timingBarrierBefore = true;
 	static constexpr auto timingBarrierAfter = true;
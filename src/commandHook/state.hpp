@@ -2,6 +2,7 @@
 
 #include <fwd.hpp>
 #include <util/ownbuf.hpp>
+#include <util/captureHeap.hpp>
 #include <vk/vulkan_core.h>
 #include <accelStruct.hpp>
 #include <variant>
@@ -19,7 +20,7 @@ struct CopiedImageToBuffer {
 struct CopiedImage {
 	Device* dev {};
 	VkImage image {};
-	VkDeviceMemory memory {};
+	CaptureHeap::Allocation memory {}; // from Device::captureHeap
 	VkExtent3D extent {};
 	u32 layerCount {};
 	u32 levelCount {};
@@ -102,7 +103,14 @@ struct CommandHookState {
 	// Only for draw commands
 	std::vector<OwnBuffer> vertexBufCopies {}; // draw cmd: Copy of all vertex buffers
 	OwnBuffer indexBufCopy {}; // draw cmd: Copy of index buffer
-	OwnBuffer transformFeedback {}; // draw cmd: position output of vertex stage
+	// draw cmd: output of the vertex stage, followed by the xfb counter
+	OwnBuffer transformFeedback {};
+	u32 xfbDraw {}; // the captured part, see CommandHookOps::xfbDraw
+	u32 xfbChunk {};
+	u32 xfbCapturedSize {}; // number of captured bytes, read from the counter
+	// offset of the xfb counter in 'transformFeedback', set by recordXfb.
+	// The buffer might be larger than needed.
+	VkDeviceSize xfbCounterOffset {};
 
 	// Only for transfer commands
 	CopiedTransferIO transferSrcBefore {};
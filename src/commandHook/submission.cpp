@@ -7,6 +7,7 @@
 #include <device.hpp>
 #include <ds.hpp>
 #include <accelStruct.hpp>
+#include <threadContext.hpp>
 
 namespace vil {
 
@@ -22,8 +23,13 @@ CommandHookSubmission::~CommandHookSubmission() {
 	// for vkQueueSubmit failure cases.
 	if(record) {
 		dlg_assert(record->record);
+		removePending();
 		record->writer = nullptr;
 
+		if(pendingCowCopy) {
+			record->cowsValid = false;
+		}
+
 		// hook was invalidated, record should be deleted
 		if(!record->hook) {
 			record->writer = nullptr;
@@ -34,6 +40,13 @@ CommandHookSubmission::~CommandHookSubmission() {
 }
 
 void CommandHookSubmission::activate() {
+	// Expose the in-flight state, see CommandHook::pendingHooks.
+	if(record->hook && record->state && record->hasHookedCmd() &&
+			!record->localCapture) {
+		record->hook->pending_.push_back(this);
+		pendingExposed = true;
+	}
+
 	for(auto& op : record->accelStructOps) {
 		if(auto* buildOp = std::get_if<CommandHookRecord::AccelStructBuild>(&op); buildOp) {
 			for(auto& build : buildOp->builds) {
@@ -41,7 +54,8 @@ void CommandHookSubmission::activate() {
 				build.dst->pendingState = build.state;
 			}
 		} else if(auto* copy = std::get_if<CommandHookRecord::AccelStructCopy>(&op); copy) {
-			dlg_assert(copy->src->pendingState);
+			// NOTE: src->pendingState might be null when it was built
+			// in a dormant record, see CommandRecord::dormant
 			copy->state = copy->src->pendingState;
 			copy->dst->pendingState = copy->src->pendingState;
 		} else if(auto* capture = std::get_if<CommandHookRecord::AccelStructCapture>(&op); capture) {
@@ -50,14 +64,14 @@ void CommandHookSubmission::activate() {
 			auto& dst = record->state->copiedDescriptors[capture->id];
 			auto& dstCapture = std::get<CommandHookState::CapturedAccelStruct>(dst.data);
 
-			dlg_assert(capture->accelStruct->pendingState);
+			// might be null when the tlas was built in a dormant record
 			dstCapture.tlas = capture->accelStruct->pendingState;
 
 			// NOTE: this can be quite expensive, in the case of many BLASes
 			// This cannot really be optimized though. At this point in time we might
 			// not know the current TLAS instances and we do not want to capture the BLASes
 			// at any later time since they might have been invalidated then already.
-			dstCapture.blases = captureBLASesLocked(*record->hook->dev_);
+			dstCapture.blases = captureBLASesLocked(*record->record->dev);
 		}
 	}
 }
@@ -65,6 +79,8 @@ void CommandHookSubmission::activate() {
 void CommandHookSubmission::finish(Submission& subm) {
 	ZoneScoped;
 	dlg_assert(record->writer == &subm);
+	pendingCowCopy = false;
+	removePending();
 
 	// In this case the hook was invalidated, no longer interested in results.
 	// Since we are the only submission left to the record, it can be
@@ -81,14 +97,16 @@ void CommandHookSubmission::finish(Submission& subm) {
 		return;
 	}
 
-	// when the record has no state, we don't have to transmit anything
+	assertOwned(record->hook->dev_->mutex);
+	transmitProfile(subm);
+
+	// when the record has no state, we don't have to transmit anything else
 	if(!record->state) {
 		dlg_assert(record->hcommand.empty());
 		finishAccelStructBuilds();
 		return;
 	}
 
-	assertOwned(record->hook->dev_->mutex);
 	transmitTiming();
 
 	// This usually is a sign of a problem somewhere inside the layer.
@@ -142,6 +160,19 @@ void CommandHookSubmission::finish(Submission& subm) {
 		}
 	}
 
+	// transform feedback readback
+	if(record->state->transformFeedback.buf) {
+		auto& xfbBuf = record->state->transformFeedback;
+		auto counterOffset = record->state->xfbCounterOffset;
+		dlg_assert(xfbBuf.size >= counterOffset + 4u);
+		xfbBuf.invalidateMap();
+
+		// the counter is stored directly after the captured data, see recordXfb
+		auto counterData = xfbBuf.data().subspan(counterOffset);
+		auto counter = read<u32>(counterData);
+		record->state->xfbCapturedSize = u32(std::min<VkDeviceSize>(counter, counterOffset));
+	}
+
 	finishAccelStructBuilds();
 
 	CompletedHook* dstCompleted {};
@@ -173,6 +204,7 @@ void CommandHookSubmission::finish(Submission& subm) {
 		dstCompleted = &record->localCapture->completed;
 	} else {
 		dstCompleted = &record->hook->completed_.emplace_back();
+		record->hook->newCompleted_.store(true, std::memory_order_release);
 	}
 
 	dstCompleted->record = IntrusivePtr<CommandRecord>(record->record);
@@ -183,6 +215,19 @@ void CommandHookSubmission::finish(Submission& subm) {
 	dstCompleted->submissionID = subm.parent->globalSubmitID;
 }
 
+void CommandHookSubmission::removePending() {
+	if(!pendingExposed) {
+		return;
+	}
+
+	// NOTE: record->hook might have been unset by invalidation already
+	auto& hook = *record->record->dev->commandHook;
+	auto it = find(hook.pending_, this);
+	dlg_assert(it != hook.pending_.end());
+	hook.pending_.erase(it);
+	pendingExposed = false;
+}
+
 void CommandHookSubmission::transmitTiming() {
 	ZoneScoped;
 
@@ -215,6 +260,36 @@ void CommandHookSubmission::transmitTiming() {
 	record->state->neededTime = diff;
 }
 
+void CommandHookSubmission::transmitProfile(Submission& subm) {
+	if(!record->profilePool) {
+		return;
+	}
+
+	ZoneScoped;
+
+	auto& dev = *record->record->dev;
+	auto count = u32(2u + 2u * record->profiled.size());
+
+	ThreadMemScope tms;
+	auto data = tms.alloc<u64>(count);
+	auto res = dev.dispatch.GetQueryPoolResults(dev.handle, record->profilePool,
+		0, count, count * sizeof(u64), data.data(), 8,
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	if(res != VK_SUCCESS) {
+		dlg_error("GetQueryPoolResults failed: {}", res);
+		return;
+	}
+
+	auto validBits = dev.queueFamilies[record->record->queueFamily].props.timestampValidBits;
+	auto mask = validBits >= 64u ? u64(-1) : (u64(1u) << validBits) - 1u;
+	auto* cbName = record->record->cbName;
+
+	auto sample = buildProfileSample(cbName ? cbName : "<unnamed>",
+		record->profiled, data, mask, dev.props.limits.timestampPeriod);
+	record->hook->profiler_.addLocked(subm.parent->globalSubmitID,
+		IntrusivePtr<CommandRecord>(record->record), std::move(sample));
+}
+
 void CommandHookSubmission::finishAccelStructBuilds() {
 	// Notify all accel struct builds that they have finished.
 	// We are guaranteed by the standard that all accelStructs build
@@ -231,8 +306,7 @@ void CommandHookSubmission::finishAccelStructBuilds() {
 				build.dst->lastValid = build.state;
 			}
 		} else if(auto* copy = std::get_if<CommandHookRecord::AccelStructCopy>(&op); copy) {
-			dlg_assert(copy->dst->pendingState);
-			dlg_assert(copy->state);
+			// copy->state might be null, see activate
 			copy->dst->lastValid = copy->state;
 		}
 	}
@@ -10,6 +10,12 @@ namespace vil {
 struct CommandHookSubmission {
 	CommandHookRecord* record {};
 	CommandDescriptorSnapshot descriptorSnapshot {};
+	// Whether the deferred copies of the record (CommandHookRecord::cowCb)
+	// were submitted with this. When the submission never completes,
+	// they have to be done again.
+	bool pendingCowCopy {};
+	// Whether this was added to CommandHook::pending_ on activation.
+	bool pendingExposed {};
 
 	CommandHookSubmission(CommandHookRecord&, Submission&,
 		CommandDescriptorSnapshot descriptors);
@@ -25,9 +31,11 @@ struct CommandHookSubmission {
 	// Called while device mutex is locked.
 	void finish(Submission&);
 	void transmitTiming();
+	void transmitProfile(Submission&);
 	void transmitIndirect();
 
 	void finishAccelStructBuilds();
+	void removePending();
 };
 
 } // namespace vil
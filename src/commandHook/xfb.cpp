@@ -0,0 +1,187 @@
+#include <commandHook/xfb.hpp>
+#include <pipe.hpp>
+#include <shader.hpp>
+#include <util/util.hpp>
+#include <algorithm>
+
+namespace vil {
+
+XfbSplit xfbSplit(const GraphicsPipeline& pipe) {
+	dlg_assert(pipe.xfbState.load() == XfbVariantState::ready);
+	dlg_assert(pipe.xfbPatch);
+
+	XfbSplit ret;
+	ret.stride = std::max(pipe.xfbPatch->stride, 1u);
+	ret.instances = !pipe.xfbPatch->readsBaseVertexInstance;
+
+	// NOTE: we don't have to care about geometry or tessellation shaders
+	// here, pipelines with those stages don't get an xfb variant.
+	switch(pipe.inputAssemblyState.topology) {
+		case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+			ret.primitiveSize = 1u;
+			ret.maxOutputPerVertex = 1u;
+			break;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+			ret.primitiveSize = 2u;
+			ret.maxOutputPerVertex = 1u;
+			break;
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST:
+			ret.primitiveSize = 3u;
+			ret.maxOutputPerVertex = 1u;
+			break;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+			ret.maxOutputPerVertex = 2u;
+			break;
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP:
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN:
+			ret.maxOutputPerVertex = 3u;
+			break;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST_WITH_ADJACENCY:
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP_WITH_ADJACENCY:
+			ret.maxOutputPerVertex = 1u;
+			break;
+		default:
+			break;
+	}
+
+	// splitting the vertex range would change gl_BaseVertex
+	if(!ret.instances) {
+		ret.primitiveSize = 0u;
+	}
+
+	return ret;
+}
+
+namespace {
+
+u64 ceilDivide64(u64 num, u64 denom) {
+	return (num + denom - 1) / denom;
+}
+
+// Number of captured vertices fitting into a chunk
+u64 chunkVertices(const XfbSplit& split) {
+	return std::max<u64>(maxXfbChunkSize / split.stride, 1u);
+}
+
+// Instances per chunk when whole instances fit into a chunk, zero otherwise
+u64 instancesPerChunk(const XfbSplit& split, u32 vertexCount) {
+	if(!split.maxOutputPerVertex) {
+		return 1u;
+	}
+
+	auto perInstance = u64(vertexCount) * split.maxOutputPerVertex;
+	return chunkVertices(split) / perInstance;
+}
+
+// Vertices per chunk when the vertex range of instances is split
+u64 verticesPerChunk(const XfbSplit& split) {
+	dlg_assert(split.primitiveSize);
+	auto count = chunkVertices(split) / split.primitiveSize;
+	return std::max<u64>(count, 1u) * split.primitiveSize;
+}
+
+} // anon namespace
+
+u32 xfbChunkCount(const XfbSplit& split, u32 vertexCount, u32 instanceCount) {
+	if(vertexCount == 0u || instanceCount == 0u) {
+		return 0u;
+	}
+
+	if(!split.instances) {
+		return 1u;
+	}
+
+	if(auto ipc = instancesPerChunk(split, vertexCount); ipc > 0u) {
+		return u32(ceilDivide64(u64(instanceCount), ipc));
+	}
+
+	if(!split.primitiveSize) {
+		// can't split an instance, capture is truncated
+		return instanceCount;
+	}
+
+	auto perInstance = ceilDivide64(u64(vertexCount), verticesPerChunk(split));
+	return u32(std::min<u64>(perInstance * instanceCount, u32(-1)));
+}
+
+XfbRange xfbChunkRange(const XfbSplit& split, u32 vertexCount,
+		u32 instanceCount, u32 chunk) {
+	dlg_assert(chunk < xfbChunkCount(split, vertexCount, instanceCount));
+
+	XfbRange ret;
+	ret.vertexCount = vertexCount;
+	ret.instanceCount = instanceCount;
+
+	if(!split.instances) {
+		return ret;
+	}
+
+	if(auto ipc = instancesPerChunk(split, vertexCount); ipc > 0u) {
+		auto first = u64(chunk) * ipc;
+		ret.firstInstance = u32(first);
+		ret.instanceCount = u32(std::min<u64>(ipc, instanceCount - first));
+		return ret;
+	}
+
+	ret.instanceCount = 1u;
+	if(!split.primitiveSize) {
+		ret.firstInstance = chunk;
+		return ret;
+	}
+
+	auto vpc = verticesPerChunk(split);
+	auto perInstance = ceilDivide64(u64(vertexCount), vpc);
+	auto first = (chunk % perInstance) * vpc;
+	ret.firstInstance = u32(chunk / perInstance);
+	ret.firstVertex = u32(first);
+	ret.vertexCount = u32(std::min<u64>(vpc, vertexCount - first));
+	return ret;
+}
+
+VkDeviceSize xfbCaptureSize(const XfbSplit& split, const XfbRange& range) {
+	if(!split.maxOutputPerVertex) {
+		return maxXfbChunkSize;
+	}
+
+	auto count = u64(range.vertexCount) * range.instanceCount * split.maxOutputPerVertex;
+	count = std::max<u64>(count, 1u);
+	return std::min<VkDeviceSize>(count * split.stride, maxXfbChunkSize);
+}
+
+std::vector<XfbPart> xfbParts(const XfbRange& chunk, u32 vertexCount,
+		u32 instanceCount) {
+	dlg_assert(chunk.firstInstance + chunk.instanceCount <= instanceCount);
+	dlg_assert(chunk.firstVertex + chunk.vertexCount <= vertexCount);
+
+	// the vertex range is only split for single instances
+	dlg_assert(chunk.instanceCount == 1u ||
+		(chunk.firstVertex == 0u && chunk.vertexCount == vertexCount));
+
+	std::vector<XfbPart> ret;
+	auto add = [&](u32 firstVertex, u32 count, u32 firstInstance,
+			u32 numInstances, bool capture) {
+		if(count == 0u || numInstances == 0u) {
+			return;
+		}
+
+		auto& part = ret.emplace_back();
+		part.range = {firstVertex, count, firstInstance, numInstances};
+		part.capture = capture;
+	};
+
+	auto endVertex = chunk.firstVertex + chunk.vertexCount;
+	auto endInstance = chunk.firstInstance + chunk.instanceCount;
+
+	add(0u, vertexCount, 0u, chunk.firstInstance, false);
+	add(0u, chunk.firstVertex, chunk.firstInstance, 1u, false);
+	add(chunk.firstVertex, chunk.vertexCount,
+		chunk.firstInstance, chunk.instanceCount, true);
+	add(endVertex, vertexCount - endVertex, chunk.firstInstance, 1u, false);
+	add(0u, vertexCount, endInstance, instanceCount - endInstance, false);
+
+	return ret;
+}
+
+} // namespace vil
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <vk/vulkan.h>
+#include <vector>
+
+namespace vil {
+
+// Transform feedback captures of huge draws are split into chunks of at
+// most this size (in bytes). Only a single chunk is captured per hook,
+// see CommandHookOps::xfbChunk. The hooked draw is recorded in multiple
+// parts so that the rendered result stays the same, see docs/own/cow.md.
+constexpr auto maxXfbChunkSize = VkDeviceSize(16 * 1024 * 1024);
+
+// Describes how draws with a given pipeline can be split up.
+struct XfbSplit {
+	u32 stride {}; // xfb stride, size of a captured vertex
+	// Number of vertices per primitive when the vertex range of an
+	// instance can be split (list topologies). Zero otherwise.
+	u32 primitiveSize {};
+	// Upper bound for the number of captured vertices per drawn vertex.
+	// Zero when not known.
+	u32 maxOutputPerVertex {};
+	// Whether the instances of a draw can be captured separately.
+	// False when the shader reads gl_BaseVertex or gl_BaseInstance.
+	bool instances {};
+};
+
+// The xfb variant of the pipeline must be ready, see requestXfbVariant.
+XfbSplit xfbSplit(const GraphicsPipeline&);
+
+// Part of a single draw. Relative to the first vertex (or index) and
+// first instance of the draw.
+struct XfbRange {
+	u32 firstVertex {};
+	u32 vertexCount {};
+	u32 firstInstance {};
+	u32 instanceCount {};
+};
+
+// A part of a draw, see xfbParts.
+struct XfbPart {
+	XfbRange range;
+	bool capture {}; // whether this is the captured chunk
+};
+
+// Returns the number of chunks a draw with the given vertex (or index)
+// and instance count is split into. Zero for empty draws.
+u32 xfbChunkCount(const XfbSplit&, u32 vertexCount, u32 instanceCount);
+
+// Returns the range of the given chunk. 'chunk' must be smaller than
+// xfbChunkCount for the same parameters.
+XfbRange xfbChunkRange(const XfbSplit&, u32 vertexCount, u32 instanceCount, u32 chunk);
+
+// Returns an upper bound for the size (in bytes) needed to capture the
+// given range. Never larger than maxXfbChunkSize.
+VkDeviceSize xfbCaptureSize(const XfbSplit&, const XfbRange&);
+
+// Returns the parts a draw has to be recorded as (in this order) when only
+// 'chunk' should be captured. Drawing all parts gives the same result as the
+// original draw: instances and vertices are drawn in the original order and
+// gl_VertexIndex, gl_InstanceIndex stay the same.
+std::vector<XfbPart> xfbParts(const XfbRange& chunk, u32 vertexCount, u32 instanceCount);
+
+} // namespace vil
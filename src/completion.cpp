@@ -0,0 +1,184 @@
+#include <completion.hpp>
+#include <device.hpp>
+#include <queue.hpp>
+#include <util/profiling.hpp>
+#include <vkutil/enumString.hpp>
+#include <algorithm>
+#include <chrono>
+
+namespace vil {
+
+// Timeout for a single wait. We need it to pick up new submissions
+// (potentially on other queues) and to react to shutdown.
+constexpr auto waitTimeout = std::chrono::milliseconds(10);
+
+// Interval in which submissions that only have an application fence
+// are polled when we don't have timeline semaphores.
+constexpr auto pollInterval = std::chrono::milliseconds(1);
+
+CompletionThread::CompletionThread(Device& xdev) : dev(&xdev) {
+	thread_ = std::thread([this]{ threadMain(); });
+}
+
+CompletionThread::~CompletionThread() {
+	{
+		std::lock_guard lock(mutex_);
+		run_.store(false);
+	}
+
+	cv_.notify_one();
+	if(thread_.joinable()) {
+		thread_.join();
+	}
+
+	dlg_assert(!waitingFence);
+	dlg_assert(deferredFences.empty());
+}
+
+void CompletionThread::notify() {
+	{
+		std::lock_guard lock(mutex_);
+		notified_ = true;
+	}
+
+	cv_.notify_one();
+}
+
+void CompletionThread::threadMain() {
+	while(run_.load()) {
+		auto waited = dev->timelineSemaphores ? waitTimeline() : waitFence();
+		if(waited) {
+			continue;
+		}
+
+		// no pending submissions, wait for new ones.
+		// Still wake up from time to time, submissions might be
+		// pending without a notification (e.g. when they weren't active yet).
+		std::unique_lock lock(mutex_);
+		cv_.wait_for(lock, waitTimeout, [&]{ return notified_ || !run_.load(); });
+		notified_ = false;
+	}
+}
+
+bool CompletionThread::waitTimeline() {
+	ZoneScoped;
+
+	std::vector<VkSemaphore> semaphores;
+	std::vector<u64> values;
+
+	{
+		std::lock_guard lock(dev->mutex);
+		checkPendingSubmissionsLocked(*dev);
+
+		// Wait for the first pending batch on each queue.
+		// Submissions on a queue complete in order.
+		for(auto& batch : dev->pending) {
+			auto active = true;
+			for(auto& subm : batch->submissions) {
+				active &= subm.active;
+			}
+
+			if(!active || batch->submissions.empty()) {
+				continue;
+			}
+
+			auto sem = batch->queue->submissionSemaphore;
+			if(std::find(semaphores.begin(), semaphores.end(), sem) != semaphores.end()) {
+				continue;
+			}
+
+			semaphores.push_back(sem);
+			values.push_back(batch->submissions.back().queueSubmitID);
+		}
+
+		if(semaphores.empty()) {
+			return false;
+		}
+	}
+
+	VkSemaphoreWaitInfo waitInfo {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.flags = VK_SEMAPHORE_WAIT_ANY_BIT;
+	waitInfo.semaphoreCount = u32(semaphores.size());
+	waitInfo.pSemaphores = semaphores.data();
+	waitInfo.pValues = values.data();
+
+	auto timeout = std::chrono::nanoseconds(waitTimeout).count();
+	auto res = dev->dispatch.WaitSemaphores(dev->handle, &waitInfo, u64(timeout));
+	if(res != VK_SUCCESS && res != VK_TIMEOUT) {
+		// device loss is handled by checkLocked
+		dlg_warn("vkWaitSemaphores: {} ({})", vk::name(res), res);
+		std::this_thread::sleep_for(pollInterval);
+		return true;
+	}
+
+	if(res == VK_SUCCESS) {
+		std::lock_guard lock(dev->mutex);
+		auto count = dev->pending.size();
+		checkPendingSubmissionsLocked(*dev);
+
+		// The fence signal operation might not have completed yet.
+		if(count == dev->pending.size()) {
+			std::this_thread::yield();
+		}
+	}
+
+	return true;
+}
+
+bool CompletionThread::waitFence() {
+	ZoneScoped;
+
+	VkFence fence {};
+
+	{
+		std::lock_guard lock(dev->mutex);
+		checkPendingSubmissionsLocked(*dev);
+
+		if(dev->pending.empty()) {
+			return false;
+		}
+
+		for(auto& batch : dev->pending) {
+			if(batch->ourFence) {
+				fence = batch->ourFence;
+				break;
+			}
+		}
+
+		waitingFence = fence;
+	}
+
+	if(!fence) {
+		// only application fences, we have to poll
+		std::this_thread::sleep_for(pollInterval);
+		return true;
+	}
+
+	auto timeout = std::chrono::nanoseconds(waitTimeout).count();
+	auto res = dev->dispatch.WaitForFences(dev->handle, 1u, &fence, true, u64(timeout));
+	if(res != VK_SUCCESS && res != VK_TIMEOUT) {
+		// device loss is handled by checkLocked
+		dlg_warn("vkWaitForFences: {} ({})", vk::name(res), res);
+	}
+
+	{
+		std::lock_guard lock(dev->mutex);
+		waitingFence = {};
+
+		// return the fences that were finished while we waited on them
+		if(!deferredFences.empty()) {
+			dev->dispatch.ResetFences(dev->handle,
+				u32(deferredFences.size()), deferredFences.data());
+			dev->fencePool.insert(dev->fencePool.end(),
+				deferredFences.begin(), deferredFences.end());
+			deferredFences.clear();
+		}
+
+		checkPendingSubmissionsLocked(*dev);
+	}
+
+	return true;
+}
+
+} // namespace vil
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <vk/vulkan.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+namespace vil {
+
+// Optional background thread that waits for pending submissions to
+// complete and then processes them (see checkLocked), including the
+// completion of hooked submissions. Without it, pending submissions
+// are only polled from within application calls, e.g. on every submission.
+// With timeline semaphores, blocks on the per-queue submission semaphores.
+// Otherwise blocks on the fences we added from the fence pool. Submissions
+// that only have an application fence are polled in that case since
+// waiting on the fence outside of the device mutex isn't safe (the
+// application might destroy it).
+// Enabled via VIL_COMPLETION_THREAD, see docs/env.md.
+struct CompletionThread {
+	Device* dev {};
+
+	// The pool fence the thread is currently waiting on. Synced via dev.mutex.
+	// When a submission using this fence is finished by another thread
+	// in the meantime, the fence must not be reset or returned to the
+	// pool, it is added to 'deferredFences' instead.
+	VkFence waitingFence {};
+	std::vector<VkFence> deferredFences;
+
+	CompletionThread(Device& dev);
+	~CompletionThread(); // stops and joins the thread
+
+	// Signals the thread that new submissions were added.
+	void notify();
+
+private:
+	std::thread thread_;
+	std::atomic<bool> run_ {true};
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool notified_ {}; // synced via mutex_
+
+	void threadMain();
+
+	// They return false when there is nothing to wait for.
+	bool waitTimeline();
+	bool waitFence();
+};
+
+} // namespace vil
@@ -2,7 +2,7 @@
 
 namespace vil {
 
-std::unordered_map<std::uint64_t, void*> dispatchableTable;
+HandleTable dispatchableTable;
 std::unordered_map<void*, Device*> devByLoaderTable;
 std::shared_mutex dataMutex;
 
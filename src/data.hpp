@@ -2,57 +2,52 @@
 
 #include <fwd.hpp>
 #include <util/handleCast.hpp>
+#include <util/handleTable.hpp>
 #include <util/dlg.hpp>
 #include <vk/vulkan.h>
 #include <cstring>
 #include <mutex>
 #include <unordered_map>
 #include <shared_mutex>
+#include <type_traits>
 
 namespace vil {
 
-// PERF(low prio): use small buffer optimization for those (especially
-//   devices & instances, optimizing for the common case of just one
-//   instance/device here would likely reduce the overhead quite a bit).
-//   Look into using the vk_layer small-buffer hashtable implementation
-
-// Table of all dispatchable handles (instance, device, phdev, queue, cb)
-extern std::unordered_map<std::uint64_t, void*> dispatchableTable;
+// Table of all dispatchable handles (instance, device, phdev, queue, cb).
+// Looked up in almost every api call, lookups don't take a lock.
+// The most recently created device is stored as hot entry since
+// applications usually only have one device.
+extern HandleTable dispatchableTable;
 // Table of device loaders (the first word in any VkDevice handle, no matter
 // where/how it is wrapped). This allows us in our public API implementation
 // to recognize VkDevice handles directly coming from the device (we can't
 // just use the dispatchableTable directly for that since it might
 // be wrapped by other layers).
 extern std::unordered_map<void*, Device*> devByLoaderTable;
-// Synchronizes access to those global tables
+// Synchronizes access to devByLoaderTable
 extern std::shared_mutex dataMutex;
 
 template<typename T>
 void* findData(T handle) {
-	std::shared_lock lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	return it == dispatchableTable.end() ? nullptr : it->second;
+	return dispatchableTable.find(handleToU64(handle));
 }
 
 template<typename R, typename T>
 R* findData(T handle) {
-	std::shared_lock lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	return static_cast<R*>(it == dispatchableTable.end() ? nullptr : it->second);
+	return static_cast<R*>(dispatchableTable.find(handleToU64(handle)));
 }
 
 template<typename R, typename T>
 R& getData(T handle) {
-	std::shared_lock lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	dlg_assert(it != dispatchableTable.end());
-	return *static_cast<R*>(it->second);
+	auto* data = dispatchableTable.find(handleToU64(handle));
+	dlg_assert(data);
+	return *static_cast<R*>(data);
 }
 
 template<typename T>
 void insertData(T handle, void* data) {
-	std::lock_guard lock(dataMutex);
-	auto [_, success] = dispatchableTable.emplace(handleToU64(handle), data);
+	constexpr auto hot = std::is_same_v<T, VkDevice>;
+	auto success = dispatchableTable.insert(handleToU64(handle), data, hot);
 	dlg_assert(success);
 }
 
@@ -65,26 +60,14 @@ R& createData(T handle, Args&&... args) {
 
 template<typename T>
 void eraseData(T handle) {
-	std::lock_guard lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	if(it == dispatchableTable.end()) {
+	if(!dispatchableTable.erase(handleToU64(handle))) {
 		dlg_error("Couldn't find data for {} ({})", handleToU64(handle), typeid(T).name());
-		return;
 	}
-
-	dispatchableTable.erase(it);
 }
 
 template<typename R, typename T>
 std::unique_ptr<R> moveDataOpt(T handle) {
-	std::lock_guard lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	if(it == dispatchableTable.end()) {
-		return nullptr;
-	}
-
-	auto ptr = it->second;
-	dispatchableTable.erase(it);
+	auto ptr = dispatchableTable.erase(handleToU64(handle));
 	return std::unique_ptr<R>(static_cast<R*>(ptr));
 }
 
@@ -115,12 +98,14 @@ inline void storeDeviceByLoader(VkDevice vkDev, Device* dev) {
 	dlg_assert(success);
 }
 
-inline void eraseDeviceFromLoaderMap(VkDevice vkDev) {
+// Returns whether it was the last device.
+inline bool eraseDeviceFromLoaderMap(VkDevice vkDev) {
 	void* table;
 	std::memcpy(&table, reinterpret_cast<void*>(vkDev), sizeof(table));
 	std::lock_guard lock(dataMutex);
 	auto count = devByLoaderTable.erase(table);
 	dlg_assert(count == 1u);
+	return devByLoaderTable.empty();
 }
 
 inline void eraseDeviceFromLoaderMap(Device& dev) {
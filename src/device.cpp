@@ -17,8 +17,14 @@
 #include <threadContext.hpp>
 #include <fault.hpp>
 #include <util/util.hpp>
+#include <util/captureHeap.hpp>
+#include <util/slab.hpp>
 #include <gui/gui.hpp>
 #include <commandHook/hook.hpp>
+#include <completion.hpp>
+#include <shader.hpp>
+#include <pipe.hpp>
+#include <xfbCache.hpp>
 #include <vk/dispatch_table_helper.h>
 
 #ifdef VIL_WITH_SWA
@@ -76,6 +82,13 @@ Device::Device() {
 }
 
 Device::~Device() {
+	// Must be stopped first, it accesses the pending submissions
+	completionThread.reset();
+	shaderParseThread.reset();
+	// uses the pipeline cache of xfbCache
+	xfbPipelineThread.reset();
+	xfbCache.reset();
+
 	// Vulkan spec requires that all pending submissions have finished.
 	while(!pending.empty()) {
 		// We don't have to lock the mutex at checkLocked here since
@@ -124,6 +137,7 @@ Device::~Device() {
 	window.reset();
 	gui_.reset();
 	commandHook.reset();
+	captureHeap.reset();
 
 	for(auto& fence : fencePool) {
 		dispatch.DestroyFence(handle, fence, nullptr);
@@ -793,6 +807,8 @@ VkResult doCreateDevice(
 	dev.nonSolidFill = pEnabledFeatures10->fillModeNonSolid;
 	dev.shaderStorageImageWriteWithoutFormat = pEnabledFeatures10->shaderStorageImageWriteWithoutFormat;
 	dev.extDeviceFault = hasDeviceFault;
+	dev.lazyTracking = checkEnvBinary("VIL_LAZY_TRACKING", false);
+	dev.dedupRecords = checkEnvBinary("VIL_DEDUP_RECORDS", true);
 
 	if(hasAddressBindingReport) {
 		dev.addressMap = std::make_unique<DeviceAddressMap>();
@@ -1098,6 +1114,8 @@ VkResult doCreateDevice(
 		}
 	}
 
+	dev.captureHeap = std::make_unique<CaptureHeap>(dev);
+
 	// init static samplers
 	VkSamplerCreateInfo sci {};
 	sci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -1142,6 +1160,22 @@ VkResult doCreateDevice(
 	// init command hook
 	dev.commandHook = std::make_unique<CommandHook>(dev);
 
+	if(checkEnvBinary("VIL_COMPLETION_THREAD", false)) {
+		dev.completionThread = std::make_unique<CompletionThread>(dev);
+	}
+
+	if(checkEnvBinary("VIL_SHADER_PARSE_THREAD", true)) {
+		dev.shaderParseThread = std::make_unique<ShaderParseThread>();
+	}
+
+	if(dev.transformFeedback && checkEnvBinary("VIL_XFB_CACHE", true)) {
+		dev.xfbCache = std::make_unique<XfbCache>(dev);
+	}
+
+	if(dev.transformFeedback) {
+		dev.xfbPipelineThread = std::make_unique<XfbPipelineThread>(dev);
+	}
+
 #ifdef VIL_WITH_SWA
 	if(window) {
 		dlg_assert(window->presentQueue);
@@ -1190,10 +1224,18 @@ VKAPI_ATTR void VKAPI_CALL DestroyDevice(
 		devd.reset();
 	}
 
-	eraseDeviceFromLoaderMap(handle);
+	auto lastDevice = eraseDeviceFromLoaderMap(handle);
 
 	dlg_assertm(DebugStats::get().aliveRecords == 0u,
 		"{}", DebugStats::get().aliveRecords);
+
+	// Give the cached blocks and unused slabs back to the system. Only when
+	// no device is left, other devices would likely just allocate them again.
+	if(lastDevice) {
+		LinBlockPool::get().trim();
+		SlabPool::trimAll();
+	}
+
 	pfnDestroyDev(handle, alloc);
 }
 
@@ -106,6 +106,17 @@ struct Device {
 	std::atomic<bool> doFullSync {};
 	std::atomic<bool> captureCmdStack {};
 
+	// Lazy tracking mode, see docs/own/lazyTracking.md.
+	// While set, command buffers only build minimal (dormant) records,
+	// see CommandRecord::dormant. Is unset as soon as a gui is shown or
+	// a local capture is requested, full tracking then starts with the
+	// next BeginCommandBuffer.
+	std::atomic<bool> lazyTracking {};
+	// Whether re-recorded command buffers identical to their previous
+	// record should keep using the previous record (and its hook records)
+	// instead of the new one. See CommandBuffer::doEnd.
+	bool dedupRecords {};
+
 	// Aside from properties, only the families used by device
 	// are initialized.
 	std::vector<QueueFamily> queueFamilies;
@@ -141,6 +152,22 @@ struct Device {
 
 	// Always valid, initialized on device creation.
 	std::unique_ptr<CommandHook> commandHook {};
+	// Always valid, initialized on device creation.
+	// Memory for the copies of command hooks.
+	std::unique_ptr<CaptureHeap> captureHeap {};
+
+	// Optional, processes completed submissions in the background.
+	// See CompletionThread.
+	std::unique_ptr<CompletionThread> completionThread {};
+	// Optional, parses new shader modules in the background.
+	// See ShaderParseThread.
+	std::unique_ptr<ShaderParseThread> shaderParseThread {};
+	// Optional, only when transform feedback is used.
+	// Persistent cache of xfb-patched shaders, see XfbCache.
+	std::unique_ptr<XfbCache> xfbCache {};
+	// Only when transform feedback is used.
+	// Creates the xfb variants of pipelines, see XfbPipelineThread.
+	std::unique_ptr<XfbPipelineThread> xfbPipelineThread {};
 
 	std::vector<VkFence> fencePool; // currently unused fences
 
@@ -167,6 +194,22 @@ struct Device {
 	// *not* on per-queue basis.
 	vilDefMutex(queueMutex);
 
+	// Orders application submissions with each other and with gui
+	// submissions. Held from the point a submission is tracked
+	// (getting its queueSubmitID, adding sync) until it was submitted to
+	// the driver and inserted into 'pending'. This allows to not hold the
+	// general mutex during the driver call while the submission order
+	// (and therefore timeline semaphore values) stays consistent
+	// with our tracking.
+	// Lock order: submissionMutex, then mutex, then queueMutex.
+	vilDefMutex(submissionMutex);
+
+	// Synchronizes allocations from and frees to 'dsPool'. Hooked
+	// command buffers are recorded without the general mutex locked,
+	// see CommandHook::hook.
+	// No other mutex may be locked while holding it.
+	vilDefMutex(dsPoolMutex);
+
 	// === VkBufferAddress lookup ===
 	// In various places we need the buffer belonging to a given buffer address.
 	// This data structure allows efficient insert, deletion and lookup.
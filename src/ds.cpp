@@ -877,6 +877,18 @@ bool needsDynamicOffset(VkDescriptorType type) {
 	}
 }
 
+bool isWritable(VkDescriptorType type) {
+	switch(type) {
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+		case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+			return true;
+		default:
+			return false;
+	}
+}
+
 // dsLayout
 VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorSetLayout(
 		VkDevice                                    device,
@@ -954,6 +966,10 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorSetLayout(
 		dst.stageFlags = bind.stageFlags;
 		dst.flags = flagsInfo ? flagsInfo->pBindingFlags[i] : 0u;
 
+		if(isWritable(bind.descriptorType) && dst.descriptorCount > 0) {
+			dsLayout.writableBindings = true;
+		}
+
 		if(needsSampler(bind.descriptorType) && dst.descriptorCount > 0 &&
 				bind.pImmutableSamplers) {
 			// Couldn't find in the spec whether this is allowed or not.
@@ -1944,9 +1960,15 @@ std::pair<DescriptorStateRef, std::unique_lock<DebugMutex>> access(DescriptorSet
 	return {DescriptorStateRef(*cow.ds), std::move(cowLock)};
 }
 
-bool hasBound(DescriptorStateRef state, const Handle& handle) {
+static bool hasBoundImpl(DescriptorStateRef state, const Handle& handle,
+		bool onlyWritable) {
 	for(auto i = 0u; i < state.layout->bindings.size(); ++i) {
-		switch(category(state.layout->bindings[i].descriptorType)) {
+		auto type = state.layout->bindings[i].descriptorType;
+		if(onlyWritable && !isWritable(type)) {
+			continue;
+		}
+
+		switch(category(type)) {
 			case DescriptorCategory::accelStruct:
 				for(auto& accelStruct : accelStructs(state, i)) {
 					if(accelStruct.accelStruct == &handle) {
@@ -1987,6 +2009,18 @@ bool hasBound(DescriptorStateRef state, const Handle& handle) {
 	return false;
 }
 
+bool hasBound(DescriptorStateRef state, const Handle& handle) {
+	return hasBoundImpl(state, handle, false);
+}
+
+bool hasBoundWritable(DescriptorStateRef state, const Handle& handle) {
+	if(!state.layout->writableBindings) {
+		return false;
+	}
+
+	return hasBoundImpl(state, handle, true);
+}
+
 // only implemented for sampler unwrapping
 VKAPI_ATTR void VKAPI_CALL GetDescriptorSetLayoutSupport(
 		VkDevice                                    device,
@@ -37,6 +37,9 @@ bool needsBoundSampler(const DescriptorSetLayout&, unsigned binding);
 bool needsImageView(VkDescriptorType);
 bool needsImageLayout(VkDescriptorType);
 bool needsDynamicOffset(VkDescriptorType);
+// Returns whether shaders can write the resources referenced by
+// descriptors of the given type (i.e. storage descriptors).
+bool isWritable(VkDescriptorType);
 
 struct DescriptorPoolSetEntry {
 	// NOTE: could compute offset, size from the referenced set.
@@ -126,6 +129,11 @@ struct DescriptorSetLayout : SharedDeviceHandle {
 	// to initialize.
 	bool immutableSamplers {};
 
+	// Whether any bindings have a writable descriptor type, see isWritable.
+	// Allows to quickly skip read-only descriptor sets when checking
+	// what a submission potentially writes.
+	bool writableBindings {};
+
 	// handle will be kept alive until this object is actually destroyed.
 	~DescriptorSetLayout();
 };
@@ -215,6 +223,8 @@ span<std::byte> inlineUniformBlock(DescriptorStateRef, unsigned binding);
 // For Buffers and Images, also returns true when one of their bufferViews/
 // imageViews is bound.
 bool hasBound(DescriptorStateRef, const Handle& handle);
+// Like hasBound but only considers bindings with writable descriptor types.
+bool hasBoundWritable(DescriptorStateRef, const Handle& handle);
 
 struct DescriptorStateCopy {
 	struct Deleter {
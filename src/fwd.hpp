@@ -66,6 +66,7 @@ struct Queue;
 struct QueueFamily;
 struct Submission;
 struct SubmissionBatch;
+struct SubmittedCommandBuffer;
 struct CommandHook;
 struct CommandHookSubmission;
 struct CommandHookRecord;
@@ -116,6 +117,11 @@ using CommandCategoryFlags = nytl::Flags<CommandCategory>;
 enum class SubmissionType : u8;
 
 struct DisplayWindow;
+struct CompletionThread;
+struct ShaderParseThread;
+struct XfbCache;
+struct XfbPipelineThread;
+struct CaptureHeap;
 struct Platform;
 struct Overlay;
 struct Draw;
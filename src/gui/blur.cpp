@@ -119,6 +119,7 @@ void destroyBuffers(GuiBlur& blur, VkDescriptorPool dsPool) {
 	}
 
 	auto& dev = *blur.dev;
+	std::lock_guard lock(dev.dsPoolMutex);
 	dev.dispatch.FreeDescriptorSets(dev.handle, dsPool, 2u, blur.steps.data());
 	blur.steps = {};
 
@@ -219,7 +220,10 @@ void resize(GuiBlur& blur, VkExtent2D size, VkSwapchainKHR swapchain,
 	dai.descriptorSetCount = sets.size();
 	dai.pSetLayouts = layouts.data();
 	dai.descriptorPool = dsPool;
-	VK_CHECK(dev.dispatch.AllocateDescriptorSets(dev.handle, &dai, sets.data()));
+	{
+		std::lock_guard lock(dev.dsPoolMutex);
+		VK_CHECK(dev.dispatch.AllocateDescriptorSets(dev.handle, &dai, sets.data()));
+	}
 
 	ivi.format = swapchainFormat;
 	ivi.subresourceRange.baseArrayLayer = 0u;
@@ -430,6 +430,11 @@ void CommandRecordGui::drawSelected(Draw& draw) {
 			imGuiText("num compute pipes: {}", rec->used.computePipes.size());
 			imGuiText("num rt pipes: {}", rec->used.rtPipes.size());
 			imGuiText("builds accel structs: {}", rec->buildsAccelStructs);
+			imGuiText("dormant: {}", rec->dormant);
+			if(rec->dormant && ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Recorded in lazy tracking mode, before the gui was "
+					"opened.\nDoes not contain all commands.");
+			}
 			break;
 		} case SelectionType::command:
 			commandViewer_.draw(draw, actionFullscreen_);
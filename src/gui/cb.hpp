@@ -116,7 +116,7 @@ private:
 	bool showSingleSections_ {};
 	UpdateTicker updateTick_ {};
 
-	LinAllocator matchAlloc_;
+	LinAllocator matchAlloc_ {&LinBlockPool::get()};
 	CommandSelection selector_;
 
 	// TODO WIP experiments
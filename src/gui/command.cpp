@@ -179,6 +179,16 @@ void CommandViewer::updateFromSelector(bool forceUpdateHook) {
 			break;
 	}
 
+	// Parse the shaders before anything in the gui accesses them.
+	// Might take a while, we must not do it while the device mutex
+	// is locked, as it might be in some places accessing the shaders.
+	if(stateCmd && stateCmd->boundPipe()) {
+		assertNotOwned(gui_->dev().mutex);
+		for(auto& stage : stages(*stateCmd->boundPipe())) {
+			(void) stage.spirv->compiled();
+		}
+	}
+
 	auto selectCommandView = false;
 
 	// update view_, only keep it if it still makes sense
@@ -305,7 +315,7 @@ void CommandViewer::updateFromSelector(bool forceUpdateHook) {
 				}
 
 				// don't need to respect specialization constants.
-				auto& mod = *stage.spirv->compiled;
+				auto& mod = stage.spirv->compiled();
 				if(!mod.get_shader_resources().push_constant_buffers.empty()) {
 					selectCommandView = false;
 				}
@@ -543,7 +553,7 @@ void CommandViewer::displayDsList() {
 					for(auto i = 0u; i < sstages.size(); ++i) {
 						auto& stage = sstages[i];
 						// don't need to respect specialization constants.
-						auto& mod = *stage.spirv->compiled;
+						auto& mod = stage.spirv->compiled();
 						auto name = bindingName(mod, setID, bID);
 						if(name.type == BindingNameRes::Type::valid) {
 							stageNames[i] = std::move(name.name);
@@ -774,7 +784,7 @@ void CommandViewer::displayIOList() {
 		auto sstages = stages(*stateCmd->boundPipe());
 		for(auto& stage : sstages) {
 			// specialization constants not relevant here
-			auto& compiled = *stage.spirv->compiled;
+			auto& compiled = stage.spirv->compiled();
 			if(compiled.get_shader_resources().push_constant_buffers.empty()) {
 				continue;
 			}
@@ -891,7 +901,10 @@ void CommandViewer::displayDs(Draw& draw) {
 	//   for the descriptor types that need copies since we want to support
 	//   local captures (that might have more data)
 	const CommandHookState::CopiedDescriptor* copiedData {};
-	auto hookState = selection().completedHookState();
+	// Image contents can be shown from a still pending submission
+	auto hookState = dsCat == DescriptorCategory::image ?
+		selection().imageHookState() :
+		selection().completedHookState();
 	if(hookState) {
 		copiedData = findDsCopy(*hookState, setID, bindingID, elemID,
 			beforeCommand_, false);
@@ -1129,7 +1142,7 @@ void CommandViewer::displayAttachment(Draw& draw) {
 		// refButtonD(*gui_, attachments[aid]->img);
 	}
 
-	auto hookState = selection().completedHookState();
+	auto hookState = selection().imageHookState();
 	if(hookState) {
 		if(hookState->copiedAttachments.empty()) {
 			dlg_error("copiedAttachments should not be empty");
@@ -1205,6 +1218,10 @@ void CommandViewer::displayTransferData(Draw& draw) {
 		return;
 	}
 
+	// buffers are read on the cpu, images can come from a pending submission
+	auto imgState = selection().imageHookState();
+	dlg_assert(imgState);
+
 	// NOTE: only show where it makes sense?
 	// shouldn't be here for src resources i guess.
 	// But could be useful for debugging anyways
@@ -1238,8 +1255,8 @@ void CommandViewer::displayTransferData(Draw& draw) {
 		} else {
 			static_assert(std::is_convertible_v<decltype(ccmd->dst), const Image*>);
 			refImage = beforeCommand_ ?
-				&hookState->transferDstBefore.img :
-				&hookState->transferDstAfter.img;
+				&imgState->transferDstBefore.img :
+				&imgState->transferDstAfter.img;
 		}
 	};
 
@@ -1262,8 +1279,8 @@ void CommandViewer::displayTransferData(Draw& draw) {
 		} else {
 			static_assert(std::is_convertible_v<decltype(ccmd->src), const Image*>);
 			refImage = beforeCommand_ ?
-				&hookState->transferSrcBefore.img :
-				&hookState->transferSrcAfter.img;
+				&imgState->transferSrcBefore.img :
+				&imgState->transferSrcAfter.img;
 		}
 	};
 
@@ -1354,10 +1371,20 @@ void CommandViewer::displayVertexViewer(Draw& draw) {
 
 		if(ImGui::BeginTabItem("Vertex Output")) {
 			if(!viewData_.mesh.output) {
-				viewData_.mesh.output = true;
+				viewData_.mesh = {true, vertexViewer_.selectedDraw(),
+					vertexViewer_.selectedChunk()};
 				updateHook();
 			} else {
 				vertexViewer_.displayOutput(draw, *drawCmd, *hookState, gui_->dt());
+
+				// capture the newly selected part of the draw
+				auto xfbDraw = vertexViewer_.selectedDraw();
+				auto xfbChunk = vertexViewer_.selectedChunk();
+				if(xfbDraw != viewData_.mesh.xfbDraw || xfbChunk != viewData_.mesh.xfbChunk) {
+					viewData_.mesh.xfbDraw = xfbDraw;
+					viewData_.mesh.xfbChunk = xfbChunk;
+					updateHook();
+				}
 			}
 
 			ImGui::EndTabItem();
@@ -1677,6 +1704,8 @@ void CommandViewer::updateHook() {
 		} case IOView::mesh:
 			if(viewData_.mesh.output) {
 				ops.copyXfb = true;
+				ops.xfbDraw = viewData_.mesh.xfbDraw;
+				ops.xfbChunk = viewData_.mesh.xfbChunk;
 				ops.copyIndirectCmd = indirectCmd;
 			} else {
 				ops.copyVertexBuffers = true;
@@ -1711,7 +1740,7 @@ void CommandViewer::displayImage(Draw& draw, const CopiedImage& img) {
 	dlg_assert(img.aspectMask);
 	dlg_assert(img.image);
 
-	auto hookState = selection().completedHookState();
+	auto hookState = selection().imageHookState();
 	dlg_assert(hookState);
 	draw.usedHookState = hookState;
 
@@ -1748,7 +1777,7 @@ const PipelineShaderStage* CommandViewer::displayDescriptorStageSelector(
 	for(auto i = 0u; i < sstages.size(); ++i) {
 		auto& stage = sstages[i];
 		// Don't need to respect specialization constants here
-		auto res = resource(*stage.spirv->compiled, setID, bindingID, dsType);
+		auto res = resource(stage.spirv->compiled(), setID, bindingID, dsType);
 		if(res) {
 			refStages[stageCount] = i;
 			++stageCount;
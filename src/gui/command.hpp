@@ -114,6 +114,8 @@ private:
 
 		struct {
 			bool output; // vertex input or output
+			u32 xfbDraw; // see CommandHookOps::xfbDraw
+			u32 xfbChunk;
 		} mesh;
 
 		struct {
@@ -16,6 +16,12 @@ CommandSelection::CommandSelection() = default;
 CommandSelection::~CommandSelection() = default;
 
 bool CommandSelection::update() {
+	auto updated = updateCompleted();
+	updatePending();
+	return updated;
+}
+
+bool CommandSelection::updateCompleted() {
 	auto& dev = *dev_;
 	auto& hook = *dev.commandHook;
 	auto completed = hook.moveCompleted();
@@ -176,6 +182,7 @@ bool CommandSelection::update() {
 	}
 
 	state_ = best->state;
+	stateSubmissionID_ = best->submissionID;
 	descriptors_ = best->descriptorSnapshot;
 
 	// update the hook
@@ -191,6 +198,45 @@ bool CommandSelection::update() {
 	return true;
 }
 
+void CommandSelection::updatePending() {
+	auto& hook = *dev_->commandHook;
+
+	// once the pending state (or a newer one) completed, we use that
+	if(pendingSubmissionID_ <= stateSubmissionID_) {
+		pendingState_ = {};
+		pendingSubmissionID_ = 0u;
+	}
+
+	// Local captures are never pending. Frozen state must not change.
+	if(mode_ == UpdateMode::localCapture || !state_ ||
+			hook.freeze.load() || freezeState) {
+		pendingState_ = {};
+		pendingSubmissionID_ = 0u;
+		return;
+	}
+
+	auto pending = hook.pendingHooks();
+	const PendingHook* best = nullptr;
+	for(auto& res : pending) {
+		if(res.submissionID <= std::max(stateSubmissionID_, pendingSubmissionID_)) {
+			continue;
+		}
+
+		if(res.match <= 0.f || (best && res.match < best->match)) {
+			continue;
+		}
+
+		best = &res;
+	}
+
+	if(!best) {
+		return;
+	}
+
+	pendingState_ = best->state;
+	pendingSubmissionID_ = best->submissionID;
+}
+
 void CommandSelection::select(IntrusivePtr<CommandRecord> record,
 		std::vector<const Command*> cmd) {
 	unselect();
@@ -305,6 +351,9 @@ void CommandSelection::unselect() {
 
 	cb_ = {};
 	state_ = {};
+	stateSubmissionID_ = 0u;
+	pendingState_ = {};
+	pendingSubmissionID_ = 0u;
 	frame_ = {};
 	record_ = {};
 	command_ = {};
@@ -383,6 +432,8 @@ CommandSelection::SelectionType CommandSelection::selectionType() const {
 
 void CommandSelection::clearState() {
 	state_.reset();
+	pendingState_.reset();
+	pendingSubmissionID_ = 0u;
 }
 
 } // namespace vil
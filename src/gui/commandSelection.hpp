@@ -84,6 +84,15 @@ public:
 	UpdateMode updateMode() const { return mode_; }
 	SelectionType selectionType() const;
 	IntrusivePtr<CommandHookState> completedHookState() const { return state_; }
+	// The most recent state that can be used for image captures.
+	// Might belong to a hooked submission that hasn't completed yet,
+	// gui draws using it must set it as Draw::usedHookState so they
+	// are chained to that submission. Must not be used for buffer
+	// captures (or anything else read on the cpu), use
+	// completedHookState for that.
+	IntrusivePtr<CommandHookState> imageHookState() const {
+		return pendingState_ ? pendingState_ : state_;
+	}
 
 	// Returns null when selectType is not 'command'
 	span<const Command* const> command() const { return command_; }
@@ -106,12 +115,19 @@ public:
 
 private:
 	void updateHookTarget();
+	bool updateCompleted();
+	void updatePending();
 
 private:
 	Device* dev_ {};
 
 	UpdateMode mode_ {};
 	IntrusivePtr<CommandHookState> state_; // the last received state
+	u64 stateSubmissionID_ {}; // global submission id of state_
+	// state of a more recent, still pending, hooked submission.
+	// See imageHookState.
+	IntrusivePtr<CommandHookState> pendingState_;
+	u64 pendingSubmissionID_ {};
 	CommandDescriptorSnapshot descriptors_; // last snapshotted descriptors
 
 	// The currently selected record.
@@ -134,7 +150,7 @@ private:
 
 	const LocalCapture* localCapture_ {};
 
-	LinAllocator matchAlloc_;
+	LinAllocator matchAlloc_ {&LinBlockPool::get()};
 };
 
 } // namespace vil
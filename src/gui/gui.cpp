@@ -27,6 +27,7 @@
 #include <nytl/bytes.hpp>
 #include <nytl/vecOps.hpp>
 #include <util/profiling.hpp>
+#include <util/slab.hpp>
 #include <imgio/file.hpp>
 
 #include <vil_api.h>
@@ -1060,6 +1061,8 @@ void Gui::drawOverviewUI(Draw& draw) {
 			ImGui::PopStyleColor();
 			ImGui::PopStyleColor();
 		}
+
+		drawFrameProfileUI();
 	}
 
 	// pretty much just own debug stuff
@@ -1068,6 +1071,7 @@ void Gui::drawOverviewUI(Draw& draw) {
 	if(checkEnvBinary("VIL_DEBUG", true)) {
 		auto& stats = DebugStats::get();
 		imGuiText("alive records: {}", stats.aliveRecords);
+		imGuiText("deduplicated records: {}", stats.dedupedRecords);
 		imGuiText("alive descriptor sets: {}", stats.aliveDescriptorSets);
 		imGuiText("alive descriptor copies: {}", stats.aliveDescriptorCopies);
 		imGuiText("alive buffers: {}", stats.aliveBuffers);
@@ -1076,10 +1080,23 @@ void Gui::drawOverviewUI(Draw& draw) {
 		imGuiText("command memory: {} MB", stats.commandMem / (1024.f * 1024.f));
 		imGuiText("ds copy memory: {} MB", stats.descriptorCopyMem / (1024.f * 1024.f));
 		imGuiText("ds pool memory: {} MB", stats.descriptorPoolMem / (1024.f * 1024.f));
+		imGuiText("pooled block memory: {} MB", stats.linBlockPoolMem / (1024.f * 1024.f));
+		imGuiText("slab memory: {} MB", stats.slabMem / (1024.f * 1024.f));
+
+		u64 slabHandles {};
+		u64 slabNodes {};
+		for(auto& pool : SlabPool::statsAll()) {
+			auto& dst = (pool.kind == SlabPool::Kind::handle) ? slabHandles : slabNodes;
+			dst += pool.numTaken;
+		}
+
+		imGuiText("slab handle objects: {}", slabHandles);
+		imGuiText("slab map nodes: {}", slabNodes);
 		imGuiText("alive hook records: {}", stats.aliveHookRecords);
 		imGuiText("alive hook states: {}", stats.aliveHookStates);
 		imGuiText("layer buffer memory: {} MB", stats.ownBufferMem / (1024.f * 1024.f));
 		imGuiText("layer image memory: {} MB", stats.copiedImageMem / (1024.f * 1024.f));
+		imGuiText("capture heap memory: {} MB", stats.captureHeapMem / (1024.f * 1024.f));
 		ImGui::Separator();
 		imGuiText("timeline semaphores: {}", dev.timelineSemaphores);
 		imGuiText("transform feedback: {}", dev.transformFeedback);
@@ -1130,6 +1147,11 @@ void Gui::drawOverviewUI(Draw& draw) {
 			dev.commandHook->allowReuse.store(allow);
 		}
 
+		auto allowCows = dev.commandHook->allowCows.load();
+		if(ImGui::Checkbox("Allow copy-on-write captures", &allowCows)) {
+			dev.commandHook->allowCows.store(allowCows);
+		}
+
 		auto hookAccel = dev.commandHook->hookAccelStructBuilds.load();
 		if(ImGui::Checkbox("Hook AccelerationStructures", &hookAccel)) {
 			dev.commandHook->hookAccelStructBuilds.store(hookAccel);
@@ -1137,6 +1159,90 @@ void Gui::drawOverviewUI(Draw& draw) {
 	}
 }
 
+void Gui::drawFrameProfileUI() {
+	auto& hook = *dev().commandHook;
+
+	const char* modeNames[] = {"Off", "Sections", "Sections and commands"};
+	auto mode = int(hook.profileMode());
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 12.f);
+	if(ImGui::Combo("GPU frame profiling", &mode, modeNames, 3)) {
+		hook.profileMode(FrameProfileMode(mode));
+	}
+
+	if(ImGui::IsItemHovered() && showHelp) {
+		ImGui::SetTooltip("Writes timestamps around all sections (and optionally\n"
+			"all draw, dispatch and traceRays commands) of all submitted\n"
+			"command buffers. Has an overhead on the gpu, especially\n"
+			"when timing all commands.");
+	}
+
+	if(FrameProfileMode(mode) == FrameProfileMode::off) {
+		return;
+	}
+
+	ImGui::SameLine();
+	if(ImGui::Button("Reset")) {
+		hook.clearFrameProfile();
+	}
+
+	auto profile = hook.frameProfile();
+	if(profile.stats.count == 0u) {
+		ImGui::Text("Waiting for completed frames...");
+		return;
+	}
+
+	auto flags = ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg;
+	if(!ImGui::BeginTable("Frame profile", 5, flags)) {
+		return;
+	}
+
+	ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_NoHide);
+	ImGui::TableSetupColumn("Last [ms]");
+	ImGui::TableSetupColumn("Min [ms]");
+	ImGui::TableSetupColumn("Avg [ms]");
+	ImGui::TableSetupColumn("P95 [ms]");
+	ImGui::TableHeadersRow();
+
+	// Ids are built from the position in the tree since the nodes
+	// are copied every frame.
+	auto displayNode = [&](auto& self, const ProfileNode& node) -> void {
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+
+		ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_SpanFullWidth;
+		if(node.children.empty()) {
+			nodeFlags |= ImGuiTreeNodeFlags_Leaf |
+				ImGuiTreeNodeFlags_NoTreePushOnOpen;
+		}
+
+		auto open = ImGui::TreeNodeEx(node.name.c_str(), nodeFlags);
+
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", node.stats.last);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", node.stats.min());
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", node.stats.avg());
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", node.stats.p95());
+
+		if(open && !node.children.empty()) {
+			for(auto [i, child] : enumerate(node.children)) {
+				ImGui::PushID(int(i));
+				self(self, child);
+				ImGui::PopID();
+			}
+
+			ImGui::TreePop();
+		}
+	};
+
+	displayNode(displayNode, profile);
+	ImGui::EndTable();
+}
+
 void Gui::drawMemoryUI(Draw&) {
 	// TODO:
 	// - display graphs instead of just the table
@@ -1714,8 +1820,12 @@ VkResult Gui::tryRender(Draw& draw, FrameInfo& info) {
 	// Important we already lock this mutex here since we need to make
 	// sure no new submissions are done by application while we process
 	// and evaluate the pending submissions
-	// NOTE: lock order is important here! First lock device mutex,
-	// later on lock queue mutex, that's how we must always do it.
+	// NOTE: lock order is important here! First lock the submission
+	// mutex, then the device mutex, later on lock queue mutex, that's
+	// how we must always do it.
+	// Application submissions release the device mutex during the driver
+	// call, we need the submission mutex to see a consistent 'pending'.
+	std::lock_guard submissionLock(dev().submissionMutex);
 	std::unique_lock devLock(dev().mutex);
 
 	dlg_assert(currDraw_ == &draw);
@@ -1751,7 +1861,10 @@ VkResult Gui::tryRender(Draw& draw, FrameInfo& info) {
 		VK_CHECK(dev().dispatch.BeginCommandBuffer(draw.cbLockedPre, &cbBegin));
 		VK_CHECK(dev().dispatch.BeginCommandBuffer(draw.cbLockedPost, &cbBegin));
 
-		if(!draw.usedImages.empty() || !draw.usedBuffers.empty()) {
+		// The hook state might be from a pending submission on this queue,
+		// see CommandSelection::imageHookState
+		if(!draw.usedImages.empty() || !draw.usedBuffers.empty() ||
+				draw.usedHookState) {
 			ThreadMemScope tms;
 
 			ScopedVector<VkImageMemoryBarrier> imgBarriersPre(tms);
@@ -2239,6 +2352,23 @@ void Gui::addFullSync(Draw& draw, VkSubmitInfo& submitInfo) {
 			waitSemaphores_.push_back(queue.submissionSemaphore);
 			waitStages_.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 		}
+	} else if(draw.usedHookState) {
+		// Only chain the hooked submission the state belongs to, if
+		// it is still pending. See CommandSelection::imageHookState.
+		for(auto& pending : dev().pending) {
+			if(pending->queue == &usedQueue()) {
+				continue;
+			}
+
+			auto subs = needsSyncLocked(*pending, draw);
+			if(subs.empty()) {
+				continue;
+			}
+
+			waitValues_.push_back(subs.back()->queueSubmitID);
+			waitSemaphores_.push_back(subs.back()->parent->queue->submissionSemaphore);
+			waitStages_.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		}
 	}
 
 	dlg_assert(waitValues_.size() == waitSemaphores_.size());
@@ -2350,7 +2480,10 @@ Queue& Gui::usedQueue() const {
 void Gui::visible(bool newVisible) {
 	visible_ = newVisible;
 
-	if(!newVisible) {
+	if(newVisible) {
+		// Start full tracking with the next recordings.
+		dev().lazyTracking.store(false);
+	} else {
 		auto& hook = *dev().commandHook;
 		hook.freeze.store(true);
 	}
@@ -2435,7 +2568,10 @@ vku::DynDs Gui::allocDs(const vku::DynDsLayout& layout, StringParam name) {
 	dsai.pSetLayouts = &layout.vkHandle();
 
 	VkDescriptorSet ds;
-	VK_CHECK(dev_->dispatch.AllocateDescriptorSets(dev_->handle, &dsai, &ds));
+	{
+		std::lock_guard lock(dev_->dsPoolMutex);
+		VK_CHECK(dev_->dispatch.AllocateDescriptorSets(dev_->handle, &dsai, &ds));
+	}
 
 	auto ret = vku::DynDs(dev_->dsPool, layout, ds);
 
@@ -19,6 +19,10 @@
 #include <shader.hpp>
 #include <ds.hpp>
 #include <numeric>
+#include <atomic>
+#include <optional>
+#include <thread>
+#include <cmath>
 #include <spirv-cross/spirv_cross.hpp>
 #include <spvm/types.h>
 #include <spvm/ext/GLSL450.h>
@@ -37,9 +41,40 @@ span<spvm_member> children(spvm_member& member) {
 	return {member.members, std::size_t(member.member_count)};
 }
 
+struct ShaderDebugger::VarInfo {
+	enum class Kind {
+		unknown,
+		resource,
+		builtin,
+	};
+
+	Kind kind {Kind::unknown};
+	spv::BuiltIn builtin {}; // only for Kind::builtin
+
+	u32 setID {};
+	u32 bindingID {};
+	std::optional<u32> arraySize {}; // for binding arrays
+	spv::StorageClass storage {};
+	spc::SPIRType::BaseType basetype {};
+	u32 baseTypeID {};
+	// For buffers, the (maybe arrayed) type of the variable.
+	// Allocated from ShaderDebugger::varTypeAlloc_.
+	const Type* type {};
+};
+
 ShaderDebugger::ShaderDebugger() = default;
 
 ShaderDebugger::~ShaderDebugger() {
+	{
+		std::lock_guard lock(searchWorkers_.mutex);
+		searchWorkers_.exit = true;
+	}
+
+	searchWorkers_.cv.notify_all();
+	for(auto& thread : searchWorkers_.threads) {
+		thread.join();
+	}
+
 	unselect();
 	if(spvm_.context) {
 		spvm_context_deinitialize(spvm_.context);
@@ -68,7 +103,9 @@ void ShaderDebugger::select(std::unique_ptr<spc::Compiler> compiled) {
 	static_assert(sizeof(spvm_word) == sizeof(u32));
 	auto ptr = reinterpret_cast<const spvm_word*>(compiled_->get_ir().spirv.data());
 	spvm_.program = spvm_program_create(spvm_.context, ptr, compiled_->get_ir().spirv.size());
+	entryPoint_ = compiled_->get_ir().default_entry_point;
 
+	initVarInfos();
 	initState();
 
 	const char* src {};
@@ -84,26 +121,34 @@ void ShaderDebugger::select(std::unique_ptr<spc::Compiler> compiled) {
 }
 
 void ShaderDebugger::initState() {
-	dlg_assert(spvm_.program);
 	dlg_assert(compiled_);
 
-	samplers_.clear();
-	images_.clear();
+	invocation_.self = this;
+	invocation_.samplers.clear();
+	invocation_.images.clear();
+	invocation_.wroteNonFinite = false;
+
+	spvm_.state = createState(invocation_);
+	invocation_.state = spvm_.state;
+}
+
+spvm_state_t ShaderDebugger::createState(Invocation& inv) {
+	dlg_assert(spvm_.program);
 
 	spvm_state_settings settings {};
 	settings.load_variable = [](struct spvm_state* state, unsigned varID,
 			unsigned index_count, const spvm_word* indices, spvm_member_list list,
 			spvm_word typeID) {
-		auto* self = static_cast<ShaderDebugger*>(state->user_data);
-		self->loadVar(varID,
+		auto* inv = static_cast<Invocation*>(state->user_data);
+		inv->self->loadVar(*inv, varID,
 			{indices, std::size_t(index_count)},
 			{list.members, std::size_t(list.member_count)}, typeID);
 	};
 	settings.store_variable = [](struct spvm_state* state, unsigned varID,
 			unsigned index_count, const spvm_word* indices, spvm_member_list list,
 			spvm_word typeID) {
-		auto* self = static_cast<ShaderDebugger*>(state->user_data);
-		self->storeVar(varID,
+		auto* inv = static_cast<Invocation*>(state->user_data);
+		inv->self->storeVar(*inv, varID,
 			{indices, std::size_t(index_count)},
 			{list.members, std::size_t(list.member_count)}, typeID);
 	};
@@ -113,34 +158,37 @@ void ShaderDebugger::initState() {
 		dlg_error("spvm: {}", buf);
 	};
 
-	spvm_.state = spvm_state_create(spvm_.program, settings);
-	spvm_.state->user_data = this;
-	spvm_.state->read_image = [](spvm_state* state, spvm_image* img,
+	auto* state = spvm_state_create(spvm_.program, settings);
+	state->user_data = &inv;
+	state->read_image = [](spvm_state* state, spvm_image* img,
 			int x, int y, int z, int layer, int level) {
-		auto* self = static_cast<ShaderDebugger*>(state->user_data);
-		return self->readImage(*img, x, y, z, layer, level);
+		auto* inv = static_cast<Invocation*>(state->user_data);
+		return inv->self->readImage(*img, x, y, z, layer, level);
 	};
-	spvm_.state->write_image = [](spvm_state* state, spvm_image* img,
+	state->write_image = [](spvm_state* state, spvm_image* img,
 			int x, int y, int z, int layer, int level, const spvm_vec4f* data) {
-		auto* self = static_cast<ShaderDebugger*>(state->user_data);
-		self->writeImage(*img, x, y, z, layer, level, *data);
+		auto* inv = static_cast<Invocation*>(state->user_data);
+		inv->self->writeImage(*inv, *img, x, y, z, layer, level, *data);
 	};
-	spvm_.state->array_length = [](spvm_state* state, unsigned varID,
+	state->array_length = [](spvm_state* state, unsigned varID,
 			unsigned index_count, const spvm_word* indices) {
-		auto* self = static_cast<ShaderDebugger*>(state->user_data);
-		return self->arrayLength(varID, {indices, std::size_t(index_count)});
+		auto* inv = static_cast<Invocation*>(state->user_data);
+		return inv->self->arrayLength(varID, {indices, std::size_t(index_count)});
 	};
 
-	static spvm_analyzer analyzer;
-	analyzer.on_undefined_behavior = [](spvm_state*, spvm_word ub) {
-		// TODO: allow to break on UB.
-		dlg_trace("shader triggered undefined behavior: {}", ub);
-	};
-	spvm_.state->analyzer = &analyzer;
+	static spvm_analyzer analyzer = []{
+		spvm_analyzer ret {};
+		ret.on_undefined_behavior = [](spvm_state*, spvm_word ub) {
+			// TODO: allow to break on UB.
+			dlg_trace("shader triggered undefined behavior: {}", ub);
+		};
+		return ret;
+	}();
+	state->analyzer = &analyzer;
 
 	spvm_word entryPoint = -1;
 	for(auto i = 0; i < spvm_.program->entry_point_count; ++i) {
-		if(u32(spvm_.program->entry_points[i].id) == compiled_->get_ir().default_entry_point) {
+		if(u32(spvm_.program->entry_points[i].id) == entryPoint_) {
 			entryPoint = spvm_.program->entry_points[i].id;
 			break;
 		}
@@ -148,18 +196,22 @@ void ShaderDebugger::initState() {
 
 	// TODO: don't static here
 	static spvm_ext_opcode_func* glslExt = spvm_build_glsl450_ext();
-	spvm_state_set_extension(spvm_.state, "GLSL.std.450", glslExt);
+	spvm_state_set_extension(state, "GLSL.std.450", glslExt);
 
 	dlg_assert(entryPoint != -1);
-	spvm_state_prepare(spvm_.state, entryPoint);
+	spvm_state_prepare(state, entryPoint);
+
+	return state;
 }
 
 void ShaderDebugger::unselect() {
 	currLine_ = {};
 	currFileName_ = {};
 	varIDToDsCopyMap_.clear();
-	samplers_.clear();
-	images_.clear();
+	searchStatus_.clear();
+	invocation_.samplers.clear();
+	invocation_.images.clear();
+	invocation_.state = nullptr;
 
 	if(spvm_.state) {
 		spvm_state_delete(spvm_.state);
@@ -172,6 +224,9 @@ void ShaderDebugger::unselect() {
 	}
 
 	compiled_ = {};
+	entryPoint_ = {};
+	varInfos_.clear();
+	varTypeAlloc_.release();
 	breakpoints_.clear();
 }
 
@@ -189,26 +244,14 @@ void ShaderDebugger::draw() {
 		return;
 	}
 
-	auto isLastReturn = [this](){
-		// TODO: kinda hacky. I guess spvm should have a function
-		// like this? or we should always save the relevant information
-		// before stepping? not sure.
-		spvm_word opcode_data = *spvm_.state->code_current;
-		SpvOp opcode = SpvOp(opcode_data & SpvOpCodeMask);
-
-		if((opcode == SpvOpReturn || opcode == SpvOpReturnValue) &&
-				spvm_.state->function_stack_current == 0) {
-			return true;
-		}
-
-		return false;
-	};
-
 	if(lastHookState_ != hookState.get()) {
 		rerun_ = true;
 		lastHookState_ = hookState.get();
 	}
 
+	invocation_.workgroupSize = workgroupSize();
+	invocation_.numWorkgroups = numWorkgroups();
+
 	if(rerun_) {
 		spvm_state_delete(spvm_.state);
 		initState();
@@ -222,7 +265,7 @@ void ShaderDebugger::draw() {
 					u32(spvm_.state->current_line) != currLine_ ||
 					!spvm_.state->current_file ||
 					spvm_.state->current_file != currFileName_)) {
-			auto doBreak = stepOpcode();
+			auto doBreak = runToLineChange(spvm_.state);
 			if(doBreak) {
 				if(freezeOnBreakPoint_) {
 					freezeOnBreakPoint_ = false;
@@ -284,13 +327,9 @@ void ShaderDebugger::draw() {
 
 		if(ImGui::Button("Run")) {
 			auto doBreak = false;
-			while(spvm_.state->code_current && !doBreak) {
-				// TODO: really do this here? kinda hacky
-				if(isLastReturn()) {
-					break;
-				}
-
-				doBreak = stepOpcode();
+			while(spvm_.state->code_current && !doBreak &&
+					!spvm_state_is_last_return(spvm_.state)) {
+				doBreak = runToLineChange(spvm_.state, true);
 			}
 
 			updatePosition(true);
@@ -395,6 +434,11 @@ void ShaderDebugger::draw() {
 				ImGui::EndTabItem();
 			}
 
+			if(ImGui::BeginTabItem("Search")) {
+				drawSearchTab();
+				ImGui::EndTabItem();
+			}
+
 			ImGui::EndTabBar();
 		}
 	}
@@ -448,7 +492,7 @@ Vec3ui ShaderDebugger::numWorkgroups() const {
 	return numWGs;
 }
 
-void ShaderDebugger::loadBuiltin(const spc::BuiltInResource& builtin,
+void ShaderDebugger::loadBuiltin(Invocation& inv, const VarInfo& builtin,
 		span<const spvm_word> indices, span<spvm_member> dst) {
 	// dlg_trace("spirv OpLoad of builtin {}", builtin.builtin);
 
@@ -474,8 +518,9 @@ void ShaderDebugger::loadBuiltin(const spc::BuiltInResource& builtin,
 		dst[0].value.u = val;
 	};
 
-	auto wgs = workgroupSize();
-	auto numWGs = numWorkgroups();
+	auto& wgs = inv.workgroupSize;
+	auto& numWGs = inv.numWorkgroups;
+	auto& globalInvocationID = inv.globalInvocationID;
 
 	switch(builtin.builtin) {
 		case spv::BuiltInNumSubgroups: {
@@ -494,29 +539,29 @@ void ShaderDebugger::loadBuiltin(const spc::BuiltInResource& builtin,
 		case spv::BuiltInWorkgroupId: {
 			Vec3ui id {0u, 0u, 0u};
 			// floor by design
-			id.x = globalInvocationID_.x / wgs.x;
-			id.y = globalInvocationID_.y / wgs.y;
-			id.z = globalInvocationID_.z / wgs.z;
+			id.x = globalInvocationID.x / wgs.x;
+			id.y = globalInvocationID.y / wgs.y;
+			id.z = globalInvocationID.z / wgs.z;
 			loadVecU(id);
 			break;
 		}
 		case spv::BuiltInGlobalInvocationId: {
-			loadVecU(globalInvocationID_);
+			loadVecU(globalInvocationID);
 			break;
 		}
 		case spv::BuiltInLocalInvocationId: {
 			Vec3ui id {0u, 0u, 0u};
-			id.x = globalInvocationID_.x % wgs.x;
-			id.y = globalInvocationID_.y % wgs.y;
-			id.z = globalInvocationID_.z % wgs.z;
+			id.x = globalInvocationID.x % wgs.x;
+			id.y = globalInvocationID.y % wgs.y;
+			id.z = globalInvocationID.z % wgs.z;
 			loadVecU(id);
 			break;
 		}
 		case spv::BuiltInLocalInvocationIndex: {
 			Vec3ui lid {0u, 0u, 0u};
-			lid.x = globalInvocationID_.x % wgs.x;
-			lid.y = globalInvocationID_.y % wgs.y;
-			lid.z = globalInvocationID_.z % wgs.z;
+			lid.x = globalInvocationID.x % wgs.x;
+			lid.y = globalInvocationID.y % wgs.y;
+			lid.z = globalInvocationID.z % wgs.z;
 			auto id =
 				lid.z * wgs.y * wgs.x +
 				lid.y * wgs.x +
@@ -531,44 +576,27 @@ void ShaderDebugger::loadBuiltin(const spc::BuiltInResource& builtin,
 
 unsigned ShaderDebugger::arrayLength(unsigned varID, span<const spvm_word> indices) {
 	ZoneScoped;
-	dlg_assert(compiled_);
 
-	auto res = resource(*this->compiled_, varID);
-	if(!res) {
+	auto* var = varInfo(varID);
+	if(!var || var->kind != VarInfo::Kind::resource) {
 		dlg_error("OpArrayLength of invalid/unknown var {}", varID);
 		return 0;
 	}
 
-	dlg_assert(compiled_->has_decoration(res->id, spv::DecorationDescriptorSet) &&
-				compiled_->has_decoration(res->id, spv::DecorationBinding));
-	auto& spcTypeMaybeArrayed = compiled_->get_type(res->type_id);
-
 	// Handle array bindings
 	auto arrayElemID = 0u;
-	auto spcType = spcTypeMaybeArrayed;
-	if(!spcTypeMaybeArrayed.array.empty()) {
-		// Multidimensional binding arrays not allowed I guess
-		dlg_assert(spcType.array.size() == 1u);
-
+	if(var->arraySize) {
 		// Loading an entire binding array is not allowed I guess, we just
 		// require an element to be selected here
 		dlg_assert(!indices.empty());
-
-		auto bounds = spcType.array[0];
-		if(spcType.array_size_literal[0] == true) {
-			bounds = compiled_->evaluate_constant_u32(bounds);
-		}
-
-		dlg_assert(u32(indices[0]) < bounds);
+		dlg_assert(u32(indices[0]) < *var->arraySize);
 
 		arrayElemID = indices[0];
 		indices = indices.subspan(1u);
-		spcType.array.clear();
-		spcType.array_size_literal.clear();
 	}
 
-	auto setID = compiled_->get_decoration(res->id, spv::DecorationDescriptorSet);
-	auto bindingID = compiled_->get_decoration(res->id, spv::DecorationBinding);
+	auto setID = var->setID;
+	auto bindingID = var->bindingID;
 
 	auto* baseCmd = selection().command().back();
 	auto* cmd = deriveCast<const StateCmdBase*>(baseCmd);
@@ -599,8 +627,9 @@ unsigned ShaderDebugger::arrayLength(unsigned varID, span<const spvm_word> indic
 	dlg_assert(copyResult.op.set == setID);
 	dlg_assert(copyResult.op.binding == bindingID);
 
-	dlg_assert_or(spcType.storage == spv::StorageClassStorageBuffer ||
-		spcType.storage == spv::StorageClassUniform, return 0);
+	dlg_assert_or(var->storage == spv::StorageClassStorageBuffer ||
+		var->storage == spv::StorageClassUniform, return 0);
+	dlg_assert_or(var->type, return 0);
 
 	auto buf = buffers(ds, bindingID)[arrayElemID];
 	u32 size = 0u;
@@ -617,7 +646,7 @@ unsigned ShaderDebugger::arrayLength(unsigned varID, span<const spvm_word> indic
 	}
 
 	ThreadMemScope tms;
-	auto [type, off] = accessBuffer(tms, res->type_id, indices, size);
+	auto [type, off] = accessBuffer(tms, *var->type, indices, size);
 	dlg_assert_or(type, return 0);
 
 	dlg_assert(!type->array.empty());
@@ -633,9 +662,8 @@ unsigned ShaderDebugger::arrayLength(unsigned varID, span<const spvm_word> indic
 }
 
 std::pair<const Type*, u32> ShaderDebugger::accessBuffer(ThreadMemScope& tms,
-		unsigned typeID, span<const spvm_word> indices, u32 dataSize) {
-	const auto* type = buildType(*compiled_, typeID, tms.customUse());
-	dlg_assert(type);
+		const Type& baseType, span<const spvm_word> indices, u32 dataSize) {
+	const auto* type = &baseType;
 
 	auto off = 0u;
 	while(!indices.empty()) {
@@ -716,55 +744,37 @@ std::pair<const Type*, u32> ShaderDebugger::accessBuffer(ThreadMemScope& tms,
 	return {type, u32(off)};
 }
 
-void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
+void ShaderDebugger::loadVar(Invocation& inv, unsigned srcID, span<const spvm_word> indices,
 		span<spvm_member> dst, u32 typeID) {
 	ZoneScoped;
-	dlg_assert(compiled_);
 
-	auto res = resource(*this->compiled_, srcID);
-	if(!res) {
-		auto builtin = builtinResource(*this->compiled_, srcID);
-		if(!builtin) {
-			dlg_error("OpLoad of invalid/unknown var {}", srcID);
-			return;
-		}
+	auto* var = varInfo(srcID);
+	if(!var) {
+		dlg_error("OpLoad of invalid/unknown var {}", srcID);
+		return;
+	}
 
-		loadBuiltin(*builtin, indices, dst);
+	if(var->kind == VarInfo::Kind::builtin) {
+		loadBuiltin(inv, *var, indices, dst);
 		return;
 	}
 
 	// dlg_trace("spirv OpLoad of non-builtin var {}", srcID);
 
-	dlg_assert(compiled_->has_decoration(res->id, spv::DecorationDescriptorSet) &&
-				compiled_->has_decoration(res->id, spv::DecorationBinding));
-	auto& spcTypeMaybeArrayed = compiled_->get_type(res->type_id);
-
 	// Handle array bindings
 	auto arrayElemID = 0u;
-	auto spcType = spcTypeMaybeArrayed;
-	if(!spcTypeMaybeArrayed.array.empty()) {
-		// Multidimensional binding arrays not allowed I guess
-		dlg_assert(spcType.array.size() == 1u);
-
+	if(var->arraySize) {
 		// Loading an entire binding array is not allowed I guess, we just
 		// require an element to be selected here
 		dlg_assert(!indices.empty());
-
-		auto bounds = spcType.array[0];
-		if(spcType.array_size_literal[0] == true) {
-			bounds = compiled_->evaluate_constant_u32(bounds);
-		}
-
-		dlg_assert(u32(indices[0]) < bounds);
+		dlg_assert(u32(indices[0]) < *var->arraySize);
 
 		arrayElemID = indices[0];
 		indices = indices.subspan(1u);
-		spcType.array.clear();
-		spcType.array_size_literal.clear();
 	}
 
-	auto setID = compiled_->get_decoration(res->id, spv::DecorationDescriptorSet);
-	auto bindingID = compiled_->get_decoration(res->id, spv::DecorationBinding);
+	auto setID = var->setID;
+	auto bindingID = var->bindingID;
 
 	auto* baseCmd = selection().command().back();
 	auto* cmd = deriveCast<const StateCmdBase*>(baseCmd);
@@ -781,9 +791,9 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 	// For samplers, we didn't do a copy and so have to early-out here
 	auto dsCopyIt = varIDToDsCopyMap_.find(srcID);
 	if(dsCopyIt == varIDToDsCopyMap_.end()) {
-		dlg_assert_or(spcType.basetype == spc::SPIRType::Sampler, return);
+		dlg_assert_or(var->basetype == spc::SPIRType::Sampler, return);
 		// ugh, not sure which one is right here
-		dlg_assert_or(spcType.storage == spv::StorageClassUniform || spcType.storage == spv::StorageClassUniformConstant, return);
+		dlg_assert_or(var->storage == spv::StorageClassUniform || var->storage == spv::StorageClassUniformConstant, return);
 		dlg_assert(indices.empty());
 
 		// dlg_trace(" >> found sampler");
@@ -791,7 +801,7 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 		auto image = vil::images(ds, bindingID)[arrayElemID];
 		dlg_assert(image.sampler);
 
-		auto& sampler = samplers_.emplace_back();
+		auto& sampler = inv.samplers.emplace_back();
 		sampler.desc = setupSampler(*image.sampler);
 
 		dlg_assert(dst.size() == 1u);
@@ -812,11 +822,12 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 	dlg_assert(copyResult.op.binding == bindingID);
 	dlg_assert(copyResult.op.elem == 0u);
 
-	if(spcType.storage == spv::StorageClassPushConstant) {
+	if(var->storage == spv::StorageClassPushConstant) {
 		auto pcrData = cmd->boundPushConstants().data;
 
+		dlg_assert_or(var->type, return);
 		ThreadMemScope tms;
-		auto [type, off] = accessBuffer(tms, res->type_id, indices, pcrData.size());
+		auto [type, off] = accessBuffer(tms, *var->type, indices, pcrData.size());
 		dlg_assert(type);
 
 		spvm_member* setupDst;
@@ -852,23 +863,23 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 
 		setupMember(*type, pcrData, *setupDst);
 		return;
-	} else if(spcType.storage == spv::StorageClassInput) {
+	} else if(var->storage == spv::StorageClassInput) {
 		// TODO: get from vertex input?
 		dlg_error("TODO: loadVar input");
 		return;
-	} else if(spcType.storage == spv::StorageClassOutput) {
+	} else if(var->storage == spv::StorageClassOutput) {
 		// TODO: from own storage? not sure what this actually means
 		dlg_error("TODO: loadVar output");
 		return;
-	} else if(spcType.storage == spv::StorageClassUniformConstant) {
+	} else if(var->storage == spv::StorageClassUniformConstant) {
 		// we already handled samplers above
-		dlg_assert(spcType.basetype != spc::SPIRType::Sampler);
+		dlg_assert(var->basetype != spc::SPIRType::Sampler);
 
 		// TODO: imageView, image from descriptor might be null here.
 		// We should probably just encode the needed information into
 		// the CommandHook so we can read the data even if original
 		// image/view were destroyed.
-		if(spcType.basetype == spc::SPIRType::Image) {
+		if(var->basetype == spc::SPIRType::Image) {
 			dlg_assert(dst.size() == 1u);
 
 			auto image = vil::images(ds, bindingID)[arrayElemID];
@@ -884,7 +895,7 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 			auto* buf = std::get_if<CopiedImageToBuffer>(&copyResult.data);
 			dlg_assert(buf);
 
-			auto& dstImg = images_.emplace_back();
+			auto& dstImg = inv.images.emplace_back();
 			dstImg.width = img.ci.extent.width;
 			dstImg.height = img.ci.extent.height;
 			dstImg.depth = img.ci.extent.depth;
@@ -894,11 +905,11 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 			dstImg.format = buf->format;
 
 			dst[0].value.image = &dstImg;
-			dlg_assert(u32(dst[0].type) == res->base_type_id);
+			dlg_assert(u32(dst[0].type) == var->baseTypeID);
 			dlg_assert(dst[0].member_count == 0u);
 
 			return;
-		} else if(spcType.basetype == spc::SPIRType::SampledImage) {
+		} else if(var->basetype == spc::SPIRType::SampledImage) {
 			dlg_assert(dst.size() == 2u);
 
 			auto image = vil::images(ds, bindingID)[arrayElemID];
@@ -915,7 +926,7 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 			auto* buf = std::get_if<CopiedImageToBuffer>(&copyResult.data);
 			dlg_assert(buf);
 
-			auto& dstImg = images_.emplace_back();
+			auto& dstImg = inv.images.emplace_back();
 			dstImg.width = img.ci.extent.width;
 			dstImg.height = img.ci.extent.height;
 			dstImg.depth = img.ci.extent.depth;
@@ -924,11 +935,11 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 			dstImg.data = buf->buffer.data();
 			dstImg.format = buf->format;
 
-			auto& sampler = samplers_.emplace_back();
+			auto& sampler = inv.samplers.emplace_back();
 			sampler.desc = setupSampler(*image.sampler);
 
-			auto& spvmRes = spvm_.state->results[srcID];
-			auto* resType = spvm_state_get_type_info(spvm_.state->results, &spvm_.state->results[spvmRes.pointer]);
+			auto& spvmRes = inv.state->results[srcID];
+			auto* resType = spvm_state_get_type_info(inv.state->results, &inv.state->results[spvmRes.pointer]);
 
 			// members[0]: image
 			dlg_assert(dst[0].member_count == 0u);
@@ -944,9 +955,9 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 			dlg_error("Invalid/unsupported UniformConstant");
 			return;
 		}
-	} else if(spcType.storage == spv::StorageClassUniform ||
-			spcType.storage == spv::StorageClassStorageBuffer) {
-		if(spcType.basetype == spc::SPIRType::Struct) {
+	} else if(var->storage == spv::StorageClassUniform ||
+			var->storage == spv::StorageClassStorageBuffer) {
+		if(var->basetype == spc::SPIRType::Struct) {
 			auto* copiedBuf = std::get_if<OwnBuffer>(&copyResult.data);
 			dlg_assert(copiedBuf);
 			auto data = copiedBuf->data();
@@ -963,8 +974,9 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 				size = data.size();
 			}
 
+			dlg_assert_or(var->type, return);
 			ThreadMemScope tms;
-			auto [type, off] = accessBuffer(tms, res->type_id, indices, size);
+			auto [type, off] = accessBuffer(tms, *var->type, indices, size);
 			dlg_assert(type);
 
 			spvm_member* setupDst;
@@ -997,15 +1009,18 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 	return;
 }
 
-void ShaderDebugger::storeVar(unsigned id, span<const spvm_word> indices,
+void ShaderDebugger::storeVar(Invocation& inv, unsigned id, span<const spvm_word> indices,
 			span<spvm_member> src, u32 typeID) {
 	// TODO
 	// even if we are not interested in the results, we have to implement
 	// it to make sure reads of previous writes return the written values.
 	(void) id;
 	(void) indices;
-	(void) src;
 	(void) typeID;
+
+	for(auto& member : src) {
+		inv.wroteNonFinite |= !isFinite(member);
+	}
 }
 
 void ShaderDebugger::updateHooks(CommandHook& hook) {
@@ -1133,6 +1148,89 @@ void ShaderDebugger::initVarMap() {
 	initVars(resources.subpass_inputs, true);
 }
 
+void ShaderDebugger::initVarInfos() {
+	ZoneScoped;
+	dlg_assert(compiled_);
+	dlg_assert(spvm_.program);
+
+	varInfos_.clear();
+	varInfos_.resize(spvm_.program->bound);
+	varTypeAlloc_.release();
+
+	auto resources = compiled_->get_shader_resources();
+
+	// Same resources as looked up by resource(const spc::Compiler&, u32)
+	auto addResources = [&](auto& resources) {
+		for(auto& res : resources) {
+			if(!compiled_->has_decoration(res.id, spv::DecorationDescriptorSet) ||
+					!compiled_->has_decoration(res.id, spv::DecorationBinding)) {
+				dlg_warn("resource {} doesn't have set/binding decorations", res.name);
+				continue;
+			}
+
+			dlg_assert_or(res.id < varInfos_.size(), continue);
+			auto& var = varInfos_[res.id];
+			var.kind = VarInfo::Kind::resource;
+			var.setID = compiled_->get_decoration(res.id, spv::DecorationDescriptorSet);
+			var.bindingID = compiled_->get_decoration(res.id, spv::DecorationBinding);
+			var.baseTypeID = res.base_type_id;
+
+			auto& spcType = compiled_->get_type(res.type_id);
+			var.storage = spcType.storage;
+			var.basetype = spcType.basetype;
+
+			if(!spcType.array.empty()) {
+				// Multidimensional binding arrays not allowed I guess
+				dlg_assert(spcType.array.size() == 1u);
+
+				auto bounds = spcType.array[0];
+				if(spcType.array_size_literal[0] == true) {
+					bounds = compiled_->evaluate_constant_u32(bounds);
+				}
+
+				var.arraySize = bounds;
+			}
+
+			if(var.basetype == spc::SPIRType::Struct && (
+					var.storage == spv::StorageClassUniform ||
+					var.storage == spv::StorageClassStorageBuffer ||
+					var.storage == spv::StorageClassPushConstant)) {
+				var.type = buildType(*compiled_, res.type_id, varTypeAlloc_);
+			}
+		}
+	};
+
+	addResources(resources.acceleration_structures);
+	addResources(resources.sampled_images);
+	addResources(resources.separate_images);
+	addResources(resources.separate_samplers);
+	addResources(resources.storage_buffers);
+	addResources(resources.storage_images);
+	addResources(resources.uniform_buffers);
+	addResources(resources.subpass_inputs);
+
+	auto addBuiltins = [&](auto& resources) {
+		for(auto& res : resources) {
+			dlg_assert_or(res.resource.id < varInfos_.size(), continue);
+			auto& var = varInfos_[res.resource.id];
+			var.kind = VarInfo::Kind::builtin;
+			var.builtin = res.builtin;
+		}
+	};
+
+	addBuiltins(resources.builtin_inputs);
+	addBuiltins(resources.builtin_outputs);
+}
+
+const ShaderDebugger::VarInfo* ShaderDebugger::varInfo(unsigned varID) const {
+	if(varID >= varInfos_.size() ||
+			varInfos_[varID].kind == VarInfo::Kind::unknown) {
+		return nullptr;
+	}
+
+	return &varInfos_[varID];
+}
+
 void ShaderDebugger::setupScalar(const Type& type, ReadBuf data, spvm_member& dst) {
 	[[maybe_unused]] auto vt = valueType(dst);
 	dlg_assert(dst.member_count == 0u);
@@ -1353,8 +1451,8 @@ spvm_vec4f ShaderDebugger::readImage(spvm_image& srcImg, int x, int y, int z, in
 	return {float(texel[0]), float(texel[1]), float(texel[2]), float(texel[3])};
 }
 
-void ShaderDebugger::writeImage(spvm_image&, int x, int y, int z, int layer, int level,
-		const spvm_vec4f& data) {
+void ShaderDebugger::writeImage(Invocation& inv, spvm_image&, int x, int y, int z,
+		int layer, int level, const spvm_vec4f& data) {
 	// TODO
 	// have to implement it, make sure subsequent reads return the same value
 	(void) x;
@@ -1362,15 +1460,38 @@ void ShaderDebugger::writeImage(spvm_image&, int x, int y, int z, int layer, int
 	(void) z;
 	(void) layer;
 	(void) level;
-	(void) data;
+
+	for(auto val : data.data) {
+		inv.wroteNonFinite |= !std::isfinite(val);
+	}
 }
 
 spvm_value_type ShaderDebugger::valueType(const spvm_member& member) {
+	// NOTE: the type results are the same for all states of the program
+	// and never change after creation, so using the main state here is
+	// fine for the invocations of a search as well.
 	auto* resType = spvm_state_get_type_info(spvm_.state->results, &spvm_.state->results[member.type]);
 	dlg_assert(resType);
 	return resType->value_type;
 }
 
+bool ShaderDebugger::isFinite(const spvm_member& member) {
+	for(auto i = 0; i < member.member_count; ++i) {
+		if(!isFinite(member.members[i])) {
+			return false;
+		}
+	}
+
+	if(member.member_count > 0 || valueType(member) != spvm_value_type_float) {
+		return true;
+	}
+
+	auto* resType = spvm_state_get_type_info(spvm_.state->results, &spvm_.state->results[member.type]);
+	return resType->value_bitcount > 32 ?
+		std::isfinite(member.value.d) :
+		std::isfinite(member.value.f);
+}
+
 void ShaderDebugger::display(const char* name, const spvm_member& member) {
 	ImGui::TableNextRow();
 	ImGui::TableNextColumn();
@@ -1600,9 +1721,9 @@ void ShaderDebugger::drawInputsTab() {
 		ImGui::Checkbox("Allow out-of-bounds invocation", &allowSelectOutOfBounds_);
 		auto sliderFlags = 0u;
 		if(!allowSelectOutOfBounds_) {
-			globalInvocationID_.x = std::min(globalInvocationID_.x, numThreads.x - 1);
-			globalInvocationID_.y = std::min(globalInvocationID_.y, numThreads.y - 1);
-			globalInvocationID_.z = std::min(globalInvocationID_.z, numThreads.z - 1);
+			invocation_.globalInvocationID.x = std::min(invocation_.globalInvocationID.x, numThreads.x - 1);
+			invocation_.globalInvocationID.y = std::min(invocation_.globalInvocationID.y, numThreads.y - 1);
+			invocation_.globalInvocationID.z = std::min(invocation_.globalInvocationID.z, numThreads.z - 1);
 			sliderFlags = ImGuiSliderFlags_AlwaysClamp;
 		}
 
@@ -1631,9 +1752,9 @@ void ShaderDebugger::drawInputsTab() {
 				}
 
 				ImGui::PushItemWidth(sizeX);
-				int v = globalInvocationID_[i];
+				int v = invocation_.globalInvocationID[i];
 				ImGui::DragInt("", &v, 1.f, 0, numThreads[i] - 1, "%d", sliderFlags);
-				globalInvocationID_[i] = u32(v);
+				invocation_.globalInvocationID[i] = u32(v);
 				ImGui::PopID();
 			}
 
@@ -1658,10 +1779,10 @@ void ShaderDebugger::drawInputsTab() {
 
 				ImGui::PushItemWidth(sizeX);
 				// floor by design
-				auto before = globalInvocationID_[i] / wgs[i];
+				auto before = invocation_.globalInvocationID[i] / wgs[i];
 				int v = before;
 				if(ImGui::DragInt("", &v, 1.f, 0, numWGs[i] - 1, "%d", sliderFlags)) {
-					globalInvocationID_[i] += (v - before) * wgs[i];
+					invocation_.globalInvocationID[i] += (v - before) * wgs[i];
 				}
 				ImGui::PopID();
 			}
@@ -1687,10 +1808,10 @@ void ShaderDebugger::drawInputsTab() {
 
 				ImGui::PushItemWidth(sizeX);
 				// floor by design
-				auto before = globalInvocationID_[i] % wgs[i];
+				auto before = invocation_.globalInvocationID[i] % wgs[i];
 				int v = before;
 				if(ImGui::DragInt("", &v, 1.f, 0, wgs[i] - 1, "%d", sliderFlags)) {
-					globalInvocationID_[i] += v - before;
+					invocation_.globalInvocationID[i] += v - before;
 				}
 				ImGui::PopID();
 			}
@@ -1700,6 +1821,255 @@ void ShaderDebugger::drawInputsTab() {
 	}
 }
 
+void ShaderDebugger::drawSearchTab() {
+	auto conditionName = [](SearchCondition cond) {
+		switch(cond) {
+			case SearchCondition::nonFinite: return "NaN/Inf stored";
+			case SearchCondition::breakpoint: return "Breakpoint hit";
+		}
+		return "?";
+	};
+
+	auto rangeName = [](SearchRange range) {
+		switch(range) {
+			case SearchRange::workgroup: return "Current workgroup";
+			case SearchRange::dispatch: return "Whole dispatch";
+		}
+		return "?";
+	};
+
+	if(ImGui::BeginCombo("Condition", conditionName(searchCondition_))) {
+		for(auto cond : {SearchCondition::nonFinite, SearchCondition::breakpoint}) {
+			if(ImGui::Selectable(conditionName(cond), cond == searchCondition_)) {
+				searchCondition_ = cond;
+			}
+		}
+
+		ImGui::EndCombo();
+	}
+
+	if(ImGui::BeginCombo("Range", rangeName(searchRange_))) {
+		for(auto range : {SearchRange::workgroup, SearchRange::dispatch}) {
+			if(ImGui::Selectable(rangeName(range), range == searchRange_)) {
+				searchRange_ = range;
+			}
+		}
+
+		ImGui::EndCombo();
+	}
+
+	if(ImGui::Button("Search")) {
+		searchInvocations();
+	}
+	if(gui_->showHelp && ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Runs the shader for all invocations in the range "
+			"and selects the first one matching the condition");
+	}
+
+	if(!searchStatus_.empty()) {
+		imGuiText("{}", searchStatus_);
+	}
+}
+
+bool ShaderDebugger::matchesSearch(const Vec3ui& globalInvocationID,
+		u32 maxInstructions, u32& executed) {
+	Invocation inv;
+	inv.self = this;
+	inv.globalInvocationID = globalInvocationID;
+	inv.workgroupSize = invocation_.workgroupSize;
+	inv.numWorkgroups = invocation_.numWorkgroups;
+
+	inv.state = createState(inv);
+
+	auto ret = false;
+	if(searchCondition_ == SearchCondition::nonFinite) {
+		spvm_state_jump_to_instruction(inv.state, maxInstructions);
+		ret = inv.wroteNonFinite;
+	} else {
+		while(inv.state->code_current &&
+				u32(inv.state->instruction_count) < maxInstructions) {
+			if(runToLineChange(inv.state)) {
+				ret = true;
+				break;
+			}
+		}
+	}
+
+	executed = u32(inv.state->instruction_count);
+	spvm_state_delete(inv.state);
+	return ret;
+}
+
+void ShaderDebugger::searchInvocations() {
+	ZoneScoped;
+	using nytl::vec::cw::operators::operator*;
+
+	auto& wgs = invocation_.workgroupSize;
+	auto& numWGs = invocation_.numWorkgroups;
+
+	if(searchCondition_ == SearchCondition::breakpoint && breakpoints_.empty()) {
+		searchStatus_ = "No breakpoints set";
+		return;
+	}
+
+	Vec3ui begin {0u, 0u, 0u};
+	Vec3ui size = numWGs * wgs;
+	if(searchRange_ == SearchRange::workgroup) {
+		auto& id = invocation_.globalInvocationID;
+		begin = {id.x - id.x % wgs.x, id.y - id.y % wgs.y, id.z - id.z % wgs.z};
+		size = wgs;
+	}
+
+	auto total = u64(size.x) * size.y * size.z;
+	auto count = u32(std::min<u64>(total, maxSearchInvocations));
+	auto invocationID = [&](u32 i) {
+		return Vec3ui{
+			begin.x + i % size.x,
+			begin.y + (i / size.x) % size.y,
+			begin.z + i / (size.x * size.y),
+		};
+	};
+
+	// The gui is blocked while searching, the selection (and therefore
+	// everything the invocations read) can't change in the meantime.
+	// Invocations are handed out in order, the first matching one wins.
+	// Each invocation reserves its instruction limit from the shared budget
+	// and gives back what it didn't use. Once the budget is used up,
+	// 'stopped' is the first invocation that couldn't be fully evaluated.
+	std::atomic<u32> next {0u};
+	std::atomic<u32> found {u32(-1)};
+	std::atomic<u32> stopped {count};
+	std::atomic<u64> budget {maxSearchTotalInstructions};
+
+	auto reserve = [&]{
+		auto avail = budget.load();
+		u64 granted;
+		do {
+			granted = std::min<u64>(avail, maxSearchInstructions);
+		} while(!budget.compare_exchange_weak(avail, avail - granted));
+		return u32(granted);
+	};
+
+	auto stop = [&](u32 i) {
+		auto prev = stopped.load();
+		while(i < prev && !stopped.compare_exchange_weak(prev, i));
+	};
+
+	std::function<void()> worker = [&]{
+		while(true) {
+			auto i = next.fetch_add(1u);
+			if(i >= stopped.load() || i > found.load()) {
+				break;
+			}
+
+			auto granted = reserve();
+			if(granted == 0u) {
+				stop(i);
+				break;
+			}
+
+			auto executed = 0u;
+			if(matchesSearch(invocationID(i), granted, executed)) {
+				auto prev = found.load();
+				while(i < prev && !found.compare_exchange_weak(prev, i));
+			} else if(granted < maxSearchInstructions && executed >= granted) {
+				// cut off by the budget, not by the per-invocation limit
+				stop(i);
+			}
+
+			budget.fetch_add(granted - std::min(executed, granted));
+		}
+	};
+
+	runOnSearchWorkers(worker);
+
+	auto searched = stopped.load();
+	auto truncated = std::string{};
+	if(searched < count) {
+		truncated = dlg::format(" (instruction budget used up, only the "
+			"first {} invocations were fully searched)", searched);
+	} else if(total > count) {
+		truncated = dlg::format(" (only the first {} invocations)", count);
+	}
+
+	if(found.load() == u32(-1)) {
+		searchStatus_ = dlg::format("No matching invocation found{}", truncated);
+		return;
+	}
+
+	invocation_.globalInvocationID = invocationID(found.load());
+	auto& id = invocation_.globalInvocationID;
+	searchStatus_ = dlg::format("Found invocation ({}, {}, {}){}", id.x, id.y, id.z, truncated);
+
+	// Re-run the found invocation up to the point it matched
+	spvm_state_delete(spvm_.state);
+	initState();
+
+	if(searchCondition_ == SearchCondition::nonFinite) {
+		while(spvm_.state->code_current && !invocation_.wroteNonFinite) {
+			spvm_state_step_opcode(spvm_.state);
+		}
+	} else {
+		while(spvm_.state->code_current && !runToLineChange(spvm_.state));
+	}
+
+	updatePosition(true);
+}
+
+void ShaderDebugger::runOnSearchWorkers(const std::function<void()>& job) {
+	auto& workers = searchWorkers_;
+	if(workers.threads.empty()) {
+		auto numThreads = std::clamp(std::thread::hardware_concurrency(), 1u, 16u);
+		for(auto t = 1u; t < numThreads; ++t) {
+			workers.threads.emplace_back([this]{ searchWorkerMain(); });
+		}
+	}
+
+	{
+		std::lock_guard lock(workers.mutex);
+		dlg_assert(!workers.job && workers.running == 0u);
+		workers.job = &job;
+		workers.running = u32(workers.threads.size());
+		++workers.jobID;
+	}
+
+	workers.cv.notify_all();
+	job();
+
+	std::unique_lock lock(workers.mutex);
+	workers.cv.wait(lock, [&]{ return workers.running == 0u; });
+	workers.job = nullptr;
+}
+
+void ShaderDebugger::searchWorkerMain() {
+	auto& workers = searchWorkers_;
+	auto lastJobID = u64(0u);
+
+	std::unique_lock lock(workers.mutex);
+	while(true) {
+		workers.cv.wait(lock, [&]{
+			return workers.exit || workers.jobID != lastJobID;
+		});
+
+		if(workers.exit) {
+			break;
+		}
+
+		lastJobID = workers.jobID;
+		auto* job = workers.job;
+		dlg_assert(job);
+
+		lock.unlock();
+		(*job)();
+		lock.lock();
+
+		dlg_assert(workers.running > 0u);
+		if(--workers.running == 0u) {
+			workers.cv.notify_all();
+		}
+	}
+}
+
 void ShaderDebugger::updatePosition(bool moveCursor) {
 	if(!spvm_.state->current_file) {
 		dlg_warn("Can't jump to debugging state, current_file is null");
@@ -1765,6 +2135,26 @@ bool ShaderDebugger::stepOpcode() {
 	return false;
 }
 
+bool ShaderDebugger::runToLineChange(spvm_state_t state, bool stopAtLastReturn) {
+	auto currLine = state->current_line;
+	auto currFile = state->current_file;
+
+	auto pos = spvm_state_run_to_line_change(state, stopAtLastReturn);
+	if(!pos || (state->current_line == currLine &&
+			state->current_file == currFile)) {
+		return false;
+	}
+
+	// same check as in stepOpcode
+	for(auto& bp : breakpoints_) {
+		if(pos == bp.pos) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 std::string_view ShaderDebugger::fileName(u32 fileID) const {
 	dlg_assert_or(fileID < spvm_.state->owner->file_count, return "");
 	return spvm_.state->owner->files[fileID].name;
@@ -1875,7 +2265,7 @@ void ShaderDebugger::stepLine() {
 	// just in case we jump to a function in another file that
 	// happens to be at the same line
 	while(spvm_.state->current_line == line && spvm_.state->code_current && !doBreak) {
-		doBreak = stepOpcode();
+		doBreak = runToLineChange(spvm_.state);
 	}
 
 	updatePosition(true);
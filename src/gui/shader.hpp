@@ -3,6 +3,7 @@
 #include <fwd.hpp>
 #include <nytl/vec.hpp>
 #include <util/intrusive.hpp>
+#include <util/linalloc.hpp>
 #include <imgui/textedit.h>
 #include <spvm/program.h>
 #include <spvm/state.h>
@@ -11,6 +12,10 @@
 #include <nytl/bytes.hpp>
 #include <vk/vulkan.h>
 #include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -35,24 +40,27 @@ public:
 	void initVarMap();
 
 private:
-	void loadVar(unsigned srcID, span<const spvm_word> indices,
+	struct Invocation;
+	struct VarInfo;
+
+	void loadVar(Invocation&, unsigned srcID, span<const spvm_word> indices,
 		span<spvm_member> dst, u32 typeID);
-	void loadBuiltin(const spc::BuiltInResource& builtin,
+	void loadBuiltin(Invocation&, const VarInfo& builtin,
 		span<const spvm_word> indices, span<spvm_member> dst);
-	void storeVar(unsigned dstID, span<const spvm_word> indices,
+	void storeVar(Invocation&, unsigned dstID, span<const spvm_word> indices,
 		span<spvm_member> src, u32 typeID);
 
 	// Returns (type, offset) tuple for accessing the sub-type
 	// given by the given indices (as usually defined by SPIR-V) in
-	// the given typeID.
+	// the given type.
 	// Requires the total dataSize of the original type/buffer to
 	// correctly handle runtime arrays.
 	std::pair<const Type*, u32> accessBuffer(ThreadMemScope& tms,
-		unsigned typeID, span<const spvm_word> indices, u32 dataSize);
+		const Type& type, span<const spvm_word> indices, u32 dataSize);
 
 	spvm_vec4f readImage(spvm_image&, int x, int y, int z, int layer, int level);
-	void writeImage(spvm_image&, int x, int y, int z, int layer, int level,
-		const spvm_vec4f&);
+	void writeImage(Invocation&, spvm_image&, int x, int y, int z, int layer,
+		int level, const spvm_vec4f&);
 	unsigned arrayLength(unsigned varID, span<const spvm_word> indices);
 
 	void setupMember(const Type& type, ReadBuf, spvm_member& dst);
@@ -62,11 +70,22 @@ private:
 
 	// (Re-)Initialized the spvm state.
 	void initState();
+	// Creates a new spvm state for the given invocation, ready to execute.
+	// Only the first state of a program modifies it (see
+	// spvm_program::setup_done), afterwards this may be called concurrently.
+	spvm_state_t createState(Invocation&);
+
+	// Resolves the spirv-cross information of all variables the shader
+	// might load, see varInfos_.
+	void initVarInfos();
+	// Returns null for unknown variables.
+	const VarInfo* varInfo(unsigned varID) const;
 
 	// Converts the information of the given sampler to a spvm_sampler_desc.
 	static spvm_sampler_desc setupSampler(const Sampler& src);
 
 	spvm_value_type valueType(const spvm_member& member);
+	bool isFinite(const spvm_member& member);
 
 	// formatting spvm_result/spvm_member for debug table
 	void display(const char* name, const spvm_member& members);
@@ -74,6 +93,10 @@ private:
 
 	// executes a single opcode. Returns true if a breakpoint was hit.
 	bool stepOpcode();
+	// executes opcodes until the current line changes (the only time a
+	// breakpoint can be hit), without going back to us for every opcode.
+	// Returns true if a breakpoint was hit.
+	bool runToLineChange(spvm_state_t, bool stopAtLastReturn = false);
 
 	// Sets the text editor to the current line of the state.
 	void updatePosition(bool moveCursor = true);
@@ -82,6 +105,20 @@ private:
 	void drawVariablesTab();
 	void drawBreakpointsTab();
 	void drawCallstackTab();
+	void drawSearchTab();
+
+	// Runs the shader for all invocations in the search range, in parallel,
+	// and selects the first one matching the search condition.
+	void searchInvocations();
+	// Runs the given invocation for at most 'maxInstructions' instructions,
+	// returns whether it matches the search condition. The number of
+	// executed instructions is stored in 'executed'.
+	bool matchesSearch(const Vec3ui& globalInvocationID,
+		u32 maxInstructions, u32& executed);
+	// Runs the given function on all search workers and the calling
+	// thread, returns when all of them are finished.
+	void runOnSearchWorkers(const std::function<void()>& job);
+	void searchWorkerMain();
 
 	// NOTE: the returned string view is only valid until the state
 	// gets recreated (which might happen every frame).
@@ -108,6 +145,37 @@ private:
 	static const OurImage emptyImage;
 	static const spvm_sampler defaultSampler;
 
+	// Data of a single shader invocation, accessed by the spvm callbacks
+	// via spvm_state::user_data. Besides the debugged invocation, there are
+	// temporary ones while searching, see searchInvocations.
+	struct Invocation {
+		ShaderDebugger* self {};
+		spvm_state_t state {};
+		Vec3ui globalInvocationID {0u, 0u, 0u};
+		Vec3ui workgroupSize {};
+		Vec3ui numWorkgroups {};
+		std::deque<spvm_sampler> samplers;
+		std::deque<OurImage> images;
+		bool wroteNonFinite {}; // whether a NaN or Inf value was stored
+	};
+
+	enum class SearchCondition {
+		nonFinite, // a NaN or Inf value is stored
+		breakpoint, // any breakpoint is hit
+	};
+
+	enum class SearchRange {
+		workgroup, // the workgroup of the current invocation
+		dispatch,
+	};
+
+	// Searching blocks the gui, those limits keep it responsive.
+	// The total budget is shared by all searched invocations, the
+	// search stops early when it is used up.
+	static constexpr auto maxSearchInvocations = 64u * 1024u;
+	static constexpr auto maxSearchInstructions = 1024u * 1024u; // per invocation
+	static constexpr auto maxSearchTotalInstructions = u64(32u) * 1024u * 1024u;
+
 	struct Location {
 		u32 fileID;
 		u32 lineID;
@@ -118,9 +186,6 @@ private:
 		return a.fileID == b.fileID && a.lineID == b.lineID;
 	}
 
-	std::deque<spvm_sampler> samplers_;
-	std::deque<OurImage> images_;
-
 	bool rerun_ {};
 	bool freezeOnBreakPoint_ {};
 	u32 currLine_ {};
@@ -132,13 +197,37 @@ private:
 	Gui* gui_ {};
 	igt::TextEditor textedit_;
 	std::unique_ptr<spc::Compiler> compiled_ {};
+	u32 entryPoint_ {};
+
+	// spirv-cross information about the variables the shader might load,
+	// indexed by varID. Resolved once on select, running invocations
+	// doesn't touch spirv-cross (which isn't thread-safe, not even its
+	// const functions) so they can be executed in parallel when searching.
+	std::vector<VarInfo> varInfos_;
+	LinAllocator varTypeAlloc_; // for VarInfo::type
 
 	std::unordered_map<u32, u32> varIDToDsCopyMap_;
 	std::vector<Location> breakpoints_;
 
-	Vec3ui globalInvocationID_ {0u, 0u, 0u};
+	Invocation invocation_; // the debugged invocation
 	bool allowSelectOutOfBounds_ {};
 
+	SearchCondition searchCondition_ {};
+	SearchRange searchRange_ {};
+	std::string searchStatus_;
+
+	// Worker threads for searchInvocations. Started on the first
+	// search and kept until destruction. See runOnSearchWorkers.
+	struct {
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable cv;
+		const std::function<void()>* job {};
+		u64 jobID {}; // increased for every job
+		u32 running {}; // number of workers still running the job
+		bool exit {};
+	} searchWorkers_;
+
 	struct {
 		spvm_context_t context {};
 		spvm_program_t program {};
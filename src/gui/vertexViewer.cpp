@@ -1261,7 +1261,12 @@ void VertexViewer::displayOutput(Draw& draw, const DrawCmdBase& cmd,
 	dlg_assert_or(cmd.state->pipe, return);
 	auto& pipe = *cmd.state->pipe;
 
-	if(!pipe.xfbPatch) {
+	auto xfbState = pipe.xfbState.load(std::memory_order_acquire);
+	if(xfbState == XfbVariantState::none || xfbState == XfbVariantState::pending) {
+		// the hook will be re-recorded once the variant is ready
+		imGuiText("Creating transform feedback pipeline...");
+		return;
+	} else if(xfbState != XfbVariantState::ready) {
 		imGuiText("Error: couldn't inject transform feedback code to shader");
 		return;
 	} else if(!state.transformFeedback.size) {
@@ -1270,82 +1275,127 @@ void VertexViewer::displayOutput(Draw& draw, const DrawCmdBase& cmd,
 	}
 
 	auto& xfbPatch = *pipe.xfbPatch;
+	auto split = xfbSplit(pipe);
+
+	// Only the selected chunk of the selected draw is captured,
+	// see CommandHookOps::xfbDraw.
+	u32 drawCount {};
+	u32 vertexCount {}; // for the selected draw
+	u32 instanceCount {};
+	auto indirect = false;
 
-	u32 vertexOffset {};
-	u32 vertexCount {};
-	auto displayCmdSlider = [&](bool indexed, u32 stride, u32 offset = 0u){
+	auto readIndirect = [&](bool indexed, u32 stride, u32 offset = 0u){
 		dlg_assert(gui_->dev().commandHook->ops().copyIndirectCmd);
 		dlg_assert(state.indirectCopy.size);
 
-		auto count = state.indirectCommandCount;
-		if(count == 0u) {
-			imGuiText("No commands (drawCount = 0)");
-			selectedID_ = -1;
+		indirect = true;
+		drawCount = state.indirectCommandCount;
+		if(drawCount == 0u) {
 			return;
-		} else if(count == 1u) {
-			selectedID_ = 0u;
-		} else {
-			auto lbl = dlg::format("Commands: {}", count);
-			optSliderRange(lbl.c_str(), selectedID_, count);
 		}
 
-		auto& ic = state.indirectCopy;
-		auto span = ic.data().subspan(offset);
+		selectedID_ = std::min(selectedID_, drawCount - 1);
+		auto span = state.indirectCopy.data().subspan(offset + selectedID_ * stride);
 		if(indexed) {
-			for(auto i = 0u; i < selectedID_; ++i) {
-				auto sub = span.subspan(i * stride);
-				auto ecmd = read<VkDrawIndexedIndirectCommand>(sub);
-				vertexOffset += ecmd.indexCount * ecmd.instanceCount;
-			}
-
-			auto sub = span.subspan(selectedID_ * stride);
-			auto ecmd = read<VkDrawIndexedIndirectCommand>(sub);
-			vertexCount = ecmd.indexCount * ecmd.instanceCount;
+			auto ecmd = read<VkDrawIndexedIndirectCommand>(span);
+			vertexCount = ecmd.indexCount;
+			instanceCount = ecmd.instanceCount;
 		} else {
-			for(auto i = 0u; i < selectedID_; ++i) {
-				auto sub = span.subspan(i * stride);
-				auto ecmd = read<VkDrawIndirectCommand>(sub);
-				vertexOffset += ecmd.vertexCount * ecmd.instanceCount;
-			}
-
-			auto sub = span.subspan(selectedID_ * stride);
-			auto ecmd = read<VkDrawIndirectCommand>(sub);
-			vertexCount = ecmd.vertexCount * ecmd.instanceCount;
+			auto ecmd = read<VkDrawIndirectCommand>(span);
+			vertexCount = ecmd.vertexCount;
+			instanceCount = ecmd.instanceCount;
 		}
 	};
 
+	auto selectDraw = [&](u32 count) {
+		drawCount = count;
+		selectedID_ = std::min(selectedID_, count ? count - 1 : 0u);
+	};
+
 	if(auto* dcmd = commandCast<const DrawCmd*>(&cmd); dcmd) {
-		vertexCount = dcmd->vertexCount * dcmd->instanceCount;
+		selectDraw(1u);
+		vertexCount = dcmd->vertexCount;
+		instanceCount = dcmd->instanceCount;
 	} else if(auto* dcmd = commandCast<const DrawIndexedCmd*>(&cmd); dcmd) {
-		vertexCount = dcmd->indexCount * dcmd->instanceCount;
-	} else if(auto* dcmd = commandCast<const DrawIndirectCmd*>(&cmd); dcmd) {
-		displayCmdSlider(dcmd->indexed, dcmd->stride);
-		if(selectedID_ == u32(-1)) {
-			return;
+		selectDraw(1u);
+		vertexCount = dcmd->indexCount;
+		instanceCount = dcmd->instanceCount;
+	} else if(auto* dcmd = commandCast<const DrawMultiCmd*>(&cmd); dcmd) {
+		selectDraw(u32(dcmd->vertexInfos.size()));
+		if(drawCount) {
+			vertexCount = dcmd->vertexInfos[selectedID_].vertexCount;
+			instanceCount = dcmd->instanceCount;
 		}
-	} else if(auto* dcmd = commandCast<const DrawIndirectCountCmd*>(&cmd); dcmd) {
-		displayCmdSlider(dcmd->indexed, dcmd->stride, 4u); // skip u32 count in the beginning
-		if(selectedID_ == u32(-1)) {
-			return;
+	} else if(auto* dcmd = commandCast<const DrawMultiIndexedCmd*>(&cmd); dcmd) {
+		selectDraw(u32(dcmd->indexInfos.size()));
+		if(drawCount) {
+			vertexCount = dcmd->indexInfos[selectedID_].indexCount;
+			instanceCount = dcmd->instanceCount;
 		}
+	} else if(auto* dcmd = commandCast<const DrawIndirectCmd*>(&cmd); dcmd) {
+		auto stride = dcmd->stride ? dcmd->stride : u32(dcmd->indexed ?
+			sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand));
+		readIndirect(dcmd->indexed, stride);
+	} else if(auto* dcmd = commandCast<const DrawIndirectCountCmd*>(&cmd); dcmd) {
+		auto stride = dcmd->stride ? dcmd->stride : u32(dcmd->indexed ?
+			sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand));
+		readIndirect(dcmd->indexed, stride, 4u); // skip u32 count in the beginning
 	} else {
 		imGuiText("Vertex viewer unimplemented for command type");
 		return;
 	}
 
-	vertexCount = topologyOutputCount(pipe.inputAssemblyState.topology, vertexCount);
-	vertexOffset = topologyOutputCount(pipe.inputAssemblyState.topology, vertexOffset);
-
-	auto capturedCount = state.transformFeedback.size / xfbPatch.stride;
-	if(vertexOffset + vertexCount > capturedCount) {
-		dlg_warn("xfb data truncated; Would need huge buffers");
+	if(drawCount == 0u) {
+		imGuiText("No commands (drawCount = 0)");
+		return;
+	} else if(drawCount > 1u) {
+		auto lbl = dlg::format("Commands: {}", drawCount);
+		optSliderRange(lbl.c_str(), selectedID_, drawCount);
+	}
 
-		if(vertexOffset >= capturedCount) {
-			imGuiText("Nothing to display; Not enough data captured");
-			return;
+	// We can't split indirect draws, see CommandHookRecord::recordXfb
+	auto range = XfbRange {0u, vertexCount, 0u, instanceCount};
+	auto chunkCount = xfbChunkCount(split, vertexCount, instanceCount);
+	if(chunkCount == 0u) {
+		imGuiText("Empty draw");
+		return;
+	} else if(indirect) {
+		selectedChunk_ = 0u;
+	} else {
+		if(chunkCount > 1u) {
+			auto lbl = dlg::format("Chunks: {}", chunkCount);
+			optSliderRange(lbl.c_str(), selectedChunk_, chunkCount);
+			ImGui::SameLine();
+			imGuiText("(?)");
+			if(ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("The draw is too large to be captured at once. "
+					"Only the selected chunk is captured");
+			}
 		}
 
-		vertexCount = capturedCount - vertexOffset;
+		selectedChunk_ = std::min(selectedChunk_, chunkCount - 1);
+		range = xfbChunkRange(split, vertexCount, instanceCount, selectedChunk_);
+	}
+
+	if(state.xfbDraw != selectedID_ || state.xfbChunk != selectedChunk_) {
+		// CommandViewer will update the hook
+		imGuiText("Waiting for a submission...");
+		return;
+	}
+
+	auto topo = pipe.inputAssemblyState.topology;
+	auto expectedCount = topologyOutputCount(topo, range.vertexCount) * range.instanceCount;
+	auto capturedCount = state.xfbCapturedSize / xfbPatch.stride;
+	vertexCount = std::min(expectedCount, capturedCount);
+	u32 vertexOffset = 0u;
+
+	if(capturedCount < expectedCount) {
+		imGuiText("Captured {} of {} vertices", capturedCount, expectedCount);
+	}
+
+	if(vertexCount == 0u) {
+		imGuiText("Nothing to display; No data captured");
+		return;
 	}
 
 	// 1: table
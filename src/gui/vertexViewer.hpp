@@ -44,6 +44,11 @@ struct VertexViewer {
 
 	void updateInput(float dt);
 
+	// The draw (of multi or indirect draws) and the xfb chunk selected
+	// in displayOutput, see CommandHookOps::xfbDraw.
+	u32 selectedDraw() const { return selectedID_; }
+	u32 selectedChunk() const { return selectedChunk_; }
+
 private:
 	void centerCamOnBounds(const AABB3f& bounds);
 	VkPipeline createPipe(VkFormat format, u32 stride, VkPrimitiveTopology topo);
@@ -118,6 +123,7 @@ private:
 	DrawData drawData_;
 
 	u32 selectedID_ {};
+	u32 selectedChunk_ {};
 	std::vector<DrawData> drawDatas_;
 };
 
@@ -6,6 +6,7 @@
 #include <data.hpp>
 #include <threadContext.hpp>
 #include <ds.hpp>
+#include <commandHook/hook.hpp>
 #include <rp.hpp>
 #include <util/util.hpp>
 #include <vkutil/enumString.hpp>
@@ -381,6 +382,9 @@ void bindImageMemory(Image& img, DeviceMemory& mem, u64 offset) {
 	memBind.resource = &img;
 
 	mem.allocations.insert(&memBind);
+	if(dev.commandHook) {
+		dev.commandHook->memoryBoundLocked(memBind);
+	}
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL BindImageMemory2(
@@ -3,11 +3,13 @@
 #include <fwd.hpp>
 #include <memory.hpp>
 #include <imageLayout.hpp>
+#include <util/slab.hpp>
 
 namespace vil {
 
 struct Image : MemoryResource {
 	static constexpr auto objectType = VK_OBJECT_TYPE_IMAGE;
+	VIL_SLAB_ALLOCATED(Image)
 
 	VkImage handle {};
 	VkImageCreateInfo ci;
@@ -46,6 +48,7 @@ private:
 
 struct ImageView : SharedDeviceHandle {
 	static constexpr auto objectType = VK_OBJECT_TYPE_IMAGE_VIEW;
+	VIL_SLAB_ALLOCATED(ImageView)
 
 	Image* img {}; // TODO: IntrusivePtr?
 	VkImageView handle {};
@@ -58,6 +61,7 @@ struct ImageView : SharedDeviceHandle {
 
 struct Sampler : SharedDeviceHandle {
 	static constexpr auto objectType = VK_OBJECT_TYPE_SAMPLER;
+	VIL_SLAB_ALLOCATED(Sampler)
 
 	VkSampler handle {};
 	VkSamplerCreateInfo ci;
@@ -1,6 +1,9 @@
 #include <imageLayout.hpp>
 #include <util/util.hpp>
 #include <threadContext.hpp>
+#include <algorithm>
+#include <iterator>
+#include <utility>
 
 namespace vil {
 
@@ -218,15 +221,13 @@ std::pair<span<ImageSubresourceLayout>, u32> doApply(
 			newEnd.range.levelCount = subLevelEnd - levelEndO;
 		}
 
-		if(subState.range.aspectMask == change.range.aspectMask) {
+		if((subState.range.aspectMask & ~change.range.aspectMask) == 0u) {
 			// erase original state
 			++inIt;
 		} else {
+			// 'subState' is a modified copy, always write it back
 			subState.range.aspectMask &= (~change.range.aspectMask);
-
-			if(outIt != inIt) {
-				*outIt = subState;
-			}
+			*outIt = subState;
 
 			++outIt;
 			++inIt;
@@ -239,6 +240,236 @@ std::pair<span<ImageSubresourceLayout>, u32> doApply(
 	return {newStates.first(numNewStates), newSize};
 }
 
+namespace {
+
+// Run of subresources with the same layout in one row, i.e. for one aspect
+// and mip level. Only stores the end of the run, it starts where the
+// previous run ends.
+struct LayoutRun {
+	u32 layerEnd;
+	VkImageLayout layout;
+};
+
+using LayoutRow = std::vector<LayoutRun>;
+
+// Marks that the given row has no known layout for a range yet.
+constexpr auto unknownLayout = VK_IMAGE_LAYOUT_MAX_ENUM;
+
+void pushRun(LayoutRow& row, u32 layerEnd, VkImageLayout layout) {
+	if(!row.empty() && row.back().layout == layout) {
+		row.back().layerEnd = layerEnd;
+		return;
+	}
+
+	row.push_back({layerEnd, layout});
+}
+
+// Sets the layout of the layers [start, end) in the given row.
+// 'scratch' is just used as temporary storage.
+void paint(LayoutRow& row, LayoutRow& scratch, u32 start, u32 end,
+		VkImageLayout layout) {
+	dlg_assert(start < end);
+	scratch.clear();
+
+	auto it = row.begin();
+	auto runStart = 0u;
+	for(; it != row.end() && it->layerEnd <= start; ++it) {
+		pushRun(scratch, it->layerEnd, it->layout);
+		runStart = it->layerEnd;
+	}
+
+	// beginning of the run cut by the change
+	if(it != row.end() && runStart < start) {
+		pushRun(scratch, start, it->layout);
+	}
+
+	pushRun(scratch, end, layout);
+
+	// skip runs covered by the change
+	while(it != row.end() && it->layerEnd <= end) {
+		++it;
+	}
+
+	for(; it != row.end(); ++it) {
+		pushRun(scratch, it->layerEnd, it->layout);
+	}
+
+	row.swap(scratch);
+}
+
+} // anon namespace
+
+std::vector<ImageSubresourceLayout> doApplyBatch(
+		span<const ImageSubresourceLayout> state,
+		span<const ImageSubresourceLayout> changes) {
+	dlg_assert(!state.empty());
+
+	// see doApply
+	constexpr VkImageAspectFlagBits supportedAspects[] = {
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_ASPECT_DEPTH_BIT,
+		VK_IMAGE_ASPECT_STENCIL_BIT,
+	};
+
+	// find the dimensions of the image. 'state' covers all subresources
+	VkImageAspectFlags aspectMask {};
+	auto numLayers = 0u;
+	auto numLevels = 0u;
+	for(auto& sub : state) {
+		aspectMask |= sub.range.aspectMask;
+		numLayers = std::max(numLayers, sub.range.baseArrayLayer + sub.range.layerCount);
+		numLevels = std::max(numLevels, sub.range.baseMipLevel + sub.range.levelCount);
+	}
+
+	VkImageAspectFlagBits aspectBits[std::size(supportedAspects)] {};
+	auto numAspects = 0u;
+	auto knownAspects = VkImageAspectFlags {};
+	for(auto bit : supportedAspects) {
+		knownAspects |= bit;
+		if(aspectMask & bit) {
+			aspectBits[numAspects++] = bit;
+		}
+	}
+
+	dlg_assert((aspectMask & ~knownAspects) == 0u);
+
+	// one row per aspect and mip level
+	std::vector<LayoutRow> rows(numAspects * numLevels,
+		LayoutRow{{numLayers, unknownLayout}});
+	LayoutRow scratch;
+
+	auto paintRange = [&](const ImageSubresourceLayout& sub) {
+		auto layerEnd = std::min(sub.range.baseArrayLayer + sub.range.layerCount, numLayers);
+		auto levelEnd = std::min(sub.range.baseMipLevel + sub.range.levelCount, numLevels);
+		if(sub.range.baseArrayLayer >= layerEnd) {
+			return;
+		}
+
+		for(auto a = 0u; a < numAspects; ++a) {
+			if(!(sub.range.aspectMask & aspectBits[a])) {
+				continue;
+			}
+
+			for(auto level = sub.range.baseMipLevel; level < levelEnd; ++level) {
+				paint(rows[a * numLevels + level], scratch,
+					sub.range.baseArrayLayer, layerEnd, sub.layout);
+			}
+		}
+	};
+
+	for(auto& sub : state) {
+		paintRange(sub);
+	}
+
+	for(auto& change : changes) {
+		dlg_assert(change.range.levelCount != VK_REMAINING_MIP_LEVELS);
+		dlg_assert(change.range.layerCount != VK_REMAINING_ARRAY_LAYERS);
+		dlg_assert((change.range.aspectMask & ~aspectMask) == 0u);
+		dlg_assert(change.range.baseArrayLayer + change.range.layerCount <= numLayers);
+		dlg_assert(change.range.baseMipLevel + change.range.levelCount <= numLevels);
+
+		// check that the change is actually valid
+		dlg_assertl_or(dlg_level_warn,
+			change.range.aspectMask != 0 &&
+			change.range.layerCount > 0 &&
+			change.range.levelCount > 0,
+			continue);
+
+		paintRange(change);
+	}
+
+	// Extract the rectangles per aspect. Runs that are the same in
+	// consecutive mip levels are merged. Rectangles are created
+	// (and therefore sorted) in (baseMipLevel, baseArrayLayer) order.
+	std::vector<ImageSubresourceLayout> ret;
+	std::vector<ImageSubresourceLayout> rects;
+	std::vector<ImageSubresourceLayout> merged;
+	std::vector<u32> open; // ids in 'rects' ending at the previous level
+	std::vector<u32> nextOpen;
+
+	for(auto a = 0u; a < numAspects; ++a) {
+		rects.clear();
+		open.clear();
+
+		for(auto level = 0u; level < numLevels; ++level) {
+			nextOpen.clear();
+
+			auto o = 0u;
+			auto start = 0u;
+			for(auto& run : rows[a * numLevels + level]) {
+				auto runStart = start;
+				start = run.layerEnd;
+
+				dlg_assertm_or(run.layout != unknownLayout, continue,
+					"ImageLayout state does not cover the whole image");
+
+				while(o < open.size() && rects[open[o]].range.baseArrayLayer < runStart) {
+					++o;
+				}
+
+				if(o < open.size()) {
+					auto& rect = rects[open[o]];
+					if(rect.range.baseArrayLayer == runStart &&
+							rect.range.layerCount == run.layerEnd - runStart &&
+							rect.layout == run.layout) {
+						++rect.range.levelCount;
+						nextOpen.push_back(open[o]);
+						continue;
+					}
+				}
+
+				nextOpen.push_back(u32(rects.size()));
+				auto& rect = rects.emplace_back();
+				rect.layout = run.layout;
+				rect.range.aspectMask = aspectBits[a];
+				rect.range.baseArrayLayer = runStart;
+				rect.range.layerCount = run.layerEnd - runStart;
+				rect.range.baseMipLevel = level;
+				rect.range.levelCount = 1u;
+			}
+
+			std::swap(open, nextOpen);
+		}
+
+		// Merge with the rectangles of the previous aspects, combining
+		// the aspect masks of identical rectangles.
+		auto less = [](const ImageSubresourceLayout& x, const ImageSubresourceLayout& y) {
+			return std::pair(x.range.baseMipLevel, x.range.baseArrayLayer) <
+				std::pair(y.range.baseMipLevel, y.range.baseArrayLayer);
+		};
+
+		merged.clear();
+		auto i = 0u;
+		auto j = 0u;
+		while(i < ret.size() && j < rects.size()) {
+			auto& x = ret[i];
+			auto& y = rects[j];
+			if(x.layout == y.layout &&
+					x.range.baseMipLevel == y.range.baseMipLevel &&
+					x.range.levelCount == y.range.levelCount &&
+					x.range.baseArrayLayer == y.range.baseArrayLayer &&
+					x.range.layerCount == y.range.layerCount) {
+				auto& dst = merged.emplace_back(x);
+				dst.range.aspectMask |= y.range.aspectMask;
+				++i;
+				++j;
+			} else if(less(y, x)) {
+				merged.push_back(y);
+				++j;
+			} else {
+				merged.push_back(x);
+				++i;
+			}
+		}
+
+		merged.insert(merged.end(), ret.begin() + i, ret.end());
+		merged.insert(merged.end(), rects.begin() + j, rects.end());
+		std::swap(ret, merged);
+	}
+
+	return ret;
+}
+
 void checkForErrors(span<const ImageSubresourceLayout> state,
 		const VkImageCreateInfo& ci) {
 	// TODO: make sure covered range is consistent: continuous and rect-shaped
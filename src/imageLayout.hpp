@@ -22,6 +22,19 @@ std::pair<span<ImageSubresourceLayout>, u32> doApply(ThreadMemScope& tms,
 		span<ImageSubresourceLayout> state,
 		const ImageSubresourceLayout& change);
 
+// Applies all changes at once and returns the resulting state.
+// Internally uses run-length encoded rows (per aspect and mip level, over
+// the array layers), so the cost doesn't grow with the number of
+// elements in 'state' for each change. The result is already simplified
+// to some degree. 'state' must cover the whole image.
+std::vector<ImageSubresourceLayout> doApplyBatch(
+		span<const ImageSubresourceLayout> state,
+		span<const ImageSubresourceLayout> changes);
+
+// The minimum number of changes for which apply uses doApplyBatch.
+// Applying the changes one-by-one is cheaper for few changes.
+constexpr auto minBatchApplyChanges = 8u;
+
 // Resolve references to VK_REMAINING_MIP_LEVELS, VK_REMAINING_ARRAY_LAYERS
 void resolve(VkImageSubresourceRange& range, const VkImageCreateInfo& ci);
 
@@ -34,6 +47,12 @@ void simplify(std::vector<ImageSubresourceLayout, A>& state) {
 template<typename A>
 void apply(std::vector<ImageSubresourceLayout, A>& state,
 		span<const ImageSubresourceLayout> changes) {
+	if(changes.size() >= minBatchApplyChanges) {
+		auto newState = doApplyBatch(state, changes);
+		state.assign(newState.begin(), newState.end());
+		return;
+	}
+
 	for(const auto& change : changes) {
 		ThreadMemScope tms;
 		auto [newStates, newSize] = doApply(tms, state, change);
@@ -37,6 +37,8 @@
 
 #include <vk/dispatch_table_helper.h>
 #include <csignal>
+#include <algorithm>
+#include <array>
 
 #include <vil_api.h>
 
@@ -447,7 +449,9 @@ uint32_t GetImageViewHandleNVX(
 }
 
 struct HookedFunction {
-	PFN_vkVoidFunction func {};
+	// Returns the function pointer. Casting function pointers isn't
+	// possible in constant expressions, converting a lambda is.
+	PFN_vkVoidFunction (*func)() {};
 	bool device {}; // device-level function
 	u32 version {}; // required vulkan version
 	// TODO: we never need both fields i guess, just merge them into 'ext'?
@@ -475,19 +479,26 @@ struct HookedFunction {
 	return val; \
 }()
 
-#define VIL_INI_HOOK(fn, ver) {"vk" # fn, {(PFN_vkVoidFunction) fn, FN_TC(fn, false), ver, {}}}
-#define VIL_INI_HOOK_EXT(fn, ext) {"vk" # fn, {(PFN_vkVoidFunction) fn, FN_TC(fn, false), VK_VERSION_1_0, ext}}
+#define FN_PTR(fn) []{ return (PFN_vkVoidFunction) fn; }
 
-#define VIL_DEV_HOOK(fn, ver) {"vk" # fn, {(PFN_vkVoidFunction) fn, FN_TC(fn, true), ver, {}, {}}}
-#define VIL_DEV_HOOK_EXT(fn, ext) {"vk" # fn, {(PFN_vkVoidFunction) fn, FN_TC(fn, true), VK_VERSION_1_0, {}, ext}}
-#define VIL_DEV_HOOK_ALIAS(alias, fn, ext) {"vk" # alias, {(PFN_vkVoidFunction) fn, FN_TC_ALIAS(alias, fn, true), VK_VERSION_1_0, {}, ext}}
+#define VIL_INI_HOOK(fn, ver) {"vk" # fn, {FN_PTR(fn), FN_TC(fn, false), ver, {}}}
+#define VIL_INI_HOOK_EXT(fn, ext) {"vk" # fn, {FN_PTR(fn), FN_TC(fn, false), VK_VERSION_1_0, ext}}
+
+#define VIL_DEV_HOOK(fn, ver) {"vk" # fn, {FN_PTR(fn), FN_TC(fn, true), ver, {}, {}}}
+#define VIL_DEV_HOOK_EXT(fn, ext) {"vk" # fn, {FN_PTR(fn), FN_TC(fn, true), VK_VERSION_1_0, {}, ext}}
+#define VIL_DEV_HOOK_ALIAS(alias, fn, ext) {"vk" # alias, {FN_PTR(fn), FN_TC_ALIAS(alias, fn, true), VK_VERSION_1_0, {}, ext}}
 
 // NOTE: not sure about these, it seems applications can use KHR functions without
 // enabling the extension when the function is in core? The vulkan samples do this
 // at least. So we return them as well.
-#define VIL_DEV_HOOK_ALIAS_CORE(alias, fn, ext) {"vk" # alias, {(PFN_vkVoidFunction) fn, FN_TC_ALIAS(alias, fn, true), VK_VERSION_1_0, {}, {}}}
+#define VIL_DEV_HOOK_ALIAS_CORE(alias, fn, ext) {"vk" # alias, {FN_PTR(fn), FN_TC_ALIAS(alias, fn, true), VK_VERSION_1_0, {}, {}}}
+
+struct NamedHook {
+	std::string_view name;
+	HookedFunction hook;
+};
 
-static const std::unordered_map<std::string_view, HookedFunction> funcPtrTable {
+constexpr NamedHook hookedFunctions[] = {
 	VIL_INI_HOOK(GetInstanceProcAddr, VK_API_VERSION_1_0),
 	VIL_INI_HOOK(CreateInstance, VK_API_VERSION_1_0),
 	VIL_INI_HOOK(DestroyInstance, VK_API_VERSION_1_0),
@@ -518,7 +529,7 @@ static const std::unordered_map<std::string_view, HookedFunction> funcPtrTable {
 	VIL_DEV_HOOK_EXT(SetDebugUtilsObjectTagEXT, VK_EXT_DEBUG_UTILS_EXTENSION_NAME),
 
 #ifdef VIL_WITH_WAYLAND
-	VIL_HOOK_EXT(CreateWaylandSurfaceKHR, VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME),
+	VIL_INI_HOOK_EXT(CreateWaylandSurfaceKHR, VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME),
 #endif // VIL_WITH_WAYLAND
 
 #ifdef VIL_WITH_X11
@@ -529,7 +540,7 @@ static const std::unordered_map<std::string_view, HookedFunction> funcPtrTable {
 #ifdef VIL_WITH_WIN32
 	// We do everything to not include the platform-specific header
 	// VIL_INI_HOOK_EXT(CreateWin32SurfaceKHR, VK_KHR_WIN32_SURFACE_EXTENSION_NAME),
-	{"vkCreateWin32SurfaceKHR", HookedFunction{(PFN_vkVoidFunction) CreateWin32SurfaceKHR, false, VK_VERSION_1_0, "VK_KHR_win32_surface"}},
+	{"vkCreateWin32SurfaceKHR", HookedFunction{FN_PTR(CreateWin32SurfaceKHR), false, VK_VERSION_1_0, "VK_KHR_win32_surface"}},
 #endif // VIL_WITH_WIN32
 
 	VIL_INI_HOOK_EXT(DestroySurfaceKHR, VK_KHR_SURFACE_EXTENSION_NAME),
@@ -904,6 +915,106 @@ static const std::unordered_map<std::string_view, HookedFunction> funcPtrTable {
 #undef VIL_DEV_HOOK
 #undef VIL_DEV_HOOK_EXT
 #undef VIL_DEV_HOOK_ALIAS
+#undef VIL_DEV_HOOK_ALIAS_CORE
+#undef FN_PTR
+
+// The hooked functions, sorted by the hash of their name at compile time.
+// Applications (and loaders) query function pointers thousands of times,
+// a lookup just hashes the name once and does a binary search.
+// There is no dynamic initialization involved.
+struct HookEntry {
+	u64 hash {};
+	std::string_view name {};
+	HookedFunction hook {};
+};
+
+// FNV-1a
+constexpr u64 hashFuncName(std::string_view name) {
+	auto hash = u64(0xCBF29CE484222325ull);
+	for(auto c : name) {
+		hash ^= u64(static_cast<unsigned char>(c));
+		hash *= u64(0x100000001B3ull);
+	}
+
+	return hash;
+}
+
+template<std::size_t N>
+constexpr std::array<HookEntry, N> buildFuncPtrTable(const NamedHook (&hooks)[N]) {
+	std::array<HookEntry, N> ret {};
+	for(auto i = 0u; i < N; ++i) {
+		ret[i] = {hashFuncName(hooks[i].name), hooks[i].name, hooks[i].hook};
+	}
+
+	// heap sort. We can't use std::sort, it isn't constexpr in C++17.
+	// Insertion sort would be too slow for some compile-time evaluators.
+	auto swap = [&](std::size_t a, std::size_t b) {
+		auto tmp = ret[a];
+		ret[a] = ret[b];
+		ret[b] = tmp;
+	};
+
+	auto siftDown = [&](std::size_t root, std::size_t end) {
+		while(2 * root + 1 < end) {
+			auto child = 2 * root + 1;
+			if(child + 1 < end && ret[child].hash < ret[child + 1].hash) {
+				++child;
+			}
+
+			if(!(ret[root].hash < ret[child].hash)) {
+				break;
+			}
+
+			swap(root, child);
+			root = child;
+		}
+	};
+
+	for(auto i = N / 2; i > 0; --i) {
+		siftDown(i - 1, N);
+	}
+
+	for(auto end = N; end > 1; --end) {
+		swap(0, end - 1);
+		siftDown(0, end - 1);
+	}
+
+	return ret;
+}
+
+template<std::size_t N>
+constexpr bool validFuncPtrTable(const std::array<HookEntry, N>& table) {
+	for(auto i = 1u; i < N; ++i) {
+		if(table[i - 1].hash > table[i].hash) {
+			return false;
+		}
+
+		// the same function must not be hooked twice
+		for(auto j = i; j > 0 && table[j - 1].hash == table[i].hash; --j) {
+			if(table[j - 1].name == table[i].name) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+constexpr auto funcPtrTable = buildFuncPtrTable(hookedFunctions);
+static_assert(validFuncPtrTable(funcPtrTable));
+
+static const HookedFunction* findHook(std::string_view name) {
+	auto hash = hashFuncName(name);
+	auto it = std::lower_bound(funcPtrTable.begin(), funcPtrTable.end(), hash,
+		[](const HookEntry& entry, u64 hash) { return entry.hash < hash; });
+	for(; it != funcPtrTable.end() && it->hash == hash; ++it) {
+		if(it->name == name) {
+			return &it->hook;
+		}
+	}
+
+	return nullptr;
+}
 
 // We make sure this way that e.g. calling vkGetInstanceProcAddr with
 // vkGetInstanceProcAddr as funcName parameter returns itself.
@@ -911,8 +1022,8 @@ static const std::unordered_map<std::string_view, HookedFunction> funcPtrTable {
 VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetInstanceProcAddr(VkInstance ini, const char* funcName) {
 	// Check if we hooked it. If we didn't hook it and ini is invalid,
 	// return nullptr.
-	auto it = funcPtrTable.find(std::string_view(funcName));
-	if(it == funcPtrTable.end()) {
+	auto* hook = findHook(funcName);
+	if(!hook) {
 		// If it's not hooked, just forward it to the next chain link
 		auto* inid = vil::findData<vil::Instance>(ini);
 		if(!inid || !inid->dispatch.GetInstanceProcAddr) {
@@ -924,13 +1035,12 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetInstanceProcAddr(VkInstance ini, con
 	}
 
 	// special case: functions that don't need instance.
-	auto& hook = it->second;
 	if(std::strcmp(funcName, "vkGetInstanceProcAddr") == 0 ||
 			// NOTE: seems that some applications need this even though
 			// it shouldn't be valid use per spec
 			std::strcmp(funcName, "vkCreateDevice") == 0 ||
 			std::strcmp(funcName, "vkCreateInstance") == 0) {
-		return hook.func;
+		return hook->func();
 	}
 
 	if(!ini) {
@@ -944,8 +1054,8 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetInstanceProcAddr(VkInstance ini, con
 		return nullptr;
 	}
 
-	if(!hook.device && !hook.iniExt.empty()) {
-		auto it = find(inid->extensions, hook.iniExt);
+	if(!hook->device && !hook->iniExt.empty()) {
+		auto it = find(inid->extensions, hook->iniExt);
 		if(it == inid->extensions.end()) {
 			return inid->dispatch.GetInstanceProcAddr(ini, funcName);
 			// return nullptr;
@@ -959,10 +1069,10 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetInstanceProcAddr(VkInstance ini, con
 	// the function (we could store a list of those in the instance data).
 	// See documentation for vkGetInstanceProcAddr.
 
-	return hook.func;
+	return hook->func();
 }
 
-auto knownUnhooked = std::set<std::string>{
+constexpr std::string_view knownUnhooked[] = {
 	"vkGetDeviceQueue",
 	"vkGetDeviceQueue2",
 	// query pool
@@ -1038,10 +1148,11 @@ auto knownUnhooked = std::set<std::string>{
 };
 
 VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetDeviceProcAddr(VkDevice vkDev, const char* funcName) {
-	auto it = funcPtrTable.find(std::string_view(funcName));
-	if(it == funcPtrTable.end()) {
+	auto* hook = findHook(funcName);
+	if(!hook) {
 		// If it's not hooked, just forward it to the next chain link
-		if(knownUnhooked.find(funcName) == knownUnhooked.end()) {
+		if(std::find(std::begin(knownUnhooked), std::end(knownUnhooked),
+				std::string_view(funcName)) == std::end(knownUnhooked)) {
 			dlg_trace("unhooked device function: {}", funcName);
 		}
 
@@ -1054,8 +1165,7 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetDeviceProcAddr(VkDevice vkDev, const
   		return dev->dispatch.GetDeviceProcAddr(vkDev, funcName);
 	}
 
-	auto& hook = it->second;
-	if(!vkDev || !hook.device) {
+	if(!vkDev || !hook->device) {
 		dlg_trace("GetDeviceProcAddr with no devcice/non-device function: {}", funcName);
 		return nullptr;
 	}
@@ -1066,8 +1176,8 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetDeviceProcAddr(VkDevice vkDev, const
 		return nullptr;
 	}
 
-	if(!hook.devExt.empty()) {
-		auto it = find(dev->appExts, hook.devExt);
+	if(!hook->devExt.empty()) {
+		auto it = find(dev->appExts, hook->devExt);
 		if(it == dev->appExts.end()) {
 			return nullptr;
 			// return dev->dispatch.GetDeviceProcAddr(vkDev, funcName);
@@ -1075,11 +1185,11 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL GetDeviceProcAddr(VkDevice vkDev, const
 	}
 
 	// TODO: consider device version?
-	if(dev->ini->app.apiVersion < hook.version) {
+	if(dev->ini->app.apiVersion < hook->version) {
 		return nullptr;
 	}
 
-	return hook.func;
+	return hook->func();
 }
 
 } // namespace vil
@@ -11,21 +11,20 @@ float maxPossibleScore(float score, u32 width, u32 height, u32 i, u32 j) {
 LazyMatrixMarch::LazyMatrixMarch(u32 width, u32 height, LinAllocator& alloc,
 	Matcher matcher, float branchThreshold) :
 		alloc_(alloc), width_(width), height_(height), matcher_(std::move(matcher)),
-		branchThreshold_(branchThreshold), candidates_(HeapCandCompare{*this}, alloc) {
+		sparseMatrix_(alloc), branchThreshold_(branchThreshold),
+		candidates_(HeapCandCompare{*this},
+			MyAlloc<HeapCand>(alloc, nodeFreeList_)) {
 
 	dlg_assert(width > 0);
 	dlg_assert(height > 0);
-	// if we ever exceed this, just use 32-bit integers for HeapCand.
-	// Not that big of a loss, 16-bit was done because of performance
-	// and memory concerns. Who matches such HUGE sequences?!
-	dlg_assert(width < 1024 * 64);
-	dlg_assert(height < 1024 * 64);
 	dlg_assert(matcher_);
 
-	matchMatrix_ = alloc.allocNonTrivial<EvalMatch>(width * height);
+	if(u64(width) * height <= maxDenseFields) {
+		matchMatrix_ = alloc.allocNonTrivial<EvalMatch>(width * height);
 
-	for(auto& m : matchMatrix_) {
-		m.candidate = candidates_.end();
+		for(auto& m : matchMatrix_) {
+			m.candidate = candidates_.end();
+		}
 	}
 
 	// insert first candidate
@@ -61,7 +60,7 @@ void LazyMatrixMarch::addCandidate(float score, u32 i, u32 j, u32 addI, u32 addJ
 				candidates_.erase(m.candidate);
 			}
 
-			auto [it, succ] = candidates_.insert({u16(i + addI), u16(j + addJ), score});
+			auto [it, succ] = candidates_.insert({i + addI, j + addJ, score});
 			dlg_assert(succ);
 			m.candidate = it;
 			m.best = score;
@@ -95,8 +94,10 @@ bool LazyMatrixMarch::step() {
 		++numEvals_;
 	}
 
-	if(m.eval > 0.f) {
-		auto newScore = cand.score + m.eval;
+	// 'm' might be invalidated by adding candidates
+	auto eval = m.eval;
+	if(eval > 0.f) {
+		auto newScore = cand.score + eval;
 		addCandidate(newScore, cand.i, cand.j, 1, 1);
 
 		// throw out all candidates that can't even reach what we have
@@ -110,7 +111,7 @@ bool LazyMatrixMarch::step() {
 	// candidates total.
 	// NOTE: only threshold = 1.f is guaranteed to be 100% correct,
 	// otherwise it's a heuristic.
-	if(m.eval < branchThreshold_) {
+	if(eval < branchThreshold_) {
 		addCandidate(cand.score, cand.i, cand.j, 1, 0);
 		addCandidate(cand.score, cand.i, cand.j, 0, 1);
 	}
@@ -133,8 +134,10 @@ LazyMatrixMarch::Result LazyMatrixMarch::run() {
 
 	dlg_assert(bestMatch_ >= 0.f);
 
+	// NOTE: we don't use match() here to not create new fields,
+	// fields never visited don't have a best path.
 	auto [i, j] = bestRes_;
-	auto& lastMatch = match(i, j);
+	auto& lastMatch = matchData(i, j);
 	dlg_assert(bestMatch_ >= lastMatch.best);
 	dlg_assert(bestMatch_ - lastMatch.best <= 1.f);
 	if(lastMatch.eval > 0.f) {
@@ -143,20 +146,20 @@ LazyMatrixMarch::Result LazyMatrixMarch::run() {
 	}
 
 	while(i > 0 && j > 0) {
-		auto& score = match(i, j);
-		auto& up = match(i, j - 1);
+		auto& score = matchData(i, j);
+		auto& up = matchData(i, j - 1);
 		if(up.best == score.best) {
 			--j;
 			continue;
 		}
 
-		auto& left = match(i - 1, j);
+		auto& left = matchData(i - 1, j);
 		if(left.best == score.best) {
 			--i;
 			continue;
 		}
 
-		auto& diag = match(i - 1, j - 1);
+		auto& diag = matchData(i - 1, j - 1);
 		dlg_assert(diag.best < score.best);
 		dlg_assertm(diag.eval > 0.f && diag.eval <= 1.f, "{}", diag.eval);
 		dlg_assertm(std::abs(diag.eval - (score.best - diag.best)) < 0.001,
@@ -175,6 +178,33 @@ LazyMatrixMarch::Result LazyMatrixMarch::run() {
 	return res;
 }
 
+LazyMatrixMarch::EvalMatch& LazyMatrixMarch::match(u32 i, u32 j) {
+	dlg_assert(i < width_ && j < height_);
+	if(!matchMatrix_.empty()) {
+		return matchMatrix_[width_ * j + i];
+	}
+
+	auto key = fieldKey(i, j);
+	auto [field, inserted] = sparseMatrix_.tryEmplace(key, key, candidates_.end());
+	(void) inserted;
+	return field.match;
+}
+
+const LazyMatrixMarch::EvalMatch& LazyMatrixMarch::matchData(u32 i, u32 j) const {
+	dlg_assert(i < width_ && j < height_);
+	if(!matchMatrix_.empty()) {
+		return matchMatrix_[width_ * j + i];
+	}
+
+	auto* field = sparseMatrix_.find(fieldKey(i, j));
+	if(!field) {
+		static const EvalMatch unvisited {};
+		return unvisited;
+	}
+
+	return field->match;
+}
+
 float LazyMatrixMarch::maxPossibleScore(float score, u32 i, u32 j) const {
 	return vil::maxPossibleScore(score, width_, height_, i, j);
 }
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <util/linalloc.hpp>
+#include <util/flatPtrSet.hpp>
 #include <functional>
 #include <utility>
 #include <set>
+#include <cstdint>
 
 namespace vil {
 
@@ -21,9 +23,9 @@ namespace vil {
 // of mostly similar sequences, it will be ~O(n).
 // The idea (and implementation) of the algorithm can be described
 // as a best-path finding through the lazily evaluated matching matrix.
-// Memory consumption is currently always O(n^2) since this was never
-// a big problem. It could be reduced, being ~O(n) for the well-matching
-// cases as well.
+// For small matrices, the matrix is stored densely, i.e. O(n^2) memory.
+// Larger matrices only store the visited fields in a hash map, making
+// memory consumption ~O(n) for the well-matching cases as well.
 //
 // In vil, we need this for command hierachy matching, associating
 // commands between different frames and submissions.
@@ -55,8 +57,8 @@ struct LazyMatrixMarch {
 	};
 
 	struct HeapCand {
-		u16 i;
-		u16 j;
+		u32 i;
+		u32 j;
 		float score;
 	};
 
@@ -89,16 +91,51 @@ struct LazyMatrixMarch {
 		}
 	};
 
+	// Free list of candidate set nodes. We constantly insert and erase
+	// candidates, without reusing their memory this grows with the
+	// number of steps.
+	struct NodeFreeList {
+		void* head {};
+		size_t nodeSize {};
+	};
+
 	template<typename T>
 	struct MyAlloc : LinearUnscopedAllocator<T> {
-		using typename LinearUnscopedAllocator<T>::is_always_equal;
-		using typename LinearUnscopedAllocator<T>::value_type;
-		using LinearUnscopedAllocator<T>::LinearUnscopedAllocator;
-		using LinearUnscopedAllocator<T>::allocate;
-
-		void deallocate(T*, size_t) const noexcept {
-			// TODO: use free-list
-			// dlg_error(":(");
+		using Base = LinearUnscopedAllocator<T>;
+		using typename Base::is_always_equal;
+		using typename Base::value_type;
+
+		NodeFreeList* freeList_ {};
+
+		MyAlloc(LinAllocator& alloc, NodeFreeList& freeList) noexcept :
+			Base(alloc), freeList_(&freeList) {}
+
+		template<typename O>
+		MyAlloc(const MyAlloc<O>& rhs) noexcept :
+			Base(rhs), freeList_(rhs.freeList_) {}
+
+		T* allocate(size_t n) {
+			static_assert(sizeof(T) >= sizeof(void*));
+			if(n == 1u && freeList_->head) {
+				// only nodes of a single type are allocated
+				dlg_assert(freeList_->nodeSize == sizeof(T));
+				auto* node = freeList_->head;
+				freeList_->head = *static_cast<void**>(node);
+				return static_cast<T*>(node);
+			}
+
+			return Base::allocate(n);
+		}
+
+		void deallocate(T* ptr, size_t n) const noexcept {
+			if(n != 1u) {
+				return;
+			}
+
+			dlg_assert(!freeList_->nodeSize || freeList_->nodeSize == sizeof(T));
+			freeList_->nodeSize = sizeof(T);
+			*reinterpret_cast<void**>(ptr) = freeList_->head;
+			freeList_->head = ptr;
 		}
 	};
 
@@ -117,6 +154,11 @@ struct LazyMatrixMarch {
 		QSet::const_iterator candidate; // candidates_.end() when there is none
 	};
 
+	// Maximum memory used for storing all fields of the matrix.
+	// Matrices with more fields only store the visited fields.
+	static constexpr u64 maxDenseMemory = 16 * 1024 * 1024;
+	static constexpr u64 maxDenseFields = maxDenseMemory / sizeof(EvalMatch);
+
 	// The function evaluating the match between the ith element in the
 	// first sequence with the jth element in the second sequence.
 	// Note how the LazyMatrixMarch algorithm itself never sees the sequences
@@ -146,9 +188,8 @@ struct LazyMatrixMarch {
 	HeapCand peekCandidate() const;
 	const auto& candidates() const { return candidates_; }
 	bool empty() const { return candidates_.empty(); }
-	const EvalMatch& matchData(u32 i, u32 j) const {
-		return matchMatrix_[width() * j + i];
-	}
+	// Returns a default EvalMatch for fields that were never visited.
+	const EvalMatch& matchData(u32 i, u32 j) const;
 
 	u32 width() const { return width_; }
 	u32 height() const { return height_; }
@@ -162,9 +203,9 @@ private:
 
 	HeapCand popCandidate();
 	void prune(float minScore);
-	EvalMatch& match(u32 i, u32 j) {
-		return matchMatrix_[width() * j + i];
-	}
+	// Creates the field if it was never visited.
+	// The returned reference is only valid until the next call.
+	EvalMatch& match(u32 i, u32 j);
 
 	// util
 	float maxPossibleScore(float score, u32 i, u32 j) const;
@@ -172,15 +213,40 @@ private:
 		return maxPossibleScore(c.score, c.i, c.j);
 	}
 
+	// Visited field in the sparse storage
+	struct SparseField {
+		u64 key; // see fieldKey
+		EvalMatch match;
+
+		SparseField(u64 xkey, QSet::const_iterator noCandidate) :
+				key(xkey) {
+			match.candidate = noCandidate;
+		}
+	};
+
+	struct SparseFieldKey {
+		u64 operator()(const SparseField& f) const {
+			return f.key;
+		}
+	};
+
+	// The index of the field in the full matrix.
+	u64 fieldKey(u32 i, u32 j) const {
+		return u64(width_) * j + i;
+	}
+
 private:
 	LinAllocator& alloc_;
 	u32 width_;
 	u32 height_;
 	Matcher matcher_;
-	// lazily evaluated matrix
+	// lazily evaluated matrix, only used for small sizes, see maxDenseFields.
 	// NOTE: need unique span since the iterator type might be
 	// non-trivially-destructible (e.g. the case for stdc++ debug mode)
 	UniqueSpan<EvalMatch> matchMatrix_;
+	// The visited fields of the lazily evaluated matrix, used
+	// when matchMatrix_ is empty.
+	FlatPtrSet<SparseField, SparseFieldKey, u64> sparseMatrix_;
 	float bestMatch_ {-1.f};
 	std::pair<u32, u32> bestRes_ {};
 	float branchThreshold_;
@@ -189,6 +255,8 @@ private:
 	u32 numEvals_ {};
 	u32 numSteps_ {};
 
+	// Must outlive candidates_
+	NodeFreeList nodeFreeList_ {};
 	QSet candidates_;
 };
 
@@ -3,6 +3,7 @@
 #include <device.hpp>
 #include <rp.hpp>
 #include <shader.hpp>
+#include <xfbCache.hpp>
 #include <ds.hpp>
 #include <accelStruct.hpp>
 #include <threadContext.hpp>
@@ -12,6 +13,8 @@
 #include <util/util.hpp>
 #include <util/dlg.hpp>
 #include <vkutil/enumString.hpp>
+#include <commandHook/hook.hpp>
+#include <util/profiling.hpp>
 
 namespace vil {
 
@@ -49,7 +52,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(
 
 	struct PreData {
 		IntrusivePtr<RenderPass> rp {};
-		IntrusivePtr<XfbPatchDesc> xfb {};
+		bool xfb {}; // whether an xfb variant is possible
 		span<const VkPipelineShaderStageCreateInfo> stages;
 	};
 
@@ -59,9 +62,6 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(
 	std::vector<PreData> pres;
 	pres.resize(createInfoCount);
 
-	// TODO: use memScope as well
-	std::vector<std::vector<VkPipelineShaderStageCreateInfo>> stagesVecs;
-
 	for(auto i = 0u; i < createInfoCount; ++i) {
 		auto& nci = ncis[i];
 		nci.layout = get(dev, nci.layout).handle;
@@ -78,88 +78,30 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(
 		}
 
 		pre.stages = {nci.pStages, nci.stageCount};
-		u32 xfbVertexStageID = u32(-1);
 
 		// transform feedback isn't supported for multiview graphics pipelines
 		// TODO: support it for non-multiview dynamic rendering
-		auto useXfb = dev.transformFeedback &&
+		pre.xfb = dev.transformFeedback &&
 			pre.rp &&
 			!hasChain(pre.rp->desc, VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO);
 
-		auto& stages = stagesVecs.emplace_back();
-		for(auto s = 0u; s < nci.stageCount; ++s) {
-			auto src = nci.pStages[s];
-			if(src.stage == VK_SHADER_STAGE_VERTEX_BIT && useXfb) {
-				dlg_assert(xfbVertexStageID == u32(-1));
-				xfbVertexStageID = u32(stages.size());
+		auto hasVertexStage = false;
+		for(auto& stage : pre.stages) {
+			if(stage.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+				hasVertexStage = true;
 			}
 
-			if(src.stage == VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT ||
-					src.stage == VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT ||
-					src.stage == VK_SHADER_STAGE_MESH_BIT_NV) {
-				useXfb = false;
-				xfbVertexStageID = u32(-1);
+			// xfb captures the output of the last pre-rasterization stage,
+			// we only patch the vertex stage.
+			if(stage.stage == VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT ||
+					stage.stage == VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT ||
+					stage.stage == VK_SHADER_STAGE_GEOMETRY_BIT ||
+					stage.stage == VK_SHADER_STAGE_MESH_BIT_NV) {
+				pre.xfb = false;
 			}
-
-			stages.push_back(src);
 		}
 
-		useXfb &= xfbVertexStageID != u32(-1);
-		if (useXfb) {
-			auto& stage = stages[xfbVertexStageID];
-			auto& mod = dev.shaderModules.get(stage.module);
-			auto spec = createShaderSpecialization(stage.pSpecializationInfo);
-
-			{
-				// All we are doing here is basically lazily creating
-				// an xfb-patched version of the vertex shader. We want to
-				// avoid locking dev.mutex *while* we actually patch it since
-				// we have to iterate over the module for that (not cheap for
-				// huge modules).
-				std::unique_lock lock(dev.mutex);
-
-				auto finder = [&](const XfbPatchData& patched) {
-					return patched.entryPoint == stage.pName && patched.spec == spec;
-				};
-				auto it = find_if(mod.xfb, finder);
-				auto itValid = true;
-				if(it == mod.xfb.end()) {
-					itValid = false;
-					lock.unlock();
-					XfbPatchData xfb;
-
-					{
-						auto& refl = specializeSpirv(mod, spec,
-							stage.pName, u32(spv::ExecutionModelVertex));
-						xfb = patchShaderXfb(dev, refl, stage.pName, mod.name);
-					}
-
-					if(xfb.mod) {
-						lock.lock();
-						// check again, it might have been constructed by another thread in the meantime
-						it = find_if(mod.xfb, finder);
-
-						if(it == mod.xfb.end()) {
-							xfb.spec = std::move(spec);
-							stage.module = xfb.mod;
-							it = mod.xfb.emplace(it, std::move(xfb));
-						} else if(xfb.mod) {
-							dlg_trace("xfb patch race prevented");
-							dev.dispatch.DestroyShaderModule(dev.handle, xfb.mod, nullptr);
-						}
-
-						itValid = true;
-					}
-				}
-
-				if(itValid) {
-					stage.module = it->mod;
-					pre.xfb = it->desc;
-				}
-			}
-		}
-
-		nci.pStages = stages.data();
+		pre.xfb &= hasVertexStage;
 	}
 
 	{
@@ -200,7 +142,6 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(
 		pipe.hasTessellation = false;
 		pipe.hasMeshShader = false;
 		pipe.hasDepthStencil = false;
-		pipe.xfbPatch = std::move(pres[i].xfb);
 
 		for(auto stage : pres[i].stages) {
 			pipe.stages.emplace_back(dev, stage);
@@ -222,9 +163,10 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(
 		}
 
 		if(!pipe.hasMeshShader) {
-			// vertex input state ignored if dynamic vertex input is set
-			if(!pipe.dynamicState.count(VK_DYNAMIC_STATE_VERTEX_INPUT_EXT)) {
-				dlg_assert(pci.pVertexInputState);
+			// vertex input state ignored if dynamic vertex input is set.
+			// Might also be null for pipeline libraries.
+			if(!pipe.dynamicState.count(VK_DYNAMIC_STATE_VERTEX_INPUT_EXT) &&
+					pci.pVertexInputState) {
 				pipe.vertexAttribs = {
 					pci.pVertexInputState->pVertexAttributeDescriptions,
 					pci.pVertexInputState->pVertexAttributeDescriptions + pci.pVertexInputState->vertexAttributeDescriptionCount
@@ -237,11 +179,21 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(
 				pipe.vertexInputState = *pci.pVertexInputState;
 			}
 
-			pipe.inputAssemblyState = *pci.pInputAssemblyState;
+			if(pci.pInputAssemblyState) {
+				pipe.inputAssemblyState = *pci.pInputAssemblyState;
+			}
 		}
 
 		if(!pci.pRasterizationState->rasterizerDiscardEnable) {
 			pipe.multisampleState = *pci.pMultisampleState;
+			if(pipe.multisampleState.pSampleMask) {
+				auto count = (u32(pipe.multisampleState.rasterizationSamples) + 31) / 32;
+				pipe.sampleMask = {
+					pipe.multisampleState.pSampleMask,
+					pipe.multisampleState.pSampleMask + count
+				};
+			}
+
 			pipe.viewportState = *pci.pViewportState;
 
 			if(!pipe.dynamicState.count(VK_DYNAMIC_STATE_SCISSOR)) {
@@ -288,6 +240,25 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(
 
 		fixPointers(pipe);
 
+		// The xfb variant is created from the state we store here,
+		// extension structs of the states aren't supported.
+		auto noExt = [](const auto* state) { return !state || !state->pNext; };
+		auto rasterized = !pci.pRasterizationState->rasterizerDiscardEnable;
+		auto xfb = pres[i].xfb &&
+			!pipe.dynamicState.count(VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE) &&
+			(pipe.dynamicState.count(VK_DYNAMIC_STATE_VERTEX_INPUT_EXT) ||
+				(pci.pVertexInputState && !pci.pVertexInputState->pNext)) &&
+			pci.pInputAssemblyState && noExt(pci.pInputAssemblyState) &&
+			noExt(pci.pRasterizationState) &&
+			(!rasterized || (
+				noExt(pci.pViewportState) &&
+				noExt(pci.pMultisampleState) &&
+				(!pipe.hasDepthStencil || noExt(pci.pDepthStencilState)) &&
+				(!needsColorBlend || noExt(pci.pColorBlendState))));
+		if(xfb) {
+			pipe.xfbState.store(XfbVariantState::none);
+		}
+
 		pPipelines[i] = castDispatch<VkPipeline>(static_cast<Pipeline&>(pipe));
 
 		auto newPipePtr = IntrusiveDerivedPtr<Pipeline>(pipePtr.get());
@@ -575,7 +546,270 @@ std::unique_ptr<spc::Compiler> copySpecializeSpirv(const PipelineShaderStage& st
 		stage.entryPoint, execModel);
 }
 
-GraphicsPipeline::~GraphicsPipeline() = default;
+GraphicsPipeline::~GraphicsPipeline() {
+	if(!dev) {
+		return;
+	}
+
+	if(xfbPipe) {
+		dev->dispatch.DestroyPipeline(dev->handle, xfbPipe, nullptr);
+	}
+}
+
+// xfb variant
+namespace {
+
+// Creates a copy of the given module. The application might already
+// have destroyed the original one.
+VkShaderModule copyShaderModule(Device& dev, ShaderModule& mod) {
+	// Parse it before locking the mutex, might take a while.
+	(void) mod.compiled();
+
+	std::vector<u32> spirv;
+	{
+		std::lock_guard lock(dev.mutex);
+		spirv = mod.compiled().get_ir().spirv;
+	}
+
+	VkShaderModuleCreateInfo ci {};
+	ci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	ci.pCode = spirv.data();
+	ci.codeSize = spirv.size() * 4;
+
+	VkShaderModule ret {};
+	auto res = dev.dispatch.CreateShaderModule(dev.handle, &ci, nullptr, &ret);
+	if(res != VK_SUCCESS) {
+		dlg_error("xfb CreateShaderModule: {} ({})", vk::name(res), res);
+		return VK_NULL_HANDLE;
+	}
+
+	return ret;
+}
+
+// Creates the variant of the given pipeline that is used to capture the
+// output of the vertex shader. It's a full copy of the pipeline, just
+// with the xfb-patched vertex stage. So the captured draw only has to
+// be drawn once, with the variant bound instead of the pipeline.
+// The dynamic state stays the same so binding it (and the original
+// pipeline afterwards) inside the hooked record doesn't invalidate the
+// dynamic state set by the application.
+// Extension structs of the pipeline state aren't supported, see
+// CreateGraphicsPipelines.
+bool createXfbVariant(Device& dev, GraphicsPipeline& pipe) {
+	ZoneScoped;
+
+	const PipelineShaderStage* vertStage {};
+	for(auto& stage : pipe.stages) {
+		if(stage.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+			vertStage = &stage;
+			break;
+		}
+	}
+
+	dlg_assert_or(vertStage && pipe.renderPass, return false);
+
+	auto patched = patchShaderXfb(dev, *vertStage->spirv,
+		vertStage->specialization, vertStage->entryPoint.c_str());
+	if(!patched.mod) {
+		return false;
+	}
+
+	std::vector<VkShaderModule> modules;
+	auto cleanup = [&]{
+		for(auto mod : modules) {
+			dev.dispatch.DestroyShaderModule(dev.handle, mod, nullptr);
+		}
+	};
+
+	modules.push_back(patched.mod);
+
+	std::vector<VkSpecializationInfo> specInfos(pipe.stages.size());
+	std::vector<VkPipelineShaderStageCreateInfo> stages(pipe.stages.size());
+	for(auto i = 0u; i < pipe.stages.size(); ++i) {
+		auto& src = pipe.stages[i];
+		auto& spec = src.specialization;
+
+		auto& specInfo = specInfos[i];
+		specInfo.mapEntryCount = u32(spec.entries.size());
+		specInfo.pMapEntries = spec.entries.data();
+		specInfo.dataSize = spec.data.size();
+		specInfo.pData = spec.data.data();
+
+		auto& stage = stages[i];
+		stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stage.stage = src.stage;
+		stage.pName = src.entryPoint.c_str();
+		stage.pSpecializationInfo = &specInfo;
+
+		if(&src == vertStage) {
+			stage.module = patched.mod;
+		} else {
+			stage.module = copyShaderModule(dev, *src.spirv);
+			if(!stage.module) {
+				cleanup();
+				return false;
+			}
+
+			modules.push_back(stage.module);
+		}
+	}
+
+	// The application's extension structs aren't supported and might not be
+	// alive anymore, see CreateGraphicsPipelines
+	auto vertexInput = pipe.vertexInputState;
+	auto inputAssembly = pipe.inputAssemblyState;
+	auto rasterization = pipe.rasterizationState;
+	auto viewport = pipe.viewportState;
+	auto multisample = pipe.multisampleState;
+	auto depthStencil = pipe.depthStencilState;
+	auto colorBlend = pipe.colorBlendState;
+	vertexInput.pNext = nullptr;
+	inputAssembly.pNext = nullptr;
+	rasterization.pNext = nullptr;
+	viewport.pNext = nullptr;
+	multisample.pNext = nullptr;
+	depthStencil.pNext = nullptr;
+	colorBlend.pNext = nullptr;
+
+	std::vector<VkDynamicState> dynStates {
+		pipe.dynamicState.begin(), pipe.dynamicState.end()};
+
+	VkPipelineDynamicStateCreateInfo dynState {};
+	dynState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynState.dynamicStateCount = u32(dynStates.size());
+	dynState.pDynamicStates = dynStates.data();
+
+	// The application might already have destroyed its render pass,
+	// we therefore create a compatible one.
+	auto rp = create(dev, pipe.renderPass->desc);
+
+	VkGraphicsPipelineCreateInfo gpi {};
+	gpi.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	gpi.stageCount = u32(stages.size());
+	gpi.pStages = stages.data();
+	gpi.pVertexInputState = &vertexInput;
+	gpi.pInputAssemblyState = &inputAssembly;
+	gpi.pRasterizationState = &rasterization;
+	gpi.pDynamicState = &dynState;
+	gpi.layout = pipe.layout->handle;
+	gpi.renderPass = rp;
+	gpi.subpass = pipe.subpass;
+
+	if(!rasterization.rasterizerDiscardEnable) {
+		gpi.pViewportState = &viewport;
+		gpi.pMultisampleState = &multisample;
+		gpi.pDepthStencilState = pipe.hasDepthStencil ? &depthStencil : nullptr;
+		gpi.pColorBlendState = pipe.blendAttachments.empty() ? nullptr : &colorBlend;
+	}
+
+	auto cache = dev.xfbCache ? dev.xfbCache->pipelineCache : VK_NULL_HANDLE;
+	VkPipeline xfbPipe {};
+	auto res = dev.dispatch.CreateGraphicsPipelines(dev.handle, cache, 1u,
+		&gpi, nullptr, &xfbPipe);
+
+	dev.dispatch.DestroyRenderPass(dev.handle, rp, nullptr);
+	cleanup();
+
+	if(res != VK_SUCCESS) {
+		dlg_error("xfb CreateGraphicsPipelines: {} ({})", vk::name(res), res);
+		return false;
+	}
+
+	std::string name;
+	{
+		std::lock_guard lock(dev.mutex);
+		name = pipe.name;
+	}
+
+	name += "(vil:xfb)";
+	nameHandle(dev, xfbPipe, name.c_str());
+
+	pipe.xfbPipe = xfbPipe;
+	pipe.xfbPatch = std::move(patched.desc);
+	return true;
+}
+
+} // anon namespace
+
+bool requestXfbVariant(GraphicsPipeline& pipe) {
+	auto state = pipe.xfbState.load(std::memory_order_acquire);
+	if(state == XfbVariantState::ready) {
+		return true;
+	}
+
+	auto& dev = *pipe.dev;
+	if(state != XfbVariantState::none || !dev.xfbPipelineThread) {
+		return false;
+	}
+
+	if(pipe.xfbState.compare_exchange_strong(state, XfbVariantState::pending)) {
+		dev.xfbPipelineThread->enqueue(IntrusivePtr<GraphicsPipeline>(&pipe));
+	}
+
+	return false;
+}
+
+XfbPipelineThread::XfbPipelineThread(Device& xdev) : dev(&xdev) {
+	thread_ = std::thread([this]{ threadMain(); });
+}
+
+XfbPipelineThread::~XfbPipelineThread() {
+	{
+		std::lock_guard lock(mutex_);
+		run_ = false;
+	}
+
+	cv_.notify_one();
+	if(thread_.joinable()) {
+		thread_.join();
+	}
+
+	// pipelines that were not handled can be requested again
+	for(auto& pipe : queue_) {
+		pipe->xfbState.store(XfbVariantState::none);
+	}
+}
+
+void XfbPipelineThread::enqueue(IntrusivePtr<GraphicsPipeline> pipe) {
+	{
+		std::lock_guard lock(mutex_);
+		queue_.push_back(std::move(pipe));
+	}
+
+	cv_.notify_one();
+}
+
+void XfbPipelineThread::threadMain() {
+	while(true) {
+		IntrusivePtr<GraphicsPipeline> pipe;
+
+		{
+			std::unique_lock lock(mutex_);
+			cv_.wait(lock, [&]{ return !queue_.empty() || !run_; });
+			if(!run_) {
+				break;
+			}
+
+			pipe = std::move(queue_.front());
+			queue_.pop_front();
+		}
+
+		// Skip pipelines that were already destroyed
+		if(pipe->refCount.load() == 1u) {
+			continue;
+		}
+
+		auto success = createXfbVariant(*dev, *pipe);
+		pipe->xfbState.store(success ? XfbVariantState::ready : XfbVariantState::failed,
+			std::memory_order_release);
+
+		// Hooked records that were created while the variant
+		// wasn't ready don't capture xfb, they have to be re-created.
+		if(success) {
+			dev->commandHook->invalidateRecordings();
+		}
+	}
+}
 
 void fixPointers(GraphicsPipeline& pipe) {
 	pipe.vertexInputState.pVertexAttributeDescriptions = pipe.vertexAttribs.data();
@@ -583,6 +817,8 @@ void fixPointers(GraphicsPipeline& pipe) {
 	pipe.viewportState.pScissors = pipe.scissors.data();
 	pipe.viewportState.pViewports = pipe.viewports.data();
 	pipe.colorBlendState.pAttachments = pipe.blendAttachments.data();
+	pipe.multisampleState.pSampleMask =
+		pipe.sampleMask.empty() ? nullptr : pipe.sampleMask.data();
 }
 
 // VK_KHR_ray_tracing_pipeline
@@ -10,11 +10,23 @@
 #include <cstdlib>
 #include <atomic>
 #include <unordered_set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace vil {
 
 struct XfbPatchDesc;
 
+enum class XfbVariantState : u8 {
+	unsupported, // no xfb variant can be created for the pipeline
+	none, // not requested yet
+	pending, // in creation
+	ready,
+	failed,
+};
+
 struct PipelineLayout : SharedDeviceHandle {
 	static constexpr auto objectType = VK_OBJECT_TYPE_PIPELINE_LAYOUT;
 
@@ -76,6 +88,7 @@ struct GraphicsPipeline : Pipeline {
 	std::vector<VkRect2D> scissors;
 	std::vector<VkVertexInputAttributeDescription> vertexAttribs;
 	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkSampleMask> sampleMask;
 	std::unordered_set<VkDynamicState> dynamicState;
 
 	VkPipelineVertexInputStateCreateInfo      vertexInputState {};
@@ -93,11 +106,25 @@ struct GraphicsPipeline : Pipeline {
 	bool hasDepthStencil : 1;
 	bool hasMeshShader : 1;
 
-	IntrusivePtr<XfbPatchDesc> xfbPatch; // valid when we injected xfb
+	// To capture the vertex shader output (via xfb), we use a variant of
+	// the pipeline that has the same state but an xfb-patched vertex stage.
+	// It is bound instead of the pipeline for the captured draw.
+	// It's created asynchronously by the XfbPipelineThread when first
+	// needed, see requestXfbVariant.
+	// xfbPipe and xfbPatch are only valid when the state is 'ready' and
+	// never change after that.
+	std::atomic<XfbVariantState> xfbState {XfbVariantState::unsupported};
+	VkPipeline xfbPipe {}; // owned by us
+	IntrusivePtr<XfbPatchDesc> xfbPatch;
 
 	~GraphicsPipeline();
 };
 
+// Returns whether the xfb variant of the given pipeline is ready.
+// Otherwise requests its creation, if possible and not done already.
+// Never blocks.
+bool requestXfbVariant(GraphicsPipeline&);
+
 void fixPointers(GraphicsPipeline& pipe);
 
 struct ComputePipeline : Pipeline {
@@ -119,6 +146,29 @@ struct RayTracingPipeline : Pipeline {
 	std::unordered_set<VkDynamicState> dynamicState;
 };
 
+// Background thread creating the xfb variants of graphics pipelines,
+// see GraphicsPipeline::xfbPipe. This way, neither the application's
+// pipeline creation nor the hooked submissions have to wait for the
+// shader patching and pipeline compilation. Only exists when transform
+// feedback is used.
+struct XfbPipelineThread {
+	Device* dev {};
+
+	XfbPipelineThread(Device& dev);
+	~XfbPipelineThread(); // stops and joins the thread
+
+	void enqueue(IntrusivePtr<GraphicsPipeline>);
+
+private:
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool run_ {true}; // synced via mutex_
+	std::deque<IntrusivePtr<GraphicsPipeline>> queue_; // synced via mutex_
+
+	void threadMain();
+};
+
 // API
 VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(
     VkDevice                                    device,
@@ -11,8 +11,10 @@
 #include <buffer.hpp>
 #include <image.hpp>
 #include <submit.hpp>
+#include <completion.hpp>
 #include <gui/gui.hpp>
 #include <commandHook/submission.hpp>
+#include <commandHook/hook.hpp>
 #include <util/util.hpp>
 #include <vkutil/enumString.hpp>
 #include <util/profiling.hpp>
@@ -32,7 +34,12 @@ void finish(SubmissionBatch& batch) {
 				if(scb.hook) {
 					scb.hook->finish(sub);
 				} else {
-					auto& accelStructCopies = scb.cb->lastRecordLocked()->accelStructCopies;
+					auto& rec = *scb.cb->lastRecordLocked();
+					for(auto* accelStruct : rec.dormantAccelStructBuilds) {
+						accelStruct->lastValid = {};
+					}
+
+					auto& accelStructCopies = rec.accelStructCopies;
 					dlg_assert(accelStructCopies.size() == scb.accelStructCopies.size());
 					for(auto [i, copy] : enumerate(accelStructCopies)) {
 						copy.dst->lastValid = scb.accelStructCopies[i];
@@ -148,7 +155,12 @@ std::optional<SubmIterator> checkLocked(SubmissionBatch& batch) {
 
 	finish(batch);
 
-	if(batch.ourFence) {
+	auto* completion = dev.completionThread.get();
+	if(completion && batch.ourFence && completion->waitingFence == batch.ourFence) {
+		// The completion thread is currently waiting on the fence,
+		// we must not reset it. Will be recycled by the thread.
+		completion->deferredFences.push_back(batch.ourFence);
+	} else if(batch.ourFence) {
 		dev.dispatch.ResetFences(dev.handle, 1, &batch.ourFence);
 		dev.fencePool.push_back(batch.ourFence);
 	} else if(batch.appFence) {
@@ -193,20 +205,23 @@ VkResult doSubmit(Queue& queue, span<const VkSubmitInfo2> submits,
 
 	VkResult res;
 
-	// Lock order is important here, lock dev mutex before queue mutex.
-	// We lock the dev mutex to sync with gui.
+	// Lock order is important here: submission mutex, dev mutex, queue mutex.
+	// The submission mutex orders us with other submissions and the gui,
+	// the dev mutex is only held while tracking the submission and not
+	// during the driver call.
 	{
-		// TODO PERF: locking the dev mutex here is terrible for performance,
-		// queueSubmit can take a long time and applications might parallelize
-		// around it.
-		// Maybe we can handle this with a separate gui/submission sync mutex?
-		std::lock_guard devLock(dev.mutex);
+		std::lock_guard submissionLock(dev.submissionMutex);
 
-		addSubmissionSyncLocked(submitter);
-		if(dev.doFullSync) {
-			addFullSyncLocked(submitter);
-		} else {
-			addGuiSyncLocked(submitter);
+		{
+			std::lock_guard devLock(dev.mutex);
+
+			addSubmissionSyncLocked(submitter);
+			addCowCopiesLocked(submitter);
+			if(dev.doFullSync) {
+				addFullSyncLocked(submitter);
+			} else {
+				addGuiSyncLocked(submitter);
+			}
 		}
 
 		{
@@ -232,6 +247,8 @@ VkResult doSubmit(Queue& queue, span<const VkSubmitInfo2> submits,
 			}
 		}
 
+		std::lock_guard devLock(dev.mutex);
+
 		if(res != VK_SUCCESS) {
 			dlg_trace("vkQueueSubmit error: {} ({})", vk::name(res), res);
 			if(res == VK_ERROR_DEVICE_LOST) {
@@ -246,6 +263,10 @@ VkResult doSubmit(Queue& queue, span<const VkSubmitInfo2> submits,
 		dev.pending.push_back(std::move(submitter.dstBatch));
 	}
 
+	if(dev.completionThread) {
+		dev.completionThread->notify();
+	}
+
 	return res;
 }
 
@@ -372,20 +393,22 @@ VKAPI_ATTR VkResult VKAPI_CALL QueueBindSparse(
 
 	VkResult res;
 
-	// Lock order is important here, lock dev mutex before queue mutex.
-	// We lock the dev mutex to sync with gui.
+	// Lock order is important here: submission mutex, dev mutex, queue mutex.
+	// The submission mutex orders us with other submissions and the gui,
+	// the dev mutex is only held while tracking the submission and not
+	// during the driver call.
 	{
-		// TODO PERF: locking the dev mutex here is terrible for performance,
-		// queueSubmit can take a long time and applications might parallelize
-		// around it.
-		// Maybe we can handle this with a separate gui/submission sync mutex?
-		std::lock_guard devLock(dev.mutex);
+		std::lock_guard submissionLock(dev.submissionMutex);
 
-		addSubmissionSyncLocked(submitter);
-		if(dev.doFullSync) {
-			addFullSyncLocked(submitter);
-		} else {
-			addGuiSyncLocked(submitter);
+		{
+			std::lock_guard devLock(dev.mutex);
+
+			addSubmissionSyncLocked(submitter);
+			if(dev.doFullSync) {
+				addFullSyncLocked(submitter);
+			} else {
+				addGuiSyncLocked(submitter);
+			}
 		}
 
 		{
@@ -397,6 +420,8 @@ VKAPI_ATTR VkResult VKAPI_CALL QueueBindSparse(
 				submitter.submFence);
 		}
 
+		std::lock_guard devLock(dev.mutex);
+
 		if(res != VK_SUCCESS) {
 			dlg_trace("vkQueueBindSparse error: {} ({})", vk::name(res), res);
 			if(res == VK_ERROR_DEVICE_LOST) {
@@ -411,6 +436,10 @@ VKAPI_ATTR VkResult VKAPI_CALL QueueBindSparse(
 		dev.pending.push_back(std::move(submitter.dstBatch));
 	}
 
+	if(dev.completionThread) {
+		dev.completionThread->notify();
+	}
+
 	return res;
 }
 
@@ -462,6 +491,9 @@ void activateLocked(MemoryResource& res, const OpaqueSparseMemoryBind& bind) {
 		}
 
 		bind.memory->allocations.insert(&*it);
+		if(res.dev->commandHook) {
+			res.dev->commandHook->memoryBoundLocked(*it);
+		}
 	} else {
 		// unbind
 		auto resEnd = bind.resourceOffset + bind.memSize;
@@ -508,6 +540,9 @@ void activateLocked(MemoryResource& res, const ImageSparseMemoryBind& bind) {
 			const_cast<ImageSparseMemoryBind&>(oldBind) = bind;
 		}
 		bind.memory->allocations.insert(&*it);
+		if(res.dev->commandHook) {
+			res.dev->commandHook->memoryBoundLocked(*it);
+		}
 	} else {
 		// TODO: lower bound and iterate? not sure how
 		auto it = bindState.imageBinds.find(bind);
@@ -568,8 +603,13 @@ void activateLocked(CommandSubmission& cmdSub) {
 			scb.hook->activate();
 		} else {
 			dlg_assert(scb.accelStructCopies.empty());
+			for(auto* accelStruct : recPtr->dormantAccelStructBuilds) {
+				accelStruct->pendingState = {};
+			}
+
+			// NOTE: src->pendingState might be null when it was built
+			// in a dormant record.
 			for(auto& copy : recPtr->accelStructCopies) {
-				dlg_assert(copy.src->pendingState);
 				copy.dst->pendingState = copy.src->pendingState;
 				scb.accelStructCopies.push_back(copy.src->pendingState);
 			}
@@ -28,7 +28,8 @@ struct Queue : Handle {
 	bool createdByUs {};
 
 	// Counted up each time this queue is submitted to.
-	// Might wrap around.
+	// Might wrap around. Incremented with dev.submissionMutex and dev.mutex
+	// locked, reading requires only one of them.
 	u64 submissionCounter {};
 
 	// Only valid when using timeline semaphores, used for full-sync.
@@ -159,6 +160,7 @@ void checkPendingSubmissionsLocked(Device&);
 
 // Implemented in submit.cpp
 bool potentiallyWritesLocked(const Submission&, const Image*, const Buffer*);
+bool potentiallyWritesLocked(const CommandRecord&, const Image*, const Buffer*);
 std::vector<const Submission*> needsSyncLocked(const SubmissionBatch&, const Draw&);
 VkResult submitSemaphore(Queue&, VkSemaphore, bool timeline = false);
 VkSemaphore getSemaphoreFromPool(Device& dev);
@@ -1,6 +1,7 @@
 #include <shader.hpp>
 #include <device.hpp>
 #include <wrap.hpp>
+#include <xfbCache.hpp>
 #include <util/spirv.hpp>
 #include <util/util.hpp>
 #include <vkutil/enumString.hpp>
@@ -8,6 +9,10 @@
 #include <filesystem>
 #include <optional>
 
+#ifdef __linux__
+	#include <sys/resource.h>
+#endif // __linux__
+
 // NOTE: useful for debugging of patching issues, not enabled by default.
 // #define VIL_OUTPUT_PATCHED_SPIRV
 
@@ -423,19 +428,52 @@ XfbPatchRes patchSpirvXfb(spc::Compiler& compiled, const char* entryPoint) {
 	auto desc = IntrusivePtr<XfbPatchDesc>(new XfbPatchDesc());
 	desc->captures = std::move(captures);
 	desc->stride = stride;
+	desc->readsBaseVertexInstance =
+		compiled.has_active_builtin(spv::BuiltInBaseVertex, spv::StorageClassInput) ||
+		compiled.has_active_builtin(spv::BuiltInBaseInstance, spv::StorageClassInput);
 	return {patched, std::move(desc)};
 }
 
-XfbPatchData patchShaderXfb(Device& dev, spc::Compiler& compiled,
-		const char* entryPoint, std::string_view modName) {
+XfbPatchData patchShaderXfb(Device& dev, ShaderModule& mod,
+		const ShaderSpecialization& spec, const char* entryPoint) {
 	ZoneScoped;
 
-	auto patched = patchSpirvXfb(compiled, entryPoint);
+	std::optional<XfbPatchRes> cached;
+	if(dev.xfbCache) {
+		cached = dev.xfbCache->find(mod.spirvHash, mod.spirvSize,
+			VK_SHADER_STAGE_VERTEX_BIT, entryPoint, spec);
+	}
+
+	// When cached, we don't even have to parse the module
+	XfbPatchRes patched;
+	if(cached) {
+		patched = std::move(*cached);
+	} else {
+		// Parse it before locking the mutex, might take a while.
+		// We work on a copy, the reflection of the module might be
+		// specialized differently in the meantime.
+		(void) mod.compiled();
+
+		std::unique_ptr<spc::Compiler> compiled;
+		{
+			std::lock_guard lock(dev.mutex);
+			compiled = copySpecializeSpirv(mod, spec, entryPoint,
+				u32(spv::ExecutionModelVertex));
+		}
+
+		patched = patchSpirvXfb(*compiled, entryPoint);
+
+		if(dev.xfbCache) {
+			dev.xfbCache->store(mod.spirvHash, mod.spirvSize,
+				VK_SHADER_STAGE_VERTEX_BIT, entryPoint, spec, patched);
+		}
+	}
+
 	if(!patched.desc) {
 		return {};
 	}
 
-	(void) modName;
+	std::string_view modName = mod.name;
 
 // #define VIL_OUTPUT_PATCHED_SPIRV
 #ifdef VIL_OUTPUT_PATCHED_SPIRV
@@ -481,7 +519,6 @@ XfbPatchData patchShaderXfb(Device& dev, spc::Compiler& compiled,
 	pname += "(vil:xfb-patched)";
 	nameHandle(dev, ret.mod, pname.c_str());
 
-	ret.entryPoint = entryPoint;
 	ret.desc = std::move(patched.desc);
 	return ret;
 }
@@ -490,20 +527,104 @@ XfbPatchData patchShaderXfb(Device& dev, spc::Compiler& compiled,
 // ShaderModule
 ShaderModule::ShaderModule() = default;
 
-ShaderModule::~ShaderModule() {
-	if(!dev) {
-		return;
+ShaderModule::~ShaderModule() = default;
+
+void ShaderModule::init(span<const u32> spirv) {
+	dlg_assert(!parsed());
+	spirv_.assign(spirv.begin(), spirv.end());
+}
+
+void ShaderModule::parse() {
+	ZoneScoped;
+
+	// TODO: catch errors here
+	compiled_ = std::make_unique<spc::Compiler>(std::move(spirv_));
+	spirv_ = {};
+
+	// copy default values of specialization constants
+	auto specConstants = compiled_->get_specialization_constants();
+	for(auto& sc : specConstants) {
+		auto& entry = constantDefaults_.emplace_back();
+		entry.constantID = sc.constant_id;
+
+		auto& constant = compiled_->get_constant(sc.id);
+		dlg_assert(constant.m.columns == 1u);
+		dlg_assert(constant.m.c[0].vecsize == 1u);
+		entry.constant = std::make_unique<spc::SPIRConstant>(constant);
+	}
+
+	parsed_.store(true, std::memory_order_release);
+}
+
+spc::Compiler& ShaderModule::compiled() {
+	std::call_once(parseFlag_, [&]{ parse(); });
+	return *compiled_;
+}
+
+span<const SpecializationConstantDefault> ShaderModule::constantDefaults() {
+	std::call_once(parseFlag_, [&]{ parse(); });
+	return constantDefaults_;
+}
+
+// ShaderParseThread
+ShaderParseThread::ShaderParseThread() {
+	thread_ = std::thread([this]{ threadMain(); });
+}
+
+ShaderParseThread::~ShaderParseThread() {
+	{
+		std::lock_guard lock(mutex_);
+		run_ = false;
 	}
 
-	// clearXfb should have been called on API object destruction
-	dlg_assert(xfb.empty());
+	cv_.notify_one();
+	if(thread_.joinable()) {
+		thread_.join();
+	}
 }
 
-void ShaderModule::clearXfb() {
-	for(auto& patched : this->xfb) {
-		dev->dispatch.DestroyShaderModule(dev->handle, patched.mod, nullptr);
+void ShaderParseThread::enqueue(IntrusivePtr<ShaderModule> mod) {
+	{
+		std::lock_guard lock(mutex_);
+		queue_.push_back(std::move(mod));
+	}
+
+	cv_.notify_one();
+}
+
+void ShaderParseThread::threadMain() {
+#ifdef __linux__
+	// Lower priority, we must not slow down the application.
+	// NOTE: we don't use SCHED_IDLE. Other threads might wait for a
+	// parse started by this thread, it must still make progress.
+	// On linux, this only affects the calling thread.
+	setpriority(PRIO_PROCESS, 0, 10);
+#endif // __linux__
+
+	while(true) {
+		IntrusivePtr<ShaderModule> mod;
+
+		{
+			std::unique_lock lock(mutex_);
+			cv_.wait(lock, [&]{ return !queue_.empty() || !run_; });
+			if(!run_) {
+				break;
+			}
+
+			mod = std::move(queue_.front());
+			queue_.pop_front();
+		}
+
+		// Skip modules that were already destroyed
+		if(mod->refCount.load() == 1u) {
+			continue;
+		}
+
+		// Might already have been parsed by an application thread.
+		// Otherwise parses it, an application thread accessing it in
+		// the meantime will simply wait for it.
+		(void) mod->compiled();
 	}
-	xfb.clear();
 }
 
 // api
@@ -524,26 +645,14 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateShaderModule(
 
 	dlg_assert(pCreateInfo->codeSize % 4 == 0);
 
-	// TODO: catch errors here
-	mod.compiled = std::make_unique<spc::Compiler>(
-		pCreateInfo->pCode, pCreateInfo->codeSize / 4);
-
-	// compute hash
-	for(auto i = 0u; i < pCreateInfo->codeSize / 4; ++i) {
-		hash_combine(mod.spirvHash, pCreateInfo->pCode[i]);
-	}
-
-	// copy default values of specialization constants
-	auto& compiled = *mod.compiled;
-	auto specConstants = compiled.get_specialization_constants();
-	for(auto& sc : specConstants) {
-		auto& entry = mod.constantDefaults.emplace_back();
-		entry.constantID = sc.constant_id;
+	auto* code = reinterpret_cast<const std::byte*>(pCreateInfo->pCode);
+	mod.spirvHash = hash64({code, pCreateInfo->codeSize});
+	mod.spirvSize = pCreateInfo->codeSize;
 
-		auto& constant = compiled.get_constant(sc.id);
-		dlg_assert(constant.m.columns == 1u);
-		dlg_assert(constant.m.c[0].vecsize == 1u);
-		entry.constant = std::make_unique<spc::SPIRConstant>(constant);
+	// The module is only parsed when needed, see ShaderModule::compiled
+	mod.init({pCreateInfo->pCode, pCreateInfo->codeSize / 4});
+	if(dev.shaderParseThread) {
+		dev.shaderParseThread->enqueue(IntrusivePtr<ShaderModule>(&mod));
 	}
 
 	return res;
@@ -558,9 +667,6 @@ VKAPI_ATTR void VKAPI_CALL DestroyShaderModule(
 	}
 
 	auto mod = mustMoveUnset(device, shaderModule);
-	// memory optimization:
-	// we don't need any xfb-patched data anymore
-	mod->clearXfb();
 	mod->dev->dispatch.DestroyShaderModule(device, shaderModule, pAllocator);
 }
 
@@ -724,20 +830,18 @@ void specializeSpirv(spc::Compiler& compiled,
 spc::Compiler& specializeSpirv(ShaderModule& mod,
 		const ShaderSpecialization& specialization, const std::string& entryPoint,
 		u32 spvExecutionModel) {
-	dlg_assert(mod.compiled);
-	auto& compiled = *mod.compiled;
+	auto& compiled = mod.compiled();
 	specializeSpirv(compiled, specialization, entryPoint, spvExecutionModel,
-		mod.constantDefaults);
+		mod.constantDefaults());
 	return compiled;
 }
 
 std::unique_ptr<spc::Compiler> copySpecializeSpirv(ShaderModule& mod,
 		const ShaderSpecialization& specialization, const std::string& entryPoint,
 		u32 spvExecutionModel) {
-	dlg_assert(mod.compiled);
-	auto compiled = std::make_unique<spc::Compiler>(mod.compiled->get_ir());
+	auto compiled = std::make_unique<spc::Compiler>(mod.compiled().get_ir());
 	specializeSpirv(*compiled, specialization, entryPoint, spvExecutionModel,
-		mod.constantDefaults);
+		mod.constantDefaults());
 	return compiled;
 }
 
@@ -5,11 +5,16 @@
 #include <vk/vulkan.h>
 #include <util/intrusive.hpp>
 #include <util/debugMutex.hpp>
+#include <nytl/span.hpp>
 
 #include <memory>
 #include <atomic>
 #include <vector>
 #include <optional>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace vil {
 
@@ -41,20 +46,19 @@ struct XfbCapture {
 };
 
 // We separate the description from the patched VkShaderModule since the description
-// might be needed as long as there exists a pipe using this module.
-// But we don't want to keep the patched VkShaderModule alive when the application's original
-// module is destroyed to not waste memory.
+// is needed as long as there exists a pipe using this module while the
+// patched VkShaderModule is only needed to create the xfb variant of a pipeline.
 struct XfbPatchDesc {
 	std::vector<XfbCapture> captures;
 	u32 stride {};
+	// Whether the shader reads gl_BaseVertex or gl_BaseInstance. In that
+	// case, a draw can't be split into multiple parts for capturing.
+	bool readsBaseVertexInstance {};
 	std::atomic<u32> refCount {};
 };
 
 struct XfbPatchData {
-	std::string entryPoint {};
-	ShaderSpecialization spec {};
-
-	VkShaderModule mod {};
+	VkShaderModule mod {}; // owned by the caller
 	IntrusivePtr<XfbPatchDesc> desc {};
 };
 
@@ -64,8 +68,13 @@ struct XfbPatchRes {
 };
 
 XfbPatchRes patchSpirvXfb(spc::Compiler&, const char* entryPoint);
-XfbPatchData patchShaderXfb(Device&, spc::Compiler& compiled,
-	const char* entryPoint, std::string_view modName);
+
+// Creates the xfb-patched version of the given module, specialized with
+// the given specialization. Uses (and fills) dev.xfbCache, if available.
+// Returns an empty result (without mod) when it can't be patched.
+// Must be called without the device mutex locked, locks it internally.
+XfbPatchData patchShaderXfb(Device&, ShaderModule&,
+	const ShaderSpecialization&, const char* entryPoint);
 
 // Returns a name for the given set, binding in the given module.
 struct BindingNameRes {
@@ -96,32 +105,65 @@ struct ShaderModule : SharedDeviceHandle {
 	static constexpr auto objectType = VK_OBJECT_TYPE_SHADER_MODULE;
 
 	VkShaderModule handle {};
+	u64 spirvHash {};
+	u64 spirvSize {}; // in bytes
+
+	ShaderModule(); // = default
+	~ShaderModule();
 
-	// NOTE: in most cases, don't access directly, see 'accessReflection' below.
+	// Parsing the spirv is expensive and most modules are never inspected,
+	// it therefore only happens on first access here or in the background
+	// via ShaderParseThread. Blocks while another thread is parsing,
+	// the first call should therefore happen without the device mutex
+	// locked.
+	// NOTE: in most cases, don't access directly, see 'specializeSpirv' below.
 	// Need to use proper specialization constants.
 	// Only to be used while the device mutex is locked, otherwise we can't
 	// sync access.
-	std::unique_ptr<spc::Compiler> compiled;
-	std::vector<SpecializationConstantDefault> constantDefaults;
-	u64 spirvHash {};
+	spc::Compiler& compiled();
+	span<const SpecializationConstantDefault> constantDefaults();
 
-	// Owend by us.
-	// When the shader module is a vertex shader, we lazily create
-	// transform-feedback version(s) of it. We might need multiple
-	// versions in case the module has multiple entry points.
-	std::vector<XfbPatchData> xfb;
+	// Sets the spirv code that will be parsed.
+	void init(span<const u32> spirv);
+	bool parsed() const { return parsed_.load(std::memory_order_acquire); }
 
-	ShaderModule(); // = default
-	~ShaderModule();
-	void clearXfb();
+private:
+	void parse();
+
+	std::once_flag parseFlag_;
+	std::atomic<bool> parsed_ {};
+	std::vector<u32> spirv_; // cleared after parsing
+	std::unique_ptr<spc::Compiler> compiled_;
+	std::vector<SpecializationConstantDefault> constantDefaults_;
+};
+
+// Low-priority background thread parsing the spirv of newly created
+// shader modules. This way, the reflection data is usually already
+// available when we need it (e.g. for xfb patching on pipeline creation
+// or in the gui) without slowing down vkCreateShaderModule.
+// Enabled via VIL_SHADER_PARSE_THREAD, see docs/env.md.
+struct ShaderParseThread {
+	ShaderParseThread();
+	~ShaderParseThread(); // stops and joins the thread
+
+	void enqueue(IntrusivePtr<ShaderModule>);
+
+private:
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool run_ {true}; // synced via mutex_
+	std::deque<IntrusivePtr<ShaderModule>> queue_; // synced via mutex_
+
+	void threadMain();
 };
 
 // Will set the given specialization, entryPoint and execution model into
-// '*mod.compiled'.
+// 'mod.compiled()'.
 // Might still need to call spc::Compiler::update_active_builtins() after this,
 // if active builtins are accessed.
 // Must only be called while the device mutex is locked for synchronization
-// of mod.compiled.
+// of mod.compiled().
 spc::Compiler& specializeSpirv(ShaderModule& mod,
 		const ShaderSpecialization& specialization, const std::string& entryPoint,
 		u32 spvExecutionModel);
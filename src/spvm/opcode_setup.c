@@ -13,6 +13,9 @@ char spvm_use_access_callback(enum spvm_result_type result_type,
 /* 3.32.2 Debug Instructions */
 void spvm_setup_OpSource(spvm_word word_count, spvm_state_t state)
 {
+	if (state->owner->setup_done)
+		return;
+
 	// check if file was already added
 	for (unsigned i = 0u; i < state->owner->file_count; ++i) {
 		if (state->owner->files[i].origin == state->code_current) {
@@ -41,6 +44,9 @@ void spvm_setup_OpSource(spvm_word word_count, spvm_state_t state)
 }
 void spvm_setup_OpSourceExtension(spvm_word word_count, spvm_state_t state)
 {
+	if (state->owner->setup_done)
+		return;
+
 	spvm_string ext = spvm_program_add_extension(state->owner, word_count);
 	spvm_string_read(state->code_current, ext, word_count);
 }
@@ -104,11 +110,25 @@ void spvm_setup_OpExtInstImport(spvm_word word_count, spvm_state_t state)
 /* 3.32.5 Mode-Setting Instructions */
 void spvm_setup_OpMemoryModel(spvm_word word_count, spvm_state_t state)
 {
+	if (state->owner->setup_done)
+		return;
+
 	state->owner->addressing = SPVM_READ_WORD(state->code_current);
 	state->owner->memory_model = SPVM_READ_WORD(state->code_current);
 }
 void spvm_setup_OpEntryPoint(spvm_word word_count, spvm_state_t state)
 {
+	if (state->owner->setup_done)
+		return;
+
+	// check if entry point was already added
+	spvm_word id = state->code_current[1];
+	for (spvm_word i = 0; i < state->owner->entry_point_count; ++i) {
+		if (state->owner->entry_points[i].id == id) {
+			return;
+		}
+	}
+
 	spvm_entry_point* entry = spvm_program_create_entry_point(state->owner);
 	entry->exec_model = SPVM_READ_WORD(state->code_current);
 	entry->id = SPVM_READ_WORD(state->code_current);
@@ -132,11 +152,17 @@ void spvm_setup_OpEntryPoint(spvm_word word_count, spvm_state_t state)
 }
 void spvm_setup_OpCapability(spvm_word word_count, spvm_state_t state)
 {
+	if (state->owner->setup_done)
+		return;
+
 	SpvCapability cap = SPVM_READ_WORD(state->code_current);
 	spvm_program_add_capability(state->owner, cap);
 }
 void spvm_setup_OpExecutionMode(spvm_word word_count, spvm_state_t state)
 {
+	if (state->owner->setup_done)
+		return;
+
 	SPVM_SKIP_WORD(state->code_current);
 	spvm_word execution_mode = SPVM_READ_WORD(state->code_current);
 
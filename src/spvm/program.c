@@ -1,5 +1,29 @@
 #include <spvm/program.h>
 
+static void spvm_program_decode(spvm_program_t prog)
+{
+	prog->instructions = (spvm_instruction*)calloc(prog->code_length + 1, sizeof(spvm_instruction));
+
+	size_t i = 0;
+	while (i < prog->code_length) {
+		spvm_word opcode_data = prog->code[i];
+		spvm_word word_count = (opcode_data & (~SpvOpCodeMask)) >> SpvWordCountShift;
+		spvm_word opcode = (opcode_data & SpvOpCodeMask);
+
+		// invalid instruction, the rest can't be decoded
+		if (word_count == 0 || i + word_count > prog->code_length)
+			break;
+
+		spvm_instruction* inst = &prog->instructions[i];
+		inst->word_count = word_count - 1;
+		inst->opcode = opcode;
+		if (opcode < SPVM_OPCODE_TABLE_LENGTH)
+			inst->execute = prog->context->opcode_execute[opcode];
+
+		i += word_count;
+	}
+}
+
 
 spvm_program_t spvm_program_create(spvm_context_t ctx, spvm_source spv, size_t spv_length)
 {
@@ -25,6 +49,7 @@ spvm_program_t spvm_program_create(spvm_context_t ctx, spvm_source spv, size_t s
 
 	prog->code_length = spv_length - 5;
 	prog->code = spv;
+	spvm_program_decode(prog);
 
 	prog->local_size_x = 1;
 	prog->local_size_y = 1;
@@ -80,5 +105,7 @@ void spvm_program_delete(spvm_program_t prog)
 
 	// files
 	free(prog->files);
+
+	free(prog->instructions);
 	free(prog);
 }
@@ -27,6 +27,16 @@ typedef struct
 	spvm_string source;
 } spvm_file;
 
+// Cached instruction header, see spvm_program::instructions.
+// Only the opcode word is decoded, the execute functions still read their
+// operands and look up their results from the code stream.
+typedef struct
+{
+	spvm_opcode_func execute; // may be NULL, e.g. for declarations
+	spvm_word word_count; // number of operand words, without the opcode word
+	spvm_word opcode;
+} spvm_instruction;
+
 typedef struct {
 	spvm_context_t context;
 
@@ -44,6 +54,21 @@ typedef struct {
 	size_t code_length;
 	spvm_source code;
 
+	// Instruction headers decoded once on creation so that executing them
+	// doesn't have to decode the opcode word and look up the execute
+	// function every time. This is not a compiled form of the program:
+	// operands and result pointers are not pre-resolved and dispatch
+	// is still one indirect call per instruction.
+	// Indexed by the word offset of an instruction into 'code' so that
+	// jumps (which just set the code position) don't need any mapping.
+	// Only entries at the start of instructions are valid.
+	spvm_instruction* instructions;
+
+	// Set once the first state was created. Only that state sets up the
+	// program-level data (files, entry points, capabilities, execution
+	// modes), creating further states doesn't modify the program.
+	spvm_byte setup_done;
+
 	spvm_word extension_count;
 	spvm_string* extensions;
 
@@ -47,6 +47,9 @@ spvm_state_t spvm_state_create(spvm_program_t prog, spvm_state_settings settings
 		i += word_count;
 	}
 
+	if (!prog->setup_done)
+		prog->setup_done = 1;
+
 	state->derivative_used = settings.force_derv;
 
 	if (!settings.is_derv_member && state->derivative_used) {
@@ -201,46 +204,92 @@ void spvm_state_group_step(spvm_state_t state)
 	if (state->derivative_group_d) spvm_state_step_opcode(state->derivative_group_d);
 }
 
-void spvm_state_step_opcode(spvm_state_t state)
+// Executes the instruction at the current position, using the
+// cached instruction headers of the program.
+static inline void spvm_state_step_decoded(spvm_state_t state)
 {
-	// read data
-	spvm_word opcode_data = SPVM_READ_WORD(state->code_current);
-	spvm_word word_count = ((opcode_data & (~SpvOpCodeMask)) >> SpvWordCountShift) - 1;
-	SpvOp opcode = (opcode_data & SpvOpCodeMask);
-	spvm_source cur_code = state->code_current;
-
-	if (opcode >= SPVM_OPCODE_TABLE_LENGTH) {
-		spvm_state_log(state, "opcode out of range: %d", (int) opcode);
-	} else if (state->context->opcode_execute[opcode]) {
-		state->context->opcode_execute[opcode](word_count, state);
-		if (opcode != SpvOpLine && opcode != SpvOpNoLine)
+	spvm_program_t prog = state->owner;
+	size_t offset = (size_t)(state->code_current - prog->code);
+	if (offset >= prog->code_length) {
+		spvm_state_log(state, "code position out of range: %d", (int) offset);
+		state->code_current = NULL;
+		return;
+	}
+
+	const spvm_instruction* inst = &prog->instructions[offset];
+	spvm_source next = state->code_current + 1 + inst->word_count;
+
+	// the execute functions expect the position after the opcode word
+	state->code_current++;
+
+	if (inst->execute) {
+		inst->execute(inst->word_count, state);
+		if (inst->opcode != SpvOpLine && inst->opcode != SpvOpNoLine)
 			state->instruction_count++;
+	} else if (inst->opcode >= SPVM_OPCODE_TABLE_LENGTH) {
+		spvm_state_log(state, "opcode out of range: %d", (int) inst->opcode);
 	}
 
 	if (!state->did_jump)
-		state->code_current = (cur_code + word_count);
+		state->code_current = next;
 	else state->did_jump = 0;
 }
+
+void spvm_state_step_opcode(spvm_state_t state)
+{
+	spvm_state_step_decoded(state);
+}
 void spvm_state_step_into(spvm_state_t state)
 {
 	spvm_word ln = state->current_line;
 	while (ln == state->current_line && state->code_current)
-		spvm_state_step_opcode(state);
+		spvm_state_step_decoded(state);
 }
 void spvm_state_jump_to(spvm_state_t state, spvm_word line)
 {
 	while (line != state->current_line && state->code_current)
-		spvm_state_step_opcode(state);
+		spvm_state_step_decoded(state);
 }
 void spvm_state_jump_to_instruction(spvm_state_t state, spvm_word inst)
 {
 	while (state->instruction_count < inst && state->code_current)
-		spvm_state_step_opcode(state);
+		spvm_state_step_decoded(state);
 }
 void spvm_state_call_function(spvm_state_t state)
 {
 	while (state->code_current)
-		spvm_state_step_opcode(state);
+		spvm_state_step_decoded(state);
+}
+spvm_byte spvm_state_is_last_return(spvm_state_t state)
+{
+	if (!state->code_current || state->function_stack_current != 0)
+		return 0;
+
+	size_t offset = (size_t)(state->code_current - state->owner->code);
+	if (offset >= state->owner->code_length)
+		return 0;
+
+	spvm_word opcode = state->owner->instructions[offset].opcode;
+	return opcode == SpvOpReturn || opcode == SpvOpReturnValue;
+}
+spvm_source spvm_state_run_to_line_change(spvm_state_t state, spvm_byte stop_at_last_return)
+{
+	spvm_word line = state->current_line;
+	const char* file = state->current_file;
+	spvm_source last = NULL;
+
+	while (state->code_current) {
+		if (stop_at_last_return && spvm_state_is_last_return(state))
+			break;
+
+		last = state->code_current;
+		spvm_state_step_decoded(state);
+
+		if (state->current_line != line || state->current_file != file)
+			break;
+	}
+
+	return last;
 }
 void spvm_state_ddx(spvm_state_t state, spvm_word id)
 {
@@ -135,6 +135,13 @@ void spvm_state_step_opcode(spvm_state_t state);
 void spvm_state_step_into(spvm_state_t state);
 void spvm_state_jump_to(spvm_state_t state, spvm_word line);
 void spvm_state_jump_to_instruction(spvm_state_t state, spvm_word instruction_count);
+// Returns whether the next instruction returns from the entry point.
+spvm_byte spvm_state_is_last_return(spvm_state_t state);
+// Executes instructions until the current line or file changes or the
+// program finished. When 'stop_at_last_return' is set, also stops before
+// returning from the entry point. Returns the position of the last
+// executed instruction (NULL if none was executed).
+spvm_source spvm_state_run_to_line_change(spvm_state_t state, spvm_byte stop_at_last_return);
 spvm_word spvm_state_get_result_location(spvm_state_t state, const char* str);
 spvm_member_t spvm_state_get_builtin(spvm_state_t state, SpvBuiltIn decor, spvm_word* mem_count);
 spvm_result_t spvm_state_get_result(spvm_state_t state, const char* str);
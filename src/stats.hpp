@@ -15,14 +15,18 @@ struct DebugStats {
 	std::atomic<u32> aliveImagesViews {};
 	std::atomic<u32> aliveHookRecords {};
 	std::atomic<u32> aliveHookStates {};
+	std::atomic<u32> dedupedRecords {};
 
 	std::atomic<u64> threadContextMem {};
 	std::atomic<u64> commandMem {};
 	std::atomic<u64> descriptorCopyMem {};
 	std::atomic<u64> descriptorPoolMem {};
+	std::atomic<u64> linBlockPoolMem {};
+	std::atomic<u64> slabMem {};
 
 	std::atomic<u64> ownBufferMem {};
 	std::atomic<u64> copiedImageMem {};
+	std::atomic<u64> captureHeapMem {};
 };
 
 } // namespace vil
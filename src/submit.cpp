@@ -124,9 +124,11 @@ void init(QueueSubmitter& subm, Queue& queue, SubmissionType type,
 		subm.globalSubmitID = ++dev.submissionCounter;
 
 		// Check all pending submissions for completion, to possibly return
-		// resources to fence/semaphore pools
-		// check all submissions for completion
-		checkPendingSubmissionsLocked(dev);
+		// resources to fence/semaphore pools.
+		// Not needed when the completion thread takes care of it.
+		if(!dev.completionThread) {
+			checkPendingSubmissionsLocked(dev);
+		}
 	}
 
 	subm.dstBatch = std::make_unique<SubmissionBatch>();
@@ -522,6 +524,54 @@ void addSubmissionSyncLocked(QueueSubmitter& subm) {
 	}
 }
 
+void addCowCopiesLocked(QueueSubmitter& subm) {
+	ZoneScoped;
+	assertOwned(subm.dev->mutex);
+
+	for(auto [i, si] : enumerate(subm.submitInfos)) {
+		auto& dst = subm.dstBatch->submissions[i];
+		auto& cmdSub = std::get<CommandSubmission>(dst.data);
+
+		auto numCowCbs = 0u;
+		for(auto& scb : cmdSub.cbs) {
+			if(!scb.hook) {
+				continue;
+			}
+
+			auto& hookRecord = *scb.hook->record;
+			if(hookRecord.cowCb && !hookRecord.cowsValid) {
+				scb.hook->pendingCowCopy = true;
+				hookRecord.cowsValid = true;
+				++numCowCbs;
+			}
+		}
+
+		if(numCowCbs == 0u) {
+			continue;
+		}
+
+		// The copies must happen directly before the hooked command buffer,
+		// the sources are in the same state there as in the hooked command.
+		dlg_assert(si.commandBufferInfoCount == cmdSub.cbs.size());
+		auto cbInfos = subm.memScope.alloc<VkCommandBufferSubmitInfo>(
+			si.commandBufferInfoCount + numCowCbs);
+		auto off = 0u;
+		for(auto [j, scb] : enumerate(cmdSub.cbs)) {
+			if(scb.hook && scb.hook->pendingCowCopy) {
+				cbInfos[off] = si.pCommandBufferInfos[j];
+				cbInfos[off].commandBuffer = scb.hook->record->cowCb;
+				++off;
+			}
+
+			cbInfos[off] = si.pCommandBufferInfos[j];
+			++off;
+		}
+
+		si.commandBufferInfoCount = u32(cbInfos.size());
+		si.pCommandBufferInfos = cbInfos.data();
+	}
+}
+
 void cleanupOnErrorLocked(QueueSubmitter& subm) {
 	auto& dev = *subm.dev;
 	auto& batch = *subm.dstBatch;
@@ -839,13 +889,56 @@ void postProcessLocked(QueueSubmitter& subm) {
 	if(subm.lastLayerSubmission) {
 		subm.queue->lastLayerSubmission = (*subm.lastLayerSubmission)->queueSubmitID;
 	}
+
+	if(subm.dev->commandHook) {
+		subm.dev->commandHook->invalidateCowsLocked(batch);
+	}
+}
+
+// Returns whether the given record potentially writes the given
+// DeviceHandle, see CommandRecord::writes.
+bool potentiallyWritesLocked(const CommandRecord& rec, const Image* img, const Buffer* buf) {
+	assertOwnedOrShared(rec.dev->mutex);
+	dlg_assert(img || buf);
+
+	// dormant records don't track all used handles
+	if(rec.dormant) {
+		return true;
+	}
+
+	// the write summary is keyed by the Image/Buffer pointers
+	const void* key = img;
+	const Handle* handle = img;
+	if(buf) {
+		key = buf;
+		handle = buf;
+	}
+
+	if(rec.writes.handles.contains(key)) {
+		return true;
+	}
+
+	// Descriptor sets might have been updated since recording,
+	// we have to check their current content. We only have to
+	// consider the ones with writable bindings though.
+	for(auto* pds : rec.writes.descriptorSets) {
+		// in this case we know that the bound descriptor set must
+		// still be valid
+		auto& state = *static_cast<DescriptorSet*>(pds);
+		// important that the ds mutex is locked mainly for
+		// update_unused_while_pending.
+		auto lock = state.lock();
+		if(hasBoundWritable(state, *handle)) {
+			return true;
+		}
+	}
+
+	return false;
 }
 
 // Returns whether the given submission potentially writes the given
 // DeviceHandle (only makes sense for Image and Buffer objects)
 bool potentiallyWritesLocked(const Submission& subm, const Image* img, const Buffer* buf) {
-	// TODO PERF: consider more information, not every use is potentially writing
-
 	assertOwned(subm.parent->queue->dev->mutex);
 	dlg_assert(img || buf);
 
@@ -853,32 +946,8 @@ bool potentiallyWritesLocked(const Submission& subm, const Image* img, const Buf
 		auto& cmdSub = std::get<CommandSubmission>(subm.data);
 		for(auto& scb : cmdSub.cbs) {
 			auto& cb = scb.cb;
-			auto& rec = *cb->lastRecordLocked();
-
-			if(buf) {
-				auto it = find(rec.used.buffers, const_cast<Buffer&>(*buf));
-				if(it != rec.used.buffers.end()) {
-					return true;
-				}
-			} else if(img) {
-				auto it = find(rec.used.images, const_cast<Image&>(*img));
-				if(it != rec.used.images.end()) {
-					return true;
-				}
-			} else {
-				dlg_error("unreachable");
-			}
-
-			for(auto& uds : rec.used.descriptorSets) {
-				// in this case we know that the bound descriptor set must
-				// still be valid
-				auto& state = *static_cast<DescriptorSet*>(uds.ds);
-				// important that the ds mutex is locked mainly for
-				// update_unused_while_pending.
-				auto lock = state.lock();
-				if((img && hasBound(state, *img)) || (buf && hasBound(state, *buf))) {
-					return true;
-				}
+			if(potentiallyWritesLocked(*cb->lastRecordLocked(), img, buf)) {
+				return true;
 			}
 		}
 	} else {
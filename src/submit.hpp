@@ -57,6 +57,12 @@ void process(QueueSubmitter&, span<const VkBindSparseInfo>);
 // so we have a semaphore knowing when it's ready.
 void addSubmissionSyncLocked(QueueSubmitter& subm);
 
+// Inserts the deferred copies of hooked records whose copy-on-write
+// captures were invalidated, see CommandHookRecord::cowCb.
+// Must be called before submissions are added, i.e. before
+// addGuiSyncLocked/addFullSyncLocked.
+void addCowCopiesLocked(QueueSubmitter&);
+
 // Makes sure the submissions synchronize properly with the gui.
 void addGuiSyncLocked(QueueSubmitter&);
 
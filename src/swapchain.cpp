@@ -9,6 +9,9 @@
 #include <overlay.hpp>
 #include <command/record.hpp>
 #include <util/profiling.hpp>
+#include <util/captureHeap.hpp>
+#include <commandHook/hook.hpp>
+#include <ds.hpp>
 #include <vkutil/enumString.hpp>
 
 namespace vil {
@@ -306,6 +309,12 @@ void swapchainPresent(Swapchain& swapchain) {
 	swapchain.nextFrameSubmissions = {};
 	swapchain.nextFrameSubmissions.submissionStart = swapchain.dev->submissionCounter + 1;
 
+	swapchain.dev->captureHeap->frame();
+
+	if(swapchain.dev->swapchainLocked() == &swapchain) {
+		swapchain.dev->commandHook->frameLocked(swapchain.frameSubmissions[0]);
+	}
+
 	// timing
 	auto now = Swapchain::Clock::now();
 	if(swapchain.lastPresent) {
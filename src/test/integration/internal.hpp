@@ -28,11 +28,15 @@ extern InternalSetup gSetup;
 // expects to be called with.
 template<typename T, typename O>
 T undispatch(O& dst) {
-	std::shared_lock lock(dataMutex);
-	for(auto& entry : dispatchableTable) {
-		if(entry.second == &dst) {
-			return u64ToHandle<T>(entry.first);
+	auto found = u64(0u);
+	dispatchableTable.forEach([&](u64 key, void* value) {
+		if(value == &dst) {
+			found = key;
 		}
+	});
+
+	if(found) {
+		return u64ToHandle<T>(found);
 	}
 
 	throw std::runtime_error("Invalid handle");
@@ -0,0 +1,114 @@
+#include "../bugged.hpp"
+#include <util/handleTable.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+void* toPtr(u64 val) {
+	return reinterpret_cast<void*>(std::uintptr_t(val));
+}
+
+} // anon namespace
+
+TEST(unit_handle_table_basic) {
+	HandleTable table;
+	EXPECT(table.find(1u), nullptr);
+
+	EXPECT(table.insert(1u, toPtr(10u)), true);
+	EXPECT(table.insert(1u, toPtr(11u)), false);
+	EXPECT(table.find(1u), toPtr(10u));
+	EXPECT(table.find(2u), nullptr);
+
+	EXPECT(table.erase(1u), toPtr(10u));
+	EXPECT(table.erase(1u), nullptr);
+	EXPECT(table.find(1u), nullptr);
+
+	// reinsert into the tombstone
+	EXPECT(table.insert(1u, toPtr(12u)), true);
+	EXPECT(table.find(1u), toPtr(12u));
+
+	// hot entry
+	EXPECT(table.insert(5u, toPtr(50u), true), true);
+	EXPECT(table.find(5u), toPtr(50u));
+	EXPECT(table.insert(6u, toPtr(60u), true), true);
+	EXPECT(table.find(5u), toPtr(50u));
+	EXPECT(table.find(6u), toPtr(60u));
+	EXPECT(table.erase(6u), toPtr(60u));
+	EXPECT(table.find(6u), nullptr);
+	EXPECT(table.find(5u), toPtr(50u));
+}
+
+TEST(unit_handle_table_grow) {
+	HandleTable table;
+
+	// keys similar to pointers
+	auto key = [](u64 i) { return 0x7F0000001000ull + 64u * i; };
+	constexpr auto count = 5000u;
+	for(auto i = 0u; i < count; ++i) {
+		EXPECT(table.insert(key(i), toPtr(i + 1)), true);
+	}
+
+	for(auto i = 0u; i < count; ++i) {
+		EXPECT(table.find(key(i)), toPtr(i + 1));
+	}
+
+	// erase every second entry, insert new ones. Leaves many tombstones.
+	for(auto i = 0u; i < count; i += 2) {
+		EXPECT(table.erase(key(i)), toPtr(i + 1));
+		EXPECT(table.insert(key(count + i), toPtr(count + i + 1)), true);
+	}
+
+	auto found = 0u;
+	table.forEach([&](u64, void*) { ++found; });
+	EXPECT(found, count);
+
+	for(auto i = 0u; i < 2 * count; ++i) {
+		auto expected = (i < count && i % 2 == 1) || (i >= count && i % 2 == 0);
+		EXPECT(table.find(key(i)), expected ? toPtr(i + 1) : nullptr);
+	}
+}
+
+TEST(unit_handle_table_threads) {
+	HandleTable table;
+
+	// stable entries, must always be found
+	constexpr auto stableCount = 64u;
+	for(auto i = 1u; i <= stableCount; ++i) {
+		table.insert(i, toPtr(i), i == 1u);
+	}
+
+	std::atomic<bool> done {};
+	std::atomic<u32> failed {};
+	std::vector<std::thread> readers;
+	for(auto t = 0u; t < 4u; ++t) {
+		readers.emplace_back([&]{
+			while(!done.load()) {
+				for(auto i = 1u; i <= stableCount; ++i) {
+					if(table.find(i) != toPtr(i)) {
+						++failed;
+					}
+				}
+			}
+		});
+	}
+
+	// forces the table to grow (and the hot entry to change) multiple times
+	for(auto i = 0u; i < 20000u; ++i) {
+		auto key = 1000u + i;
+		table.insert(key, toPtr(key), i % 100 == 0u);
+		if(i % 3 == 0u) {
+			table.erase(key);
+		}
+	}
+
+	done.store(true);
+	for(auto& reader : readers) {
+		reader.join();
+	}
+
+	EXPECT(failed.load(), 0u);
+}
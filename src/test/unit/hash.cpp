@@ -0,0 +1,33 @@
+#include "../bugged.hpp"
+#include <util/util.hpp>
+#include <string_view>
+
+using namespace vil;
+
+namespace {
+
+u64 hashString(std::string_view str, u64 seed = 0u) {
+	auto* data = reinterpret_cast<const std::byte*>(str.data());
+	return hash64(span<const std::byte>(data, str.size()), seed);
+}
+
+} // anon namespace
+
+TEST(unit_hash64) {
+	// reference values of xxHash64
+	EXPECT(hashString(""), 0xEF46DB3751D8E999ull);
+	EXPECT(hashString("a"), 0xD24EC4F1A98C6E5Bull);
+	EXPECT(hashString("abc"), 0x44BC2CF5AD770999ull);
+	EXPECT(hashString("Nobody inspects the spammish repetition"),
+		0xFBCEA83C8A378BF1ull);
+
+	// seed and every byte must have an effect
+	std::string str(100, 'x');
+	auto base = hashString(str);
+	EXPECT(hashString(str, 1u) != base, true);
+	for(auto i = 0u; i < str.size(); ++i) {
+		auto copy = str;
+		copy[i] = 'y';
+		EXPECT(hashString(copy) != base, true);
+	}
+}
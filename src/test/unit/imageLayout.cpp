@@ -1,6 +1,7 @@
 #include <imageLayout.hpp>
 #include <random>
 #include <algorithm>
+#include <chrono>
 #include "../bugged.hpp"
 #include "../approx.hpp"
 
@@ -117,3 +118,170 @@ TEST(unit_imageLayout_simplify) {
 	// }
 }
 
+
+namespace {
+
+// Applies the changes one-by-one, like apply does for few changes
+void applySequential(std::vector<vil::ImageSubresourceLayout>& state,
+		vil::span<const vil::ImageSubresourceLayout> changes) {
+	for(auto& c : changes) {
+		vil::apply(state, {{c}});
+	}
+}
+
+void expectSameLayouts(vil::span<const vil::ImageSubresourceLayout> a,
+		vil::span<const vil::ImageSubresourceLayout> b, const VkImageCreateInfo& ici,
+		VkImageAspectFlags aspects) {
+	for(auto aspect : {VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+			VK_IMAGE_ASPECT_STENCIL_BIT}) {
+		if(!(aspects & aspect)) {
+			continue;
+		}
+
+		for(auto level = 0u; level < ici.mipLevels; ++level) {
+			for(auto layer = 0u; layer < ici.arrayLayers; ++layer) {
+				VkImageSubresource subres {VkImageAspectFlags(aspect), level, layer};
+				EXPECT(vil::layout(a, subres), vil::layout(b, subres));
+			}
+		}
+	}
+}
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+} // anon namespace
+
+TEST(unit_imageLayout_batch) {
+	VkImageCreateInfo ici {};
+	ici.format = VK_FORMAT_D24_UNORM_S8_UINT;
+	ici.arrayLayers = 6u;
+	ici.mipLevels = 4u;
+	ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	constexpr auto ds = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	auto state = std::vector{change(0, 4, 0, 6, VK_IMAGE_LAYOUT_UNDEFINED, ds)};
+
+	std::vector<vil::ImageSubresourceLayout> changes {
+		change(0, 4, 0, 6, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, ds),
+		change(1, 1, 2, 3, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_DEPTH_BIT),
+		change(1, 2, 0, 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, ds),
+		change(0, 4, 5, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_STENCIL_BIT),
+		change(3, 1, 0, 6, VK_IMAGE_LAYOUT_GENERAL, ds),
+		change(2, 1, 4, 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, ds),
+		change(0, 1, 0, 6, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, ds),
+		change(1, 1, 3, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_STENCIL_BIT),
+	};
+
+	auto batched = vil::doApplyBatch(state, changes);
+	vil::checkForErrors(batched, ici);
+
+	auto sequential = state;
+	applySequential(sequential, changes);
+	vil::checkForErrors(sequential, ici);
+
+	expectSameLayouts(batched, sequential, ici, ds);
+
+	EXPECT(vil::layout(batched, {VK_IMAGE_ASPECT_DEPTH_BIT, 1, 2}), VK_IMAGE_LAYOUT_GENERAL);
+	EXPECT(vil::layout(batched, {VK_IMAGE_ASPECT_STENCIL_BIT, 1, 2}), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	EXPECT(vil::layout(batched, {VK_IMAGE_ASPECT_STENCIL_BIT, 1, 3}), VK_IMAGE_LAYOUT_GENERAL);
+	EXPECT(vil::layout(batched, {VK_IMAGE_ASPECT_STENCIL_BIT, 2, 5}), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	EXPECT(vil::layout(batched, {VK_IMAGE_ASPECT_DEPTH_BIT, 3, 5}), VK_IMAGE_LAYOUT_GENERAL);
+
+	// a full transition collapses everything again
+	changes.push_back(change(0, 4, 0, 6, VK_IMAGE_LAYOUT_GENERAL, ds));
+	batched = vil::doApplyBatch(state, changes);
+	EXPECT(batched.size(), 1u);
+	EXPECT(batched[0].range.aspectMask, VkImageAspectFlags(ds));
+}
+
+TEST(unit_imageLayout_batch_random) {
+	VkImageCreateInfo ici {};
+	ici.format = VK_FORMAT_R8G8B8A8_UNORM;
+	ici.arrayLayers = 64u;
+	ici.mipLevels = 7u;
+	ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	auto state = std::vector{vil::initialLayout(ici)};
+
+	std::mt19937 e2(42u);
+	std::uniform_int_distribution<> distLevel(0, ici.mipLevels - 1);
+	std::uniform_int_distribution<> distLayer(0, ici.arrayLayers - 1);
+	std::uniform_int_distribution<> distLayout(0, 3);
+	constexpr VkImageLayout layouts[] = {
+		VK_IMAGE_LAYOUT_GENERAL,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+	};
+
+	std::vector<vil::ImageSubresourceLayout> changes;
+	for(auto i = 0u; i < 500; ++i) {
+		auto layerStart = distLayer(e2);
+		auto levelStart = distLevel(e2);
+		auto layerCount = std::min<unsigned>(1 + distLayer(e2) / 8, ici.arrayLayers - layerStart);
+		auto levelCount = std::min<unsigned>(1 + distLevel(e2) / 2, ici.mipLevels - levelStart);
+		changes.push_back(change(levelStart, levelCount, layerStart,
+			layerCount, layouts[distLayout(e2)]));
+	}
+
+	auto batched = vil::doApplyBatch(state, changes);
+	vil::checkForErrors(batched, ici);
+
+	auto sequential = state;
+	applySequential(sequential, changes);
+
+	expectSameLayouts(batched, sequential, ici, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	// applying on a fragmented state must work as well
+	auto batched2 = vil::doApplyBatch(sequential, changes);
+	vil::checkForErrors(batched2, ici);
+	expectSameLayouts(batched, batched2, ici, VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
+// Not really a test, just reports how applying per-subresource barriers
+// scales with the number of changes, for sequential and batched application.
+TEST(unit_imageLayout_scaling) {
+	for(auto layers : {16u, 64u, 2048u}) {
+		VkImageCreateInfo ici {};
+		ici.format = VK_FORMAT_R8G8B8A8_UNORM;
+		ici.arrayLayers = layers;
+		ici.mipLevels = 12u;
+		ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		auto state = std::vector{vil::initialLayout(ici)};
+
+		// e.g. mip generation: one barrier per (layer, mip)
+		std::vector<vil::ImageSubresourceLayout> changes;
+		for(auto layer = 0u; layer < layers; ++layer) {
+			for(auto level = 0u; level < ici.mipLevels; ++level) {
+				changes.push_back(change(level, 1, layer, 1,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+			}
+		}
+
+		// Sequential application produces one state per change here.
+		// Don't run it for huge states, doApply warns about them.
+		auto seqTime = -1.0;
+		if(changes.size() < 1024u) {
+			auto start = Clock::now();
+			auto sequential = state;
+			applySequential(sequential, changes);
+			seqTime = msSince(start);
+		}
+
+		auto start = Clock::now();
+		auto batched = state;
+		vil::apply(batched, changes);
+		auto batchTime = msSince(start);
+
+		vil::checkForErrors(batched, ici);
+		EXPECT(batched.size(), 1u);
+		EXPECT(vil::layout(batched, {VK_IMAGE_ASPECT_COLOR_BIT, 11, layers - 1}),
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+		dlg_info("{} changes: sequential {} ms, batched {} ms",
+			changes.size(), seqTime, batchTime);
+	}
+}
@@ -0,0 +1,75 @@
+#include "../bugged.hpp"
+#include <util/linalloc.hpp>
+#include <stats.hpp>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace vil;
+
+TEST(unit_lin_block_pool) {
+	auto& pool = LinBlockPool::get();
+	auto& stats = DebugStats::get();
+	constexpr auto blockSize = LinBlockPool::blockSize;
+
+	pool.trim();
+	EXPECT(stats.linBlockPoolMem.load(), 0u);
+
+	// blocks can be used over their full size
+	std::vector<std::byte*> blocks;
+	constexpr auto count = LinBlockPool::maxThreadBlocks + 8u;
+	for(auto i = 0u; i < count; ++i) {
+		auto* block = pool.alloc();
+		std::memset(block, int(i), blockSize);
+		blocks.push_back(block);
+	}
+
+	for(auto i = 0u; i < count; ++i) {
+		EXPECT(blocks[i][0], std::byte(i));
+		EXPECT(blocks[i][blockSize - 1], std::byte(i));
+	}
+
+	// the thread cache is full, the rest goes into the global list
+	for(auto* block : blocks) {
+		pool.free(block);
+	}
+
+	// the cached blocks are counted as well
+	auto pooledMem = stats.linBlockPoolMem.load();
+	EXPECT(pooledMem, u64(count) * blockSize);
+
+	// the global list is used once the thread cache is empty
+	for(auto& block : blocks) {
+		block = pool.alloc();
+	}
+
+	EXPECT(stats.linBlockPoolMem.load() < pooledMem, true);
+
+	// freed on another thread, its cache is moved into the
+	// global list on thread exit
+	std::thread([&]{
+		for(auto* block : blocks) {
+			pool.free(block);
+		}
+	}).join();
+
+	EXPECT(stats.linBlockPoolMem.load(), u64(count) * blockSize);
+
+	// the global list is capped
+	blocks.clear();
+	constexpr auto capCount = LinBlockPool::maxGlobalBlocks + 8u;
+	for(auto i = 0u; i < capCount; ++i) {
+		blocks.push_back(pool.alloc());
+	}
+
+	std::thread([&]{
+		for(auto* block : blocks) {
+			pool.free(block);
+		}
+	}).join();
+
+	EXPECT(stats.linBlockPoolMem.load(), u64(LinBlockPool::maxGlobalBlocks) * blockSize);
+
+	pool.trim();
+	EXPECT(stats.linBlockPoolMem.load(), 0u);
+}
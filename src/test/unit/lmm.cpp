@@ -2,6 +2,7 @@
 #include "../approx.hpp"
 #include "lmm.hpp"
 #include <random>
+#include <chrono>
 #include <unordered_set>
 #include <util/profiling.hpp>
 
@@ -304,3 +305,72 @@ TEST(unit_lmm_strings) {
 	checkMatch("dddda", "aaaad", 1);
 	checkMatch("a", "aaaadaaaa", 1);
 }
+
+// Matches sequences of the given length where the given fraction of
+// elements was edited (replaced, inserted or removed).
+// Large sequences use the sparse matrix storage.
+void benchEdited(u32 len, float editRate) {
+	std::mt19937 e2(len);
+	std::uniform_real_distribution<float> dist(0.f, 1.f);
+
+	std::vector<u32> seqA(len);
+	for(auto i = 0u; i < len; ++i) {
+		seqA[i] = i;
+	}
+
+	auto numEdits = 0u;
+	std::vector<u32> seqB;
+	seqB.reserve(len + len / 10);
+	for(auto i = 0u; i < len; ++i) {
+		auto r = dist(e2);
+		if(r < editRate / 3) { // replace
+			seqB.push_back(len + i);
+			++numEdits;
+		} else if(r < 2 * editRate / 3) { // insert
+			seqB.push_back(len + i);
+			seqB.push_back(seqA[i]);
+			++numEdits;
+		} else if(r < editRate) { // remove
+			++numEdits;
+		} else {
+			seqB.push_back(seqA[i]);
+		}
+	}
+
+	auto matcher = [&](u32 i, u32 j) -> float {
+		return seqA[i] == seqB[j] ? 1.f : 0.f;
+	};
+
+	using Clock = std::chrono::high_resolution_clock;
+	u64 memSize = 0u; // allocated memory in bytes
+	LinAllocator alloc(
+		[&](const std::byte*, u32 size) { memSize += size; },
+		[&](const std::byte*, u32 size) { memSize -= size; });
+	LazyMatrixMarch lmm(len, u32(seqB.size()), alloc, matcher);
+
+	auto before = Clock::now();
+	auto res = lmm.run();
+	auto time = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - before).count();
+
+	// every unedited element must be matched
+	auto numMatches = 0u;
+	for(auto& m : res.matches) {
+		EXPECT(seqA[m.i], seqB[m.j]);
+		++numMatches;
+	}
+
+	EXPECT(numMatches >= len - numEdits, true);
+
+	dlg_info("lmm {} elements, {} edits: {} mus, {} evals, {} steps, {} KiB memory",
+		len, numEdits, time, lmm.numEvals(), lmm.numSteps(),
+		memSize / 1024);
+}
+
+TEST(unit_lmm_large) {
+	benchEdited(10 * 1000u, 0.01f);
+	benchEdited(10 * 1000u, 0.05f);
+
+	// The number of evaluations grows with (length * number of edits),
+	// 100k elements with 5% edits would take minutes.
+	benchEdited(100 * 1000u, 0.01f);
+}
@@ -3,6 +3,7 @@
 #include <command/commands.hpp>
 #include <command/alloc.hpp>
 #include <command/builder.hpp>
+#include <ds.hpp>
 #include <threadContext.hpp>
 #include <vk/vulkan.h>
 #include "../bugged.hpp"
@@ -144,3 +145,100 @@ TEST(unit_match_labels) {
 		dlg_assert(matches2[2].a == &b4);
 	}
 }
+
+TEST(unit_match_may_find) {
+	Device dev;
+	dev.captureCmdStack.store(false);
+
+	RecordBuilder rb(&dev);
+	BarrierCmd* targetCmd;
+	{
+		LabelSection section(rb, "1");
+		targetCmd = &rb.add<BarrierCmd>();
+	}
+	auto recA = rb.record_;
+	auto* labelA = recA->commands->firstChildParent();
+	dlg_assert(labelA);
+
+	std::vector<const Command*> hierarchy {recA->commands, labelA, targetCmd};
+
+	// barrier in a label section, not the first one
+	rb.reset(&dev);
+	emptyLabelSection(rb, "1");
+	{
+		LabelSection section(rb, "2");
+		rb.add<BarrierCmd>();
+	}
+	auto recB = rb.record_;
+
+	// label section without a barrier
+	rb.reset(&dev);
+	emptyLabelSection(rb, "1");
+	rb.add<BarrierCmd>();
+	auto recC = rb.record_;
+
+	// barrier without label section
+	rb.reset(&dev);
+	rb.add<BarrierCmd>();
+	auto recD = rb.record_;
+
+	EXPECT(mayFind(matchType, *recA->commands, hierarchy), true);
+	EXPECT(mayFind(matchType, *recB->commands, hierarchy), true);
+	EXPECT(mayFind(matchType, *recC->commands, hierarchy), false);
+	EXPECT(mayFind(matchType, *recD->commands, hierarchy), false);
+
+	// must be conservative
+	for(auto& rec : {recA, recB, recC, recD}) {
+		auto res = find(matchType, *rec->commands, hierarchy, {});
+		if(!res.hierarchy.empty()) {
+			EXPECT(mayFind(matchType, *rec->commands, hierarchy), true);
+		}
+	}
+}
+
+TEST(unit_match_fingerprint_fast_path) {
+	Device dev;
+	dev.captureCmdStack.store(false);
+
+	auto record = [&]{
+		RecordBuilder rb(&dev);
+		auto& barrier = rb.add<BarrierCmd>();
+		barrier.srcStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+
+		auto& draw = rb.add<DrawCmd>();
+		draw.vertexCount = 3u;
+		draw.instanceCount = 1u;
+
+		rb.flushHash();
+		return rb.record_;
+	};
+
+	auto rec1 = record();
+	auto rec2 = record();
+
+	auto& barrier1 = static_cast<const BarrierCmd&>(*rec1->commands->children());
+	auto& barrier2 = static_cast<const BarrierCmd&>(*rec2->commands->children());
+	auto& draw1 = static_cast<const DrawCmd&>(*barrier1.next);
+	auto& draw2 = static_cast<const DrawCmd&>(*barrier2.next);
+
+	// the fast path must give the same result as the full matching
+	auto checkSame = [](const auto& a, const auto& b) {
+		EXPECT(a.paramHash != 0u, true);
+		EXPECT(a.paramHash, b.paramHash);
+
+		auto fast = match(a, b, matchType);
+
+		auto slowA = a;
+		auto slowB = b;
+		slowA.structureHash = slowB.structureHash = 0u;
+		slowA.paramHash = slowB.paramHash = 0u;
+		auto slow = match(slowA, slowB, matchType);
+
+		EXPECT(fast.match, approx(slow.match));
+		EXPECT(fast.total, approx(slow.total));
+	};
+
+	checkSame(barrier1, barrier2);
+	checkSame(draw1, draw2);
+}
@@ -0,0 +1,83 @@
+#include "../bugged.hpp"
+#include <commandHook/profile.hpp>
+
+using namespace vil;
+
+namespace {
+
+ProfileSample sample(std::string name, float ms,
+		std::vector<ProfileSample> children = {}) {
+	ProfileSample ret;
+	ret.name = std::move(name);
+	ret.ms = ms;
+	ret.children = std::move(children);
+	return ret;
+}
+
+} // anon namespace
+
+TEST(unit_profile_stats) {
+	TimingStats stats;
+	EXPECT(stats.min(), 0.f);
+	EXPECT(stats.avg(), 0.f);
+	EXPECT(stats.p95(), 0.f);
+
+	for(auto i = 1u; i <= 100u; ++i) {
+		stats.add(float(i));
+	}
+
+	EXPECT(stats.count, 100u);
+	EXPECT(stats.last, 100.f);
+	EXPECT(stats.min(), 1.f);
+	EXPECT(stats.avg(), 50.5f);
+	EXPECT(stats.p95(), 95.f);
+
+	// only the last windowSize samples are considered
+	for(auto i = 0u; i < TimingStats::windowSize; ++i) {
+		stats.add(2.f);
+	}
+
+	EXPECT(stats.min(), 2.f);
+	EXPECT(stats.avg(), 2.f);
+	EXPECT(stats.p95(), 2.f);
+}
+
+TEST(unit_profile_merge) {
+	ProfileNode root;
+
+	auto frame0 = sample("Frame", 3.f, {
+		sample("Draw", 1.f),
+		sample("Shadows", 1.f, {sample("Draw", 0.5f)}),
+		sample("Draw", 1.f),
+	});
+	merge(root, frame0, 1u, 256u);
+
+	EXPECT(root.children.size(), 3u);
+	EXPECT(root.children[0].name, std::string("Draw"));
+	EXPECT(root.children[1].name, std::string("Shadows"));
+	EXPECT(root.children[1].children.size(), 1u);
+
+	// the second "Draw" is matched by occurrence, not position
+	auto frame1 = sample("Frame", 4.f, {
+		sample("Shadows", 2.f, {sample("Draw", 1.f)}),
+		sample("Draw", 1.f),
+		sample("Draw", 3.f),
+	});
+	merge(root, frame1, 2u, 256u);
+
+	EXPECT(root.stats.count, 2u);
+	EXPECT(root.children.size(), 3u);
+	EXPECT(root.children[0].stats.count, 2u);
+	EXPECT(root.children[1].stats.last, 2.f);
+	EXPECT(root.children[2].stats.last, 3.f);
+	EXPECT(root.children[2].stats.min(), 1.f);
+
+	// nodes missing for too long are dropped
+	auto frame2 = sample("Frame", 1.f, {sample("Draw", 1.f)});
+	merge(root, frame2, 3u, 256u);
+	EXPECT(root.children.size(), 3u);
+
+	merge(root, frame2, 300u, 256u);
+	EXPECT(root.children.size(), 1u);
+	EXPECT(root.children[0].stats.count, 4u);
+}
@@ -0,0 +1,118 @@
+#include <command/record.hpp>
+#include <command/commands.hpp>
+#include <command/alloc.hpp>
+#include <command/builder.hpp>
+#include <device.hpp>
+#include <vk/vulkan.h>
+#include "../bugged.hpp"
+
+using namespace vil;
+
+namespace {
+
+IntrusivePtr<CommandRecord> recordDraws(Device& dev, u32 vertexCount) {
+	RecordBuilder rb(&dev);
+
+	auto& barrier = rb.add<BarrierCmd>();
+	barrier.srcStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+
+	auto& lbl = rb.add<BeginDebugUtilsLabelCmd, SectionType::begin>();
+	lbl.name = copyString(*rb.record_, "section");
+
+	auto& draw = rb.add<DrawCmd>();
+	draw.vertexCount = vertexCount;
+	draw.instanceCount = 1u;
+	draw.firstVertex = 0u;
+	draw.firstInstance = 0u;
+
+	rb.add<EndDebugUtilsLabelCmd, SectionType::end>();
+	rb.flushHash();
+
+	return rb.record_;
+}
+
+} // anon namespace
+
+TEST(unit_record_hash_equal) {
+	Device dev;
+	dev.captureCmdStack.store(false);
+
+	auto rec1 = recordDraws(dev, 3u);
+	auto rec2 = recordDraws(dev, 3u);
+
+	EXPECT(rec1->hashComplete, true);
+	EXPECT(rec1->hash, rec2->hash);
+	EXPECT(sameContent(*rec1, *rec2), true);
+}
+
+TEST(unit_record_hash_params) {
+	Device dev;
+	dev.captureCmdStack.store(false);
+
+	// the last command's parameters are only hashed in flushHash,
+	// this must be included as well
+	auto rec1 = recordDraws(dev, 3u);
+	auto rec2 = recordDraws(dev, 6u);
+
+	EXPECT(rec1->hash == rec2->hash, false);
+	EXPECT(sameContent(*rec1, *rec2), false);
+}
+
+TEST(unit_record_hash_collision) {
+	Device dev;
+	dev.captureCmdStack.store(false);
+
+	// simulate a hash collision, the commands themselves are compared
+	auto rec1 = recordDraws(dev, 3u);
+	auto rec2 = recordDraws(dev, 6u);
+	rec2->hash = rec1->hash;
+
+	EXPECT(sameContent(*rec1, *rec2), false);
+	EXPECT(sameCommands(rec1->commands, rec1->commands), true);
+	EXPECT(sameCommands(rec1->commands, rec2->commands), false);
+}
+
+TEST(unit_record_hash_unsupported) {
+	Device dev;
+	dev.captureCmdStack.store(false);
+
+	RecordBuilder rb(&dev);
+	rb.add<SetVertexInputCmd>();
+	rb.add<DrawCmd>();
+	rb.flushHash();
+
+	auto rec1 = rb.record_;
+	EXPECT(rec1->hashComplete, false);
+	EXPECT(sameContent(*rec1, *rec1), false);
+}
+
+TEST(unit_command_fingerprints) {
+	Device dev;
+	dev.captureCmdStack.store(false);
+
+	auto rec1 = recordDraws(dev, 3u);
+	auto rec2 = recordDraws(dev, 3u);
+	auto rec3 = recordDraws(dev, 6u);
+
+	auto draw = [](const CommandRecord& rec) -> const Command& {
+		auto* lbl = rec.commands->children()->next;
+		return *lbl->children();
+	};
+
+	auto& draw1 = draw(*rec1);
+	auto& draw2 = draw(*rec2);
+	auto& draw3 = draw(*rec3);
+
+	EXPECT(draw1.structureHash != 0u, true);
+	EXPECT(draw1.paramHash != 0u, true);
+	EXPECT(draw1.structureHash, draw2.structureHash);
+	EXPECT(draw1.paramHash, draw2.paramHash);
+
+	// vertexCount is hard-matched
+	EXPECT(draw1.structureHash == draw3.structureHash, false);
+	EXPECT(draw1.paramHash == draw3.paramHash, false);
+
+	auto& barrier1 = *rec1->commands->children();
+	EXPECT(barrier1.structureHash == draw1.structureHash, false);
+}
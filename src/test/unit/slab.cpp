@@ -0,0 +1,132 @@
+#include "../bugged.hpp"
+#include <util/slab.hpp>
+#include <stats.hpp>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+struct SlabObject {
+	VIL_SLAB_ALLOCATED(SlabObject)
+
+	u64 data[5] {};
+};
+
+struct TrimmedObject {
+	VIL_SLAB_ALLOCATED(TrimmedObject)
+
+	u64 data[7] {};
+};
+
+} // anon namespace
+
+TEST(unit_slab_pool) {
+	auto& stats = DebugStats::get();
+	auto& pool = slabPool<SlabObject>();
+	EXPECT(pool.stats().kind, SlabPool::Kind::handle);
+	auto taken = pool.stats().numTaken;
+
+	std::vector<SlabObject*> objects;
+	for(auto i = 0u; i < 1000u; ++i) {
+		auto* obj = new SlabObject();
+		EXPECT(reinterpret_cast<std::uintptr_t>(obj) % alignof(SlabObject), 0u);
+		obj->data[0] = i;
+		obj->data[4] = i;
+		objects.push_back(obj);
+	}
+
+	// the thread cache is refilled with maxThreadObjects / 2 objects at once
+	EXPECT(pool.stats().numTaken >= taken + 1000u, true);
+	EXPECT(pool.stats().numTaken <= taken + 1000u + SlabPool::maxThreadObjects, true);
+	for(auto i = 0u; i < objects.size(); ++i) {
+		EXPECT(objects[i]->data[0], i);
+		EXPECT(objects[i]->data[4], i);
+	}
+
+	// objects freed on another thread
+	std::thread([&]{
+		for(auto* obj : objects) {
+			delete obj;
+		}
+	}).join();
+
+	// the other thread returned its cache on exit
+	EXPECT(pool.stats().numTaken <= taken + SlabPool::maxThreadObjects, true);
+
+	// memory is reused
+	auto slabMem = stats.slabMem.load();
+	for(auto& obj : objects) {
+		obj = new SlabObject();
+	}
+
+	EXPECT(stats.slabMem.load(), slabMem);
+	for(auto* obj : objects) {
+		delete obj;
+	}
+}
+
+TEST(unit_slab_allocator) {
+	using Alloc = SlabAllocator<std::pair<const u64, u64>>;
+	std::unordered_map<u64, u64, std::hash<u64>, std::equal_to<u64>, Alloc> map;
+	for(auto i = 0u; i < 5000u; ++i) {
+		map.emplace(i, 2 * i);
+	}
+
+	for(auto i = 0u; i < 5000u; i += 2) {
+		map.erase(i);
+	}
+
+	EXPECT(map.size(), 2500u);
+	for(auto i = 1u; i < 5000u; i += 2) {
+		EXPECT(map.at(i), 2 * i);
+	}
+
+	// map nodes are counted separately from handle objects
+	u64 numNodes {};
+	for(auto& pool : SlabPool::statsAll()) {
+		if(pool.kind == SlabPool::Kind::node) {
+			numNodes += pool.numTaken;
+		}
+	}
+
+	EXPECT(numNodes >= 2500u, true);
+}
+
+TEST(unit_slab_trim) {
+	auto& stats = DebugStats::get();
+	auto slabMem = stats.slabMem.load();
+
+	std::vector<TrimmedObject*> objects;
+	for(auto i = 0u; i < 5000u; ++i) {
+		objects.push_back(new TrimmedObject());
+	}
+
+	EXPECT(stats.slabMem.load() > slabMem, true);
+
+	// slabs that still have alive objects are kept
+	std::thread([&]{
+		for(auto i = 1u; i < objects.size(); ++i) {
+			delete objects[i];
+		}
+	}).join();
+
+	slabPool<TrimmedObject>().trim();
+	EXPECT(stats.slabMem.load() > slabMem, true);
+
+	auto* obj = new TrimmedObject();
+	obj->data[6] = 42u;
+	EXPECT(obj->data[6], 42u);
+	delete obj;
+
+	delete objects[0];
+	slabPool<TrimmedObject>().trim();
+	EXPECT(stats.slabMem.load(), slabMem);
+
+	// the pool can still be used after trimming
+	obj = new TrimmedObject();
+	EXPECT(stats.slabMem.load() > slabMem, true);
+	delete obj;
+}
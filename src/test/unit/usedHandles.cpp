@@ -0,0 +1,161 @@
+#include "../bugged.hpp"
+#include <command/record.hpp>
+#include <util/flatPtrSet.hpp>
+#include <random>
+#include <chrono>
+#include <unordered_set>
+
+using namespace vil;
+
+namespace {
+
+struct DummyHandle {
+	std::atomic<u32> refCount {1u};
+	u32 id {};
+	std::byte data[120]; // roughly the size of a small handle
+};
+
+using DummyRef = RefHandle<DummyHandle>;
+
+// Returns the number of bytes allocated from the given allocator
+std::size_t usedBytes(const LinAllocator& alloc) {
+	std::size_t ret = 0u;
+	auto* block = alloc.memRoot.next;
+	while(block) {
+		ret += memOffset(*block);
+		if(block == alloc.memCurrent) {
+			break;
+		}
+
+		block = block->next;
+	}
+
+	return ret;
+}
+
+// The previously used set, for comparison.
+struct DummyRefHash {
+	size_t operator()(const DummyRef& x) const {
+		return std::hash<DummyHandle*>{}(x.handle.get());
+	}
+};
+
+using OldUsedSet = std::unordered_set<DummyRef, DummyRefHash,
+	std::equal_to<DummyRef>, LinearUnscopedAllocator<DummyRef>>;
+
+void useOld(OldUsedSet& set, LinAllocator& alloc, DummyHandle& handle) {
+	DummyRef rh(alloc);
+	rh.handle = IntrusivePtr<DummyHandle>(acquireOwnership, &handle);
+	auto it = set.find(rh);
+	(void) rh.handle.release();
+
+	if(it == set.end()) {
+		DummyRef nrh(alloc);
+		nrh.handle.reset(&handle);
+		set.insert(std::move(nrh));
+	}
+}
+
+void useNew(UsedHandleSet<DummyHandle>& set, LinAllocator& alloc, DummyHandle& handle) {
+	set.tryEmplace(&handle, alloc, handle);
+}
+
+} // anon namespace
+
+TEST(unit_usedHandles_basic) {
+	std::vector<DummyHandle> handles(1000);
+	LinAllocator alloc;
+
+	{
+		UsedHandleSet<DummyHandle> set(alloc);
+		EXPECT(set.empty(), true);
+		EXPECT(set.find(&handles[0]), nullptr);
+		EXPECT(set.begin() == set.end(), true);
+
+		for(auto i = 0u; i < handles.size(); ++i) {
+			handles[i].id = i;
+			useNew(set, alloc, handles[i]);
+			useNew(set, alloc, handles[i / 2]);
+		}
+
+		EXPECT(set.size(), handles.size());
+
+		auto count = 0u;
+		for(auto& use : set) {
+			EXPECT(use.handle->refCount.load(), 2u);
+			++count;
+		}
+
+		EXPECT(count, handles.size());
+
+		for(auto& handle : handles) {
+			auto* use = set.find(&handle);
+			EXPECT(use != nullptr, true);
+			EXPECT(use->handle.get(), &handle);
+		}
+
+		DummyHandle other;
+		EXPECT(set.contains(&other), false);
+	}
+
+	// destroying the set must release all references
+	for(auto& handle : handles) {
+		EXPECT(handle.refCount.load(), 1u);
+	}
+}
+
+// Microbenchmark for the useHandleImpl pattern (cb.cpp): every bind/draw
+// looks up a couple of handles, most of them already used before in
+// the same record.
+TEST(unit_usedHandles_bench) {
+	using Clock = std::chrono::high_resolution_clock;
+
+	constexpr auto numHandles = 4096u;
+	constexpr auto numRecords = 1000u;
+	constexpr auto usesPerRecord = 200u;
+	constexpr auto handlesPerRecord = 40u;
+
+	// Allocate them individually, like real handles
+	std::vector<std::unique_ptr<DummyHandle>> handles;
+	for(auto i = 0u; i < numHandles; ++i) {
+		handles.emplace_back(std::make_unique<DummyHandle>());
+	}
+
+	std::mt19937 rng(42u);
+	std::vector<u32> uses(numRecords * usesPerRecord);
+	for(auto r = 0u; r < numRecords; ++r) {
+		auto base = rng() % (numHandles - handlesPerRecord);
+		for(auto i = 0u; i < usesPerRecord; ++i) {
+			uses[r * usesPerRecord + i] = base + rng() % handlesPerRecord;
+		}
+	}
+
+	auto bench = [&](auto& useFunc, auto tag) {
+		using Set = typename decltype(tag)::type;
+		std::size_t bytes = 0u;
+		auto before = Clock::now();
+		for(auto r = 0u; r < numRecords; ++r) {
+			LinAllocator alloc(&LinBlockPool::get());
+			Set set(alloc);
+			for(auto i = 0u; i < usesPerRecord; ++i) {
+				useFunc(set, alloc, *handles[uses[r * usesPerRecord + i]]);
+			}
+
+			bytes += usedBytes(alloc);
+		}
+
+		auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			Clock::now() - before).count();
+		return std::pair{double(time) / uses.size(), double(bytes) / numRecords};
+	};
+
+	auto [timeOld, bytesOld] = bench(useOld,
+		std::common_type<OldUsedSet>{});
+	auto [timeNew, bytesNew] = bench(useNew,
+		std::common_type<UsedHandleSet<DummyHandle>>{});
+
+	dlg_trace("unordered_set: {} ns per use, {} bytes per record", timeOld, bytesOld);
+	dlg_trace("FlatPtrSet: {} ns per use, {} bytes per record", timeNew, bytesNew);
+
+	EXPECT(bytesNew < bytesOld, true);
+}
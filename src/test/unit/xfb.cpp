@@ -1,4 +1,6 @@
 #include <shader.hpp>
+#include <commandHook/xfb.hpp>
+#include <xfbCache.hpp>
 #include <util/spirv.hpp>
 #include <util/dlg.hpp>
 #include <nytl/span.hpp>
@@ -61,6 +63,8 @@ TEST(unit_xfb_patch) {
 	EXPECT(out2.width, 32u);
 	EXPECT(out2.type, XfbCapture::typeUint);
 	EXPECT(out2.builtin, std::nullopt);
+
+	EXPECT(patched.desc->readsBaseVertexInstance, false);
 }
 
 TEST(unit_xfb_patch_spec) {
@@ -87,3 +91,144 @@ TEST(unit_xfb_patch_spec) {
 	EXPECT(out4.type, XfbCapture::typeFloat);
 	EXPECT(out4.builtin, std::nullopt);
 }
+
+TEST(unit_xfb_chunks) {
+	XfbSplit split;
+	split.stride = 64u;
+	split.primitiveSize = 3u;
+	split.maxOutputPerVertex = 1u;
+	split.instances = true;
+
+	auto chunkVerts = u32(maxXfbChunkSize / split.stride);
+	auto vpc = chunkVerts - chunkVerts % 3u;
+
+	// small draws are captured at once
+	EXPECT(xfbChunkCount(split, 0u, 1u), 0u);
+	EXPECT(xfbChunkCount(split, 300u, 1u), 1u);
+	auto range = xfbChunkRange(split, 300u, 1u, 0u);
+	EXPECT(range.vertexCount, 300u);
+	EXPECT(range.instanceCount, 1u);
+	EXPECT(xfbCaptureSize(split, range), VkDeviceSize(300u * 64u));
+
+	// multiple instances per chunk
+	auto ipc = chunkVerts / 300u;
+	EXPECT(xfbChunkCount(split, 300u, 2 * ipc + 1), 3u);
+	range = xfbChunkRange(split, 300u, 2 * ipc + 1, 2u);
+	EXPECT(range.firstInstance, 2 * ipc);
+	EXPECT(range.instanceCount, 1u);
+
+	// the vertex range of a single instance is split
+	auto numVerts = 2 * vpc + 30u;
+	EXPECT(xfbChunkCount(split, numVerts, 2u), 6u);
+	range = xfbChunkRange(split, numVerts, 2u, 5u);
+	EXPECT(range.firstInstance, 1u);
+	EXPECT(range.instanceCount, 1u);
+	EXPECT(range.firstVertex, 2 * vpc);
+	EXPECT(range.vertexCount, 30u);
+	EXPECT(xfbCaptureSize(split, xfbChunkRange(split, numVerts, 2u, 0u)) <= maxXfbChunkSize, true);
+
+	// when the shader reads gl_BaseVertex/gl_BaseInstance, draws can't be split
+	split.instances = false;
+	split.primitiveSize = 0u;
+	EXPECT(xfbChunkCount(split, numVerts, 2u), 1u);
+	range = xfbChunkRange(split, numVerts, 2u, 0u);
+	EXPECT(range.vertexCount, numVerts);
+	EXPECT(range.instanceCount, 2u);
+	EXPECT(xfbCaptureSize(split, range), maxXfbChunkSize);
+}
+
+TEST(unit_xfb_parts) {
+	// chunk inside the vertex range of an instance
+	XfbRange chunk {30u, 60u, 2u, 1u};
+	auto parts = xfbParts(chunk, 120u, 4u);
+	EXPECT(parts.size(), 5u);
+
+	// instances before
+	EXPECT(parts[0].range.firstInstance, 0u);
+	EXPECT(parts[0].range.instanceCount, 2u);
+	EXPECT(parts[0].range.vertexCount, 120u);
+	EXPECT(parts[0].capture, false);
+
+	// vertices before
+	EXPECT(parts[1].range.firstInstance, 2u);
+	EXPECT(parts[1].range.firstVertex, 0u);
+	EXPECT(parts[1].range.vertexCount, 30u);
+
+	EXPECT(parts[2].capture, true);
+	EXPECT(parts[2].range.firstVertex, 30u);
+	EXPECT(parts[2].range.vertexCount, 60u);
+
+	// vertices after
+	EXPECT(parts[3].range.firstVertex, 90u);
+	EXPECT(parts[3].range.vertexCount, 30u);
+	EXPECT(parts[3].capture, false);
+
+	// instances after
+	EXPECT(parts[4].range.firstInstance, 3u);
+	EXPECT(parts[4].range.instanceCount, 1u);
+	EXPECT(parts[4].range.vertexCount, 120u);
+
+	// whole draw
+	parts = xfbParts({0u, 120u, 0u, 4u}, 120u, 4u);
+	EXPECT(parts.size(), 1u);
+	EXPECT(parts[0].capture, true);
+}
+
+TEST(unit_xfb_cache_entry) {
+	spc::Compiler compiled{{std::begin(a_vert_spv_data), std::end(a_vert_spv_data)}};
+	compiled.set_entry_point("main", spv::ExecutionModelVertex);
+	auto patched = patchSpirvXfb(compiled, "main");
+
+	ShaderSpecialization spec;
+	spec.entries.push_back({0u, 0u, 4u});
+	spec.data.resize(4u);
+
+	constexpr auto spirvSize = u64(1024u);
+	constexpr auto stage = VK_SHADER_STAGE_VERTEX_BIT;
+
+	SaveBuf buf;
+	saveXfbCacheEntry(buf, 42u, spirvSize, stage, "main", spec, patched);
+
+	auto load = LoadBuf{ReadBuf(buf)};
+	auto loaded = loadXfbCacheEntry(load, 42u, spirvSize, stage, "main", spec);
+	EXPECT(loaded.has_value(), true);
+	EXPECT(loaded->spirv == patched.spirv, true);
+	EXPECT(loaded->desc.get() != nullptr, true);
+	EXPECT(loaded->desc->stride, patched.desc->stride);
+	EXPECT(loaded->desc->captures.size(), patched.desc->captures.size());
+
+	auto& out4 = getCapture(*loaded->desc, "outStruct.out4");
+	EXPECT(out4.array.size(), 1u);
+	EXPECT(out4.offset, getCapture(*patched.desc, "outStruct.out4").offset);
+	auto& pos = getCapture(*loaded->desc, spv11::BuiltIn::Position);
+	EXPECT(pos.type, XfbCapture::typeFloat);
+
+	// different key
+	load = LoadBuf{ReadBuf(buf)};
+	EXPECT(loadXfbCacheEntry(load, 43u, spirvSize, stage, "main", spec).has_value(), false);
+	load = LoadBuf{ReadBuf(buf)};
+	EXPECT(loadXfbCacheEntry(load, 42u, spirvSize, stage, "main2", spec).has_value(), false);
+	load = LoadBuf{ReadBuf(buf)};
+	EXPECT(loadXfbCacheEntry(load, 42u, spirvSize + 4u, stage, "main", spec).has_value(), false);
+	load = LoadBuf{ReadBuf(buf)};
+	EXPECT(loadXfbCacheEntry(load, 42u, spirvSize,
+		VK_SHADER_STAGE_FRAGMENT_BIT, "main", spec).has_value(), false);
+
+	// not patchable
+	SaveBuf emptyBuf;
+	saveXfbCacheEntry(emptyBuf, 42u, spirvSize, stage, "main", spec, {});
+	load = LoadBuf{ReadBuf(emptyBuf)};
+	loaded = loadXfbCacheEntry(load, 42u, spirvSize, stage, "main", spec);
+	EXPECT(loaded.has_value(), true);
+	EXPECT(loaded->desc.get(), nullptr);
+
+	// truncated
+	auto threw = false;
+	try {
+		load = LoadBuf{ReadBuf(buf).subspan(0u, buf.size() / 2)};
+		loadXfbCacheEntry(load, 42u, spirvSize, stage, "main", spec);
+	} catch(const std::exception&) {
+		threw = true;
+	}
+	EXPECT(threw, true);
+}
@@ -32,7 +32,7 @@ struct ThreadContext {
 	static std::vector<ThreadContext*> contexts_;
 
 	// Only to be used in a scoped manner, via ThreadMemScope.
-	LinAllocator linalloc_;
+	LinAllocator linalloc_ {&LinBlockPool::get()};
 
 	ThreadContext() {
 		linalloc_.onAlloc = [&](auto* buf, auto size) {
@@ -0,0 +1,227 @@
+#include <util/captureHeap.hpp>
+#include <util/util.hpp>
+#include <util/allocation.hpp>
+#include <util/profiling.hpp>
+#include <device.hpp>
+#include <stats.hpp>
+
+namespace vil {
+
+struct CaptureHeap::Block {
+	VkDeviceMemory memory {};
+	VkDeviceSize size {};
+	VkDeviceSize offset {}; // where the next slot is carved from
+	std::byte* map {};
+	u32 memType {};
+	u32 numAlive {};
+	u64 lastUsed {}; // frame
+	bool dedicated {};
+};
+
+CaptureHeap::CaptureHeap(Device& xdev) : dev(&xdev) {
+	// Aligning all slots to (at least) the granularity means
+	// that buffers and images never share a page. The atom size
+	// allows to flush/invalidate slots independently.
+	auto& limits = dev->props.limits;
+	auto granularity = std::max<VkDeviceSize>(1u, std::max(
+		limits.bufferImageGranularity, limits.nonCoherentAtomSize));
+	minSlot_ = std::max<VkDeviceSize>(minSlotSize, nextPOT(u32(granularity)));
+
+	while(numClasses_ < maxClasses && (minSlot_ << numClasses_) <= blockSize / 2) {
+		++numClasses_;
+	}
+}
+
+CaptureHeap::~CaptureHeap() {
+	for(auto& pool : pools_) {
+		for(auto& block : pool.blocks) {
+			dlg_assertm(block->numAlive == 0u, "{} capture allocations alive",
+				block->numAlive);
+			destroy(*block);
+		}
+	}
+}
+
+u32 CaptureHeap::sizeClass(VkDeviceSize size) const {
+	auto ret = 0u;
+	while(ret < numClasses_ && (minSlot_ << ret) < size) {
+		++ret;
+	}
+
+	return ret;
+}
+
+CaptureHeap::Block* CaptureHeap::allocBlock(Pool& pool, u32 memType,
+		VkDeviceSize size, bool dedicated) {
+	ZoneScoped;
+
+	VkMemoryAllocateInfo allocInfo {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memType;
+
+	VkMemoryAllocateFlagsInfo flagsInfo {};
+	if(dev->bufferDeviceAddress) {
+		flagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+		flagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+		allocInfo.pNext = &flagsInfo;
+	}
+
+	VkDeviceMemory memory {};
+	auto res = dev->dispatch.AllocateMemory(dev->handle, &allocInfo, nullptr, &memory);
+	if(res != VK_SUCCESS) {
+		dlg_error("CaptureHeap: allocating {} bytes failed: {}", size, res);
+		return nullptr;
+	}
+
+	nameHandle(*dev, memory, "CaptureHeap:block");
+
+	auto& block = *pool.blocks.emplace_back(std::make_unique<Block>());
+	block.memory = memory;
+	block.size = size;
+	block.memType = memType;
+	block.dedicated = dedicated;
+	block.lastUsed = frame_;
+
+	auto flags = dev->memProps.memoryTypes[memType].propertyFlags;
+	if(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		void* pmap;
+		VK_CHECK_DEV(dev->dispatch.MapMemory(dev->handle, memory, 0, VK_WHOLE_SIZE, 0, &pmap), *dev);
+		block.map = static_cast<std::byte*>(pmap);
+	}
+
+	DebugStats::get().captureHeapMem += size;
+	return &block;
+}
+
+void CaptureHeap::destroy(Block& block) {
+	// no need to unmap memory, automtically done when memory is destroyed
+	dev->dispatch.FreeMemory(dev->handle, block.memory, nullptr);
+	DebugStats::get().captureHeapMem -= block.size;
+}
+
+CaptureHeap::Allocation CaptureHeap::alloc(const VkMemoryRequirements& reqs,
+		u32 memTypeBits) {
+	auto typeBits = reqs.memoryTypeBits & memTypeBits;
+	dlg_assert_or(typeBits != 0u, return {});
+
+	auto memType = findLSB(typeBits);
+	auto size = std::max(reqs.size, reqs.alignment);
+
+	std::lock_guard lock(mutex_);
+	auto& pool = pools_[memType];
+
+	Block* block {};
+	VkDeviceSize offset {};
+	VkDeviceSize slotSize {};
+
+	auto cls = sizeClass(size);
+	if(cls < numClasses_) {
+		// Slots are aligned to their size, this satisfies the alignment
+		// requirement since both are powers of two.
+		slotSize = minSlot_ << cls;
+		auto& freeList = pool.freeLists[cls];
+		if(!freeList.empty()) {
+			block = freeList.back().block;
+			offset = freeList.back().offset;
+			freeList.pop_back();
+		} else {
+			// The rest of the current block is lost when the slot
+			// doesn't fit anymore. It is recovered once all slots carved
+			// from the block are unused and the block is destroyed.
+			auto* current = pool.current;
+			if(!current || alignPOT(current->offset, slotSize) + slotSize > current->size) {
+				current = allocBlock(pool, memType, blockSize, false);
+				if(!current) {
+					return {};
+				}
+
+				pool.current = current;
+			}
+
+			block = current;
+			offset = alignPOT(current->offset, slotSize);
+			current->offset = offset + slotSize;
+		}
+	} else {
+		// Re-use an unused dedicated block that isn't too large
+		for(auto& b : pool.blocks) {
+			if(b->dedicated && b->numAlive == 0u &&
+					b->size >= size && b->size <= 2 * size) {
+				block = b.get();
+				break;
+			}
+		}
+
+		if(!block) {
+			block = allocBlock(pool, memType, alignPOT(size, minSlot_), true);
+			if(!block) {
+				return {};
+			}
+		}
+
+		slotSize = block->size;
+	}
+
+	++block->numAlive;
+	block->lastUsed = frame_;
+
+	Allocation ret;
+	ret.block = block;
+	ret.memory = block->memory;
+	ret.offset = offset;
+	ret.size = slotSize;
+	ret.map = block->map ? block->map + offset : nullptr;
+	return ret;
+}
+
+void CaptureHeap::free(const Allocation& alloc) {
+	if(!alloc) {
+		return;
+	}
+
+	std::lock_guard lock(mutex_);
+	auto& block = *alloc.block;
+	dlg_assert(block.numAlive > 0u);
+	--block.numAlive;
+	block.lastUsed = frame_;
+
+	if(!block.dedicated) {
+		auto cls = sizeClass(alloc.size);
+		dlg_assert(cls < numClasses_ && (minSlot_ << cls) == alloc.size);
+		pools_[block.memType].freeLists[cls].push_back({&block, alloc.offset});
+	}
+}
+
+void CaptureHeap::frame() {
+	ZoneScoped;
+	std::lock_guard lock(mutex_);
+	++frame_;
+
+	for(auto& pool : pools_) {
+		for(auto it = pool.blocks.begin(); it != pool.blocks.end();) {
+			auto& block = **it;
+			if(block.numAlive > 0u || frame_ - block.lastUsed < keepFrames) {
+				++it;
+				continue;
+			}
+
+			if(!block.dedicated) {
+				for(auto& freeList : pool.freeLists) {
+					erase_if(freeList, [&](const FreeSlot& slot) {
+						return slot.block == &block;
+					});
+				}
+			}
+
+			if(pool.current == &block) {
+				pool.current = nullptr;
+			}
+
+			destroy(block);
+			it = pool.blocks.erase(it);
+		}
+	}
+}
+
+} // namespace vil
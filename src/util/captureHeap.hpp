@@ -0,0 +1,82 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <vk/vulkan.h>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vil {
+
+// Memory for the copies made by command hooks, see CommandHookState.
+// Hooked submissions are usually repeated every frame (e.g. while a
+// command is selected in the gui), allocating dedicated memory for each
+// copy churns allocations and can hit maxMemoryAllocationCount.
+// Memory is allocated in large blocks per memory type and handed out in
+// power-of-two size classes. Freed allocations are kept in per-class free
+// lists and re-used by the next hooked submissions. Blocks that were
+// unused for 'keepFrames' frames are given back to the driver, see frame().
+// Larger allocations get dedicated blocks that are recycled the same way.
+// Internally synchronized.
+struct CaptureHeap {
+	struct Block;
+
+	struct Allocation {
+		Block* block {};
+		VkDeviceMemory memory {};
+		VkDeviceSize offset {};
+		VkDeviceSize size {}; // size of the slot, at least the requested size
+		std::byte* map {}; // only for host-visible memory, already offset
+
+		explicit operator bool() const { return block; }
+	};
+
+	// Size of the blocks that are sub-allocated.
+	static constexpr VkDeviceSize blockSize = 64 * 1024 * 1024;
+	// Smallest size class. Might be raised to bufferImageGranularity.
+	static constexpr VkDeviceSize minSlotSize = 4 * 1024;
+	// Maximum number of size classes. Allocations larger than
+	// blockSize / 2 get dedicated blocks.
+	static constexpr u32 maxClasses = 14u;
+	// Number of frames an unused block is kept around for re-use.
+	static constexpr u64 keepFrames = 64u;
+
+	Device* dev {};
+
+	CaptureHeap(Device& dev);
+	~CaptureHeap();
+
+	// Returns memory fulfilling the given requirements from the first
+	// memory type in 'memTypeBits' supported by it.
+	// Host-visible memory is mapped. Returns an empty allocation on failure.
+	Allocation alloc(const VkMemoryRequirements&, u32 memTypeBits);
+	void free(const Allocation&);
+
+	// Called once per presented frame.
+	void frame();
+
+private:
+	struct FreeSlot {
+		Block* block;
+		VkDeviceSize offset;
+	};
+
+	struct Pool {
+		std::vector<std::unique_ptr<Block>> blocks;
+		Block* current {}; // the block new slots are carved from
+		std::array<std::vector<FreeSlot>, maxClasses> freeLists;
+	};
+
+	std::mutex mutex_;
+	u64 frame_ {};
+	VkDeviceSize minSlot_ {};
+	u32 numClasses_ {};
+	std::array<Pool, VK_MAX_MEMORY_TYPES> pools_;
+
+	u32 sizeClass(VkDeviceSize size) const;
+	Block* allocBlock(Pool&, u32 memType, VkDeviceSize size, bool dedicated);
+	void destroy(Block&);
+};
+
+} // namespace vil
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <util/linalloc.hpp>
+#include <util/dlg.hpp>
+#include <iterator>
+#include <utility>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif // _MSC_VER
+
+namespace vil {
+
+// Open-addressing hash set of T objects, each identified by a pointer key
+// (e.g. the handle it references). KeyFn must return the key of an element.
+// Key can also be an integer type, e.g. for indices. Pointer keys must not
+// be null.
+// Designed for allocation from a LinAllocator: memory is never freed
+// individually, the slot arrays simply grow by doubling.
+// Similar to swiss tables, we store one control byte per slot (empty or
+// 7 bits of the hash) in a separate, densely packed array. Slots are
+// organized in groups of 8, the control bytes of a group are checked at
+// once via bit tricks. Uses linear probing over the groups. The elements
+// themselves only have to be accessed when the control byte matches.
+// Lookup is transparent: it only needs the raw key, no temporary
+// element has to be constructed.
+// Does not support erasing single elements. Pointers and references to
+// elements are invalidated when the set grows.
+template<typename T, typename KeyFn, typename Key = const void*>
+class FlatPtrSet {
+public:
+	// Maximum load factor is maxLoadNum / maxLoadDenom
+	static constexpr u32 maxLoadNum = 7u;
+	static constexpr u32 maxLoadDenom = 8u;
+	static constexpr u32 groupSize = 8u;
+	static constexpr u32 minCapacity = groupSize;
+
+	template<typename V>
+	class Iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = std::remove_const_t<V>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = V*;
+		using reference = V&;
+
+		Iterator() = default;
+		Iterator(const u8* ctrl, V* values, u32 id, u32 cap) :
+				ctrl_(ctrl), values_(values), id_(id), cap_(cap) {
+			skip();
+		}
+
+		V& operator*() const { return values_[id_]; }
+		V* operator->() const { return &values_[id_]; }
+
+		Iterator& operator++() {
+			++id_;
+			skip();
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			auto ret = *this;
+			++(*this);
+			return ret;
+		}
+
+		friend bool operator==(const Iterator& a, const Iterator& b) {
+			return a.id_ == b.id_;
+		}
+
+		friend bool operator!=(const Iterator& a, const Iterator& b) {
+			return a.id_ != b.id_;
+		}
+
+	private:
+		void skip() {
+			while(id_ < cap_ && ctrl_[id_] == ctrlEmpty) {
+				++id_;
+			}
+		}
+
+		const u8* ctrl_ {};
+		V* values_ {};
+		u32 id_ {};
+		u32 cap_ {};
+	};
+
+	using iterator = Iterator<T>;
+	using const_iterator = Iterator<const T>;
+
+public:
+	explicit FlatPtrSet(LinAllocator& alloc) noexcept : alloc_(&alloc) {}
+
+	~FlatPtrSet() {
+		if constexpr(!std::is_trivially_destructible_v<T>) {
+			for(auto i = 0u; i < capacity_; ++i) {
+				if(ctrl_[i] != ctrlEmpty) {
+					values_[i].~T();
+				}
+			}
+		}
+	}
+
+	FlatPtrSet(const FlatPtrSet&) = delete;
+	FlatPtrSet& operator=(const FlatPtrSet&) = delete;
+
+	// Returns the element with the given key or nullptr if there is none.
+	T* find(Key key) {
+		if(capacity_ == 0u) {
+			return nullptr;
+		}
+
+		auto [id, found] = findSlot(key, hash(key));
+		return found ? &values_[id] : nullptr;
+	}
+
+	const T* find(Key key) const {
+		return const_cast<FlatPtrSet*>(this)->find(key);
+	}
+
+	bool contains(Key key) const {
+		return find(key) != nullptr;
+	}
+
+	// If there is no element with the given key yet, constructs a new
+	// one with the given arguments. The constructed element must have
+	// the given key. Returns the element with the key and whether
+	// it was newly inserted.
+	template<typename... Args>
+	std::pair<T&, bool> tryEmplace(Key key, Args&&... args) {
+		if constexpr(std::is_pointer_v<Key>) {
+			dlg_assert(key);
+		}
+
+		if(maxLoadDenom * (size_ + 1) > maxLoadNum * capacity_) {
+			grow();
+		}
+
+		auto h = hash(key);
+		auto [id, found] = findSlot(key, h);
+		if(found) {
+			return {values_[id], false};
+		}
+
+		new(&values_[id]) T(std::forward<Args>(args)...);
+		dlg_assert(KeyFn{}(values_[id]) == key);
+		ctrl_[id] = ctrlByte(h);
+		++size_;
+		return {values_[id], true};
+	}
+
+	u32 size() const { return size_; }
+	bool empty() const { return size_ == 0u; }
+	u32 capacity() const { return capacity_; }
+
+	iterator begin() { return {ctrl_, values_, 0u, capacity_}; }
+	iterator end() { return {ctrl_, values_, capacity_, capacity_}; }
+	const_iterator begin() const { return {ctrl_, values_, 0u, capacity_}; }
+	const_iterator end() const { return {ctrl_, values_, capacity_, capacity_}; }
+
+private:
+	static constexpr u8 ctrlEmpty = 0u;
+
+	static u64 hash(Key key) {
+		// Fibonacci hashing. The lower bits of the pointers are usually
+		// zero due to alignment, the higher bits of the product depend
+		// on all bits of the key though.
+		u64 val;
+		if constexpr(std::is_pointer_v<Key>) {
+			val = u64(reinterpret_cast<std::uintptr_t>(key));
+		} else {
+			static_assert(std::is_integral_v<Key>);
+			val = u64(key);
+		}
+
+		return val * 0x9E3779B97F4A7C15ull;
+	}
+
+	// Group index from the high bits, control byte from the middle bits.
+	u32 group(u64 h) const { return u32(h >> 32u) & (capacity_ / groupSize - 1); }
+	static u8 ctrlByte(u64 h) { return u8(0x80u | ((h >> 25u) & 0x7Fu)); }
+
+	u64 loadGroup(u32 group) const {
+		u64 ret;
+		std::memcpy(&ret, ctrl_ + group * groupSize, sizeof(ret));
+		return ret;
+	}
+
+	// Returns a mask that has the highest bit set for every byte in 'word'
+	// that is equal to 'val'. Might have false positives above the first
+	// real match, the lowest set bit is always correct though.
+	static u64 matchBytes(u64 word, u8 val) {
+		constexpr auto lsbs = 0x0101010101010101ull;
+		constexpr auto msbs = 0x8080808080808080ull;
+		auto x = word ^ (lsbs * val);
+		return (x - lsbs) & ~x & msbs;
+	}
+
+	// Returns the byte index of the lowest set bit in the given mask.
+	static u32 lowestByte(u64 mask) {
+		dlg_assert(mask);
+#ifdef _MSC_VER
+		unsigned long id;
+		_BitScanForward64(&id, mask);
+		return u32(id) / 8u;
+#else // _MSC_VER
+		return u32(__builtin_ctzll(mask)) / 8u;
+#endif // _MSC_VER
+	}
+
+	// Returns the slot containing the given key or the first empty
+	// slot in its probe sequence.
+	std::pair<u32, bool> findSlot(Key key, u64 h) const {
+		auto groupMask = capacity_ / groupSize - 1;
+		auto g = group(h);
+		auto c = ctrlByte(h);
+		while(true) {
+			auto word = loadGroup(g);
+			for(auto m = matchBytes(word, c); m; m &= m - 1) {
+				auto id = g * groupSize + lowestByte(m);
+				if(KeyFn{}(values_[id]) == key) {
+					return {id, true};
+				}
+			}
+
+			auto empty = matchBytes(word, ctrlEmpty);
+			if(empty) {
+				return {g * groupSize + lowestByte(empty), false};
+			}
+
+			g = (g + 1) & groupMask;
+		}
+	}
+
+	void grow() {
+		auto oldCtrl = ctrl_;
+		auto oldValues = values_;
+		auto oldCap = capacity_;
+
+		capacity_ = oldCap ? 2 * oldCap : minCapacity;
+		ctrl_ = alloc_->allocRaw<u8>(capacity_); // zero-initialized, i.e. empty
+		values_ = reinterpret_cast<T*>(alloc_->allocate(
+			sizeof(T) * capacity_, alignof(T)));
+
+		for(auto i = 0u; i < oldCap; ++i) {
+			if(oldCtrl[i] == ctrlEmpty) {
+				continue;
+			}
+
+			auto key = KeyFn{}(oldValues[i]);
+			auto [id, found] = findSlot(key, hash(key));
+			dlg_assert(!found);
+			(void) found;
+
+			ctrl_[id] = oldCtrl[i];
+			new(&values_[id]) T(std::move(oldValues[i]));
+			oldValues[i].~T();
+		}
+
+		// NOTE: the old arrays are stranded in the linear allocator
+		// but due to the exponential growth that is at most as much
+		// memory as the current arrays.
+	}
+
+	LinAllocator* alloc_ {};
+	u8* ctrl_ {};
+	T* values_ {};
+	u32 capacity_ {};
+	u32 size_ {};
+};
+
+} // namespace vil
@@ -0,0 +1,334 @@
+#include <util/handleTable.hpp>
+#include <util/dlg.hpp>
+#include <algorithm>
+
+namespace vil {
+
+namespace {
+
+// Epoch-based reclamation.
+// While accessing a table, every thread announces the current global
+// epoch in its own reader slot. A table retired at epoch 'e' (after the
+// table was replaced, the global epoch is incremented to 'e') can be
+// destroyed once every reader slot is either inactive or holds an epoch
+// of at least 'e': such readers loaded the epoch (and therefore the table
+// pointer) after the table was replaced.
+struct alignas(64) ReaderSlot {
+	std::atomic<u64> epoch {}; // zero when not reading
+	bool inUse {}; // protected by registry mutex
+};
+
+struct ReaderRegistry {
+	std::atomic<u64> epoch {1u};
+	std::mutex mutex;
+	// Slots are never destroyed. They are reused when a thread exits.
+	std::vector<ReaderSlot*> slots;
+
+	static ReaderRegistry& get() {
+		// intentionally leaked, might be accessed during thread exit
+		static auto* registry = new ReaderRegistry();
+		return *registry;
+	}
+};
+
+struct ThreadReader {
+	ReaderSlot* slot {};
+
+	ThreadReader();
+	~ThreadReader();
+};
+
+// NOTE: ThreadReader is destroyed at thread exit, potentially before
+// other thread_local objects that still access a table.
+// We therefore track its lifetime in a trivially destructible flag.
+thread_local bool threadReaderDestroyed = false;
+thread_local ThreadReader threadReader;
+
+ThreadReader::ThreadReader() {
+	auto& registry = ReaderRegistry::get();
+	std::lock_guard lock(registry.mutex);
+	for(auto* reader : registry.slots) {
+		if(!reader->inUse) {
+			slot = reader;
+			break;
+		}
+	}
+
+	if(!slot) {
+		slot = registry.slots.emplace_back(new ReaderSlot());
+	}
+
+	slot->inUse = true;
+}
+
+ThreadReader::~ThreadReader() {
+	auto& registry = ReaderRegistry::get();
+	std::lock_guard lock(registry.mutex);
+	slot->epoch.store(0u, std::memory_order_release);
+	slot->inUse = false;
+	threadReaderDestroyed = true;
+}
+
+ReaderSlot* readerSlot() {
+	if(threadReaderDestroyed) {
+		return nullptr;
+	}
+
+	return threadReader.slot;
+}
+
+// fmix64 from MurmurHash3. Handles are usually pointers, their low
+// bits are not well distributed.
+u64 hashKey(u64 key) {
+	key ^= key >> 33u;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33u;
+	key *= 0xC4CEB9FE1A85EC53ull;
+	key ^= key >> 33u;
+	return key;
+}
+
+constexpr auto minCapacity = u64(64u);
+
+} // anon namespace
+
+HandleTable::Table::Table(u64 capacity) : mask(capacity - 1) {
+	dlg_assert(capacity > 0u && (capacity & mask) == 0u);
+	slots = std::make_unique<Slot[]>(capacity);
+}
+
+HandleTable::HandleTable() {
+	table_.store(new Table(minCapacity), std::memory_order_relaxed);
+}
+
+HandleTable::~HandleTable() {
+	// No lookups can happen anymore, destroy everything
+	delete table_.load(std::memory_order_relaxed);
+	delete hot_.load(std::memory_order_relaxed);
+
+	for(auto& retired : retired_) {
+		delete retired.table;
+		delete retired.hot;
+	}
+}
+
+void* HandleTable::findInTable(const Table& table, u64 key) const {
+	// Terminates since the table always has empty slots, see growLocked.
+	for(auto i = hashKey(key) & table.mask; ; i = (i + 1) & table.mask) {
+		auto& slot = table.slots[i];
+		auto slotKey = slot.key.load(std::memory_order_acquire);
+		if(slotKey == key) {
+			return slot.value.load(std::memory_order_acquire);
+		} else if(!slotKey) {
+			return nullptr;
+		}
+	}
+}
+
+void* HandleTable::find(u64 key) const {
+	dlg_assert(key);
+
+	auto* reader = readerSlot();
+	if(!reader) {
+		// thread is exiting. Can't announce our epoch anymore, we
+		// simply prevent the tables from changing.
+		std::lock_guard lock(mutex_);
+		auto* hot = hot_.load(std::memory_order_relaxed);
+		if(hot && hot->key == key) {
+			return hot->value;
+		}
+
+		return findInTable(*table_.load(std::memory_order_relaxed), key);
+	}
+
+	// The announcement of our epoch must be ordered before loading
+	// the table pointers, therefore seq_cst. The epoch itself is loaded
+	// with seq_cst as well so that it can't be older than a retirement
+	// whose table we might still load below.
+	auto& registry = ReaderRegistry::get();
+	auto epoch = registry.epoch.load(std::memory_order_seq_cst);
+	reader->epoch.store(epoch, std::memory_order_seq_cst);
+
+	void* ret;
+	auto* hot = hot_.load(std::memory_order_seq_cst);
+	if(hot && hot->key == key) {
+		ret = hot->value;
+	} else {
+		ret = findInTable(*table_.load(std::memory_order_seq_cst), key);
+	}
+
+	reader->epoch.store(0u, std::memory_order_release);
+	return ret;
+}
+
+bool HandleTable::insert(u64 key, void* value, bool hot) {
+	dlg_assert(key);
+	dlg_assert(value);
+
+	std::lock_guard lock(mutex_);
+
+	auto* table = table_.load(std::memory_order_relaxed);
+	Slot* dst {};
+	Slot* empty {};
+	for(auto i = hashKey(key) & table->mask; ; i = (i + 1) & table->mask) {
+		auto& slot = table->slots[i];
+		auto slotKey = slot.key.load(std::memory_order_relaxed);
+		if(slotKey == key) {
+			if(slot.value.load(std::memory_order_relaxed)) {
+				return false;
+			}
+
+			// Reuse the tombstone. Drivers often reuse handle values.
+			// NOTE: we never reuse tombstones of other keys, a concurrent
+			// lookup for the old key could otherwise see the new value.
+			dst = &slot;
+			break;
+		} else if(!slotKey) {
+			empty = &slot;
+			break;
+		}
+	}
+
+	if(!dst) {
+		dlg_assert(empty);
+		if(2 * (used_ + 1) > table->mask + 1) {
+			growLocked();
+			table = table_.load(std::memory_order_relaxed);
+
+			// the new table has no tombstones
+			for(auto i = hashKey(key) & table->mask; ; i = (i + 1) & table->mask) {
+				if(!table->slots[i].key.load(std::memory_order_relaxed)) {
+					empty = &table->slots[i];
+					break;
+				}
+			}
+		}
+
+		dst = empty;
+		++used_;
+	}
+
+	// Store the key first. Lookups for it might see the key without
+	// value, returning null. Fine since the handle is still being created.
+	dst->key.store(key, std::memory_order_release);
+	dst->value.store(value, std::memory_order_release);
+	++size_;
+
+	if(hot) {
+		auto* oldHot = hot_.exchange(new HotEntry{key, value}, std::memory_order_seq_cst);
+		if(oldHot) {
+			retireLocked(nullptr, oldHot);
+		}
+	}
+
+	reclaimLocked();
+	return true;
+}
+
+void* HandleTable::erase(u64 key) {
+	dlg_assert(key);
+
+	std::lock_guard lock(mutex_);
+
+	void* ret {};
+	auto& table = *table_.load(std::memory_order_relaxed);
+	for(auto i = hashKey(key) & table.mask; ; i = (i + 1) & table.mask) {
+		auto& slot = table.slots[i];
+		auto slotKey = slot.key.load(std::memory_order_relaxed);
+		if(slotKey == key) {
+			// the key stays, the slot is a tombstone now
+			ret = slot.value.load(std::memory_order_relaxed);
+			slot.value.store(nullptr, std::memory_order_release);
+			break;
+		} else if(!slotKey) {
+			break;
+		}
+	}
+
+	if(ret) {
+		dlg_assert(size_ > 0u);
+		--size_;
+	}
+
+	auto* hot = hot_.load(std::memory_order_relaxed);
+	if(hot && hot->key == key) {
+		hot_.store(nullptr, std::memory_order_seq_cst);
+		retireLocked(nullptr, hot);
+	}
+
+	reclaimLocked();
+	return ret;
+}
+
+void HandleTable::growLocked() {
+	auto* oldTable = table_.load(std::memory_order_relaxed);
+
+	// Tombstones are dropped here. Leave enough space so that we don't
+	// immediately have to grow again.
+	auto capacity = minCapacity;
+	while(capacity < 4 * (size_ + 1)) {
+		capacity *= 2;
+	}
+
+	auto* table = new Table(capacity);
+	used_ = 0u;
+	for(auto i = 0u; i <= oldTable->mask; ++i) {
+		auto& src = oldTable->slots[i];
+		auto* value = src.value.load(std::memory_order_relaxed);
+		if(!value) {
+			continue;
+		}
+
+		auto key = src.key.load(std::memory_order_relaxed);
+		for(auto j = hashKey(key) & table->mask; ; j = (j + 1) & table->mask) {
+			auto& dst = table->slots[j];
+			if(!dst.key.load(std::memory_order_relaxed)) {
+				dst.key.store(key, std::memory_order_relaxed);
+				dst.value.store(value, std::memory_order_relaxed);
+				break;
+			}
+		}
+
+		++used_;
+	}
+
+	table_.store(table, std::memory_order_seq_cst);
+	retireLocked(oldTable, nullptr);
+}
+
+void HandleTable::retireLocked(Table* table, HotEntry* hot) {
+	auto& registry = ReaderRegistry::get();
+	auto epoch = registry.epoch.fetch_add(1u, std::memory_order_seq_cst) + 1u;
+	retired_.push_back({epoch, table, hot});
+}
+
+void HandleTable::reclaimLocked() {
+	if(retired_.empty()) {
+		return;
+	}
+
+	auto minEpoch = u64(-1);
+	{
+		auto& registry = ReaderRegistry::get();
+		std::lock_guard lock(registry.mutex);
+		for(auto* reader : registry.slots) {
+			auto epoch = reader->epoch.load(std::memory_order_seq_cst);
+			if(epoch) {
+				minEpoch = std::min(minEpoch, epoch);
+			}
+		}
+	}
+
+	auto it = std::remove_if(retired_.begin(), retired_.end(), [&](auto& retired) {
+		if(retired.epoch > minEpoch) {
+			return false;
+		}
+
+		delete retired.table;
+		delete retired.hot;
+		return true;
+	});
+	retired_.erase(it, retired_.end());
+}
+
+} // namespace vil
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+namespace vil {
+
+// Concurrent map from (non-zero) handles to data, optimized for lookups.
+// Lookups don't take any lock and don't write to memory shared with other
+// threads: the map uses open addressing with atomic slots. When the table
+// has to grow, it is replaced and the old table is only destroyed once no
+// lookup might still access it (epoch-based reclamation, see handleTable.cpp).
+// Insertion and erasure are synchronized via an internal mutex.
+// Erased slots stay as tombstones until the table grows the next time,
+// they are reused when the same key is inserted again.
+// Additionally, a single 'hot' entry can be stored that is checked first,
+// allowing to skip the probing for the most frequently used handle.
+struct HandleTable {
+public:
+	HandleTable();
+	~HandleTable();
+
+	HandleTable(const HandleTable&) = delete;
+	HandleTable& operator=(const HandleTable&) = delete;
+
+	// Returns null when there is no entry for the given key.
+	void* find(u64 key) const;
+
+	// Returns false when there already is an entry for the key.
+	// When 'hot' is true, the entry replaces the current hot entry.
+	bool insert(u64 key, void* value, bool hot = false);
+
+	// Returns the erased value, null when there was no entry.
+	void* erase(u64 key);
+
+	// Calls the given function for all entries.
+	// Must not modify the table.
+	template<typename F>
+	void forEach(F&& func) const {
+		std::lock_guard lock(mutex_);
+		auto* table = table_.load(std::memory_order_relaxed);
+		for(auto i = 0u; i <= table->mask; ++i) {
+			auto& slot = table->slots[i];
+			auto* value = slot.value.load(std::memory_order_relaxed);
+			if(value) {
+				func(slot.key.load(std::memory_order_relaxed), value);
+			}
+		}
+	}
+
+private:
+	struct Slot {
+		std::atomic<u64> key {}; // zero for empty slots, never changes otherwise
+		std::atomic<void*> value {}; // null for erased slots
+	};
+
+	struct Table {
+		u64 mask {}; // capacity - 1
+		std::unique_ptr<Slot[]> slots;
+
+		explicit Table(u64 capacity);
+	};
+
+	struct HotEntry {
+		u64 key;
+		void* value;
+	};
+
+	struct Retired {
+		u64 epoch;
+		Table* table;
+		HotEntry* hot;
+	};
+
+	void* findInTable(const Table&, u64 key) const;
+	void growLocked();
+	void retireLocked(Table*, HotEntry*);
+	void reclaimLocked();
+
+	std::atomic<Table*> table_ {};
+	std::atomic<HotEntry*> hot_ {};
+
+	// Protects all members below, and the modification of the tables.
+	mutable std::mutex mutex_;
+	u64 size_ {}; // number of entries
+	u64 used_ {}; // number of non-empty slots, including tombstones
+	std::vector<Retired> retired_;
+};
+
+} // namespace vil
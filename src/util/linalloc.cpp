@@ -1,6 +1,8 @@
 #include <util/linalloc.hpp>
 #include <util/util.hpp> // nextPOT
 #include <device.hpp>
+#include <stats.hpp>
+#include <array>
 
 #ifdef VIL_DEBUG
 	#define assertCanary(block) dlg_assert((block).canary == LinMemBlock::canaryValue);
@@ -10,13 +12,143 @@
 
 namespace vil {
 
+static_assert(LinBlockPool::blockSize == LinAllocator::minBlockSize);
+
+// LinBlockPool
+struct LinBlockPool::ThreadCache {
+	std::array<std::byte*, maxThreadBlocks> blocks {};
+	u32 count {};
+
+	~ThreadCache();
+};
+
+// NOTE: ThreadCache is destroyed at thread exit, potentially before other
+// thread_local objects (e.g. ThreadContext) that still free blocks.
+// We therefore track its lifetime in a trivially destructible flag.
+thread_local bool LinBlockPool::threadCacheDestroyed_ = false;
+thread_local LinBlockPool::ThreadCache LinBlockPool::threadCache_;
+
+LinBlockPool::ThreadCache::~ThreadCache() {
+	auto& pool = LinBlockPool::get();
+	for(auto i = 0u; i < count; ++i) {
+		DebugStats::get().linBlockPoolMem -= blockSize;
+		pool.freeGlobal(blocks[i]);
+	}
+
+	count = 0u;
+	threadCacheDestroyed_ = true;
+}
+
+LinBlockPool& LinBlockPool::get() {
+	// intentionally leaked, see declaration
+	static auto* pool = new LinBlockPool();
+	return *pool;
+}
+
+LinBlockPool::ThreadCache* LinBlockPool::threadCache() {
+	if(threadCacheDestroyed_) {
+		return nullptr;
+	}
+
+	return &threadCache_;
+}
+
+std::byte* LinBlockPool::alloc() {
+	// fast path: thread-local cache
+	auto* cache = threadCache();
+	if(cache && cache->count > 0u) {
+		--cache->count;
+		DebugStats::get().linBlockPoolMem -= blockSize;
+		return cache->blocks[cache->count];
+	}
+
+	{
+		std::lock_guard lock(mutex_);
+		if(freeList_) {
+			auto* block = freeList_;
+			freeList_ = block->next;
+			--numFree_;
+			DebugStats::get().linBlockPoolMem -= blockSize;
+			return reinterpret_cast<std::byte*>(block);
+		}
+	}
+
+	return new std::byte[blockSize]; // no need to value-initialize
+}
+
+void LinBlockPool::free(std::byte* buf) {
+	dlg_assert(buf);
+
+	auto* cache = threadCache();
+	if(cache && cache->count < maxThreadBlocks) {
+		cache->blocks[cache->count] = buf;
+		++cache->count;
+		DebugStats::get().linBlockPoolMem += blockSize;
+		return;
+	}
+
+	freeGlobal(buf);
+}
+
+void LinBlockPool::freeGlobal(std::byte* buf) {
+	{
+		std::lock_guard lock(mutex_);
+		if(numFree_ < maxGlobalBlocks) {
+			// we re-use the memory to store the free list
+			auto* block = new(buf) LinMemBlock;
+			block->next = freeList_;
+			freeList_ = block;
+			++numFree_;
+			DebugStats::get().linBlockPoolMem += blockSize;
+			return;
+		}
+	}
+
+	delete[] buf;
+}
+
+void LinBlockPool::trim() {
+	auto* cache = threadCache();
+	if(cache) {
+		for(auto i = 0u; i < cache->count; ++i) {
+			delete[] cache->blocks[i];
+		}
+
+		DebugStats::get().linBlockPoolMem -= cache->count * blockSize;
+		cache->count = 0u;
+	}
+
+	LinMemBlock* head;
+
+	{
+		std::lock_guard lock(mutex_);
+		head = freeList_;
+		freeList_ = nullptr;
+		DebugStats::get().linBlockPoolMem -= numFree_ * blockSize;
+		numFree_ = 0u;
+	}
+
+	while(head) {
+		auto next = head->next;
+		delete[] reinterpret_cast<std::byte*>(head);
+		head = next;
+	}
+}
+
+// LinAllocator
 std::byte* LinAllocator::addBlock(std::size_t size, std::size_t alignment) {
 	auto newBlockSize = (memCurrent == &memRoot) ? minBlockSize :
 		std::min<size_t>(blockGrowFac * memSize(*memCurrent), maxBlockSize);
 	auto neededSize = alignPOT(size, alignment) + sizeof(LinMemBlock);
 	newBlockSize = nextPOT(std::max<size_t>(newBlockSize, neededSize));
 
-	auto buf = new std::byte[newBlockSize]; // no need to value-initialize
+	std::byte* buf;
+	if(parent && newBlockSize == LinBlockPool::blockSize) {
+		buf = parent->alloc();
+	} else {
+		buf = new std::byte[newBlockSize]; // no need to value-initialize
+	}
+
 	auto* newBlock = new(buf) LinMemBlock;
 	newBlock->data = buf + sizeof(LinMemBlock);
 	newBlock->end = buf + newBlockSize;
@@ -47,6 +179,11 @@ LinAllocator::LinAllocator(Callback alloc, Callback free) : LinAllocator() {
 	onFree = free;
 }
 
+LinAllocator::LinAllocator(LinBlockPool* xparent, Callback alloc, Callback free) :
+		LinAllocator(std::move(alloc), std::move(free)) {
+	parent = xparent;
+}
+
 LinAllocator::~LinAllocator() {
 	release();
 }
@@ -72,13 +209,19 @@ void LinAllocator::release() {
 		auto next = head->next;
 
 		auto ptr = reinterpret_cast<std::byte*>(head);
+		auto size = sizeof(LinMemBlock) + memSize(*head);
 		if(onFree) {
-			onFree(ptr, sizeof(LinMemBlock) + memSize(*head));
+			onFree(ptr, size);
 		}
 
 		// no need to call MemBlocks destructor, it's trivial
 		static_assert(std::is_trivially_destructible_v<LinMemBlock>);
-		delete[] ptr;
+		if(parent && size == LinBlockPool::blockSize) {
+			parent->free(ptr);
+		} else {
+			delete[] ptr;
+		}
+
 		head = next;
 	}
 
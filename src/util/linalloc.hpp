@@ -6,6 +6,7 @@
 #include <cstring>
 #include <memory_resource>
 #include <functional>
+#include <mutex>
 #include <util/allocation.hpp>
 #include <util/profiling.hpp>
 #include <util/dlg.hpp>
@@ -16,8 +17,8 @@
 // the allocation fast path only needs ~6 instructions (1 load, 1 store).
 // Creating a LinAllocScope has ~7 instructions with ~2 independent loads.
 // See node 2107.
-// TODO: add support for retrieving the memory blocks from a parent
-// allocator instead of calling new[], delete[] directly every time.
+// Memory blocks can optionally be retrieved from a LinBlockPool instead
+// of calling new[], delete[] directly every time.
 // PERF: maybe don't support any alignment? Instead define a
 // maxAlignment and always align allocation size to multiple? We could
 // hope that constant folding will detect that object size is a multiple
@@ -60,6 +61,53 @@ inline std::size_t memOffset(const LinMemBlock& block) {
 	return block.data - dataBegin(block);
 }
 
+// Process-wide pool of LinMemBlock memory.
+// Only blocks of the default size are pooled, allocations that need
+// larger blocks directly go to new[], delete[].
+// Freed blocks are first put into a small per-thread cache and otherwise
+// into a global, mutex-protected free list. The global list is capped,
+// blocks exceeding the limit are returned to the system.
+// The per-thread caches are not part of that cap. In total, the pool
+// keeps at most (maxGlobalBlocks + maxThreadBlocks * numThreads) blocks.
+// All of them are counted in DebugStats::linBlockPoolMem.
+// Thread-safe, blocks may be freed on a different thread than the one
+// that allocated them.
+struct LinBlockPool {
+	// Must match LinAllocator::minBlockSize, see there.
+	static constexpr std::size_t blockSize = 1024 * 1024;
+	// Maximum number of blocks cached per thread.
+	static constexpr u32 maxThreadBlocks = 4u;
+	// Maximum number of blocks kept in the global free list.
+	static constexpr u32 maxGlobalBlocks = 64u;
+
+	// Returns the process-wide pool instance.
+	// It is never destroyed so it can safely be used during
+	// static and thread_local destruction.
+	static LinBlockPool& get();
+
+	// Returns uninitialized memory of size 'blockSize'.
+	std::byte* alloc();
+	// Returns memory previously returned by 'alloc' to the pool.
+	void free(std::byte* buf);
+
+	// Frees all blocks in the global free list and the ones cached
+	// by the calling thread. Blocks cached by other threads are kept.
+	void trim();
+
+private:
+	LinBlockPool() = default;
+
+	struct ThreadCache;
+	static thread_local ThreadCache threadCache_;
+	static thread_local bool threadCacheDestroyed_;
+	static ThreadCache* threadCache();
+	void freeGlobal(std::byte* buf);
+
+	std::mutex mutex_;
+	LinMemBlock* freeList_ {};
+	u32 numFree_ {};
+};
+
 template<typename T>
 class UniqueSpan : public span<T> {
 public:
@@ -86,6 +134,10 @@ struct LinAllocator {
 	LinMemBlock memRoot {}; // empty block
 	LinMemBlock* memCurrent;
 
+	// Optional parent from which default-sized blocks are retrieved.
+	// When null, blocks are directly allocated via new[].
+	LinBlockPool* parent {};
+
 	// NOTE: should be removed later in final release mode.
 	// For keeping track of allocation size.
 	using Callback = std::function<void(const std::byte*, u32)>;
@@ -94,6 +146,8 @@ struct LinAllocator {
 
 	LinAllocator();
 	LinAllocator(Callback alloc, Callback free);
+	explicit LinAllocator(LinBlockPool* parent,
+		Callback alloc = {}, Callback free = {});
 	~LinAllocator();
 
 	// NOTE: could be implemented but need special handling of memRoot
@@ -104,7 +158,8 @@ struct LinAllocator {
 	// associated memory.
 	void reset();
 
-	// Releases all allocated memory
+	// Releases all allocated memory.
+	// Blocks are returned to the parent pool, if there is one.
 	void release();
 
 	// Returns whether there are no allocations in the allocator.
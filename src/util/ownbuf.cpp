@@ -6,25 +6,39 @@
 
 namespace vil {
 
-void OwnBuffer::ensure(Device& dev, VkDeviceSize reqSize,
-		VkBufferUsageFlags usage, u32 queueFamsBitset, StringParam name,
-		Type type) {
-	dlg_assert(!this->dev || this->dev == &dev);
-	if(size >= reqSize) {
-		return;
+namespace {
+
+void release(OwnBuffer& buf) {
+	auto& dev = *buf.dev;
+	dev.dispatch.DestroyBuffer(dev.handle, buf.buf, nullptr);
+
+	if(buf.heapAlloc) {
+		dev.captureHeap->free(buf.heapAlloc);
+	} else {
+		dev.dispatch.FreeMemory(dev.handle, buf.mem, nullptr);
 	}
 
-	this->dev = &dev;
+	DebugStats::get().ownBufferMem -= buf.size;
+}
 
-	if(buf) {
-		dev.dispatch.DestroyBuffer(dev.handle, buf, nullptr);
-		dev.dispatch.FreeMemory(dev.handle, mem, nullptr);
+bool doEnsure(OwnBuffer& ownBuf, Device& dev, VkDeviceSize reqSize,
+		VkBufferUsageFlags usage, u32 queueFamsBitset, StringParam name,
+		OwnBuffer::Type type, bool capture) {
+	dlg_assert(!ownBuf.dev || ownBuf.dev == &dev);
+	if(ownBuf.size >= reqSize) {
+		return true;
+	}
 
-		DebugStats::get().ownBufferMem -= size;
+	ownBuf.dev = &dev;
 
-		mem = {};
-		buf = {};
-		size = {};
+	if(ownBuf.buf) {
+		release(ownBuf);
+
+		ownBuf.mem = {};
+		ownBuf.buf = {};
+		ownBuf.size = {};
+		ownBuf.map = {};
+		ownBuf.heapAlloc = {};
 	}
 
 	// new buffer
@@ -50,23 +64,44 @@ void OwnBuffer::ensure(Device& dev, VkDeviceSize reqSize,
 		bufInfo.queueFamilyIndexCount = qfcount;
 	}
 
+	auto& buf = ownBuf.buf;
 	VK_CHECK_DEV(dev.dispatch.CreateBuffer(dev.handle, &bufInfo, nullptr, &buf), dev);
-	nameHandle(dev, this->buf, name.empty() ? "OwnBuffer:buf" : name.c_str());
+	nameHandle(dev, buf, name.empty() ? "OwnBuffer:buf" : name.c_str());
 
 	// get memory props
 	VkMemoryRequirements memReqs;
 	dev.dispatch.GetBufferMemoryRequirements(dev.handle, buf, &memReqs);
 	memReqs.size = align(memReqs.size, dev.props.limits.nonCoherentAtomSize);
 
+	auto memBits = (type == OwnBuffer::Type::hostVisible) ?
+		dev.hostVisibleMemTypeBits :
+		dev.deviceLocalMemTypeBits;
+	dlg_assert(memBits != 0u);
+
+	if(capture) {
+		// The heap maps host-visible memory itself
+		ownBuf.heapAlloc = dev.captureHeap->alloc(memReqs, memBits);
+		if(!ownBuf.heapAlloc) {
+			dev.dispatch.DestroyBuffer(dev.handle, buf, nullptr);
+			buf = {};
+			return false;
+		}
+
+		ownBuf.mem = ownBuf.heapAlloc.memory;
+		ownBuf.map = ownBuf.heapAlloc.map;
+		dlg_assert(type != OwnBuffer::Type::hostVisible || ownBuf.map);
+
+		VK_CHECK_DEV(dev.dispatch.BindBufferMemory(dev.handle, buf,
+			ownBuf.mem, ownBuf.heapAlloc.offset), dev);
+		ownBuf.size = reqSize;
+		DebugStats::get().ownBufferMem += ownBuf.size;
+		return true;
+	}
+
 	// new memory
 	VkMemoryAllocateInfo allocInfo {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 	allocInfo.allocationSize = align(memReqs.size, dev.props.limits.nonCoherentAtomSize);
-
-	auto memBits = (type == Type::hostVisible) ?
-		dev.hostVisibleMemTypeBits :
-		dev.deviceLocalMemTypeBits;
-	dlg_assert(memBits != 0u);
 	allocInfo.memoryTypeIndex = findLSB(memReqs.memoryTypeBits & memBits);
 
 	VkMemoryAllocateFlagsInfo flagsInfo {};
@@ -76,36 +111,68 @@ void OwnBuffer::ensure(Device& dev, VkDeviceSize reqSize,
 		allocInfo.pNext = &flagsInfo;
 	}
 
+	auto& mem = ownBuf.mem;
 	VK_CHECK_DEV(dev.dispatch.AllocateMemory(dev.handle, &allocInfo, nullptr, &mem), dev);
-	nameHandle(dev, this->mem, "OwnBuffer:mem");
+	nameHandle(dev, mem, "OwnBuffer:mem");
 
 	// bind
 	VK_CHECK_DEV(dev.dispatch.BindBufferMemory(dev.handle, buf, mem, 0), dev);
-	this->size = reqSize;
+	ownBuf.size = reqSize;
 
 	// Might not be 100% accurate for used memory but good enough
-	DebugStats::get().ownBufferMem += size;
+	DebugStats::get().ownBufferMem += ownBuf.size;
 
 	// map
-	if(type == Type::hostVisible) {
+	if(type == OwnBuffer::Type::hostVisible) {
 		void* pmap;
 		VK_CHECK_DEV(dev.dispatch.MapMemory(dev.handle, mem, 0, VK_WHOLE_SIZE, 0, &pmap), dev);
-		this->map = static_cast<std::byte*>(pmap);
-		dlg_assert(this->map);
+		ownBuf.map = static_cast<std::byte*>(pmap);
+		dlg_assert(ownBuf.map);
 	}
+
+	return true;
+}
+
+} // anon namespace
+
+void OwnBuffer::ensure(Device& dev, VkDeviceSize reqSize,
+		VkBufferUsageFlags usage, u32 queueFamsBitset, StringParam name,
+		Type type) {
+	// Only allocations from the capture heap can fail
+	[[maybe_unused]] auto res = doEnsure(*this, dev, reqSize, usage,
+		queueFamsBitset, name, type, false);
+	dlg_assert(res);
+}
+
+bool OwnBuffer::ensureCapture(Device& dev, VkDeviceSize reqSize,
+		VkBufferUsageFlags usage, u32 queueFamsBitset, Type type) {
+	return doEnsure(*this, dev, reqSize, usage, queueFamsBitset, "OwnBuffer:capture",
+		type, true);
 }
 
 OwnBuffer::~OwnBuffer() {
-	if(!dev) {
+	if(!dev || !buf) {
 		return;
 	}
 
 	// no need to unmap memory, automtically done when memory is destroyed
+	release(*this);
+}
 
-	dev->dispatch.DestroyBuffer(dev->handle, buf, nullptr);
-	dev->dispatch.FreeMemory(dev->handle, mem, nullptr);
+VkMappedMemoryRange mappedRange(const OwnBuffer& buf) {
+	VkMappedMemoryRange range {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = buf.mem;
+
+	// Slots of the capture heap are aligned to nonCoherentAtomSize
+	if(buf.heapAlloc) {
+		range.offset = buf.heapAlloc.offset;
+		range.size = buf.heapAlloc.size;
+	} else {
+		range.size = VK_WHOLE_SIZE;
+	}
 
-	DebugStats::get().ownBufferMem -= size;
+	return range;
 }
 
 void OwnBuffer::invalidateMap() {
@@ -115,11 +182,8 @@ void OwnBuffer::invalidateMap() {
 	}
 
 	// PERF: only invalidate when on non-coherent memory
-	VkMappedMemoryRange range[1] {};
-	range[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	range[0].memory = mem;
-	range[0].size = VK_WHOLE_SIZE;
-	VK_CHECK_DEV(dev->dispatch.InvalidateMappedMemoryRanges(dev->handle, 1, range), *dev);
+	auto range = mappedRange(*this);
+	VK_CHECK_DEV(dev->dispatch.InvalidateMappedMemoryRanges(dev->handle, 1, &range), *dev);
 }
 
 void OwnBuffer::flushMap() {
@@ -129,11 +193,8 @@ void OwnBuffer::flushMap() {
 	}
 
 	// PERF: only invalidate when on non-coherent memory
-	VkMappedMemoryRange range[1] {};
-	range[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	range[0].memory = mem;
-	range[0].size = VK_WHOLE_SIZE;
-	VK_CHECK_DEV(dev->dispatch.FlushMappedMemoryRanges(dev->handle, 1, range), *dev);
+	auto range = mappedRange(*this);
+	VK_CHECK_DEV(dev->dispatch.FlushMappedMemoryRanges(dev->handle, 1, &range), *dev);
 }
 
 vku::BufferSpan OwnBuffer::asSpan(VkDeviceSize offset, VkDeviceSize size) const {
@@ -152,6 +213,7 @@ void swap(OwnBuffer& a, OwnBuffer& b) noexcept {
 	swap(a.mem, b.mem);
 	swap(a.size, b.size);
 	swap(a.map, b.map);
+	swap(a.heapAlloc, b.heapAlloc);
 }
 
 } // namespace vil
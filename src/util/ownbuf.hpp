@@ -5,6 +5,7 @@
 #include <nytl/stringParam.hpp>
 #include <vk/vulkan_core.h>
 #include <vkutil/bufferSpan.hpp>
+#include <util/captureHeap.hpp>
 
 namespace vil {
 
@@ -19,6 +20,8 @@ struct OwnBuffer {
 	VkDeviceMemory mem {};
 	VkDeviceSize size {};
 	std::byte* map {};
+	// Only set when the memory is sub-allocated from Device::captureHeap.
+	CaptureHeap::Allocation heapAlloc {};
 
 	// Will ensure the buffer has at least the given size.
 	// If not, will recreate it with the given size and usage.
@@ -29,6 +32,11 @@ struct OwnBuffer {
 	void ensure(Device&, VkDeviceSize, VkBufferUsageFlags,
 		u32 queueFamsBitfield = {}, StringParam name = {},
 		Type type = Type::hostVisible);
+	// Like ensure, but sub-allocates the memory from Device::captureHeap.
+	// Used for the copies of command hooks. Returns false when the heap
+	// has no space left, the buffer is empty then.
+	[[nodiscard]] bool ensureCapture(Device&, VkDeviceSize, VkBufferUsageFlags,
+		u32 queueFamsBitfield = {}, Type type = Type::hostVisible);
 
 	void invalidateMap();
 	void flushMap();
@@ -0,0 +1,271 @@
+#include <util/slab.hpp>
+#include <util/dlg.hpp>
+#include <stats.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+namespace vil {
+
+namespace {
+
+// All pools that use the per-thread caches, indexed by their id.
+// Needed to return the cached objects on thread exit.
+std::array<std::atomic<SlabPool*>, SlabPool::maxCachedPools> cachedPools {};
+std::atomic<u32> nextPoolID {};
+// All pools, linked via SlabPool::nextPool_. Pools are never destroyed.
+std::atomic<SlabPool*> poolList {};
+
+} // anon namespace
+
+struct SlabPool::ThreadCache {
+	struct Pool {
+		FreeNode* head {};
+		u32 count {};
+	};
+
+	std::array<Pool, maxCachedPools> pools {};
+
+	~ThreadCache();
+};
+
+// NOTE: ThreadCache is destroyed at thread exit, potentially before other
+// thread_local objects that still free objects.
+// We therefore track its lifetime in a trivially destructible flag.
+thread_local bool SlabPool::threadCacheDestroyed_ = false;
+thread_local SlabPool::ThreadCache SlabPool::threadCache_;
+
+SlabPool::ThreadCache::~ThreadCache() {
+	for(auto i = 0u; i < maxCachedPools; ++i) {
+		auto& cache = pools[i];
+		if(!cache.head) {
+			continue;
+		}
+
+		auto* pool = cachedPools[i].load(std::memory_order_acquire);
+		dlg_assert(pool);
+
+		auto* tail = cache.head;
+		while(tail->next) {
+			tail = tail->next;
+		}
+
+		pool->freeGlobal(cache.head, tail, cache.count);
+		cache = {};
+	}
+
+	threadCacheDestroyed_ = true;
+}
+
+SlabPool::ThreadCache* SlabPool::threadCache() {
+	if(threadCacheDestroyed_) {
+		return nullptr;
+	}
+
+	return &threadCache_;
+}
+
+SlabPool::SlabPool(std::size_t objSize, std::size_t objAlign, Kind kind) {
+	kind_ = kind;
+
+	// we re-use the memory of free objects to store the free list
+	objAlign_ = std::max(objAlign, alignof(FreeNode));
+	objSize_ = std::max(objSize, sizeof(FreeNode));
+	objSize_ = objAlign_ * ((objSize_ + objAlign_ - 1) / objAlign_);
+	slabSize_ = std::max(minSlabSize, 16 * objSize_);
+
+	id_ = nextPoolID.fetch_add(1u, std::memory_order_relaxed);
+	if(id_ < maxCachedPools) {
+		cachedPools[id_].store(this, std::memory_order_release);
+	}
+
+	nextPool_ = poolList.load(std::memory_order_relaxed);
+	while(!poolList.compare_exchange_weak(nextPool_, this,
+		std::memory_order_release, std::memory_order_relaxed));
+}
+
+void* SlabPool::alloc() {
+	// fast path: thread-local cache
+	auto* cache = id_ < maxCachedPools ? threadCache() : nullptr;
+	if(!cache) {
+		FreeNode* head {};
+		auto count = allocGlobal(head, 1u);
+		dlg_assert(count == 1u && head);
+		return head;
+	}
+
+	auto& pool = cache->pools[id_];
+	if(!pool.head) {
+		// refill half of the cache at once
+		pool.count = allocGlobal(pool.head, maxThreadObjects / 2);
+		dlg_assert(pool.count > 0u && pool.head);
+	}
+
+	auto* node = pool.head;
+	pool.head = node->next;
+	--pool.count;
+	return node;
+}
+
+void SlabPool::free(void* ptr) {
+	dlg_assert(ptr);
+
+	auto* node = new(ptr) FreeNode{};
+	auto* cache = id_ < maxCachedPools ? threadCache() : nullptr;
+	if(!cache) {
+		freeGlobal(node, node, 1u);
+		return;
+	}
+
+	auto& pool = cache->pools[id_];
+	node->next = pool.head;
+	pool.head = node;
+	++pool.count;
+
+	if(pool.count > maxThreadObjects) {
+		// give half of the cache back at once
+		auto* tail = pool.head;
+		for(auto i = 1u; i < maxThreadObjects / 2; ++i) {
+			tail = tail->next;
+		}
+
+		auto* head = pool.head;
+		pool.head = tail->next;
+		pool.count -= maxThreadObjects / 2;
+		freeGlobal(head, tail, maxThreadObjects / 2);
+	}
+}
+
+u32 SlabPool::allocGlobal(FreeNode*& head, u32 count) {
+	std::lock_guard lock(mutex_);
+	if(!freeList_) {
+		// allocate a new slab, only freed in trim
+		auto* slab = static_cast<std::byte*>(::operator new(slabSize_,
+			std::align_val_t(objAlign_)));
+		slabs_.insert(std::upper_bound(slabs_.begin(), slabs_.end(), slab), slab);
+		DebugStats::get().slabMem += slabSize_;
+
+		auto numObjects = slabSize_ / objSize_;
+		for(auto i = numObjects; i-- > 0u;) {
+			auto* node = new(slab + i * objSize_) FreeNode{};
+			node->next = freeList_;
+			freeList_ = node;
+		}
+	}
+
+	auto moved = 0u;
+	while(moved < count && freeList_) {
+		auto* node = freeList_;
+		freeList_ = node->next;
+		node->next = head;
+		head = node;
+		++moved;
+	}
+
+	numTaken_ += moved;
+	return moved;
+}
+
+void SlabPool::freeGlobal(FreeNode* head, FreeNode* tail, u32 count) {
+	dlg_assert(head && tail);
+
+	std::lock_guard lock(mutex_);
+	tail->next = freeList_;
+	freeList_ = head;
+
+	dlg_assert(numTaken_ >= count);
+	numTaken_ -= count;
+}
+
+void SlabPool::trim() {
+	// give the objects cached by this thread back first
+	auto* cache = id_ < maxCachedPools ? threadCache() : nullptr;
+	if(cache && cache->pools[id_].head) {
+		auto& pool = cache->pools[id_];
+		auto* tail = pool.head;
+		while(tail->next) {
+			tail = tail->next;
+		}
+
+		freeGlobal(pool.head, tail, pool.count);
+		pool = {};
+	}
+
+	std::lock_guard lock(mutex_);
+	if(slabs_.empty()) {
+		return;
+	}
+
+	auto slabID = [&](const FreeNode* node) {
+		auto* ptr = reinterpret_cast<const std::byte*>(node);
+		auto it = std::upper_bound(slabs_.begin(), slabs_.end(), ptr);
+		dlg_assert(it != slabs_.begin());
+		return u32(it - slabs_.begin()) - 1u;
+	};
+
+	// count the free objects per slab
+	std::vector<u32> numFree(slabs_.size());
+	for(auto* node = freeList_; node; node = node->next) {
+		++numFree[slabID(node)];
+	}
+
+	auto numObjects = slabSize_ / objSize_;
+	auto released = [&](const FreeNode* node) {
+		return numFree[slabID(node)] == numObjects;
+	};
+
+	// remove the objects of released slabs from the free list
+	FreeNode** next = &freeList_;
+	while(*next) {
+		if(released(*next)) {
+			*next = (*next)->next;
+		} else {
+			next = &(*next)->next;
+		}
+	}
+
+	auto dst = 0u;
+	for(auto i = 0u; i < slabs_.size(); ++i) {
+		if(numFree[i] == numObjects) {
+			::operator delete(slabs_[i], std::align_val_t(objAlign_));
+			DebugStats::get().slabMem -= slabSize_;
+		} else {
+			slabs_[dst++] = slabs_[i];
+		}
+	}
+
+	slabs_.resize(dst);
+}
+
+void SlabPool::trimAll() {
+	auto* pool = poolList.load(std::memory_order_acquire);
+	while(pool) {
+		pool->trim();
+		pool = pool->nextPool_;
+	}
+}
+
+SlabPool::Stats SlabPool::stats() {
+	std::lock_guard lock(mutex_);
+
+	Stats ret {};
+	ret.kind = kind_;
+	ret.objSize = objSize_;
+	ret.numSlabs = u32(slabs_.size());
+	ret.slabMem = slabs_.size() * slabSize_;
+	ret.numTaken = numTaken_;
+	return ret;
+}
+
+std::vector<SlabPool::Stats> SlabPool::statsAll() {
+	std::vector<Stats> ret;
+	auto* pool = poolList.load(std::memory_order_acquire);
+	while(pool) {
+		ret.push_back(pool->stats());
+		pool = pool->nextPool_;
+	}
+
+	return ret;
+}
+
+} // namespace vil
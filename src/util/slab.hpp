@@ -0,0 +1,152 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace vil {
+
+// Process-wide pool of memory for objects of a fixed size, see slabPool<T>.
+// Memory is carved out of larger slabs, freed objects are put into a small
+// per-thread cache and otherwise into a global, mutex-protected free list.
+// Slabs are only returned to the system by 'trim'.
+// Used for handle objects that are created and destroyed at a high rate
+// (e.g. image views and buffers of streaming systems), see VIL_SLAB_ALLOCATED.
+// Thread-safe, objects may be freed on a different thread than the one
+// that allocated them.
+struct SlabPool {
+	// Number of pools that can use the per-thread caches. Additional
+	// pools always use the global free list.
+	static constexpr u32 maxCachedPools = 64u;
+	// Maximum number of objects cached per thread and pool.
+	static constexpr u32 maxThreadObjects = 32u;
+	// Minimum size of a slab, in bytes.
+	static constexpr std::size_t minSlabSize = 64 * 1024;
+
+	// What the objects of a pool are used for. Only used for statistics.
+	enum class Kind {
+		handle, // handle objects, see VIL_SLAB_ALLOCATED
+		node, // nodes of containers, see SlabAllocator
+	};
+
+	// Statistics of a single pool.
+	struct Stats {
+		Kind kind;
+		std::size_t objSize;
+		u32 numSlabs;
+		std::size_t slabMem;
+		// Number of objects taken out of the global free list. Includes
+		// the objects cached by threads, at most maxThreadObjects per thread.
+		u64 numTaken;
+	};
+
+	SlabPool(std::size_t objSize, std::size_t objAlign, Kind kind);
+
+	// Returns uninitialized memory for one object.
+	void* alloc();
+	// Returns memory previously returned by 'alloc' to the pool.
+	void free(void* ptr);
+
+	// Frees all slabs whose objects are all in the global free list.
+	// Moves the objects cached by the calling thread there first, objects
+	// cached by other threads keep their slabs alive.
+	void trim();
+	// Calls 'trim' on all pools.
+	static void trimAll();
+
+	// Only counted when objects move from or to the global free list,
+	// the per-thread caches don't touch any shared counters.
+	Stats stats();
+	static std::vector<Stats> statsAll();
+
+private:
+	struct FreeNode {
+		FreeNode* next;
+	};
+
+	struct ThreadCache;
+	static thread_local ThreadCache threadCache_;
+	static thread_local bool threadCacheDestroyed_;
+	static ThreadCache* threadCache();
+
+	// Moves up to 'count' objects from the global free list into 'head'.
+	// Returns the number of moved objects, allocates a new slab if needed.
+	u32 allocGlobal(FreeNode*& head, u32 count);
+	// Moves the given list of 'count' objects into the global free list.
+	void freeGlobal(FreeNode* head, FreeNode* tail, u32 count);
+
+	u32 id_ {};
+	Kind kind_ {};
+	std::size_t objSize_ {};
+	std::size_t objAlign_ {};
+	std::size_t slabSize_ {};
+	SlabPool* nextPool_ {}; // linked list of all pools, see trimAll
+
+	std::mutex mutex_;
+	FreeNode* freeList_ {};
+	std::vector<std::byte*> slabs_; // sorted
+	u64 numTaken_ {};
+};
+
+// Returns the pool for objects of type T.
+// It is never destroyed so it can safely be used during
+// static and thread_local destruction.
+template<typename T, SlabPool::Kind kind = SlabPool::Kind::handle>
+SlabPool& slabPool() {
+	static auto* pool = new SlabPool(sizeof(T), alignof(T), kind);
+	return *pool;
+}
+
+// Allocator that takes single objects from slabPool<T>, for the nodes of
+// node-based containers. Allocations of multiple objects (e.g. the bucket
+// arrays of unordered containers) directly use operator new.
+template<typename T>
+struct SlabAllocator {
+	using value_type = T;
+
+	SlabAllocator() noexcept = default;
+	template<typename O> SlabAllocator(const SlabAllocator<O>&) noexcept {}
+
+	T* allocate(std::size_t n) {
+		if(n == 1u) {
+			return static_cast<T*>(slabPool<T, SlabPool::Kind::node>().alloc());
+		}
+
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* ptr, std::size_t n) noexcept {
+		if(n == 1u) {
+			slabPool<T, SlabPool::Kind::node>().free(ptr);
+			return;
+		}
+
+		std::allocator<T>().deallocate(ptr, n);
+	}
+
+	template<typename O> bool operator==(const SlabAllocator<O>&) const noexcept { return true; }
+	template<typename O> bool operator!=(const SlabAllocator<O>&) const noexcept { return false; }
+};
+
+} // namespace vil
+
+// Defines operator new and delete for type T inside its declaration,
+// allocating it from slabPool<T>. Derived types that don't use this
+// macro themselves fall back to the global operators.
+#define VIL_SLAB_ALLOCATED(T) \
+	static void* operator new(std::size_t size) { \
+		if(size != sizeof(T)) { \
+			return ::operator new(size); \
+		} \
+		return ::vil::slabPool<T>().alloc(); \
+	} \
+	static void operator delete(void* ptr, std::size_t size) noexcept { \
+		if(size != sizeof(T)) { \
+			::operator delete(ptr); \
+			return; \
+		} \
+		::vil::slabPool<T>().free(ptr); \
+	}
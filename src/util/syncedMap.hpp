@@ -9,6 +9,7 @@
 #include <util/intrusive.hpp>
 #include <util/debugMutex.hpp>
 #include <util/profiling.hpp>
+#include <util/slab.hpp>
 
 namespace vil {
 
@@ -33,6 +34,8 @@ struct WrappedHandle {
 		obj().~T();
 	}
 
+	VIL_SLAB_ALLOCATED(WrappedHandle)
+
 	T& obj() { return *std::launder(reinterpret_cast<T*>(&obj_)); }
 };
 
@@ -106,10 +109,13 @@ struct UniqueWrappedPtr : std::unique_ptr<WrappedHandle<T>> {
 // at *any* moment, when the unordered map needs a rehash. But the underlying
 // elements are guaranteed to survive.
 // The mutex will always be unlocked when the destructor of an object is run.
+// The nodes of the map are allocated from a slab pool, handles of some
+// types are created and destroyed at high rates.
 template<typename K, typename T, template<typename...> typename P>
 class SyncedUnorderedMap {
 public:
-	using UnorderedMap = std::unordered_map<K, P<T>>;
+	using UnorderedMap = std::unordered_map<K, P<T>, std::hash<K>,
+		std::equal_to<K>, SlabAllocator<std::pair<const K, P<T>>>>;
 
 	P<T> moveLocked(const K& key) {
 		assertOwned(*mutex);
@@ -268,7 +274,8 @@ public:
 	// we don't need the std::equal_to<> thingy here
 	// using UnorderedSet = std::unordered_set<P<T>, std::hash<P<T>>, std::equal_to<>>;
 
-	using UnorderedSet = std::unordered_set<P<T>>;
+	using UnorderedSet = std::unordered_set<P<T>, std::hash<P<T>>,
+		std::equal_to<P<T>>, SlabAllocator<P<T>>>;
 	using pointer = T*;
 	// using reference = T&;
 	using const_reference = const T&;
@@ -38,6 +38,96 @@ u32 nextPOT(u32 v) {
     return v;
 }
 
+namespace {
+
+constexpr u64 hashPrime1 = 0x9E3779B185EBCA87ull;
+constexpr u64 hashPrime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr u64 hashPrime3 = 0x165667B19E3779F9ull;
+constexpr u64 hashPrime4 = 0x85EBCA77C2B2AE63ull;
+constexpr u64 hashPrime5 = 0x27D4EB2F165667C5ull;
+
+constexpr u64 rotl64(u64 x, unsigned r) {
+	return (x << r) | (x >> (64u - r));
+}
+
+constexpr u64 hashRound(u64 acc, u64 input) {
+	acc += input * hashPrime2;
+	acc = rotl64(acc, 31u);
+	return acc * hashPrime1;
+}
+
+constexpr u64 hashMergeRound(u64 acc, u64 val) {
+	acc ^= hashRound(0u, val);
+	return acc * hashPrime1 + hashPrime4;
+}
+
+template<typename T>
+T readUnaligned(const std::byte* ptr) {
+	T ret;
+	std::memcpy(&ret, ptr, sizeof(ret));
+	return ret;
+}
+
+} // anon namespace
+
+u64 hash64(span<const std::byte> data, u64 seed) {
+	auto* ptr = data.data();
+	auto* end = ptr + data.size();
+	u64 h;
+
+	if(data.size() >= 32u) {
+		u64 v1 = seed + hashPrime1 + hashPrime2;
+		u64 v2 = seed + hashPrime2;
+		u64 v3 = seed;
+		u64 v4 = seed - hashPrime1;
+
+		// the lanes don't depend on each other, allows the cpu
+		// to process them in parallel
+		auto* limit = end - 32u;
+		do {
+			v1 = hashRound(v1, readUnaligned<u64>(ptr));
+			v2 = hashRound(v2, readUnaligned<u64>(ptr + 8));
+			v3 = hashRound(v3, readUnaligned<u64>(ptr + 16));
+			v4 = hashRound(v4, readUnaligned<u64>(ptr + 24));
+			ptr += 32;
+		} while(ptr <= limit);
+
+		h = rotl64(v1, 1u) + rotl64(v2, 7u) + rotl64(v3, 12u) + rotl64(v4, 18u);
+		h = hashMergeRound(h, v1);
+		h = hashMergeRound(h, v2);
+		h = hashMergeRound(h, v3);
+		h = hashMergeRound(h, v4);
+	} else {
+		h = seed + hashPrime5;
+	}
+
+	h += u64(data.size());
+
+	for(; ptr + 8 <= end; ptr += 8) {
+		h ^= hashRound(0u, readUnaligned<u64>(ptr));
+		h = rotl64(h, 27u) * hashPrime1 + hashPrime4;
+	}
+
+	if(ptr + 4 <= end) {
+		h ^= u64(readUnaligned<u32>(ptr)) * hashPrime1;
+		h = rotl64(h, 23u) * hashPrime2 + hashPrime3;
+		ptr += 4;
+	}
+
+	for(; ptr < end; ++ptr) {
+		h ^= u64(u8(*ptr)) * hashPrime5;
+		h = rotl64(h, 11u) * hashPrime1;
+	}
+
+	h ^= h >> 33u;
+	h *= hashPrime2;
+	h ^= h >> 29u;
+	h *= hashPrime3;
+	h ^= h >> 32u;
+
+	return h;
+}
+
 bool checkEnvBinary(const char* env, bool defaultValue) {
 	auto e = std::getenv(env);
 	if(!e) {
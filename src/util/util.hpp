@@ -71,6 +71,11 @@ inline constexpr unsigned ceilDivide(unsigned num, unsigned denom) {
 // defaultValue.
 bool checkEnvBinary(const char* env, bool defaultValue);
 
+// Fast 64-bit hash of the given data (xxHash64). Processes 32 bytes
+// per iteration in four independent lanes, way faster than
+// hash_combine-ing single words for large inputs.
+u64 hash64(span<const std::byte> data, u64 seed = 0u);
+
 template<typename C, typename K>
 auto find(C&& c, K&& k) {
 	return std::find(std::begin(c), std::end(c), std::forward<K>(k));
@@ -59,7 +59,12 @@ void DynDs::destroy() {
 	if(handle_) {
 		dlg_assert(layout_ && layout_->vkHandle());
 		dlg_assert(pool_);
-		dev_->dispatch.FreeDescriptorSets(dev_->handle, pool_, 1, &handle_);
+		if(pool_ == dev_->dsPool) {
+			std::lock_guard lock(dev_->dsPoolMutex);
+			dev_->dispatch.FreeDescriptorSets(dev_->handle, pool_, 1, &handle_);
+		} else {
+			dev_->dispatch.FreeDescriptorSets(dev_->handle, pool_, 1, &handle_);
+		}
 		handle_ = {};
 		dev_ = {};
 		layout_ = {};
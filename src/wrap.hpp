@@ -132,6 +132,18 @@ inline Sampler& get(VkDevice, VkSampler handle) { return unwrap(handle); }
 template<typename = void>
 inline IntrusivePtr<Sampler> getPtr(Device&, VkSampler handle) { return IntrusivePtr<Sampler>(&unwrap(handle)); }
 
+// Returns the driver handle for the given handle. Does not have to look
+// up our handle object when the handle type isn't wrapped.
+// Useful when a call only has to be forwarded.
+template<typename H> H unwrapHandle(H handle) {
+	static_assert(!HandleDesc<H>::dispatchable);
+	if(!HandleDesc<H>::wrap || !handle) {
+		return handle;
+	}
+
+	return unwrap(handle).handle;
+}
+
 template<typename H> MapHandle<H>& get(Device& dev, H handle) {
 	if(HandleDesc<H>::wrap) {
 		return unwrap(handle);
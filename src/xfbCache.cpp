@@ -0,0 +1,291 @@
+#include <xfbCache.hpp>
+#include <device.hpp>
+#include <util/util.hpp>
+#include <util/profiling.hpp>
+#include <vkutil/enumString.hpp>
+#include <imgio/file.hpp>
+#include <filesystem>
+#include <cstdio>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace vil {
+
+namespace {
+
+constexpr auto xfbCacheMagicValue = u64(0x7A3F0C51D96E24B1);
+constexpr auto pipelineCacheName = std::string_view("pipelines.bin");
+
+fs::path cacheFolder() {
+	return fs::path(".vil") / ("xfbCache_v" + std::to_string(XfbCache::version));
+}
+
+fs::path entryPath(u64 spirvHash, u64 spirvSize, VkShaderStageFlagBits stage,
+		std::string_view entryPoint, const ShaderSpecialization& spec) {
+	auto* name = reinterpret_cast<const std::byte*>(entryPoint.data());
+	auto key = hash64({name, entryPoint.size()}, spirvHash);
+	key = hash64(bytes(spirvSize), key);
+	key = hash64(bytes(stage), key);
+	key = hash64(bytes(spec.entries), key);
+	key = hash64(spec.data, key);
+
+	char fileName[32];
+	std::snprintf(fileName, sizeof(fileName), "%016llx.bin",
+		static_cast<unsigned long long>(key));
+	return cacheFolder() / fileName;
+}
+
+// Writes to a temporary file first so that other threads or processes
+// never see partially written files.
+void writeCacheFile(const fs::path& path, span<const std::byte> data) {
+	std::error_code ec;
+	fs::create_directories(path.parent_path(), ec);
+	if(ec) {
+		dlg_warn("Could not create {}: {}", path.parent_path(), ec.message());
+		return;
+	}
+
+	auto tmpPath = path;
+	auto threadID = std::hash<std::thread::id>{}(std::this_thread::get_id());
+	tmpPath += ".tmp" + std::to_string(threadID);
+	writeFile(tmpPath.string().c_str(), data);
+
+	fs::rename(tmpPath, path, ec);
+	if(ec) {
+		dlg_warn("Could not write {}: {}", path, ec.message());
+		fs::remove(tmpPath, ec);
+	}
+}
+
+std::vector<std::byte> readCacheFile(const fs::path& path) {
+	std::error_code ec;
+	if(!fs::exists(path, ec)) {
+		return {};
+	}
+
+	return imgio::readFile<std::vector<std::byte>>(path.string().c_str());
+}
+
+template<typename IO, typename T>
+void serializeEnum(IO& buf, T& val) {
+	auto raw = u32(val);
+	serialize(buf, raw);
+	val = T(raw);
+}
+
+template<typename IO, typename C>
+void serializeXfbCapture(IO& buf, C& cap) {
+	serializeEnum(buf, cap.type);
+	serialize(buf, cap.columns);
+	serialize(buf, cap.vecsize);
+	serializeContainer(buf, cap.array);
+	serialize(buf, cap.width);
+	serialize(buf, cap.builtin);
+	serialize(buf, cap.name);
+	serialize(buf, cap.offset);
+}
+
+u32 captureSize(const XfbCapture& cap) {
+	auto size = cap.vecsize * cap.columns * (cap.width / 8);
+	for(auto dim : cap.array) {
+		size *= dim;
+	}
+
+	return size;
+}
+
+void writeXfbCachePayload(SaveBuf& buf, u64 spirvHash, u64 spirvSize,
+		VkShaderStageFlagBits stage, std::string_view entryPoint,
+		const ShaderSpecialization& spec, const XfbPatchRes& res) {
+	// key, to detect hash collisions
+	write(buf, spirvHash);
+	write(buf, spirvSize);
+	write<u32>(buf, stage);
+	write(buf, entryPoint);
+	writeContainer(buf, spec.entries);
+	writeContainer(buf, spec.data);
+
+	write<u8>(buf, !!res.desc);
+	if(!res.desc) {
+		return;
+	}
+
+	auto& desc = *res.desc;
+	write(buf, desc.stride);
+	write<u8>(buf, desc.readsBaseVertexInstance);
+	writeContainer(buf, desc.captures, [](auto& buf, auto& cap) {
+		serializeXfbCapture(buf, cap);
+	});
+
+	writeContainer(buf, res.spirv);
+}
+
+std::optional<XfbPatchRes> readXfbCachePayload(LoadBuf& buf, u64 spirvHash,
+		u64 spirvSize, VkShaderStageFlagBits stage, std::string_view entryPoint,
+		const ShaderSpecialization& spec) {
+	ShaderSpecialization storedSpec;
+	auto storedHash = read<u64>(buf);
+	auto storedSize = read<u64>(buf);
+	auto storedStage = read<u32>(buf);
+	auto storedEntryPoint = read<std::string>(buf);
+	readContainer(buf, storedSpec.entries);
+	readContainer(buf, storedSpec.data);
+
+	if(storedHash != spirvHash || storedSize != spirvSize ||
+			storedStage != u32(stage) || storedEntryPoint != entryPoint ||
+			!(storedSpec == spec)) {
+		dlg_trace("xfb cache: hash collision");
+		return std::nullopt;
+	}
+
+	XfbPatchRes ret;
+	if(!read<u8>(buf)) {
+		return ret;
+	}
+
+	ret.desc = IntrusivePtr<XfbPatchDesc>(new XfbPatchDesc());
+	auto& desc = *ret.desc;
+	desc.stride = read<u32>(buf);
+	desc.readsBaseVertexInstance = read<u8>(buf);
+	readContainer(buf, desc.captures, [](auto& buf, auto& cap) {
+		serializeXfbCapture(buf, cap);
+	});
+
+	// the stride must match the captures, it's used for the xfb buffer
+	for(auto& cap : desc.captures) {
+		if(u64(cap.offset) + captureSize(cap) > desc.stride) {
+			throw std::invalid_argument("Capture outside of stride");
+		}
+	}
+
+	readContainer(buf, ret.spirv);
+	if(ret.spirv.empty()) {
+		throw std::invalid_argument("Empty spirv");
+	}
+
+	return ret;
+}
+
+} // anon namespace
+
+// XfbCache
+XfbCache::XfbCache(Device& xdev) : dev(&xdev) {
+	auto data = readCacheFile(cacheFolder() / pipelineCacheName);
+
+	// The driver validates the header and just ignores the initial
+	// data if it is incompatible, e.g. from another device.
+	VkPipelineCacheCreateInfo pci {};
+	pci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pci.initialDataSize = data.size();
+	pci.pInitialData = data.data();
+
+	auto res = dev->dispatch.CreatePipelineCache(dev->handle, &pci, nullptr, &pipelineCache);
+	if(res != VK_SUCCESS) {
+		dlg_error("xfb CreatePipelineCache: {} ({})", vk::name(res), res);
+		pipelineCache = {};
+		return;
+	}
+
+	nameHandle(*dev, pipelineCache, "XfbCache:pipelineCache");
+}
+
+XfbCache::~XfbCache() {
+	if(!pipelineCache) {
+		return;
+	}
+
+	std::size_t size {};
+	auto res = dev->dispatch.GetPipelineCacheData(dev->handle, pipelineCache, &size, nullptr);
+	std::vector<std::byte> data(size);
+	if(res == VK_SUCCESS && size > 0u) {
+		res = dev->dispatch.GetPipelineCacheData(dev->handle, pipelineCache,
+			&size, data.data());
+	}
+
+	if(res == VK_SUCCESS && size > 0u) {
+		data.resize(size);
+		writeCacheFile(cacheFolder() / pipelineCacheName, data);
+	} else if(res != VK_SUCCESS) {
+		dlg_error("xfb GetPipelineCacheData: {} ({})", vk::name(res), res);
+	}
+
+	dev->dispatch.DestroyPipelineCache(dev->handle, pipelineCache, nullptr);
+}
+
+std::optional<XfbPatchRes> XfbCache::find(u64 spirvHash, u64 spirvSize,
+		VkShaderStageFlagBits stage, std::string_view entryPoint,
+		const ShaderSpecialization& spec) const {
+	ZoneScoped;
+
+	auto path = entryPath(spirvHash, spirvSize, stage, entryPoint, spec);
+	auto data = readCacheFile(path);
+	if(data.empty()) {
+		return std::nullopt;
+	}
+
+	try {
+		auto buf = LoadBuf{ReadBuf(data)};
+		return loadXfbCacheEntry(buf, spirvHash, spirvSize, stage, entryPoint, spec);
+	} catch(const std::exception& err) {
+		dlg_warn("Invalid xfb cache entry {}: {}", path, err.what());
+		return std::nullopt;
+	}
+}
+
+void XfbCache::store(u64 spirvHash, u64 spirvSize, VkShaderStageFlagBits stage,
+		std::string_view entryPoint, const ShaderSpecialization& spec,
+		const XfbPatchRes& res) {
+	ZoneScoped;
+
+	SaveBuf buf;
+	saveXfbCacheEntry(buf, spirvHash, spirvSize, stage, entryPoint, spec, res);
+	writeCacheFile(entryPath(spirvHash, spirvSize, stage, entryPoint, spec), buf);
+}
+
+// serialize
+void saveXfbCacheEntry(SaveBuf& buf, u64 spirvHash, u64 spirvSize,
+		VkShaderStageFlagBits stage, std::string_view entryPoint,
+		const ShaderSpecialization& spec, const XfbPatchRes& res) {
+	SaveBuf payload;
+	writeXfbCachePayload(payload, spirvHash, spirvSize, stage, entryPoint, spec, res);
+
+	write(buf, xfbCacheMagicValue);
+	write<u32>(buf, XfbCache::version);
+	write<u64>(buf, payload.size());
+	write(buf, hash64(payload));
+	writeBytes(buf, payload);
+}
+
+std::optional<XfbPatchRes> loadXfbCacheEntry(LoadBuf& buf, u64 spirvHash,
+		u64 spirvSize, VkShaderStageFlagBits stage, std::string_view entryPoint,
+		const ShaderSpecialization& spec) {
+	// Validate the whole entry first so that truncated or otherwise
+	// corrupted files are detected before we interpret any of the data.
+	constexpr auto headerSize = 8u + 4u + 8u + 8u;
+	if(buf.buf.size() < headerSize) {
+		throw std::out_of_range("Truncated header");
+	}
+
+	if(read<u64>(buf) != xfbCacheMagicValue) {
+		throw std::invalid_argument("Invalid magic value");
+	}
+
+	if(read<u32>(buf) != XfbCache::version) {
+		throw std::invalid_argument("Invalid version");
+	}
+
+	auto size = read<u64>(buf);
+	auto checksum = read<u64>(buf);
+	if(size != buf.buf.size()) {
+		throw std::out_of_range("Invalid size");
+	}
+
+	if(checksum != hash64(buf.buf)) {
+		throw std::invalid_argument("Checksum mismatch");
+	}
+
+	return readXfbCachePayload(buf, spirvHash, spirvSize, stage, entryPoint, spec);
+}
+
+} // namespace vil
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <shader.hpp>
+#include <serialize/bufs.hpp>
+#include <vk/vulkan.h>
+#include <optional>
+#include <string_view>
+
+namespace vil {
+
+// Persistent on-disk cache of xfb-patched vertex shaders, see
+// VIL_TRANSFORM_FEEDBACK. Patching requires parsing the module and is
+// expensive for huge shaders, with the cache it only has to be done once
+// and not in every session.
+// Entries are keyed by the hash and size of the original spirv, the shader
+// stage, the entry point and the specialization. Additionally persists a VkPipelineCache that is
+// used when creating pipelines with patched shaders, their creation would
+// otherwise always miss the application's pipeline cache.
+// Stored in a versioned folder inside '.vil/' in the working directory.
+// Enabled via VIL_XFB_CACHE, see docs/env.md.
+struct XfbCache {
+	// Must be increased when the patching or the file format changes.
+	static constexpr auto version = 2u;
+
+	Device* dev {};
+
+	// May be null, e.g. when we could not create it.
+	// Does not need external synchronization.
+	VkPipelineCache pipelineCache {};
+
+	XfbCache(Device& dev);
+	~XfbCache(); // writes the pipeline cache to disk
+
+	// Returns std::nullopt when there is no cached entry.
+	// Returns a result without desc when the shader was previously
+	// found to not be patchable.
+	// Thread-safe.
+	std::optional<XfbPatchRes> find(u64 spirvHash, u64 spirvSize,
+		VkShaderStageFlagBits stage, std::string_view entryPoint,
+		const ShaderSpecialization&) const;
+
+	// 'res.desc' may be null, see find.
+	// Thread-safe.
+	void store(u64 spirvHash, u64 spirvSize, VkShaderStageFlagBits stage,
+		std::string_view entryPoint, const ShaderSpecialization&,
+		const XfbPatchRes& res);
+};
+
+// Serialization of a single cache entry.
+// Entries contain a checksum, loading throws on truncated or otherwise
+// invalid data, e.g. captures outside of the stored stride.
+// Returns std::nullopt when the entry was stored for different
+// parameters (i.e. on hash collision).
+void saveXfbCacheEntry(SaveBuf&, u64 spirvHash, u64 spirvSize,
+	VkShaderStageFlagBits stage, std::string_view entryPoint,
+	const ShaderSpecialization&, const XfbPatchRes&);
+std::optional<XfbPatchRes> loadXfbCacheEntry(LoadBuf&, u64 spirvHash,
+	u64 spirvSize, VkShaderStageFlagBits stage, std::string_view entryPoint,
+	const ShaderSpecialization&);
+
+} // namespace vil